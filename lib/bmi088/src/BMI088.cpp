@@ -892,6 +892,59 @@ void Bmi088Accel::getSensorRawValues(int16_t* accelX, int16_t* accelY, int16_t*
  *accelZ = accel[2];
 }
 
+/* reads only the raw accel data in a single burst (no temperature, no sensor time, no unit conversion) */
+void Bmi088Accel::readSensorRawValues(int16_t* accelX, int16_t* accelY, int16_t* accelZ)
+{
+  readRegisters(ACC_ACCEL_DATA_ADDR,6,_buffer);
+  accel[0] = (_buffer[1] << 8) | _buffer[0];
+  accel[1] = (_buffer[3] << 8) | _buffer[2];
+  accel[2] = (_buffer[5] << 8) | _buffer[4];
+  *accelX = accel[0];
+  *accelY = accel[1];
+  *accelZ = accel[2];
+}
+
+/* enables the accel FIFO in stream mode (oldest frames overwritten when full) */
+bool Bmi088Accel::setFifoStream(bool enable)
+{
+  uint8_t readReg = 0;
+  writeRegister(ACC_FIFO_CONFIG_0_ADDR,ACC_FIFO_STREAM_MODE);
+  writeRegister(ACC_FIFO_CONFIG_1_ADDR,enable ? ACC_FIFO_ACC_EN : ACC_FIFO_DISABLED);
+  delay(1);
+  readRegisters(ACC_FIFO_CONFIG_1_ADDR,1,&readReg);
+  return (readReg == (enable ? ACC_FIFO_ACC_EN : ACC_FIFO_DISABLED)) ? true : false;
+}
+
+/* returns the number of bytes in the accel FIFO */
+uint16_t Bmi088Accel::getFifoLength()
+{
+  uint8_t buffer[2];
+  readRegisters(ACC_FIFO_LENGTH_0_ADDR,2,buffer);
+  return ((buffer[1] & 0x3F) << 8) | buffer[0];
+}
+
+/* reads up to count bytes from the accel FIFO, data register address does not increment, returns the number of bytes read */
+/* SPI reads everything in one transaction, I2C reads one burst of at most FIFO_READ_CHUNK bytes: a frame cut at the */
+/* end of a burst is sent again in full by the next burst, so the caller must only keep the complete frames of each burst */
+uint16_t Bmi088Accel::readFifo(uint16_t count, uint8_t* dest)
+{
+  if (_useSPI) {
+    _spi->beginTransaction(SPISettings(SPI_CLOCK, MSBFIRST, SPI_MODE0)); // begin the transaction
+    digitalWrite(_csPin,LOW); // select the chip
+    _spi->transfer(ACC_FIFO_DATA_ADDR | SPI_READ); // specify the starting register address
+    _spi->transfer(0x00); // discard the first byte read
+    for (uint16_t i = 0; i < count; i++) {
+      dest[i] = _spi->transfer(0x00); // read the data
+    }
+    digitalWrite(_csPin,HIGH); // deselect the chip
+    _spi->endTransaction(); // end the transaction
+    return count;
+  }
+  uint8_t chunk = (count > FIFO_READ_CHUNK) ? FIFO_READ_CHUNK : count;
+  readRegisters(ACC_FIFO_DATA_ADDR,chunk,dest);
+  return chunk;
+}
+
 /* returns the x acceleration, m/s/s */
 float Bmi088Accel::getAccelX_mss()
 {
@@ -1439,6 +1492,53 @@ void Bmi088Gyro::getSensorRawValues(int16_t* gyroX, int16_t* gyroY, int16_t* gyr
  *gyroZ = gyro[2];
 }
 
+/* reads only the raw gyro data in a single burst (no unit conversion) */
+void Bmi088Gyro::readSensorRawValues(int16_t* gyroX, int16_t* gyroY, int16_t* gyroZ)
+{
+  readRegisters(GYRO_DATA_ADDR,6,_buffer);
+  gyro[0] = (_buffer[1] << 8) | _buffer[0];
+  gyro[1] = (_buffer[3] << 8) | _buffer[2];
+  gyro[2] = (_buffer[5] << 8) | _buffer[4];
+  *gyroX = gyro[0];
+  *gyroY = gyro[1];
+  *gyroZ = gyro[2];
+}
+
+/* enables the gyro FIFO in stream mode, writing FIFO_CONFIG_1 also clears the FIFO and the overrun flag */
+bool Bmi088Gyro::setFifoStream(bool enable)
+{
+  uint8_t readReg = 0;
+  writeRegister(GYRO_FIFO_CONFIG_1_ADDR,enable ? GYRO_FIFO_STREAM_MODE : GYRO_FIFO_BYPASS_MODE);
+  delay(1);
+  readRegisters(GYRO_FIFO_CONFIG_1_ADDR,1,&readReg);
+  return (readReg == (enable ? GYRO_FIFO_STREAM_MODE : GYRO_FIFO_BYPASS_MODE)) ? true : false;
+}
+
+/* clears the gyro FIFO and the overrun flag without waiting (safe to call from the control loop) */
+void Bmi088Gyro::resetFifo()
+{
+  writeRegister(GYRO_FIFO_CONFIG_1_ADDR,GYRO_FIFO_STREAM_MODE);
+}
+
+/* returns FIFO_STATUS, bit 7 = overrun, bits 6:0 = number of frames */
+uint8_t Bmi088Gyro::getFifoStatus()
+{
+  uint8_t readReg = 0;
+  readRegisters(GYRO_FIFO_STATUS_ADDR,1,&readReg);
+  return readReg;
+}
+
+/* reads count bytes from the gyro FIFO, data register address does not increment */
+void Bmi088Gyro::readFifo(uint16_t count, uint8_t* dest)
+{
+  uint16_t done = 0;
+  while (done < count) {
+    uint8_t chunk = ((count - done) > FIFO_READ_CHUNK) ? FIFO_READ_CHUNK : (count - done);
+    readRegisters(GYRO_FIFO_DATA_ADDR,chunk,dest + done);
+    done += chunk;
+  }
+}
+
 /* returns the x gyro, rad/s */
 float Bmi088Gyro::getGyroX_rads()
 {
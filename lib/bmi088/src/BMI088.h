@@ -82,6 +82,10 @@ class Bmi088Accel {
     bool getDrdyStatus();
     void readSensor();
     void getSensorRawValues(int16_t* accelX, int16_t* accelY, int16_t* accelZ);
+    void readSensorRawValues(int16_t* accelX, int16_t* accelY, int16_t* accelZ);
+    bool setFifoStream(bool enable);
+    uint16_t getFifoLength();
+    uint16_t readFifo(uint16_t count, uint8_t* dest);
     float getAccelX_mss();
     float getAccelY_mss();
     float getAccelZ_mss();
@@ -109,6 +113,14 @@ class Bmi088Accel {
     // buffer for reading from sensor
     uint8_t _buffer[9];
     // constants
+    static const uint8_t ACC_FIFO_LENGTH_0_ADDR = 0x24;
+    static const uint8_t ACC_FIFO_DATA_ADDR = 0x26;
+    static const uint8_t ACC_FIFO_CONFIG_0_ADDR = 0x48;
+    static const uint8_t ACC_FIFO_CONFIG_1_ADDR = 0x49;
+    static const uint8_t ACC_FIFO_STREAM_MODE = 0x02; // bit 1 must always be 1, bit 0 = 0 for stream mode
+    static const uint8_t ACC_FIFO_ACC_EN = 0x50; // bit 6 = acc_en, bit 4 must always be 1
+    static const uint8_t ACC_FIFO_DISABLED = 0x10;
+    static const uint8_t FIFO_READ_CHUNK = 30; // keeps each I2C burst within the Wire buffer
     static const uint8_t ACC_CHIP_ID = 0x1E;
     static const uint8_t ACC_RESET_CMD = 0xB6;
     static const uint8_t ACC_ENABLE_CMD = 0x04;
@@ -245,6 +257,11 @@ class Bmi088Gyro {
     bool getDrdyStatus();
     void readSensor();
     void getSensorRawValues(int16_t* gyroX, int16_t* gyroY, int16_t* gyroZ);
+    void readSensorRawValues(int16_t* gyroX, int16_t* gyroY, int16_t* gyroZ);
+    bool setFifoStream(bool enable);
+    void resetFifo();
+    uint8_t getFifoStatus();
+    void readFifo(uint16_t count, uint8_t* dest);
     float getGyroX_rads();
     float getGyroY_rads();
     float getGyroZ_rads();
@@ -268,6 +285,12 @@ class Bmi088Gyro {
     // buffer for reading from sensor
     uint8_t _buffer[9];
     // constants
+    static const uint8_t GYRO_FIFO_STATUS_ADDR = 0x0E;
+    static const uint8_t GYRO_FIFO_CONFIG_1_ADDR = 0x3E;
+    static const uint8_t GYRO_FIFO_DATA_ADDR = 0x3F;
+    static const uint8_t GYRO_FIFO_STREAM_MODE = 0x80; // fifo_mode = stream, x/y/z data
+    static const uint8_t GYRO_FIFO_BYPASS_MODE = 0x00;
+    static const uint8_t FIFO_READ_CHUNK = 30; // keeps each burst within the Wire buffer
     static const uint8_t GYRO_CHIP_ID = 0x0F;
     static const uint8_t GYRO_RESET_CMD = 0xB6;
     static const uint8_t GYRO_ENABLE_DRDY_INT = 0x80;
@@ -15,6 +15,9 @@
 #include "gpf.h"
 #include "gpf_cons.h"
 #include "gpf_debug.h"
+#include "gpf_fast_math.h"
+
+GPF *GPF::controlLoopInstance = NULL;
 
 GPF::GPF() {
     gpf_telemetry_info.battery_voltage           = 0;
@@ -40,11 +43,23 @@ GPF::GPF() {
 
 void GPF::initialize(gpf_config_struct *ptr) {    
     myConfig_ptr = ptr;
-    debug_sincePrint = 0;
     mySdCard.initialize();
     
     myImu.initialize(ptr);
+    #if defined GPF_CONTROLLER_CASCADE_ENABLED
+     pidController.initialize(GPF_CONTROLLER_I_LIMIT, GPF_CONTROLLER_OUTPUT_LIMIT, GPF_CONTROLLER_FILTER_DTERM_TYPE, GPF_CONTROLLER_FILTER_DTERM_CUTOFF, GPF_OUTPUT_LOOP_RATE / 1000000.0);
+    #else
+     pidController.initialize(GPF_CONTROLLER_I_LIMIT, GPF_CONTROLLER_OUTPUT_LIMIT, GPF_CONTROLLER_FILTER_DTERM_TYPE, GPF_CONTROLLER_FILTER_DTERM_CUTOFF, GPF_MAIN_LOOP_RATE / 1000000.0);
+     pidController.setDerivativeSource(GPF_AXE_ROLL,  GPF_PID_DERIVATIVE_FROM_RATE); //Le gyro est la dérivée de l'angle
+     pidController.setDerivativeSource(GPF_AXE_PITCH, GPF_PID_DERIVATIVE_FROM_RATE);
+    #endif
+    refreshPidGains();
+    refreshMixer();
+    #if defined GPF_RC_SMOOTHING_ENABLED
+     rcSmoothing.initialize(GPF_RC_SMOOTHING_FILTER_TYPE, 1000000.0 / GPF_MAIN_LOOP_RATE, myRc.get_channelsFrameIntervalUs());
+    #endif
     myRc.initialize(&Serial7); 
+    refreshFailSafe();
     myRc.setupTelemetry(&gpf_telemetry_info); 
     myDshot.initialize();
 
@@ -53,81 +68,693 @@ void GPF::initialize(gpf_config_struct *ptr) {
     myTouch.initialize();
     myMusicPlayer.initialize();
     
+    GPF_PROFILER::initialize();
+
+    controlLoopInstance = this;
+    controlLoopStart();
+}
+
+// La boucle de contrôle (IMU, fusion, PID, mixer, DShot) est appelée par un timer matériel (PIT) à chaque GPF_GYRO_LOOP_RATE us.
+// Tout le reste (RC, menu, carte SD, alarmes, musique) roule en arrière plan dans loop() avec le temps CPU restant.
+// Si GPF_IMU_GYRO_DRDY_SYNC_ENABLED, c'est plutôt l'interruption DRDY du gyro qui déclenche la boucle de contrôle.
+void GPF::controlLoopStart() {
+ if (!controlLoopIsRunning) {
+  #if defined GPF_IMU_GYRO_DRDY_SYNC_ENABLED
+   controlLoopIsRunning = myImu.drdySyncStart(GPF::controlLoopISR);
+   DEBUG_GPF_PRINT("Boucle de controle synchronisee sur DRDY du gyro=");
+  #else
+   controlLoopTimer.priority(GPF_MAIN_LOOP_TIMER_PRIORITY);
+   controlLoopIsRunning = controlLoopTimer.begin(GPF::controlLoopISR, GPF_GYRO_LOOP_RATE);
+   DEBUG_GPF_PRINT("Timer de la boucle de controle demarre=");
+  #endif
+  DEBUG_GPF_PRINTLN(controlLoopIsRunning);
+ }
+}
+
+// A utiliser lorsque loop() doit avoir le IMU à lui seul (ex: calibration).
+void GPF::controlLoopStop() {
+ #if defined GPF_IMU_GYRO_DRDY_SYNC_ENABLED
+  myImu.drdySyncStop();
+ #else
+  controlLoopTimer.end();
+ #endif
+ myImu.waitForPendingRead();
+ controlLoopIsRunning = false;
+}
+
+void GPF::controlLoopISR() {
+ if (controlLoopInstance != NULL) {
+  controlLoopInstance->controlLoop();
+ }
+}
+
+// Étage gyro à chaque appel (GPF_GYRO_LOOP_RATE) puis étage PID à tous les GPF_PID_LOOP_DIVIDER appels (GPF_MAIN_LOOP_RATE).
+// Si GPF_CONTROLLER_CASCADE_ENABLED, la boucle de vitesse suit à tous les GPF_CONTROLLER_RATE_LOOP_DIVIDER appels, après l'étage PID
+// pour utiliser aussitôt une nouvelle consigne de la boucle d'angle.
+void GPF::controlLoop() {
+ unsigned long gyroStageStartedAt = micros();
+
+ if (loopJitter_previousTickAt != 0) {
+  loopJitterHistogram.record(abs((long)(gyroStageStartedAt - loopJitter_previousTickAt) - GPF_GYRO_LOOP_RATE));
+ }
+ loopJitter_previousTickAt = gyroStageStartedAt;
+
+ myImu.set_fusion_type(flight_mode);
+
+ {
+  GPF_PROFILE_STAGE(GPF_PROFILER_STAGE_IMU_READ);
+  if (myImu.getIMUData()) { //Armé ou non, on va toujours lire le IMU
+    pidStage_imuSampleReady = true;
+  }
+ }
+
+ #if defined GPF_CRSF_RX_IN_CONTROL_LOOP_ENABLED
+  {
+   GPF_PROFILE_STAGE(GPF_PROFILER_STAGE_RC_POLL);
+   myRc.pollRx(); //Les frames sont décodés ici, readRx() (loop) ne fait plus que le fail safe et la télémétrie
+  }
+ #endif
+
+ gyroStageTime             = micros() - gyroStageStartedAt;
+ gyroStageTimeMax          = max(gyroStageTimeMax, gyroStageTime);
+ gyroStageTimeAccumulated += gyroStageTime;
+
+ pidStage_tickCount++;
+ if (pidStage_tickCount >= GPF_PID_LOOP_DIVIDER) {
+  pidStage_tickCount = 0;
+  controlLoop_pidStage();
+ }
+
+ #if defined GPF_CONTROLLER_CASCADE_ENABLED
+  rateStage_tickCount++;
+  if (rateStage_tickCount >= GPF_CONTROLLER_RATE_LOOP_DIVIDER) {
+   rateStage_tickCount = 0;
+   controlLoop_rateStage(gyroStageStartedAt);
+  }
+ #endif
+
+ if ((long)(micros() - gyroStageStartedAt) > GPF_GYRO_LOOP_RATE) { //Le timer va redéclencher aussitôt et le prochain tour sera en retard
+  loopTimeOverFlowCount++;
+ }
+}
+
+void GPF::controlLoop_pidStage() {
+ unsigned long previousLoopStartedAt = loopStartedAt;
+ iAmStartingLoopNow();
+ float dt = (loopStartedAt - previousLoopStartedAt) / 1000000.0; //s //Premier tour trop long, remplacé par la période nominale (Voir GPF_PID_DT_MAX)
+
+ if (pidStage_imuSampleReady) {
+   GPF_PROFILE_STAGE(GPF_PROFILER_STAGE_FUSION);
+   myImu.doFusion(); //Estimateur de la config (Madgwick, Mahony ou EKF) ou Complementary filter selon la position de la switch mode de vol.
+   pidStage_imuSampleReady = false;
+ }
+
+ getDesiredState(dt); //Compute desired state //Convert raw commands to normalized values based on saturated control limits
+ {
+  GPF_PROFILE_STAGE(GPF_PROFILER_STAGE_CONTROL_ANGLE);
+  #if defined GPF_CONTROLLER_CASCADE_ENABLED
+   controlANGLE2();  //Boucle d'angle seulement //Donne les consignes de controlRATE() (Voir controlLoop_rateStage())
+  #else
+   controlANGLE(dt); //PID Controller //Stabilize on angle setpoint
+  #endif
+ }
+
+ #if !defined GPF_CONTROLLER_CASCADE_ENABLED
+  controlLoop_outputStage();
+ #endif
+
+ #if defined GPF_IMU_HARMONIC_NOTCH_ENABLED
+  myImu.harmonicNotch.update(get_harmonicNotchThrottle());
+ #endif
+
+ iAmEndingLoopNow();
+}
+
+// Boucle de vitesse du contrôleur en cascade (GPF_CONTROLLER_CASCADE_ENABLED) sur le gyro filtré de l'étage gyro.
+void GPF::controlLoop_rateStage(unsigned long tickAt) {
+ float dt = (tickAt - rateStage_previousTickAt) / 1000000.0; //s
+ rateStage_previousTickAt = tickAt;
+ {
+  GPF_PROFILE_STAGE(GPF_PROFILER_STAGE_CONTROL_RATE);
+  controlRATE(dt);
+ }
+ controlLoop_outputStage();
 }
 
-void GPF::iAmStartingLoopNow(bool syncLoop) {
+// Mixer et envoi aux moteurs à chaque GPF_OUTPUT_LOOP_RATE us (étage PID ou boucle de vitesse si cascade).
+void GPF::controlLoop_outputStage() {
+ {
+  GPF_PROFILE_STAGE(GPF_PROFILER_STAGE_MIXER);
+  controlMixer();    //Actuator mixing and scaling to PWM values //Mixes PID outputs to scaled actuator commands -- custom mixing assignments done here
+ }
+
+ if (arm_isArmed) {
+  scaleCommands();   //Scales motor commands to DSHOT commands
+  manageFailSafe();
+
+  // On envoi les commandes aux ESC seulement lorsqu'on est armé.
+  // Lorsque la commande des moteurs ne change pas, ca ne donnerait normalement rien de réenvoyer la commande continuellement 
+  // puisque en réalité ce n'est pas la fonction sendCommand() qui envoi le signal aux ESC mais plutôt les DMA. 
+  // Mais j'appel cette fonction continuellement quand-même car c'est plus simple comme celà.
+  for (uint8_t motorNumber = 0; motorNumber < GPF_MOTOR_ITEM_COUNT; motorNumber++) { 
+   myDshot.sendCommand(motorNumber, motor_command_DSHOT[motorNumber], false);
+  }
+ } else {
+  failSafe_stage_previous = GPF_FAILSAFE_STAGE_OK;
+ }
+}
+
+// Gaz (0 à 1) qui déterminent la fréquence du bruit des moteurs pour les filtres coupe-bande harmoniques
+float GPF::get_harmonicNotchThrottle() {
+ #if defined GPF_IMU_HARMONIC_NOTCH_SOURCE_DSHOT
+  float dshotSum = 0;
+
+  if (!arm_isArmed) {
+    return 0; //Moteurs arrêtés
+  }
+
+  for (uint8_t motorNumber = 0; motorNumber < GPF_MOTOR_ITEM_COUNT; motorNumber++) {
+    dshotSum += max(0, motor_command_DSHOT[motorNumber] - GPF_DSHOT_THROTTLE_MINIMUM);
+  }
+  return constrain(dshotSum / (GPF_MOTOR_ITEM_COUNT * GPF_DSHOT_RESOLUTION), 0.0, 1.0);
+ #else
+  return desired_state_throttle;
+ #endif
+}
+
+void GPF::iAmStartingLoopNow() {
+ loopStartedAt = micros(); 
 
  if (firstLoopStartedAt == 0) { 
-   firstLoopStartedAt = micros();
+   firstLoopStartedAt = loopStartedAt;
  }
- 
- loopBusyTime    = micros() - loopStartedAt;
+
+ loopCount++; 
+}
+
+// Le temps occupé d'un tour de l'étage PID comprend aussi les GPF_PID_LOOP_DIVIDER tours de l'étage gyro qui l'ont précédé.
+void GPF::iAmEndingLoopNow() {
+ pidStageTime    = micros() - loopStartedAt;
+ pidStageTimeMax = max(pidStageTimeMax, pidStageTime);
+
+ loopBusyTime    = gyroStageTimeAccumulated + pidStageTime;
  loopBusyTimeMin = min(loopBusyTimeMin,loopBusyTime);
  loopBusyTimeMax = max(loopBusyTimeMax,loopBusyTime);
  loopFreeTime    = GPF_MAIN_LOOP_RATE - loopBusyTime; 
+ gyroStageTimeAccumulated = 0;
 
- if (loopFreeTime < 0) {
-  loopTimeOverFlowCount++;
- }
+ loopBusyHistogram.record(loopBusyTime);
+ loopFreeHistogram.record(max(0L, (long)loopFreeTime));
 
  loopBusyTimePercent = (float)(loopBusyTime / (float)GPF_MAIN_LOOP_RATE) * 100.0;
  loopFreeTimePercent = 100.0 - loopBusyTimePercent;
+ loopBusyTimePercentAverage += GPF_GOVERNOR_AVERAGE_WEIGHT * (loopBusyTimePercent - loopBusyTimePercentAverage);
+}
+
+// Gouverneur de charge, appelé à chaque tour de loop().
+// La boucle de contrôle roule par interruption. Quand elle prend beaucoup de CPU ou que loop() s'allonge, c'est loop() (et donc la
+// lecture RC) qui en souffre. On retire alors du travail non essentiel un niveau à la fois (gpf_governor_level_enum) puis on le
+// remet quand la marge revient. L'hystérésis et GPF_GOVERNOR_MIN_DWELL_TIME évitent d'osciller entre deux niveaux.
+void GPF::manageLoadGovernor() {
+ unsigned long now = micros();
+ float         busyAverage;
 
- if (syncLoop) {
-  //On attend pour que chaque loop commence au même moment
-  while ((micros() - loopStartedAt) < GPF_MAIN_LOOP_RATE) {
-   //Attend (Dans la mesure du possible, ne jamais  mettre de delay() ou delayMicroseconds() dans un programme!!!)
+ if (governor_loopPassStartedAt != 0) { //Sans le temps passé à dessiner le menu (Voir GPF_SCHEDULER::set_taskCountsInLoopPass())
+  governor_loopPassAverage += GPF_GOVERNOR_AVERAGE_WEIGHT * ((float)(now - governor_loopPassStartedAt - myScheduler.get_lastRunUncountedDuration()) - governor_loopPassAverage);
+ }
+ governor_loopPassStartedAt = now;
+
+ if (governor_sinceChange < GPF_GOVERNOR_MIN_DWELL_TIME) {
+  return;
+ }
+
+ busyAverage = loopBusyTimePercentAverage;
+
+ if ((busyAverage > GPF_GOVERNOR_SHED_BUSY_PERCENT) || (governor_loopPassAverage > GPF_GOVERNOR_SHED_LOOP_PASS)) {
+  if (governor_level < (GPF_GOVERNOR_LEVEL_ITEM_COUNT - 1)) {
+   governor_applyLevel(governor_level + 1);
+   governor_logEvent(true, governor_level, busyAverage, governor_loopPassAverage);
+  }
+ } else if ((busyAverage < GPF_GOVERNOR_RESTORE_BUSY_PERCENT) && (governor_loopPassAverage < GPF_GOVERNOR_RESTORE_LOOP_PASS)) {
+  if (governor_level > GPF_GOVERNOR_LEVEL_NORMAL) {
+   governor_applyLevel(governor_level - 1);
+   governor_logEvent(false, governor_level, busyAverage, governor_loopPassAverage);
   }
- } 
+ }
+}
 
- loopStartedAt = micros(); 
- loopCount++; 
+uint8_t GPF::get_governor_level() {
+ return governor_level;
+}
+
+// Chaque niveau inclut ceux d'en dessous
+void GPF::governor_applyLevel(uint8_t level) {
+ governor_level       = level;
+ governor_sinceChange = 0;
+ governor_eventCount++;
+
+ myRc.set_telemetryRateDivider((level >= GPF_GOVERNOR_LEVEL_TELEMETRY) ? GPF_GOVERNOR_TELEMETRY_RATE_DIVIDER : 1);
+ myScheduler.set_taskPeriod(task_blackBox, (level >= GPF_GOVERNOR_LEVEL_BLACK_BOX) ? GPF_GOVERNOR_BLACK_BOX_PERIOD : GPF_TASK_BLACK_BOX_PERIOD);
+ myScheduler.set_taskPeriod(task_alarms,   (level >= GPF_GOVERNOR_LEVEL_ALARMS_MUSIC) ? GPF_GOVERNOR_ALARMS_PERIOD : GPF_TASK_ALARMS_PERIOD);
+ myScheduler.set_taskIsEnabled(task_music, (level < GPF_GOVERNOR_LEVEL_ALARMS_MUSIC));
+}
+
+// Chaque changement de niveau est écrit dans le log d'information pour l'analyse après le vol (par la tâche BlackBox)
+void GPF::governor_logEvent(bool isShed, uint8_t level, float busyAverage, float loopPassAverage) {
+ const char *levelDescriptions[GPF_GOVERNOR_LEVEL_ITEM_COUNT] = {"Normal", "Telemetry", "BlackBox", "AlarmsMusic"};
+
+ DEBUG_GPF_PRINT("GPF: Governor ");
+ DEBUG_GPF_PRINT(isShed ? "shed" : "restore");
+ DEBUG_GPF_PRINT(" level=");
+ DEBUG_GPF_PRINT(levelDescriptions[level]);
+ DEBUG_GPF_PRINT(" busyAvg=");
+ DEBUG_GPF_PRINT(busyAverage);
+ DEBUG_GPF_PRINT("% loopPassAvg=");
+ DEBUG_GPF_PRINTLN(loopPassAverage);
+
+ char line[GPF_INFO_LOG_LINE_MAX_LENGTH];
+ snprintf(line, GPF_INFO_LOG_LINE_MAX_LENGTH, "%s%s%s,busyAvg%%=%.2f,loopPassAvgUs=%.2f",
+          gpf_util_get_dateTimeString(GPF_MISC_FORMAT_DATE_TIME_FRIENDLY_US,true),
+          isShed ? "Governor shed," : "Governor restore,", levelDescriptions[level], busyAverage, loopPassAverage);
+ info_log_queueLine(line);
+}
+
+// Garde une ligne (date comprise) pour le log d'information. Elle sera écrite par info_log_writeQueuedLines().
+// Quand la queue est pleine, la ligne est perdue et comptée dans info_log_droppedLineCount.
+void GPF::info_log_queueLine(const char *line) {
+ if (info_log_queueCount >= GPF_INFO_LOG_QUEUE_SIZE) {
+  info_log_droppedLineCount++;
+  return;
+ }
+
+ strncpy(info_log_queue[(info_log_queueFirst + info_log_queueCount) % GPF_INFO_LOG_QUEUE_SIZE], line, GPF_INFO_LOG_LINE_MAX_LENGTH - 1);
+ info_log_queue[(info_log_queueFirst + info_log_queueCount) % GPF_INFO_LOG_QUEUE_SIZE][GPF_INFO_LOG_LINE_MAX_LENGTH - 1] = 0;
+ info_log_queueCount++;
 }
 
+// Appelée par la tâche BlackBox. Le fichier est ouvert une seule fois pour toutes les lignes en attente.
+void GPF::info_log_writeQueuedLines() {
+ if ((info_log_queueCount == 0) && (info_log_droppedLineCount == 0)) {
+  return;
+ }
+
+ mySdCard.openFile(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG);
+ while (info_log_queueCount > 0) {
+  mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->println(info_log_queue[info_log_queueFirst]);
+  info_log_queueFirst = (info_log_queueFirst + 1) % GPF_INFO_LOG_QUEUE_SIZE;
+  info_log_queueCount--;
+ }
+ if (info_log_droppedLineCount > 0) {
+  mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print("Lignes perdues (queue pleine),");
+  mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->println(info_log_droppedLineCount);
+  info_log_droppedLineCount = 0;
+ }
+ mySdCard.closeFile(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG);
+}
+
+// Étapes du fail safe (Voir gpf_failsafe_stage_enum) appliquées aux manches avant qu'ils soient utilisés (Voir getDesiredState()).
+// HOLD: roll, pitch et yaw au neutre pour laisser le drone se stabiliser, gaz gardés. LANDING: en plus, pendant 5 secondes,
+// les gaz descendent de leur valeur à l'entrée en LANDING jusqu'au minimum. Les canaux reçus ne sont pas modifiés: un frame
+// qui revient pendant le délai de retour (Voir GPF_FAILSAFE::update()) ne redonne pas les manches au pilote avant la fin.
+void GPF::failSafe_overrideSticks(uint16_t *throttle, uint16_t *roll, uint16_t *pitch, uint16_t *yaw) {
+ uint8_t stage = myRc.failSafe.get_stage();
+
+ if (stage >= GPF_FAILSAFE_STAGE_HOLD) {
+  // Todo: Ajouter condition avec lidar si distance avec le sol est plus petite que 0.5 mètre environ.
+  *roll  = GPF_RC_CHANNEL_VALUE_FAILSAFE;
+  *pitch = GPF_RC_CHANNEL_VALUE_FAILSAFE;
+  *yaw   = GPF_RC_CHANNEL_VALUE_FAILSAFE;
+ }
+
+ if (stage == GPF_FAILSAFE_STAGE_LANDING) {
+  if (failSafe_stage_previous != GPF_FAILSAFE_STAGE_LANDING) { //On entre en LANDING avec les derniers gaz reçus (gardés en HOLD)
+   failSafe_pwmThrottleValue = *throttle;
+   //Pas de DEBUG_GPF_PRINT ici, on est dans l'interruption du timer. Voir logFailSafeStage().
+  }
+
+  float progress = min(1.0, (float)myRc.getFailSafeDuration() / GPF_FAILSAFE_MOTORS_DECELERATION_DURATION);
+  *throttle = failSafe_pwmThrottleValue - progress * max(0.0, failSafe_pwmThrottleValue - GPF_RC_CHANNEL_VALUE_MIN);
+ }
+
+ failSafe_stage_previous = stage;
+}
+
+// Une fois qu'on a laissé le temps aux moteurs de ralentir pendant 5 secondes pour que le drone descendre/tombe en douceur
+// (Voir failSafe_overrideSticks()), on s'assure que les moteurs arrêtent complètement.
+void GPF::manageFailSafe() {
+ if ((myRc.failSafe.get_stage() == GPF_FAILSAFE_STAGE_LANDING) && (myRc.getFailSafeDuration() >= GPF_FAILSAFE_MOTORS_DECELERATION_DURATION)) {
+  for (uint8_t motorNumber = 0; motorNumber < GPF_MOTOR_ITEM_COUNT; motorNumber++) { 
+   motor_command_DSHOT[motorNumber] = GPF_DSHOT_CMD_MOTOR_STOP; 
+  }
+ }
+}
+
+// Appelée à chaque tour de loop() après readRx(). Chaque changement d'étape du fail safe est mis dans la queue du log
+// d'information (Voir info_log_queueLine()) avec les stats du lien à ce moment pour l'analyse après le vol.
+void GPF::logFailSafeStage() {
+ uint32_t transitionCount = myRc.failSafe.get_transitionCount();
+
+ if (transitionCount == failSafe_transitionCount) {
+  return;
+ }
+ failSafe_transitionCount = transitionCount;
+
+ const char *stageDescription    = GPF_FAILSAFE::getStageDescription(myRc.failSafe.get_stage());
+ const char *previousDescription = GPF_FAILSAFE::getStageDescription(myRc.failSafe.get_previousStage());
+
+ DEBUG_GPF_PRINT("GPF: FailSafe ");
+ DEBUG_GPF_PRINT(previousDescription);
+ DEBUG_GPF_PRINT(" -> ");
+ DEBUG_GPF_PRINT(stageDescription);
+ DEBUG_GPF_PRINT(" silenceUs=");
+ DEBUG_GPF_PRINT(myRc.failSafe.get_silenceUs());
+ DEBUG_GPF_PRINT(" lqAvg=");
+ DEBUG_GPF_PRINTLN(myRc.failSafe.get_linkQualityAverage());
+
+ char line[GPF_INFO_LOG_LINE_MAX_LENGTH];
+ snprintf(line, GPF_INFO_LOG_LINE_MAX_LENGTH, "%sFailSafe,%s->%s,silenceUs=%lu,missedLimitUs=%lu,rateHz=%.2f,lq=%u,lqAvg=%.2f,rssi1=-%u,rssi2=-%u,rssiAvg=-%.2f,snr=%d,armed=%d",
+          gpf_util_get_dateTimeString(GPF_MISC_FORMAT_DATE_TIME_FRIENDLY_US,true), previousDescription, stageDescription,
+          myRc.failSafe.get_silenceUs(), myRc.failSafe.get_missedLimitUs(), myRc.get_packetRateHz(),
+          myRc.link_statistics.up_link_quality, myRc.failSafe.get_linkQualityAverage(), myRc.link_statistics.up_rssi_ant1,
+          myRc.link_statistics.up_rssi_ant2, myRc.failSafe.get_rssiAverage(), myRc.link_statistics.up_snr, arm_isArmed);
+ info_log_queueLine(line); //Écrite par la tâche BlackBox, pas d'écriture bloquante sur la carte SD ici
+}
+
+// Appelée par la tâche GPF_TASK_DEBUG_STATS à chaque DEBUG_GPF_DELAY ms (Voir main.cpp)
 void GPF::debugDisplayLoopStats() {
  #ifdef DEBUG_GPF_ENABLED 
-  if (debug_sincePrint > DEBUG_GPF_DELAY) {
-   DEBUG_GPF_PRINT("GPF: loopCount=");
-   DEBUG_GPF_PRINT(loopCount);
-   DEBUG_GPF_PRINT(F(" "));
-   DEBUG_GPF_PRINT(getLoopFrequency());
-   DEBUG_GPF_PRINT("hz loopBusyTime=");
-   DEBUG_GPF_PRINT(loopBusyTime);
-   DEBUG_GPF_PRINT("/");
-   DEBUG_GPF_PRINT(GPF_MAIN_LOOP_RATE);
-   DEBUG_GPF_PRINT(" loopBusyTimePercent=");
-   DEBUG_GPF_PRINT(loopBusyTimePercent);
-   DEBUG_GPF_PRINT("%");
-   DEBUG_GPF_PRINT(" free ram=");
-   DEBUG_GPF_PRINT(gpf_util_freeRam());
-   DEBUG_GPF_PRINT(" loopBusyTimeMin=");
-   DEBUG_GPF_PRINT(loopBusyTimeMin);
-   DEBUG_GPF_PRINT(" loopBusyTimeMax=");
-   DEBUG_GPF_PRINT(loopBusyTimeMax);
-   DEBUG_GPF_PRINT(" loopTimeOverFlowCount=");
-   DEBUG_GPF_PRINT(loopTimeOverFlowCount);
-   DEBUG_GPF_PRINT(" Armed=");
-   DEBUG_GPF_PRINT(get_arm_IsArmed());
-   DEBUG_GPF_PRINT(" arm_allowArming=");
-   DEBUG_GPF_PRINT(arm_allowArming);
-   DEBUG_GPF_PRINT(" wasArmedAtLeastOnce=");
-   DEBUG_GPF_PRINT(wasArmedAtLeastOnce);
-
-   DEBUG_GPF_PRINTLN();
-
-   debug_sincePrint = 0;
-
-   //ptrMemoryLeakTest = (byte*)malloc(5000); //Test pour créer un memory leak
-  }
+  DEBUG_GPF_PRINT("GPF: loopCount=");
+  DEBUG_GPF_PRINT(loopCount);
+  DEBUG_GPF_PRINT(F(" "));
+  DEBUG_GPF_PRINT(getLoopFrequency());
+  DEBUG_GPF_PRINT("hz loopBusyTime=");
+  DEBUG_GPF_PRINT(loopBusyTime);
+  DEBUG_GPF_PRINT("/");
+  DEBUG_GPF_PRINT(GPF_MAIN_LOOP_RATE);
+  DEBUG_GPF_PRINT(" loopBusyTimePercent=");
+  DEBUG_GPF_PRINT(loopBusyTimePercent);
+  DEBUG_GPF_PRINT("%");
+  DEBUG_GPF_PRINT(" free ram=");
+  DEBUG_GPF_PRINT(gpf_util_freeRam());
+  DEBUG_GPF_PRINT(" loopBusyTimeMin=");
+  DEBUG_GPF_PRINT(loopBusyTimeMin);
+  DEBUG_GPF_PRINT(" loopBusyTimeMax=");
+  DEBUG_GPF_PRINT(loopBusyTimeMax);
+  DEBUG_GPF_PRINT(" loopTimeOverFlowCount=");
+  DEBUG_GPF_PRINT(loopTimeOverFlowCount);
+  DEBUG_GPF_PRINT(" gyroStage@");
+  DEBUG_GPF_PRINT(1000000 / GPF_GYRO_LOOP_RATE);
+  DEBUG_GPF_PRINT("hz=");
+  DEBUG_GPF_PRINT(gyroStageTime);
+  DEBUG_GPF_PRINT("/");
+  DEBUG_GPF_PRINT(gyroStageTimeMax);
+  DEBUG_GPF_PRINT("/");
+  DEBUG_GPF_PRINT(GPF_GYRO_LOOP_RATE);
+  DEBUG_GPF_PRINT("us ");
+  DEBUG_GPF_PRINT((float)(gyroStageTime * 100.0 / GPF_GYRO_LOOP_RATE));
+  DEBUG_GPF_PRINT("% pidStage@");
+  DEBUG_GPF_PRINT(1000000 / GPF_MAIN_LOOP_RATE);
+  DEBUG_GPF_PRINT("hz=");
+  DEBUG_GPF_PRINT(pidStageTime);
+  DEBUG_GPF_PRINT("/");
+  DEBUG_GPF_PRINT(pidStageTimeMax);
+  DEBUG_GPF_PRINT("/");
+  DEBUG_GPF_PRINT(GPF_MAIN_LOOP_RATE);
+  DEBUG_GPF_PRINT("us ");
+  DEBUG_GPF_PRINT((float)(pidStageTime * 100.0 / GPF_MAIN_LOOP_RATE));
+  DEBUG_GPF_PRINT("%");
+  DEBUG_GPF_PRINT(" Armed=");
+  DEBUG_GPF_PRINT(get_arm_IsArmed());
+  DEBUG_GPF_PRINT(" arm_allowArming=");
+  DEBUG_GPF_PRINT(arm_allowArming);
+  DEBUG_GPF_PRINT(" wasArmedAtLeastOnce=");
+  DEBUG_GPF_PRINT(wasArmedAtLeastOnce);
+  DEBUG_GPF_PRINT(" drdyMissed=");
+  DEBUG_GPF_PRINT(myImu.drdy_missedSampleCount);
+  DEBUG_GPF_PRINT(" drdyDuplicated=");
+  DEBUG_GPF_PRINT(myImu.drdy_duplicatedSampleCount);
+  DEBUG_GPF_PRINT(" imuRead(");
+  DEBUG_GPF_PRINT(myImu.get_transportDescription());
+  DEBUG_GPF_PRINT(")=");
+  DEBUG_GPF_PRINT(myImu.readDuration);
+  DEBUG_GPF_PRINT("/");
+  DEBUG_GPF_PRINT(myImu.readDurationMax);
+  DEBUG_GPF_PRINT(" fifoDepth=");
+  DEBUG_GPF_PRINT(myImu.fifo_gyroDepth);
+  DEBUG_GPF_PRINT("/");
+  DEBUG_GPF_PRINT(myImu.fifo_gyroDepthMax);
+  DEBUG_GPF_PRINT(" fifoOverflow=");
+  DEBUG_GPF_PRINT(myImu.fifo_gyroOverflowCount);
+  DEBUG_GPF_PRINT(" fifoDropped=");
+  DEBUG_GPF_PRINT(myImu.fifo_gyroDroppedFrameCount);
+  DEBUG_GPF_PRINT(" fifoAccelSkipped=");
+  DEBUG_GPF_PRINT(myImu.fifo_accelSkippedFrameCount);
+  #if defined GPF_IMU_DYN_NOTCH_ENABLED
+   DEBUG_GPF_PRINT(" dynNotch(pic/centre hz)=");
+   for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+     for (uint8_t notch = 0; notch < myImu.dynNotch.get_notchCount(); notch++) {
+       DEBUG_GPF_PRINT(myImu.dynNotch.get_peakHz(axe, notch), 0);
+       DEBUG_GPF_PRINT("/");
+       DEBUG_GPF_PRINT(myImu.dynNotch.get_centerHz(axe, notch), 0);
+       DEBUG_GPF_PRINT((notch < myImu.dynNotch.get_notchCount() - 1) ? " " : "");
+     }
+     DEBUG_GPF_PRINT((axe < GPF_FILTER_AXE_COUNT - 1) ? "," : "");
+   }
+  #endif
+  #if defined GPF_IMU_HARMONIC_NOTCH_ENABLED
+   DEBUG_GPF_PRINT(" harmonicNotch=");
+   DEBUG_GPF_PRINT(myImu.harmonicNotch.get_fundamentalHz(), 0);
+   DEBUG_GPF_PRINT("hz x");
+   DEBUG_GPF_PRINT(myImu.harmonicNotch.get_harmonicCount());
+  #endif
+  DEBUG_GPF_PRINT(" i2cAsyncNotReady=");
+  DEBUG_GPF_PRINT(myImu.i2cAsync_notReadyCount);
+  DEBUG_GPF_PRINT(" i2cAsyncErrors=");
+  DEBUG_GPF_PRINT(myImu.i2cAsync.errorCount);
+  DEBUG_GPF_PRINT(" i2cAsyncStartFailed=");
+  DEBUG_GPF_PRINT(myImu.i2cAsync.startFailedCount);
+  DEBUG_GPF_PRINT(" governor=");
+  DEBUG_GPF_PRINT(governor_level);
+  DEBUG_GPF_PRINT("/");
+  DEBUG_GPF_PRINT(governor_eventCount);
+  DEBUG_GPF_PRINT(" FailSafe=");
+  DEBUG_GPF_PRINT(myRc.get_isInFailSafe());
+  DEBUG_GPF_PRINT(" failSafeThrottleStart=");
+  DEBUG_GPF_PRINT(failSafe_pwmThrottleValue);
+
+  DEBUG_GPF_PRINTLN();
+
+  //ptrMemoryLeakTest = (byte*)malloc(5000); //Test pour créer un memory leak
  #endif
 }
 
 void GPF::resetLoopStats() {
+ noInterrupts(); //Les stats sont écrites par la boucle de contrôle (interruption du timer)
  firstLoopStartedAt    = 0; 
  loopCount             = 0; 
  loopBusyTimeMin       = 999999;
  loopBusyTimeMax       = 0;
  loopTimeOverFlowCount = 0;
+ gyroStageTimeMax      = 0;
+ pidStageTimeMax       = 0;
+ myImu.resetReadDurationStats();
+ myImu.resetEstimatorCycleStats();
+ loopJitterHistogram.reset();
+ loopBusyHistogram.reset();
+ loopFreeHistogram.reset();
+ loopJitter_previousTickAt = 0;
+ interrupts();
+ myRc.resetLinkStats();
+ GPF_PROFILER::reset();
+ myScheduler.resetStats();
+}
+
+// Min/moyenne/max de chaque étape mesurée par GPF_PROFILER (en us)
+void GPF::debugDisplayProfilerStats() {
+ #if defined DEBUG_GPF_ENABLED && defined GPF_PROFILER_ENABLED
+  gpf_profiler_stage_stats_struct stats;
+
+  DEBUG_GPF_PRINT("GPF: Profiler (us min/moy/max count) @");
+  DEBUG_GPF_PRINT(F_CPU_ACTUAL / 1000000);
+  DEBUG_GPF_PRINTLN("MHz");
+
+  for (uint8_t stage = 0; stage < GPF_PROFILER_STAGE_ITEM_COUNT; stage++) {
+   GPF_PROFILER::getStats(stage, &stats);
+   DEBUG_GPF_PRINT("  ");
+   DEBUG_GPF_PRINT(GPF_PROFILER::getStageName(stage));
+   DEBUG_GPF_PRINT("=");
+   DEBUG_GPF_PRINT(GPF_PROFILER::cyclesToMicros(stats.cyclesMin));
+   DEBUG_GPF_PRINT("/");
+   DEBUG_GPF_PRINT(GPF_PROFILER::cyclesToMicros((stats.count > 0) ? (float)stats.cyclesTotal / stats.count : 0));
+   DEBUG_GPF_PRINT("/");
+   DEBUG_GPF_PRINT(GPF_PROFILER::cyclesToMicros(stats.cyclesMax));
+   DEBUG_GPF_PRINT(" ");
+   DEBUG_GPF_PRINTLN(stats.count);
+  }
+ #endif
+}
+
+// Cycles par appel des fonctions de gpf_fast_math.h comparées à la librairie standard (double) sur le Teensy.
+// Roule dans loop() avec les interruptions actives, les chiffres incluent donc un peu du temps de la boucle de contrôle.
+void GPF::debugBenchmarkFastMath() {
+ #if defined DEBUG_GPF_ENABLED && defined GPF_PROFILER_ENABLED
+  const uint16_t  callCount = 1000;
+  const char     *names[8]  = {"atan2", "atan2 (std)", "asin", "asin (std)", "atan", "atan (std)", "invSqrt", "invSqrt (1.0/sqrtf)"};
+  volatile float  sink      = 0;
+  uint32_t        cycles[8];
+  uint32_t        startedAt;
+  float           x;
+
+  #define GPF_BENCHMARK_FAST_MATH(index, expression) \
+   startedAt = ARM_DWT_CYCCNT; \
+   for (uint16_t i = 0; i < callCount; i++) { x = (i - (callCount / 2)) / (float)(callCount / 2); sink = sink + (expression); } \
+   cycles[index] = ARM_DWT_CYCCNT - startedAt;
+
+  GPF_BENCHMARK_FAST_MATH(0, gpf_fast_math_atan2(x, 0.5f - x));
+  GPF_BENCHMARK_FAST_MATH(1, atan2(x, 0.5f - x) * 57.29577951);
+  GPF_BENCHMARK_FAST_MATH(2, gpf_fast_math_asin(x));
+  GPF_BENCHMARK_FAST_MATH(3, asin(x) * 57.29577951);
+  GPF_BENCHMARK_FAST_MATH(4, gpf_fast_math_atan(x * 3.0f));
+  GPF_BENCHMARK_FAST_MATH(5, atan(x * 3.0f));
+  GPF_BENCHMARK_FAST_MATH(6, gpf_fast_math_invSqrt(x + 2.0f));
+  GPF_BENCHMARK_FAST_MATH(7, 1.0 / sqrtf(x + 2.0f));
+  #undef GPF_BENCHMARK_FAST_MATH
+
+  DEBUG_GPF_PRINTLN("GPF: gpf_fast_math (cycles par appel, boucle comprise)");
+  for (uint8_t index = 0; index < 8; index++) {
+   DEBUG_GPF_PRINT("  ");
+   DEBUG_GPF_PRINT(names[index]);
+   DEBUG_GPF_PRINT("=");
+   DEBUG_GPF_PRINTLN((float)cycles[index] / callCount, 1);
+  }
+ #endif
+}
+
+// Cycles par update() de chaque estimateur d'attitude. Sans GPF_IMU_ESTIMATOR_COMPARE_ENABLED, seul celui qui a roulé en fm-3 a des chiffres.
+void GPF::debugDisplayEstimatorStats() {
+ #ifdef DEBUG_GPF_ENABLED
+  uint32_t cyclesLast[GPF_ESTIMATOR_TYPE_ITEM_COUNT];
+  uint32_t cyclesMax[GPF_ESTIMATOR_TYPE_ITEM_COUNT];
+  float    cyclesAverage[GPF_ESTIMATOR_TYPE_ITEM_COUNT];
+
+  noInterrupts(); //Copie cohérente, les stats sont mises à jour par la boucle de contrôle
+  for (uint8_t estimatorType = 0; estimatorType < GPF_ESTIMATOR_TYPE_ITEM_COUNT; estimatorType++) {
+   cyclesLast[estimatorType]    = myImu.get_estimator(estimatorType)->get_cyclesLast();
+   cyclesMax[estimatorType]     = myImu.get_estimator(estimatorType)->get_cyclesMax();
+   cyclesAverage[estimatorType] = myImu.get_estimator(estimatorType)->get_cyclesAverage();
+  }
+  interrupts();
+
+  DEBUG_GPF_PRINT("GPF: Estimateurs (cycles dernier/moy/max) @");
+  DEBUG_GPF_PRINT(F_CPU_ACTUAL / 1000000);
+  DEBUG_GPF_PRINT("MHz, config=");
+  DEBUG_GPF_PRINTLN(myImu.get_estimator(myConfig_ptr->estimator)->getName());
+  for (uint8_t estimatorType = 0; estimatorType < GPF_ESTIMATOR_TYPE_ITEM_COUNT; estimatorType++) {
+   DEBUG_GPF_PRINT("  ");
+   DEBUG_GPF_PRINT(myImu.get_estimator(estimatorType)->getName());
+   DEBUG_GPF_PRINT("=");
+   DEBUG_GPF_PRINT(cyclesLast[estimatorType]);
+   DEBUG_GPF_PRINT("/");
+   DEBUG_GPF_PRINT(cyclesAverage[estimatorType], 1);
+   DEBUG_GPF_PRINT("/");
+   DEBUG_GPF_PRINTLN(cyclesMax[estimatorType]);
+  }
+ #endif
+}
+
+// P50/P90/P99/P99.9 de la gigue, du temps occupé et du temps libre de la boucle de contrôle
+void GPF::debugDisplayLoopHistograms() {
+ #ifdef DEBUG_GPF_ENABLED
+  GPF_HISTOGRAM *histograms[3]   = {&loopJitterHistogram, &loopBusyHistogram, &loopFreeHistogram};
+  const char    *names[3]        = {"jitter", "busy", "free"};
+  const float    percentiles[4]  = {50.0, 90.0, 99.0, 99.9};
+  uint32_t       values[4];
+  uint32_t       maxValue;
+  uint32_t       count;
+
+  DEBUG_GPF_PRINTLN("GPF: Loop histograms (us P50/P90/P99/P99.9 max count)");
+  for (uint8_t h = 0; h < 3; h++) {
+   noInterrupts(); //Copie cohérente, les histogrammes sont mis à jour par la boucle de contrôle
+   for (uint8_t p = 0; p < 4; p++) {
+    values[p] = histograms[h]->getPercentile(percentiles[p]);
+   }
+   maxValue = histograms[h]->get_max();
+   count    = histograms[h]->get_count();
+   interrupts();
+
+   DEBUG_GPF_PRINT("  ");
+   DEBUG_GPF_PRINT(names[h]);
+   DEBUG_GPF_PRINT("=");
+   for (uint8_t p = 0; p < 4; p++) {
+    DEBUG_GPF_PRINT(values[p]);
+    DEBUG_GPF_PRINT("/");
+   }
+   DEBUG_GPF_PRINT(maxValue);
+   DEBUG_GPF_PRINT(" ");
+   DEBUG_GPF_PRINTLN(count);
+  }
+ #endif
+}
+
+// Empreinte temporelle du vol écrite dans le log d'information au désarmement. Le fichier doit déjà être ouvert.
+void GPF::info_log_writeLoopHistograms() {
+  GPF_HISTOGRAM *histograms[3]   = {&loopJitterHistogram, &loopBusyHistogram, &loopFreeHistogram};
+  const char    *names[3]        = {"loop_jitter_us", "loop_busy_us", "loop_free_us"};
+  const float    percentiles[4]  = {50.0, 90.0, 99.0, 99.9};
+  uint32_t       values[4];
+  uint32_t       maxValue;
+  uint32_t       count;
+
+  mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->println("histogram,P50,P90,P99,P99.9,max,count");
+
+  for (uint8_t h = 0; h < 3; h++) {
+   noInterrupts(); //Copie cohérente, les histogrammes sont mis à jour par la boucle de contrôle
+   for (uint8_t p = 0; p < 4; p++) {
+    values[p] = histograms[h]->getPercentile(percentiles[p]);
+   }
+   maxValue = histograms[h]->get_max();
+   count    = histograms[h]->get_count();
+   interrupts();
+
+   mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(names[h]);
+   for (uint8_t p = 0; p < 4; p++) {
+    mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
+    mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(values[p]);
+   }
+   mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
+   mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(maxValue);
+   mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
+   mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->println(count);
+  }
+}
+
+// Commandes reçues par le port USB. 'p' = afficher le profileur, 'h' = percentiles de la boucle, 't' = tâches, 'm' = cycles de gpf_fast_math, 'e' = cycles des estimateurs, 'r' = reset des stats.
+void GPF::debugProcessUsbRequest() {
+ #ifdef DEBUG_GPF_ENABLED
+  while (DebugStream_GPF.available() > 0) {
+   switch (DebugStream_GPF.read()) {
+    case 'p':
+     debugDisplayProfilerStats();
+     break;
+    case 'h':
+     debugDisplayLoopHistograms();
+     break;
+    case 't':
+     myScheduler.debugDisplayStats();
+     break;
+    case 'm':
+     debugBenchmarkFastMath();
+     break;
+    case 'e':
+     debugDisplayEstimatorStats();
+     break;
+    case 'r':
+     resetLoopStats();
+     DEBUG_GPF_PRINTLN("GPF: Reset loop stats");
+     break;
+   }
+  }
+ #endif
 }
 
 void GPF::waitUntilNextLoop() {
@@ -142,6 +769,7 @@ void GPF::waitUntilNextLoop() {
 void GPF::toggMainBoardLed() {    
   // Attention, la LED_BUILTIN (pin 13) est la même pin que le SPI SCK sur un Teensy 4.1 
   // alors une fois mon SPI initialisé, je ne devrait plus me servir de cette fonction.
+  // Pas une tâche de myScheduler: plus appelée nulle part depuis que le SPI est initialisé au démarrage.
   static bool ledState = true;
   static elapsedMillis since_ledToggled = 0;
 
@@ -259,12 +887,19 @@ void GPF::menu_gotoTestTouchScreen(bool firstTime, int not_used_param_2=0, int n
   
 }
 
+// Copie des canaux pour tout le tour de loop(): l'armement, la boîte noire et le mode de vol sont décidés sur le même frame
+// même si un nouveau frame les change entre deux lectures.
+void GPF::refreshRcSnapshot() {
+  myRc.getPwmChannelValues(rc_snapshot);
+}
+
+// Selon la copie de refreshRcSnapshot(), pour loop() seulement
 bool GPF::get_IsStickInPosition(uint8_t stick, gpf_rc_channel_position_type_enum channel_position_required) {    
   bool retour = false;
   unsigned int currentPos;
 
   if (myConfig_ptr != NULL) {
-    currentPos    = myRc.getPwmChannelPos(myConfig_ptr->channelMaps[stick]);
+    currentPos    = rc_snapshot[myConfig_ptr->channelMaps[stick]];
     retour = gpf_util_isPwmChannelAtPos(currentPos, channel_position_required);
   }
   
@@ -282,7 +917,7 @@ void GPF::update_arm_allowArming() {
   //que la swith arm ne soit pas déjà en position armée.
 
   if (!wasArmedAtLeastOnce) {
-   firstTimeConditionOk = ( (myRc.getPwmChannelPos(myConfig_ptr->channelMaps[GPF_RC_STICK_THROTTLE]) < 1001) &&
+   firstTimeConditionOk = ( (rc_snapshot[myConfig_ptr->channelMaps[GPF_RC_STICK_THROTTLE]] < 1001) &&
                             (!get_IsStickInPosition(GPF_RC_STICK_ARM, GPF_RC_CHANNEL_POSITION_HIGH)) 
                           );
   } else {
@@ -344,29 +979,29 @@ void GPF::black_box_writeHeader() {
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("gyrY_raw_plus_offsets,"); 
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("gyrZ_raw_plus_offsets,");   
 
-       //acc?_output avant lp filter (lp filter seulement si fusion_type == GPF_IMU_FUSION_TYPE_MADGWICK)
+       //acc?_output avant lp filter (lp filter seulement si fusion_type != GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER)
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("accX_output_no_lp_filter,");
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("accY_output_no_lp_filter,");
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("accZ_output_no_lp_filter,");  
 
-       //gyr?_output avant lp filter (lp filter seulement si fusion_type == GPF_IMU_FUSION_TYPE_MADGWICK)
+       //gyr?_output avant lp filter (lp filter seulement si fusion_type != GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER)
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("gyrX_output_no_lp_filter,"); 
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("gyrY_output_no_lp_filter,"); 
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("gyrZ_output_no_lp_filter,");   
 
-       //acc?_output après lp filter (lp filter seulement si fusion_type == GPF_IMU_FUSION_TYPE_MADGWICK)
+       //acc?_output après lp filter (lp filter seulement si fusion_type != GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER)
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("     ");  
 
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("accX_output,");  
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("accY_output,");  
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("accZ_output,");    
 
-       //gyr?_output après lp filter (lp filter seulement si fusion_type == GPF_IMU_FUSION_TYPE_MADGWICK)
+       //gyr?_output après lp filter (lp filter seulement si fusion_type != GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER)
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("gyrX_output,");   
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("gyrY_output,");   
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("gyrZ_output,");     
 
-       //pitch/roll/yaw degres après fusion (peu importe si fution Madgwick ou Complementary filter)
+       //pitch/roll/yaw degres après fusion (peu importe si fution Madgwick, Mahony, EKF ou Complementary filter)
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("     ");  
 
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("fusion_degree_pitch,");   
@@ -408,6 +1043,28 @@ void GPF::black_box_writeHeader() {
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("flight_mode,");      
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("get_isInFailSafe,"); 
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("Imu_errorCount,"); 
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("Imu_drdy_missedSampleCount,"); 
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("Imu_drdy_duplicatedSampleCount,"); 
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("Imu_fifo_gyroDepth,"); 
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("Imu_fifo_gyroOverflowCount,"); 
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("Imu_fifo_gyroDroppedFrameCount,"); 
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("Mixer_saturationCount,"); 
+       #if defined GPF_IMU_DYN_NOTCH_ENABLED
+        for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+          for (uint8_t notch = 0; notch < myImu.dynNotch.get_notchCount(); notch++) {
+            mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->printf("Imu_dynNotch_peakHz_%d_%d,Imu_dynNotch_centerHz_%d_%d,", axe, notch, axe, notch);
+          }
+        }
+       #endif
+       #if defined GPF_IMU_HARMONIC_NOTCH_ENABLED
+        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("Imu_harmonicNotch_fundamentalHz,");
+       #endif
+       #if defined GPF_IMU_ESTIMATOR_COMPARE_ENABLED
+        for (uint8_t estimatorType = 0; estimatorType < GPF_ESTIMATOR_TYPE_ITEM_COUNT; estimatorType++) {
+          const char *name = myImu.get_estimator(estimatorType)->getName();
+          mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->printf("Imu_estimator_%s_pitch,Imu_estimator_%s_roll,Imu_estimator_%s_cycles,", name, name, name);
+        }
+       #endif
 
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->println("end");
 
@@ -415,6 +1072,8 @@ void GPF::black_box_writeHeader() {
 
 void GPF::black_box_writeRow() {    
 
+       myImu.updateFusionDegrees();
+
        //Date/Time
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(gpf_util_get_dateTimeString(GPF_MISC_FORMAT_DATE_TIME_LOGGING,true));
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");
@@ -435,7 +1094,7 @@ void GPF::black_box_writeRow() {
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.gyrZ_raw_plus_offsets);
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");   
 
-       //acc?_output avant lp filter (lp filter seulement si fusion_type == GPF_IMU_FUSION_TYPE_MADGWICK)
+       //acc?_output avant lp filter (lp filter seulement si fusion_type != GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER)
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.accX_raw_plus_offsets / GPF_IMU_ACCEL_SCALE_FACTOR,6);
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.accY_raw_plus_offsets / GPF_IMU_ACCEL_SCALE_FACTOR,6);
@@ -443,7 +1102,7 @@ void GPF::black_box_writeRow() {
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.accZ_raw_plus_offsets / GPF_IMU_ACCEL_SCALE_FACTOR,6);
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");  
 
-       //gyr?_output avant lp filter (lp filter seulement si fusion_type == GPF_IMU_FUSION_TYPE_MADGWICK)
+       //gyr?_output avant lp filter (lp filter seulement si fusion_type != GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER)
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.gyrX_raw_plus_offsets / GPF_IMU_GYRO_SCALE_FACTOR,6);
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(","); 
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.gyrY_raw_plus_offsets / GPF_IMU_GYRO_SCALE_FACTOR,6);
@@ -451,7 +1110,7 @@ void GPF::black_box_writeRow() {
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.gyrZ_raw_plus_offsets / GPF_IMU_GYRO_SCALE_FACTOR,6);
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");    
 
-       //acc?_output après lp filter (lp filter seulement si fusion_type == GPF_IMU_FUSION_TYPE_MADGWICK)
+       //acc?_output après lp filter (lp filter seulement si fusion_type != GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER)
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("     ");  
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.accX_output,6);
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");  
@@ -460,7 +1119,7 @@ void GPF::black_box_writeRow() {
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.accZ_output,6);
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");    
 
-       //gyr?_output après lp filter (lp filter seulement si fusion_type == GPF_IMU_FUSION_TYPE_MADGWICK)
+       //gyr?_output après lp filter (lp filter seulement si fusion_type != GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER)
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.gyrX_output,6);
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");   
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.gyrY_output,6);
@@ -468,7 +1127,7 @@ void GPF::black_box_writeRow() {
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.gyrZ_output,6);
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");     
 
-       //pitch/roll/yaw degres après fusion (peu importe si fution Madgwick ou Complementary filter)
+       //pitch/roll/yaw degres après fusion (peu importe si fution Madgwick, Mahony, EKF ou Complementary filter)
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print("     ");  
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.fusion_degree_pitch,6);
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");   
@@ -533,6 +1192,44 @@ void GPF::black_box_writeRow() {
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");      
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.errorCount);
         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");       
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.drdy_missedSampleCount);
+        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");       
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.drdy_duplicatedSampleCount);
+        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");       
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.fifo_gyroDepth);
+        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");       
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.fifo_gyroOverflowCount);
+        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");       
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.fifo_gyroDroppedFrameCount);
+        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");       
+       mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myMixer.get_saturationCount());
+        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");       
+       #if defined GPF_IMU_DYN_NOTCH_ENABLED
+        for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+          for (uint8_t notch = 0; notch < myImu.dynNotch.get_notchCount(); notch++) {
+            mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.dynNotch.get_peakHz(axe, notch), 1);
+             mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");
+            mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.dynNotch.get_centerHz(axe, notch), 1);
+             mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");
+          }
+        }
+       #endif
+       #if defined GPF_IMU_HARMONIC_NOTCH_ENABLED
+        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.harmonicNotch.get_fundamentalHz(), 1);
+         mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");
+       #endif
+       #if defined GPF_IMU_ESTIMATOR_COMPARE_ENABLED
+        for (uint8_t estimatorType = 0; estimatorType < GPF_ESTIMATOR_TYPE_ITEM_COUNT; estimatorType++) {
+          float roll, pitch, yaw;
+          myImu.get_estimator(estimatorType)->getEulerDegrees(&roll, &pitch, &yaw);
+          mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(pitch, 2);
+           mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");
+          mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(roll, 2);
+           mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");
+          mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(myImu.get_estimator(estimatorType)->get_cyclesLast());
+           mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->print(",");
+        }
+       #endif
 
        mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->println("end");
   
@@ -541,15 +1238,20 @@ void GPF::black_box_writeRow() {
 void GPF::get_set_flightMode() {    
   
   if (get_IsStickInPosition(GPF_RC_STICK_FLIGHT_MODE, GPF_RC_CHANNEL_POSITION_HIGH)) {
-    flight_mode = GPF_FLIGHT_MODE_3_FUSION_TYPE_MADGWICK;
-    strncpy(gpf_telemetry_info.flight_mode_description, "GPF Madgwick", GPF_UTIL_FLIGHT_MODE_DESCRIPTION_MAX_LENGTH);
+    flight_mode = GPF_FLIGHT_MODE_3_FUSION_TYPE_MADGWICK; //Estimateur choisi dans la config (Voir GPF_IMU::set_fusion_type())
+    snprintf(gpf_telemetry_info.flight_mode_description, GPF_UTIL_FLIGHT_MODE_DESCRIPTION_MAX_LENGTH, "GPF %s", myImu.get_estimator(myConfig_ptr->estimator)->getName());
   } else {
     if (get_IsStickInPosition(GPF_RC_STICK_FLIGHT_MODE, GPF_RC_CHANNEL_POSITION_MID)) {
       flight_mode = GPF_FLIGHT_MODE_2_FUSION_TYPE_COMPLEMENTARY_FILTER;
       strncpy(gpf_telemetry_info.flight_mode_description, "GPF Complemen", GPF_UTIL_FLIGHT_MODE_DESCRIPTION_MAX_LENGTH);
     } else {
+     #if defined GPF_CONTROLLER_ACRO_ON_LOW_POSITION
+      flight_mode = GPF_FLIGHT_MODE_4_ACRO;
+      strncpy(gpf_telemetry_info.flight_mode_description, "GPF Acro", GPF_UTIL_FLIGHT_MODE_DESCRIPTION_MAX_LENGTH);
+     #else
       flight_mode = GPF_FLIGHT_MODE_1_EQUAL_THROTTLE_FOR_TESTS_ONLY;
       strncpy(gpf_telemetry_info.flight_mode_description, "GPF **TEST**", GPF_UTIL_FLIGHT_MODE_DESCRIPTION_MAX_LENGTH);
+     #endif
     }
   }
 
@@ -572,6 +1274,7 @@ void GPF::menu_gotoInfoStats(bool firstTime, int not_used_param_2=0, int not_use
   uint16_t charHeight = 0;
   uint16_t charWidth  = 0;
   const uint16_t x_pos = 120;
+  // La tâche Menu roule à 100hz pour le tactile. Ce délai est seulement celui du rafraîchissement de cet écran, d'où le elapsedMillis.
   static elapsedMillis sincePrint = 1001; //pour que le tout s'affiche tout de suite dès le premier appel de la fonction.
   const uint16_t sincePrint_delay = 1000;
   myDisplay.get_tft()->measureChar('X',&charWidth,&charHeight); 
@@ -590,12 +1293,24 @@ void GPF::menu_gotoInfoStats(bool firstTime, int not_used_param_2=0, int not_use
     myDisplay.println("     Freq");
     myDisplay.println("Busy Time");
     myDisplay.println("   Busy %");
-    myDisplay.println("BusyT.Min");
-    myDisplay.println("BusyT.Max");
+    myDisplay.println("BusyT.m/M");
     myDisplay.println("OverF Cpt");
+    myDisplay.println("IMU Lect.");
+    myDisplay.println("IMU Perdu");
+    myDisplay.println("CRSF Err.");
+    myDisplay.println("RC Hz/Jit");
+    myDisplay.println("Mixer Sat");
     myDisplay.println(" Free RAM");
-    myDisplay.println("Ver. Prog");
-    myDisplay.println("Ver. Conf");
+    myDisplay.println("Ver. P/C");
+
+    #if defined GPF_PROFILER_ENABLED
+     myDisplay.setTextSize(1);
+     myDisplay.println();
+     myDisplay.println("Profiler (us)  min / moy / max");
+     for (uint8_t stage = 0; stage < GPF_PROFILER_STAGE_ITEM_COUNT; stage++) {
+      myDisplay.println(GPF_PROFILER::getStageName(stage));
+     }
+    #endif
     
     /*
     u_int64_t taille = mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_BLACK_BOX)->size();
@@ -645,28 +1360,79 @@ void GPF::menu_gotoInfoStats(bool firstTime, int not_used_param_2=0, int not_use
 
     myDisplay.get_tft()->fillRect(x_pos, myDisplay.get_tft()->getCursorY(), myDisplay.getDisplayWidth()-x_pos, charHeight, ILI9341_BLACK);
     myDisplay.get_tft()->setCursor(x_pos,myDisplay.get_tft()->getCursorY());  
-    myDisplay.println(loopBusyTimeMin);    
+    myDisplay.print(loopBusyTimeMin);
+    myDisplay.print("/");
+    myDisplay.println(loopBusyTimeMax);    
 
     myDisplay.get_tft()->fillRect(x_pos, myDisplay.get_tft()->getCursorY(), myDisplay.getDisplayWidth()-x_pos, charHeight, ILI9341_BLACK);
     myDisplay.get_tft()->setCursor(x_pos,myDisplay.get_tft()->getCursorY());  
-    myDisplay.println(loopBusyTimeMax);    
+    myDisplay.println(loopTimeOverFlowCount);    
 
     myDisplay.get_tft()->fillRect(x_pos, myDisplay.get_tft()->getCursorY(), myDisplay.getDisplayWidth()-x_pos, charHeight, ILI9341_BLACK);
     myDisplay.get_tft()->setCursor(x_pos,myDisplay.get_tft()->getCursorY());  
-    myDisplay.println(loopTimeOverFlowCount);    
+    myDisplay.print(myImu.readDuration);
+    myDisplay.print("/");
+    myDisplay.print(myImu.readDurationMax);
+    myDisplay.print(" ");
+    myDisplay.println(myImu.get_transportDescription());
 
     myDisplay.get_tft()->fillRect(x_pos, myDisplay.get_tft()->getCursorY(), myDisplay.getDisplayWidth()-x_pos, charHeight, ILI9341_BLACK);
     myDisplay.get_tft()->setCursor(x_pos,myDisplay.get_tft()->getCursorY());  
-    myDisplay.println(gpf_util_freeRam());
+    myDisplay.print(myImu.fifo_gyroDroppedFrameCount); //Frames du FIFO jetées / échantillons DRDY manqués
+    myDisplay.print("/");
+    myDisplay.println(myImu.drdy_missedSampleCount);
 
     myDisplay.get_tft()->fillRect(x_pos, myDisplay.get_tft()->getCursorY(), myDisplay.getDisplayWidth()-x_pos, charHeight, ILI9341_BLACK);
     myDisplay.get_tft()->setCursor(x_pos,myDisplay.get_tft()->getCursorY());  
-    myDisplay.println(GPF_MISC_PROG_CURRENT_VERSION);
+    myDisplay.print(myRc.get_crcErrorCount()); //CRC / resynchronisations / buffer plein
+    myDisplay.print("/");
+    myDisplay.print(myRc.get_resyncCount());
+    myDisplay.print("/");
+    myDisplay.println(myRc.get_overrunCount());
 
     myDisplay.get_tft()->fillRect(x_pos, myDisplay.get_tft()->getCursorY(), myDisplay.getDisplayWidth()-x_pos, charHeight, ILI9341_BLACK);
     myDisplay.get_tft()->setCursor(x_pos,myDisplay.get_tft()->getCursorY());  
+    myDisplay.print(myRc.get_packetRateHz(), 0); //Frames de canaux par seconde / gigue P99 en us
+    myDisplay.print("/");
+    myDisplay.println(myRc.get_frameJitterPercentile(99.0));
+
+    myDisplay.get_tft()->fillRect(x_pos, myDisplay.get_tft()->getCursorY(), myDisplay.getDisplayWidth()-x_pos, charHeight, ILI9341_BLACK);
+    myDisplay.get_tft()->setCursor(x_pos,myDisplay.get_tft()->getCursorY());  
+    myDisplay.print(myMixer.get_saturationCount()); //Tours saturés / préréglage de la config (refusé si pas GPF_MOTOR_ITEM_COUNT moteurs)
+    myDisplay.print(" ");
+    myDisplay.print(GPF_MIXER::getPresetDescription(myConfig_ptr->mixerPreset));
+    myDisplay.println(mixerRefused ? " refuse" : "");
+
+    myDisplay.get_tft()->fillRect(x_pos, myDisplay.get_tft()->getCursorY(), myDisplay.getDisplayWidth()-x_pos, charHeight, ILI9341_BLACK);
+    myDisplay.get_tft()->setCursor(x_pos,myDisplay.get_tft()->getCursorY());  
+    myDisplay.println(gpf_util_freeRam());
+
+    myDisplay.get_tft()->fillRect(x_pos, myDisplay.get_tft()->getCursorY(), myDisplay.getDisplayWidth()-x_pos, charHeight, ILI9341_BLACK);
+    myDisplay.get_tft()->setCursor(x_pos,myDisplay.get_tft()->getCursorY());  
+    myDisplay.print(GPF_MISC_PROG_CURRENT_VERSION);
+    myDisplay.print("/");
     myDisplay.println(GPF_MISC_CONFIG_CURRENT_VERSION);
-    
+
+    #if defined GPF_PROFILER_ENABLED
+     const uint16_t x_pos_profiler = 60;
+     uint16_t charHeightSmall = 0;
+     gpf_profiler_stage_stats_struct stats;
+
+     myDisplay.setTextSize(1);
+     myDisplay.get_tft()->measureChar('X',&charWidth,&charHeightSmall); 
+     myDisplay.println();
+     myDisplay.println();
+     for (uint8_t stage = 0; stage < GPF_PROFILER_STAGE_ITEM_COUNT; stage++) {
+      GPF_PROFILER::getStats(stage, &stats);
+      myDisplay.get_tft()->fillRect(x_pos_profiler, myDisplay.get_tft()->getCursorY(), myDisplay.getDisplayWidth()-x_pos_profiler, charHeightSmall, ILI9341_BLACK);
+      myDisplay.get_tft()->setCursor(x_pos_profiler,myDisplay.get_tft()->getCursorY());  
+      myDisplay.print(GPF_PROFILER::cyclesToMicros(stats.cyclesMin));
+      myDisplay.print(" / ");
+      myDisplay.print(GPF_PROFILER::cyclesToMicros((stats.count > 0) ? (float)stats.cyclesTotal / stats.count : 0));
+      myDisplay.print(" / ");
+      myDisplay.println(GPF_PROFILER::cyclesToMicros(stats.cyclesMax));
+     }
+    #endif
 
   }
 
@@ -850,6 +1616,108 @@ void GPF::menu_gotoConfigurationChannels(bool firstTime, int rcStick=0, int not_
   }
   
 
+}
+
+// Choix de l'estimateur d'attitude du mode de vol fm-3 (Voir gpf_estimator.cpp). Pris en compte dès le prochain tour de la boucle de contrôle.
+void GPF::menu_gotoConfigurationEstimator(bool firstTime, int not_used_param_2=0, int not_used_param_3=0) {  
+  uint16_t charHeight = 0;
+  uint16_t charWidth  = 0;
+  uint16_t x          = 0;
+  uint16_t y          = 1;
+
+  static uint16_t x_new_estimator = 0;
+  static uint16_t y_new_estimator = 0;
+
+  static uint8_t newEstimator     = 0;
+
+  const uint16_t buttonHeight = 50;
+  const uint16_t buttonWidth  = 140;
+  const uint16_t buttonSpace  = 10;
+
+  myDisplay.setTextSize(2);
+  myDisplay.get_tft()->measureChar('X',&charWidth,&charHeight); 
+
+  if (firstTime) {
+    newEstimator = (myConfig_ptr->estimator < GPF_ESTIMATOR_TYPE_ITEM_COUNT) ? myConfig_ptr->estimator : GPF_ESTIMATOR_TYPE_MADGWICK;
+    myDisplay.clearScreen();
+    menu_display_button_Exit();
+
+    myDisplay.get_tft()->setCursor(0,y);
+
+    myDisplay.print("Estimateur fm-3 *");
+    myDisplay.print(myImu.get_estimator(myConfig_ptr->estimator)->getName());
+    myDisplay.println();
+
+    myDisplay.print("Nouveau = ");
+    x_new_estimator = myDisplay.get_tft()->getCursorX();
+    y_new_estimator = myDisplay.get_tft()->getCursorY();
+    myDisplay.println();
+    
+    x = 5;
+    y = myDisplay.get_tft()->getCursorY();    
+    y = y + buttonSpace;
+
+    for (uint8_t estimatorType = 0; estimatorType < GPF_ESTIMATOR_TYPE_ITEM_COUNT; estimatorType++) {
+      buttons[estimatorType].initButton(myDisplay.get_tft(),x + round(buttonWidth/2),y + round(buttonHeight/2),buttonWidth,buttonHeight,ILI9341_YELLOW, ILI9341_BLACK,ILI9341_YELLOW,myImu.get_estimator(estimatorType)->getName(),2);
+      buttons[estimatorType].drawButton();
+      x = x + buttonWidth + buttonSpace;
+      if (x + buttonWidth >= myDisplay.getDisplayWidth()) {
+        x = 5;
+        y = y + buttonHeight + buttonSpace;
+      }
+    }
+
+    menu_display_button_Save("Save");
+    
+  }
+
+  //Affiche la valeur sélectionnée par l'utilisateur  
+  myDisplay.get_tft()->fillRect(x_new_estimator, y_new_estimator, myDisplay.getDisplayWidth() - x_new_estimator, charHeight, ILI9341_BLACK);
+  myDisplay.get_tft()->setCursor(x_new_estimator,y_new_estimator);  
+  myDisplay.print(myImu.get_estimator(newEstimator)->getName());
+  
+  boolean istouched = myTouch.ts_touched();
+
+  if (istouched) { 
+   TS_Point p = myTouch.ts_getPoint();
+
+   int16_t pixelX = GPF_TOUCH::mapTouchXToPixelX(p.x);
+   int16_t pixelY = GPF_TOUCH::mapTouchYToPixelY(p.y);
+
+   for (uint8_t estimatorType = 0; estimatorType < GPF_ESTIMATOR_TYPE_ITEM_COUNT; estimatorType++) { 
+     if (buttons[estimatorType].contains(pixelX, pixelY)) { //Check si il a cliqué sur un des boutons
+      newEstimator = estimatorType;
+      myTouch.set_waitForUnTouch(true);
+     }
+   }
+
+   if (button_Save.contains(pixelX, pixelY)) { //Check si il a cliqué sur bouton "Save"
+    DEBUG_GPF_PRINT("On sort de la fonction ");
+    DEBUG_GPF_PRINTLN(__func__);
+    DEBUG_GPF_PRINT("newEstimator= ");
+    DEBUG_GPF_PRINT(newEstimator);
+    DEBUG_GPF_PRINTLN();
+
+    //Met à jour la config et save config
+    myConfig_ptr->estimator = newEstimator; 
+    saveConfig();
+
+    menu_current = GPF_MENU_CONFIG_MENU;
+    menu_pleaseRefresh = true;
+    myTouch.set_waitForUnTouch(true);
+   }
+
+   if (button_Exit.contains(pixelX, pixelY)) { //Check si il a cliqué sur bouton "Sortir"
+    DEBUG_GPF_PRINT("On sort de la fonction ");
+    DEBUG_GPF_PRINTLN(__func__);
+
+    menu_current = GPF_MENU_CONFIG_MENU;
+    menu_pleaseRefresh = true;
+    myTouch.set_waitForUnTouch(true);
+   }
+  }
+  
+
 }
 
 void GPF::displayAndProcessMenu() {
@@ -1097,10 +1965,71 @@ void GPF::menu_display_button_Minus_n(uint8_t buttonNumber, uint16_t x, uint16_t
 
 void GPF::saveConfig() {
  EEPROM.put(0, *myConfig_ptr);  
+ refreshPidGains();
+ refreshMixer();
+ refreshFailSafe();
  DEBUG_GPF_PRINT("Save de la config ");
  DEBUG_GPF_PRINTLN(__func__);
 }
 
+// Les gains de pidController sont en float et déjà mis à l'échelle. On les recalcule seulement quand la config change
+// plutôt qu'à chaque tour de la boucle de contrôle.
+void GPF::refreshPidGains() {
+ float gains[GPF_AXE_ITEM_COUNT][GPF_PID_TERM_ITEM_COUNT];
+
+ for (uint8_t axe = 0; axe < GPF_AXE_ITEM_COUNT; axe++) {
+  for (uint8_t pid_term = 0; pid_term < GPF_PID_TERM_ITEM_COUNT; pid_term++) {
+   gains[axe][pid_term] = myConfig_ptr->pids[axe][pid_term] / GPF_PID_STORAGE_MULTIPLIER;
+  }
+ }
+
+ noInterrupts(); //Les 3 axes changent ensemble pour la boucle de contrôle
+ #if defined GPF_CONTROLLER_CASCADE_ENABLED //Seul le yaw de la config est un PID de vitesse
+  pidController.setGains(GPF_AXE_ROLL,  GPF_CONTROLLER_Kp_roll_rate,  GPF_CONTROLLER_Ki_roll_rate,  GPF_CONTROLLER_Kd_roll_rate);
+  pidController.setGains(GPF_AXE_PITCH, GPF_CONTROLLER_Kp_pitch_rate, GPF_CONTROLLER_Ki_pitch_rate, GPF_CONTROLLER_Kd_pitch_rate);
+  pidController.setGains(GPF_AXE_YAW,   gains[GPF_AXE_YAW][GPF_PID_TERM_PROPORTIONAL], gains[GPF_AXE_YAW][GPF_PID_TERM_INTEGRAL], gains[GPF_AXE_YAW][GPF_PID_TERM_DERIVATIVE]);
+ #else
+  for (uint8_t axe = 0; axe < GPF_AXE_ITEM_COUNT; axe++) {
+   pidController.setGains(axe, gains[axe][GPF_PID_TERM_PROPORTIONAL], gains[axe][GPF_PID_TERM_INTEGRAL], gains[axe][GPF_PID_TERM_DERIVATIVE]);
+  }
+ #endif
+ interrupts();
+}
+
+// La matrice du préréglage choisi (ou celle de la config si GPF_MIXER_PRESET_CUSTOM) est convertie en float une seule fois.
+// Seulement GPF_MOTOR_ITEM_COUNT sorties DShot existent: un mixer avec un autre nombre de moteurs (ex: hex ou octo) est
+// refusé, le quad X est utilisé et mixerRefused l'indique dans l'écran des stats.
+void GPF::refreshMixer() {
+ int16_t matrix[GPF_MIXER_MAX_MOTORS][GPF_MIXER_INPUT_ITEM_COUNT];
+ uint8_t motorCount = myConfig_ptr->mixerMotorCount;
+
+ if (!GPF_MIXER::loadPreset(myConfig_ptr->mixerPreset, matrix, &motorCount)) {
+  motorCount = myConfig_ptr->mixerMotorCount;
+  memcpy(matrix, myConfig_ptr->mixerMatrix, sizeof(matrix));
+ }
+
+ mixerRefused = (motorCount != GPF_MOTOR_ITEM_COUNT);
+ if (mixerRefused) {
+  DEBUG_GPF_PRINT("Mixer ");
+  DEBUG_GPF_PRINT(GPF_MIXER::getPresetDescription(myConfig_ptr->mixerPreset));
+  DEBUG_GPF_PRINT(": ");
+  DEBUG_GPF_PRINT(motorCount);
+  DEBUG_GPF_PRINT(" moteurs pour ");
+  DEBUG_GPF_PRINT(GPF_MOTOR_ITEM_COUNT);
+  DEBUG_GPF_PRINTLN(" sorties DShot, quad X utilisé");
+  GPF_MIXER::loadPreset(GPF_MIXER_PRESET_QUAD_X, matrix, &motorCount);
+ }
+
+ noInterrupts(); //Tous les moteurs changent ensemble pour la boucle de contrôle
+ myMixer.loadMatrix(matrix, motorCount);
+ interrupts();
+}
+
+void GPF::refreshFailSafe() {
+ myRc.setFailSafeThresholds(myConfig_ptr->failSafeMissedFrames, myConfig_ptr->failSafeLinkQualityMin, myConfig_ptr->failSafeRssiMin,
+                            myConfig_ptr->failSafeHoldTime, myConfig_ptr->failSafeRecoveryTime);
+}
+
 void GPF::menu_gotoConfigurationPID(bool firstTime, int axe=0, int pid_term=0) {  
   uint16_t charHeight = 0;
   uint16_t charWidth  = 0;
@@ -1372,7 +2301,9 @@ void GPF::menu_gotoCalibrationIMU(bool firstTime, int not_used_param_2=0, int no
     myDisplay.println("cours veuillez");
     myDisplay.println("patienter s.v.p....");
 
+    controlLoopStop(); //La calibration lit le IMU directement, on ne doit pas le partager avec la boucle de contrôle
     myImu.calibrate();
+    controlLoopStart();
 
     myDisplay.get_tft()->fillRect(0, 0, myDisplay.getDisplayWidth(), charHeight * 15, ILI9341_BLACK);    
 
@@ -1499,7 +2430,7 @@ void GPF::menu_gotoTestImu(bool firstTime, int not_used_param_2=0, int not_used_
   uint16_t charHeight = 0;
   uint16_t charWidth  = 0;
   const uint16_t x_pos = 130;
-  static elapsedMillis sincePrint = 251; //pour que le tout s'affiche tout de suite dès le premier appel de la fonction.
+  static elapsedMillis sincePrint = 251; //pour que le tout s'affiche tout de suite dès le premier appel de la fonction. //Rafraîchissement de l'écran, pas de la tâche Menu
   const uint16_t sincePrint_delay = 250;
 
   myDisplay.setTextSize(2);
@@ -1525,6 +2456,7 @@ void GPF::menu_gotoTestImu(bool firstTime, int not_used_param_2=0, int not_used_
 
   if (sincePrint > sincePrint_delay) {
     sincePrint = 0;
+    myImu.updateFusionDegrees();
     //myDisplay.setTextSize(2);
     //myDisplay.get_tft()->measureChar('X',&charWidth,&charHeight); 
 
@@ -1801,7 +2733,7 @@ unsigned long GPF::get_loopCount() {
 
 void GPF::manageAlarms() {
   const uint16_t ALARM_TOGGLE_DURATION = 1000; //ms
-  static elapsedMillis sinceChange = 0;
+  static elapsedMillis sinceChange = 0; //Durée de chaque ton de la sirène. La tâche Alarms, elle, est cadencée par myScheduler
   static bool          sirenAlarmToneToggle  = false;
          bool          somethingToDo         = false;
   //alarmVoltageLow = true; //test
@@ -1832,7 +2764,7 @@ void GPF::manageAlarms() {
   }
 }
 
-void GPF::getDesiredState() {
+void GPF::getDesiredState(float dt) {
   // Cette fonction, légèrement adaptée pour ce projet, provient du projet dRehmFlight VTOL Flight Controller de Nicholas Rehm à https://github.com/nickrehm/dRehmFlight
 
   //DESCRIPTION: Normalizes desired control values to appropriate values
@@ -1844,10 +2776,17 @@ void GPF::getDesiredState() {
    * yaw_passthru variables, to be used in commanding motors/servos with direct unstabilized commands in controlMixer().
    */
 
-  desired_state_throttle = (myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_THROTTLE]) - GPF_RC_CHANNEL_VALUE_MIN)/1000.0; //Between 0 and 1
-  desired_state_roll     = (myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_ROLL])- GPF_RC_CHANNEL_VALUE_MID)/500.0; //Between -1 and 1
-  desired_state_pitch    = (myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_PITCH])- GPF_RC_CHANNEL_VALUE_MID)/500.0; //Between -1 and 1
-  desired_state_yaw      = (myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_YAW])- GPF_RC_CHANNEL_VALUE_MID)/500.0; //Between -1 and 1
+  uint16_t throttlePwm = myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_THROTTLE]);
+  uint16_t rollPwm     = myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_ROLL]);
+  uint16_t pitchPwm    = myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_PITCH]);
+  uint16_t yawPwm      = myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_YAW]);
+  failSafe_overrideSticks(&throttlePwm, &rollPwm, &pitchPwm, &yawPwm); //Avant toute utilisation des manches
+  rc_throttlePwm = throttlePwm;
+
+  desired_state_throttle = (throttlePwm - GPF_RC_CHANNEL_VALUE_MIN)/1000.0; //Between 0 and 1
+  desired_state_roll     = (rollPwm - GPF_RC_CHANNEL_VALUE_MID)/500.0; //Between -1 and 1
+  desired_state_pitch    = (pitchPwm - GPF_RC_CHANNEL_VALUE_MID)/500.0; //Between -1 and 1
+  desired_state_yaw      = (yawPwm - GPF_RC_CHANNEL_VALUE_MID)/500.0; //Between -1 and 1
 
   passthru_roll  = desired_state_roll/2.0;  //Between -0.5 and 0.5
   passthru_pitch = desired_state_pitch/2.0; //Between -0.5 and 0.5
@@ -1855,19 +2794,33 @@ void GPF::getDesiredState() {
   
   //Constrain within normalized bounds
   desired_state_throttle = constrain(desired_state_throttle, 0.0, 1.0); //Between 0 and 1
-  desired_state_roll     = constrain(desired_state_roll, -1.0, 1.0)*GPF_CONTROLLER_MAX_DEGREE_ROLL; //Between -GPF_CONTROLLER_MAX_DEGREE_ROLL and +GPF_CONTROLLER_MAX_DEGREE_ROLL
-  desired_state_pitch    = constrain(desired_state_pitch, -1.0, 1.0)*GPF_CONTROLLER_MAX_DEGREE_PITCH; //Between -GPF_CONTROLLER_MAX_DEGREE_PITCH and +GPF_CONTROLLER_MAX_DEGREE_PITCH
+  if (flight_mode == GPF_FLIGHT_MODE_4_ACRO) { //Consignes de vitesse en deg/sec pour controlRATE()
+   desired_state_roll    = constrain(desired_state_roll, -1.0, 1.0)*GPF_CONTROLLER_ACRO_MAX_RATE_ROLL;
+   desired_state_pitch   = constrain(desired_state_pitch, -1.0, 1.0)*GPF_CONTROLLER_ACRO_MAX_RATE_PITCH;
+  } else {
+   desired_state_roll    = constrain(desired_state_roll, -1.0, 1.0)*GPF_CONTROLLER_MAX_DEGREE_ROLL; //Between -GPF_CONTROLLER_MAX_DEGREE_ROLL and +GPF_CONTROLLER_MAX_DEGREE_ROLL
+   desired_state_pitch   = constrain(desired_state_pitch, -1.0, 1.0)*GPF_CONTROLLER_MAX_DEGREE_PITCH; //Between -GPF_CONTROLLER_MAX_DEGREE_PITCH and +GPF_CONTROLLER_MAX_DEGREE_PITCH
+  }
   desired_state_yaw      = constrain(desired_state_yaw, -1.0, 1.0)*GPF_CONTROLLER_MAX_DEGREE_YAW; //Between -GPF_CONTROLLER_MAX_DEGREE_YAW and +GPF_CONTROLLER_MAX_DEGREE_YAW
 
   passthru_roll  = constrain(passthru_roll, -0.5, 0.5);
   passthru_pitch = constrain(passthru_pitch, -0.5, 0.5);
   passthru_yaw   = constrain(passthru_yaw, -0.5, 0.5);
+
+  #if defined GPF_RC_SMOOTHING_ENABLED //Plus d'escalier entre deux frames du récepteur (Voir gpf_rc_smoothing.cpp)
+   uint32_t frameCount = myRc.get_channelsFrameCount();
+   if (frameCount != rcSmoothing_frameCount) {
+    rcSmoothing_frameCount = frameCount;
+    rcSmoothing.newFrame(myRc.get_channelsFrameIntervalUs()); //Même mesure que le fail safe et l'écran des stats
+   }
+   rcSmoothing.apply(&desired_state_roll, &desired_state_pitch, &desired_state_yaw, &desired_state_throttle, dt);
+  #endif
   
   //DEBUG_GPF_PRINT("myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_THROTTLE]:");    
   //DEBUG_GPF_PRINTLN(myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_THROTTLE]));    
 }
 
-void GPF::controlANGLE() {
+void GPF::controlANGLE(float dt) {
   // Cette fonction, légèrement adaptée pour ce projet, provient du projet dRehmFlight VTOL Flight Controller de Nicholas Rehm à https://github.com/nickrehm/dRehmFlight
 
   //DESCRIPTION: Computes control commands based on state error (angle)
@@ -1881,64 +2834,87 @@ void GPF::controlANGLE() {
    * terms will always start from 0 on takeoff. This function updates the variables roll_PID, pitch_PID, and yaw_PID which
    * can be thought of as 1-D stablized signals. They are mixed to the configuration of the vehicle in controlMixer().
    */
+  // Le calcul des 3 axes est fait par pidController (Voir gpf_pid.cpp). dt vient de l'étage PID (Voir controlLoop_pidStage()).
 
   const uint16_t THROTTLE_MINIMUM = 1060;
 
-  float Kp_roll_angle  = myConfig_ptr->pids[GPF_AXE_ROLL][GPF_PID_TERM_PROPORTIONAL]  / GPF_PID_STORAGE_MULTIPLIER;
-  float Ki_roll_angle  = myConfig_ptr->pids[GPF_AXE_ROLL][GPF_PID_TERM_INTEGRAL]      / GPF_PID_STORAGE_MULTIPLIER;
-  float Kd_roll_angle  = myConfig_ptr->pids[GPF_AXE_ROLL][GPF_PID_TERM_DERIVATIVE]    / GPF_PID_STORAGE_MULTIPLIER;
+  float setpoint[GPF_AXE_ITEM_COUNT]        = {desired_state_roll,       desired_state_pitch,       desired_state_yaw};
+  float measurement[GPF_AXE_ITEM_COUNT]     = {myImu.fusion_degree_roll, myImu.fusion_degree_pitch, myImu.gyrZ_output}; //Yaw, stablize on rate from GyroZ
+  float measurementRate[GPF_AXE_ITEM_COUNT] = {myImu.gyrX_output,        myImu.gyrY_output,         0};                 //Termes D du roll et pitch sur le gyro
+
+  #if defined GPF_CONTROLLER_QUATERNION_ANGLE_ENABLED
+   float error_roll, error_pitch;
+   if (myImu.getTiltErrorDegrees(desired_state_roll, desired_state_pitch, &error_roll, &error_pitch)) { //Sans atan2/asin ni singularité à +/-90 degrés de pitch
+    setpoint[GPF_AXE_ROLL]     = error_roll; //L'erreur est déjà calculée, le terme D du roll et pitch ne dépend pas de la mesure
+    setpoint[GPF_AXE_PITCH]    = error_pitch;
+    measurement[GPF_AXE_ROLL]  = 0;
+    measurement[GPF_AXE_PITCH] = 0;
+   }
+  #endif
 
-  float Kp_pitch_angle = myConfig_ptr->pids[GPF_AXE_PITCH][GPF_PID_TERM_PROPORTIONAL] / GPF_PID_STORAGE_MULTIPLIER;
-  float Ki_pitch_angle = myConfig_ptr->pids[GPF_AXE_PITCH][GPF_PID_TERM_INTEGRAL]     / GPF_PID_STORAGE_MULTIPLIER;
-  float Kd_pitch_angle = myConfig_ptr->pids[GPF_AXE_PITCH][GPF_PID_TERM_DERIVATIVE]   / GPF_PID_STORAGE_MULTIPLIER;
+  bool throttleIsLow = (rc_throttlePwm < THROTTLE_MINIMUM); //Don't let integrator build if throttle is too low //Gaz du fail safe compris
+  pidController.update(setpoint, measurement, measurementRate, dt, throttleIsLow);
 
-  float Kp_yaw         = myConfig_ptr->pids[GPF_AXE_YAW][GPF_PID_TERM_PROPORTIONAL]   / GPF_PID_STORAGE_MULTIPLIER;
-  float Ki_yaw         = myConfig_ptr->pids[GPF_AXE_YAW][GPF_PID_TERM_INTEGRAL]       / GPF_PID_STORAGE_MULTIPLIER;
-  float Kd_yaw         = myConfig_ptr->pids[GPF_AXE_YAW][GPF_PID_TERM_DERIVATIVE]     / GPF_PID_STORAGE_MULTIPLIER;
-  
-  static unsigned long micros_previous = 0;
-  unsigned long current_time = micros();
-  float time_elapsed = (current_time - micros_previous)/1000000.0;
-  micros_previous = micros();
-
-  //Roll
-  error_roll = desired_state_roll - myImu.fusion_degree_roll ; //roll_IMU;
-  integral_roll = integral_roll_prev + error_roll*time_elapsed;
-  if (myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_THROTTLE]) < THROTTLE_MINIMUM) {   //Don't let integrator build if throttle is too low
-    integral_roll = 0;
-  }
-  integral_roll = constrain(integral_roll, -GPF_CONTROLLER_I_LIMIT, GPF_CONTROLLER_I_LIMIT); //Saturate integrator to prevent unsafe buildup
-  derivative_roll = myImu.gyrX_output; //GyroX;
-  roll_PID = 0.01*(Kp_roll_angle*error_roll + Ki_roll_angle*integral_roll - Kd_roll_angle*derivative_roll); //Scaled by .01 to bring within -1 to 1 range
-
-  //Pitch
-  error_pitch = desired_state_pitch - myImu.fusion_degree_pitch;
-  integral_pitch = integral_pitch_prev + error_pitch*time_elapsed;
-  if (myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_THROTTLE]) < THROTTLE_MINIMUM) {   //Don't let integrator build if throttle is too low
-    integral_pitch = 0;
-  }
-  integral_pitch = constrain(integral_pitch, -GPF_CONTROLLER_I_LIMIT, GPF_CONTROLLER_I_LIMIT); //Saturate integrator to prevent unsafe buildup
-  derivative_pitch = myImu.gyrY_output;
-  pitch_PID = .01*(Kp_pitch_angle*error_pitch + Ki_pitch_angle*integral_pitch - Kd_pitch_angle*derivative_pitch); //Scaled by .01 to bring within -1 to 1 range
-
-  //Yaw, stablize on rate from GyroZ
-  error_yaw = desired_state_yaw - myImu.gyrZ_output;
-  integral_yaw = integral_yaw_prev + error_yaw*time_elapsed;
-  if (myRc.getPwmChannelValue(myConfig_ptr->channelMaps[GPF_RC_STICK_THROTTLE]) < THROTTLE_MINIMUM) {   //Don't let integrator build if throttle is too low
-    integral_yaw = 0;
+  roll_PID  = pidController.get_output(GPF_AXE_ROLL);
+  pitch_PID = pidController.get_output(GPF_AXE_PITCH);
+  yaw_PID   = pidController.get_output(GPF_AXE_YAW);
+  addFeedForward();
+}
+
+void GPF::controlANGLE2() {
+  // Boucle d'angle du contrôleur en cascade (GPF_CONTROLLER_CASCADE_ENABLED), inspirée de controlANGLE2() du projet dRehmFlight.
+  // L'erreur d'angle devient une consigne de vitesse (deg/sec) pour controlRATE(). Le gain intégral et le terme D sont dans la
+  // boucle de vitesse: une erreur d'angle constante y est corrigée puisque la consigne de vitesse reste non nulle tant qu'elle dure.
+  // En mode acro, les consignes des manches sont déjà des vitesses (Voir getDesiredState()) et l'attitude n'est pas utilisée.
+
+  if (flight_mode == GPF_FLIGHT_MODE_4_ACRO) {
+   rate_setpoint_roll  = desired_state_roll;
+   rate_setpoint_pitch = desired_state_pitch;
+  } else {
+   float error_roll, error_pitch;
+   bool  tiltErrorIsReady = false;
+   #if defined GPF_CONTROLLER_QUATERNION_ANGLE_ENABLED
+    tiltErrorIsReady = myImu.getTiltErrorDegrees(desired_state_roll, desired_state_pitch, &error_roll, &error_pitch);
+   #endif
+   if (!tiltErrorIsReady) {
+    error_roll  = desired_state_roll  - myImu.fusion_degree_roll;
+    error_pitch = desired_state_pitch - myImu.fusion_degree_pitch;
+   }
+
+   rate_setpoint_roll  = constrain(GPF_CONTROLLER_Kp_roll_angle_ol  * error_roll,  -GPF_CONTROLLER_CASCADE_MAX_RATE, GPF_CONTROLLER_CASCADE_MAX_RATE);
+   rate_setpoint_pitch = constrain(GPF_CONTROLLER_Kp_pitch_angle_ol * error_pitch, -GPF_CONTROLLER_CASCADE_MAX_RATE, GPF_CONTROLLER_CASCADE_MAX_RATE);
   }
-  integral_yaw = constrain(integral_yaw, -GPF_CONTROLLER_I_LIMIT, GPF_CONTROLLER_I_LIMIT); //Saturate integrator to prevent unsafe buildup
-  derivative_yaw = (error_yaw - error_yaw_prev)/time_elapsed; 
-  yaw_PID = .01*(Kp_yaw*error_yaw + Ki_yaw*integral_yaw + Kd_yaw*derivative_yaw); //Scaled by .01 to bring within -1 to 1 range
-
-  //Update roll variables
-  integral_roll_prev = integral_roll;
-  //Update pitch variables
-  integral_pitch_prev = integral_pitch;
-  //Update yaw variables
-  error_yaw_prev = error_yaw;
-  integral_yaw_prev = integral_yaw;
-  
+
+  rate_setpoint_yaw = desired_state_yaw; //Le yaw est déjà une consigne de vitesse
+}
+
+void GPF::controlRATE(float dt) {
+  // Boucle de vitesse du contrôleur en cascade (GPF_CONTROLLER_CASCADE_ENABLED), adaptée de controlRATE() du projet dRehmFlight.
+  // Roule à tous les GPF_CONTROLLER_RATE_LOOP_DIVIDER tours de l'étage gyro sur gyrX_output, gyrY_output et gyrZ_output.
+  // Mêmes protections des termes I que controlANGLE(). Le PID de yaw est celui de la config, les autres sont dans gpf_cons.h.
+
+  const uint16_t THROTTLE_MINIMUM = 1060;
+
+  float setpoint[GPF_AXE_ITEM_COUNT]    = {rate_setpoint_roll, rate_setpoint_pitch, rate_setpoint_yaw};
+  float measurement[GPF_AXE_ITEM_COUNT] = {myImu.gyrX_output,  myImu.gyrY_output,   myImu.gyrZ_output};
+
+  bool throttleIsLow = (rc_throttlePwm < THROTTLE_MINIMUM); //Don't let integrator build if throttle is too low //Gaz du fail safe compris
+  pidController.update(setpoint, measurement, NULL, dt, throttleIsLow); //Termes D par différence du gyro
+
+  roll_PID  = pidController.get_output(GPF_AXE_ROLL);
+  pitch_PID = pidController.get_output(GPF_AXE_PITCH);
+  yaw_PID   = pidController.get_output(GPF_AXE_YAW);
+  addFeedForward();
+}
+
+// Terme feed-forward sur la dérivée des consignes lissées (GPF_RC_SMOOTHING_FEED_FORWARD_ENABLED). Le mouvement des manches
+// arrive aux moteurs sans attendre que l'erreur se forme. Appelée après pidController, aussi en cascade.
+void GPF::addFeedForward() {
+ #if defined GPF_RC_SMOOTHING_FEED_FORWARD_ENABLED
+  roll_PID  += GPF_PID_OUTPUT_SCALE * GPF_CONTROLLER_FEED_FORWARD_GAIN_ROLL  * rcSmoothing.get_derivative(GPF_RC_SMOOTHING_ROLL);
+  pitch_PID += GPF_PID_OUTPUT_SCALE * GPF_CONTROLLER_FEED_FORWARD_GAIN_PITCH * rcSmoothing.get_derivative(GPF_RC_SMOOTHING_PITCH);
+  yaw_PID   += GPF_PID_OUTPUT_SCALE * GPF_CONTROLLER_FEED_FORWARD_GAIN_YAW   * rcSmoothing.get_derivative(GPF_RC_SMOOTHING_YAW);
+ #endif
 }
 
 void GPF::controlMixer() {
@@ -1960,16 +2936,16 @@ void GPF::controlMixer() {
    *channel_6_pwm - free auxillary channel, can be used to toggle things with an 'if' statement
    */
    
+  float motorCommands[GPF_MIXER_MAX_MOTORS];
+
   if (flight_mode == GPF_FLIGHT_MODE_1_EQUAL_THROTTLE_FOR_TESTS_ONLY) {
-   motor_command_scaled[GPF_MOTOR_FRONT_LEFT]  = desired_state_throttle; //Front Left  //m4 //dRehmFlight m1
-   motor_command_scaled[GPF_MOTOR_FRONT_RIGHT] = desired_state_throttle; //Front Right //m2 //dRehmFlight m2
-   motor_command_scaled[GPF_MOTOR_BACK_RIGHT]  = desired_state_throttle; //Back Right  //m1 //dRehmFlight m3
-   motor_command_scaled[GPF_MOTOR_BACK_LEFT]   = desired_state_throttle; //Back Left   //m3 //dRehmFlight m4
+   myMixer.mix(desired_state_throttle, 0, 0, 0, motorCommands);
   } else {
-   motor_command_scaled[GPF_MOTOR_FRONT_LEFT]  = desired_state_throttle - pitch_PID + roll_PID + yaw_PID; //Front Left  //m4 //dRehmFlight m1
-   motor_command_scaled[GPF_MOTOR_FRONT_RIGHT] = desired_state_throttle - pitch_PID - roll_PID - yaw_PID; //Front Right //m2 //dRehmFlight m2
-   motor_command_scaled[GPF_MOTOR_BACK_RIGHT]  = desired_state_throttle + pitch_PID - roll_PID + yaw_PID; //Back Right  //m1 //dRehmFlight m3
-   motor_command_scaled[GPF_MOTOR_BACK_LEFT]   = desired_state_throttle + pitch_PID + roll_PID - yaw_PID; //Back Left   //m3 //dRehmFlight m4
+   myMixer.mix(desired_state_throttle, roll_PID, pitch_PID, yaw_PID, motorCommands); //Voir gpf_mixer.cpp pour la matrice et la saturation
+  }
+
+  for (uint8_t motor = 0; motor < GPF_MOTOR_ITEM_COUNT; motor++) { //refreshMixer() garantit myMixer.get_motorCount() == GPF_MOTOR_ITEM_COUNT
+   motor_command_scaled[motor] = motorCommands[motor];
   }
   
 }
@@ -1980,16 +2956,11 @@ void GPF::scaleCommands() {
   //Dshot commands: 48 = Throttle 0% à 2047 = Throttle 100%
   
   //Scaled to 48 to 2000 for dshot protocol
-  motor_command_DSHOT[GPF_MOTOR_FRONT_LEFT]  = motor_command_scaled[GPF_MOTOR_FRONT_LEFT]  * GPF_DSHOT_RESOLUTION + GPF_DSHOT_THROTTLE_MINIMUM; 
-  motor_command_DSHOT[GPF_MOTOR_FRONT_RIGHT] = motor_command_scaled[GPF_MOTOR_FRONT_RIGHT] * GPF_DSHOT_RESOLUTION + GPF_DSHOT_THROTTLE_MINIMUM; 
-  motor_command_DSHOT[GPF_MOTOR_BACK_RIGHT]  = motor_command_scaled[GPF_MOTOR_BACK_RIGHT]  * GPF_DSHOT_RESOLUTION + GPF_DSHOT_THROTTLE_MINIMUM; 
-  motor_command_DSHOT[GPF_MOTOR_BACK_LEFT]   = motor_command_scaled[GPF_MOTOR_BACK_LEFT]   * GPF_DSHOT_RESOLUTION + GPF_DSHOT_THROTTLE_MINIMUM; 
-  
   //Constrain commands to motors within dshot bounds
-  motor_command_DSHOT[GPF_MOTOR_FRONT_LEFT]  = constrain(motor_command_DSHOT[GPF_MOTOR_FRONT_LEFT],  GPF_DSHOT_THROTTLE_MINIMUM, GPF_DSHOT_THROTTLE_MAXIMUM); 
-  motor_command_DSHOT[GPF_MOTOR_FRONT_RIGHT] = constrain(motor_command_DSHOT[GPF_MOTOR_FRONT_RIGHT], GPF_DSHOT_THROTTLE_MINIMUM, GPF_DSHOT_THROTTLE_MAXIMUM); 
-  motor_command_DSHOT[GPF_MOTOR_BACK_RIGHT]  = constrain(motor_command_DSHOT[GPF_MOTOR_BACK_RIGHT],  GPF_DSHOT_THROTTLE_MINIMUM, GPF_DSHOT_THROTTLE_MAXIMUM); 
-  motor_command_DSHOT[GPF_MOTOR_BACK_LEFT]   = constrain(motor_command_DSHOT[GPF_MOTOR_BACK_LEFT],   GPF_DSHOT_THROTTLE_MINIMUM, GPF_DSHOT_THROTTLE_MAXIMUM); 
+  for (uint8_t motor = 0; motor < GPF_MOTOR_ITEM_COUNT; motor++) {
+   motor_command_DSHOT[motor] = motor_command_scaled[motor] * GPF_DSHOT_RESOLUTION + GPF_DSHOT_THROTTLE_MINIMUM;
+   motor_command_DSHOT[motor] = constrain(motor_command_DSHOT[motor], GPF_DSHOT_THROTTLE_MINIMUM, GPF_DSHOT_THROTTLE_MAXIMUM);
+  }
 
 }
 
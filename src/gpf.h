@@ -18,6 +18,12 @@
 #include "gpf_sdcard.h"
 #include "gpf_dshot.h"
 #include "gpf_music_player.h"
+#include "gpf_profiler.h"
+#include "gpf_histogram.h"
+#include "gpf_scheduler.h"
+#include "gpf_pid.h"
+#include "gpf_rc_smoothing.h"
+#include "gpf_mixer.h"
 
 class GPF {
     typedef void (GPF::*method_function)(bool, int, int);
@@ -33,19 +39,48 @@ class GPF {
     public:
         GPF();
         void initialize(gpf_config_struct *);
-        void iAmStartingLoopNow(bool);
+        void controlLoopStart();
+        void controlLoopStop();
+        void controlLoop();
+        void controlLoop_pidStage();
+        void controlLoop_rateStage(unsigned long tickAt);
+        void controlLoop_outputStage();
+        static void controlLoopISR();
+        void manageLoadGovernor();
+        void logFailSafeStage();
+        uint8_t get_governor_level();
+        void debugDisplayProfilerStats();
+        void debugDisplayLoopHistograms();
+        void debugBenchmarkFastMath();
+        void debugDisplayEstimatorStats();
+        void info_log_writeLoopHistograms();
+        void info_log_queueLine(const char *line);
+        void info_log_writeQueuedLines();
+        void debugProcessUsbRequest();
+        float get_harmonicNotchThrottle();
+        void iAmStartingLoopNow();
+        void iAmEndingLoopNow();
         void resetLoopStats();
         void waitUntilNextLoop();
         void toggMainBoardLed();
         void genDummyTelemetryData();
         unsigned long get_loopCount();
         void manageAlarms();
-        void getDesiredState();   
-        void controlANGLE();
+        void getDesiredState(float dt);   
+        void controlANGLE(float dt);
+        void controlANGLE2();
+        void controlRATE(float dt);
+        void refreshPidGains();
+        void refreshMixer();
+        void refreshFailSafe();
+        void addFeedForward();
         
         void controlMixer();
         void scaleCommands();
+        void manageFailSafe();
+        void failSafe_overrideSticks(uint16_t *throttle, uint16_t *roll, uint16_t *pitch, uint16_t *yaw);
         
+        void refreshRcSnapshot();
         bool get_IsStickInPosition(uint8_t stick, gpf_rc_channel_position_type_enum channel_position_required);
         void update_arm_allowArming();
         bool get_arm_IsArmed();
@@ -75,6 +110,7 @@ class GPF {
         void menu_gotoConfigurationChannels(bool, int, int);
         void menu_gotoConfigurationPID(bool, int, int);
         void menu_gotoCalibrationIMU(bool, int, int);
+        void menu_gotoConfigurationEstimator(bool, int, int);
         void menu_gotoDisplayAllPIDs(bool, int, int);
         void menu_gotoTestMotors(bool, int, int);
         
@@ -86,6 +122,13 @@ class GPF {
         GPF_SDCARD   mySdCard;
         GPF_DSHOT    myDshot;
         GPF_MUSIC_PLAYER    myMusicPlayer;
+        GPF_SCHEDULER       myScheduler; //Tâches d'arrière plan de loop()
+
+        int8_t task_blackBox   = GPF_SCHEDULER_NO_TASK;
+        int8_t task_menu       = GPF_SCHEDULER_NO_TASK;
+        int8_t task_alarms     = GPF_SCHEDULER_NO_TASK;
+        int8_t task_music      = GPF_SCHEDULER_NO_TASK;
+        int8_t task_debugStats = GPF_SCHEDULER_NO_TASK;
 
         gpf_telemetry_info_s gpf_telemetry_info;
         int16_t  menu_current  = GPF_MENU_MAIN_MENU; //GPF_MENU_TEST_MOTORS; //GPF_MENU_TEST_MOTORS; //GPF_MENU_MAIN_MENU;
@@ -108,35 +151,85 @@ class GPF {
 
         //Normalized desired state:
         float desired_state_throttle, desired_state_roll, desired_state_pitch, desired_state_yaw;
+        uint16_t rc_throttlePwm = 0; //us //Gaz lus par getDesiredState(), fail safe compris
         float passthru_roll, passthru_pitch, passthru_yaw;
 
         //Controller:
-        float error_roll, error_roll_prev, roll_des_prev, integral_roll, integral_roll_il, integral_roll_ol, integral_roll_prev, integral_roll_prev_il, integral_roll_prev_ol, derivative_roll, roll_PID = 0;
-        float error_pitch, error_pitch_prev, pitch_des_prev, integral_pitch, integral_pitch_il, integral_pitch_ol, integral_pitch_prev, integral_pitch_prev_il, integral_pitch_prev_ol, derivative_pitch, pitch_PID = 0;
-        float error_yaw, error_yaw_prev, integral_yaw, integral_yaw_prev, derivative_yaw, yaw_PID = 0;
+        GPF_PID pidController;                  //controlANGLE() ou controlRATE() si cascade //Gains mis à jour par refreshPidGains()
+        float   roll_PID, pitch_PID, yaw_PID = 0; //Sorties de pidController pour controlMixer()
+
+        GPF_RC_SMOOTHING rcSmoothing;                //Consignes des manches entre deux frames (GPF_RC_SMOOTHING_ENABLED)
+        uint32_t         rcSmoothing_frameCount = 0; //Dernier GPF_CRSF::get_channelsFrameCount() vu par getDesiredState()
+        float rate_setpoint_roll, rate_setpoint_pitch, rate_setpoint_yaw = 0; //deg/sec //Consignes de la boucle de vitesse (GPF_CONTROLLER_CASCADE_ENABLED)
 
         //Mixer
+        GPF_MIXER myMixer;                       //Matrice de la config //Mise à jour par refreshMixer()
+        bool      mixerRefused = false;          //Préréglage de la config sans GPF_MOTOR_ITEM_COUNT moteurs, quad X utilisé (Voir refreshMixer())
         float motor_command_scaled[GPF_MOTOR_ITEM_COUNT];
         int motor_command_DSHOT[GPF_MOTOR_ITEM_COUNT];
-        uint8_t flight_mode = GPF_FLIGHT_MODE_3_FUSION_TYPE_MADGWICK; 
+        volatile uint8_t flight_mode = GPF_FLIGHT_MODE_3_FUSION_TYPE_MADGWICK; //Écrit par loop(), lu par la boucle de contrôle
 
     private:
-        elapsedMillis debug_sincePrint;        
-        
-        unsigned long loopCount             = 0;
-        unsigned long loopStartedAt         = 0; //us
-        unsigned long firstLoopStartedAt    = 0; //us
-                 long loopFreeTime          = 0; //us
-                 long loopBusyTime          = 0; //us
-                 long loopBusyTimeMin       = 999999; //us
-                 long loopBusyTimeMax       = 0; //us 
-        unsigned long loopTimeOverFlowCount = 0; 
-
-        float         loopFreeTimePercent = 0.0; 
-        float         loopBusyTimePercent = 0.0; 
+        // Boucle de contrôle cadencée par un timer matériel (PIT) plutôt que par une attente active dans loop().
+        // Les statistiques sont mises à jour dans l'interruption d'où les volatile.
+        IntervalTimer controlLoopTimer;
+        static GPF   *controlLoopInstance;
+        volatile bool controlLoopIsRunning  = false;
+
+        volatile unsigned long loopCount             = 0;
+        volatile unsigned long loopStartedAt         = 0; //us
+        volatile unsigned long firstLoopStartedAt    = 0; //us
+        volatile          long loopFreeTime          = 0; //us
+        volatile          long loopBusyTime          = 0; //us
+        volatile          long loopBusyTimeMin       = 999999; //us
+        volatile          long loopBusyTimeMax       = 0; //us 
+        volatile unsigned long loopTimeOverFlowCount = 0; 
+
+        // Boucle de contrôle multi-vitesse (Voir GPF_GYRO_LOOP_RATE et GPF_PID_LOOP_DIVIDER)
+        volatile uint8_t       pidStage_tickCount       = 0;
+        volatile uint8_t       rateStage_tickCount      = 0; //GPF_CONTROLLER_CASCADE_ENABLED
+        volatile unsigned long rateStage_previousTickAt = 0; //us //dt de controlRATE()
+        volatile bool          pidStage_imuSampleReady  = false; //Au moins un nouvel échantillon du IMU depuis la dernière fusion
+        volatile          long gyroStageTime            = 0; //us //Lecture et filtrage du IMU
+        volatile          long gyroStageTimeMax         = 0; //us
+        volatile          long gyroStageTimeAccumulated = 0; //us //Depuis le dernier tour de l'étage PID
+        volatile          long pidStageTime             = 0; //us //Fusion, PIDs, mixer et moteurs
+        volatile          long pidStageTimeMax          = 0; //us
+
+        // Distribution des temps de la boucle de contrôle (us). Mises à jour dans l'interruption, lire avec noInterrupts().
+        GPF_HISTOGRAM          loopJitterHistogram;   //Écart entre la période mesurée de l'étage gyro et GPF_GYRO_LOOP_RATE
+        GPF_HISTOGRAM          loopBusyHistogram;     //loopBusyTime de chaque tour de l'étage PID
+        GPF_HISTOGRAM          loopFreeHistogram;     //loopFreeTime de chaque tour de l'étage PID (0 si dépassement)
+        unsigned long          loopJitter_previousTickAt = 0; //us
+
+        // Gouverneur de charge
+        volatile float         loopBusyTimePercentAverage = 0.0; //Moyenne mobile mise à jour par la boucle de contrôle
+        float                  governor_loopPassAverage   = 0.0; //us //Moyenne mobile de la durée d'un tour de loop()
+        unsigned long          governor_loopPassStartedAt = 0;   //us
+        uint8_t                governor_level             = GPF_GOVERNOR_LEVEL_NORMAL;
+        elapsedMillis          governor_sinceChange;
+        unsigned long          governor_eventCount        = 0;
+        void                   governor_applyLevel(uint8_t level);
+        void                   governor_logEvent(bool isShed, uint8_t level, float busyAverage, float loopPassAverage);
+
+        // Lignes du log d'information écrites plus tard par la tâche BlackBox plutôt que d'ouvrir le fichier sur la carte SD
+        // au milieu d'un tour de loop() (Voir info_log_queueLine())
+        char                   info_log_queue[GPF_INFO_LOG_QUEUE_SIZE][GPF_INFO_LOG_LINE_MAX_LENGTH];
+        uint8_t                info_log_queueFirst        = 0;
+        uint8_t                info_log_queueCount        = 0;
+        unsigned long          info_log_droppedLineCount  = 0; //Queue pleine
+
+        volatile float         loopFreeTimePercent = 0.0; 
+        volatile float         loopBusyTimePercent = 0.0; 
+
+        //Fail Safe (géré dans la boucle de contrôle)
+        uint8_t       failSafe_stage_previous               = GPF_FAILSAFE_STAGE_OK; //gpf_failsafe_stage_enum
+        uint32_t      failSafe_transitionCount              = 0;                     //Dernier myRc.failSafe.get_transitionCount() écrit par logFailSafeStage()
+        int           failSafe_pwmThrottleValue             = 0;                     //us //Gaz à l'entrée en LANDING
 
         gpf_config_struct *myConfig_ptr = NULL;
-        bool          arm_isArmed = false;
+        volatile bool arm_isArmed = false; //Écrit par loop(), lu par la boucle de contrôle
+        uint16_t      rc_snapshot[GPF_RC_NUMBER_CHANNELS + 1] = {0}; //Canaux vus par loop() pendant un tour (Voir refreshRcSnapshot())
         elapsedMillis arm_isArmed_sinceChange;
         bool          wasArmedAtLeastOnce = false;
         bool          arm_allowArming     = false;
@@ -180,7 +273,8 @@ class GPF {
                           { GPF_MENU_CONFIG_PID_AXE_YAW_TERM_DERIVATIVE, GPF_MENU_CONFIG_PID_AXE_YAW_MENU, "Yaw D Gain",&GPF::menu_gotoConfigurationPID},   
                        { GPF_MENU_CONFIG_PID_DISPLAY_ALL_PIDS, GPF_MENU_CONFIG_PID_MENU, "Voir All PIDs",&GPF::menu_gotoDisplayAllPIDs},   
                     { GPF_MENU_CONFIG_CALIBRATION_MENU, GPF_MENU_CONFIG_MENU, "Calibration",NULL},
-                       { GPF_MENU_CONFIG_CALIBRATION_IMU, GPF_MENU_CONFIG_CALIBRATION_MENU, "IMU Calibration",&GPF::menu_gotoCalibrationIMU}                             
+                       { GPF_MENU_CONFIG_CALIBRATION_IMU, GPF_MENU_CONFIG_CALIBRATION_MENU, "IMU Calibration",&GPF::menu_gotoCalibrationIMU},
+                    { GPF_MENU_CONFIG_ESTIMATOR, GPF_MENU_CONFIG_MENU, "Estimateur",&GPF::menu_gotoConfigurationEstimator}                             
            };
 
          void saveConfig();  
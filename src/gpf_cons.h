@@ -12,9 +12,10 @@
 #define GPF_FLIGHT_MODE_1_EQUAL_THROTTLE_FOR_TESTS_ONLY    1
 #define GPF_FLIGHT_MODE_2_FUSION_TYPE_COMPLEMENTARY_FILTER 2
 #define GPF_FLIGHT_MODE_3_FUSION_TYPE_MADGWICK             3
+#define GPF_FLIGHT_MODE_4_ACRO                             4 //Vitesse seulement (Voir GPF_CONTROLLER_ACRO_ON_LOW_POSITION)
 
 #define GPF_MISC_PROG_CURRENT_VERSION      101
-#define GPF_MISC_CONFIG_CURRENT_VERSION    15
+#define GPF_MISC_CONFIG_CURRENT_VERSION    18
 #define GPF_MISC_NUMBER_OF_BUTTONS_TYPE_NUMERO  20
 #define GPF_MISC_NUMBER_OF_BUTTONS_TYPE_PLUS    4
 #define GPF_MISC_NUMBER_OF_BUTTONS_TYPE_MINUS   4
@@ -76,11 +77,49 @@ typedef enum { // *** Ne pas changer l'ordre car sert aussi pour enregistrer con
     GPF_RC_STICK_ITEM_COUNT // MUST BE LAST
 } gpf_rc_stick_type_enum;
 
+typedef enum { // *** Ne pas changer l'ordre car sert aussi pour enregistrer config dans eeprom ***
+    GPF_ESTIMATOR_TYPE_MADGWICK,
+    GPF_ESTIMATOR_TYPE_MAHONY,
+    GPF_ESTIMATOR_TYPE_EKF,
+
+    GPF_ESTIMATOR_TYPE_ITEM_COUNT // MUST BE LAST
+} gpf_estimator_type_enum;
+
+typedef enum { // *** Ne pas changer l'ordre car sert aussi pour enregistrer config dans eeprom ***
+    GPF_MIXER_INPUT_THROTTLE,
+    GPF_MIXER_INPUT_ROLL,
+    GPF_MIXER_INPUT_PITCH,
+    GPF_MIXER_INPUT_YAW,
+
+    GPF_MIXER_INPUT_ITEM_COUNT // MUST BE LAST
+} gpf_mixer_input_enum;
+
+typedef enum { // *** Ne pas changer l'ordre car sert aussi pour enregistrer config dans eeprom ***
+    GPF_MIXER_PRESET_QUAD_X,
+    GPF_MIXER_PRESET_HEX_X,
+    GPF_MIXER_PRESET_OCTO_X,
+    GPF_MIXER_PRESET_CUSTOM, //Matrice de la config modifiée à la main
+
+    GPF_MIXER_PRESET_ITEM_COUNT // MUST BE LAST
+} gpf_mixer_preset_enum;
+
+#define GPF_MIXER_MAX_MOTORS          8       //Lignes de la matrice du mixer (Voir gpf_mixer.cpp)
+#define GPF_MIXER_STORAGE_MULTIPLIER  1000.0  //Coefficients du mixer enregistrés en int16_t * 1000
+
 struct gpf_config_struct {
          uint16_t  version;
          uint8_t   channelMaps[GPF_RC_STICK_ITEM_COUNT];
          uint32_t  pids[GPF_AXE_ITEM_COUNT][GPF_PID_TERM_ITEM_COUNT];
          int16_t   imuOffsets[GPF_IMU_SENSOR_ITEM_COUNT][GPF_AXE_ITEM_COUNT];
+         uint8_t   estimator; //gpf_estimator_type_enum //Estimateur d'attitude du mode de vol fm-3
+         uint8_t   mixerPreset; //gpf_mixer_preset_enum
+         uint8_t   mixerMotorCount;
+         int16_t   mixerMatrix[GPF_MIXER_MAX_MOTORS][GPF_MIXER_INPUT_ITEM_COUNT]; //Coefficients * GPF_MIXER_STORAGE_MULTIPLIER, une ligne par moteur //Utilisée seulement si mixerPreset == GPF_MIXER_PRESET_CUSTOM (Voir GPF::refreshMixer())
+         uint8_t   failSafeMissedFrames;   //Frames de canaux manqués avant HOLD (Voir gpf_failsafe.cpp)
+         uint8_t   failSafeLinkQualityMin; //% //LQ moyen sous lequel le lien est faible //0 = pas de seuil
+         uint8_t   failSafeRssiMin;        //-dBm //RSSI moyen sous lequel le lien est faible (ex: 105 pour -105dBm) //0 = pas de seuil
+         uint16_t  failSafeHoldTime;       //ms //Durée du HOLD avant LANDING
+         uint16_t  failSafeRecoveryTime;   //ms //Frames reçus sans trou avant de sortir de LANDING
 };
         
 typedef enum {
@@ -117,6 +156,7 @@ typedef enum {
              GPF_MENU_CONFIG_PID_DISPLAY_ALL_PIDS,   
           GPF_MENU_CONFIG_CALIBRATION_MENU, 
              GPF_MENU_CONFIG_CALIBRATION_IMU, 
+          GPF_MENU_CONFIG_ESTIMATOR,
            
        
     GPF_MENU_ITEM_COUNT // MUST BE LAST
@@ -145,16 +185,71 @@ typedef enum {
 #define GPF_RC_CHANNEL_VALUE_MAX 2000.0 //us
 
 #define GPF_RC_CHANNEL_VALUE_FAILSAFE 1500.0 //us
+
+//Décommentez pour que la boucle de contrôle (étage gyro, à tous les GPF_GYRO_LOOP_RATE) vide le buffer de réception du récepteur
+//plutôt que loop(). Un frame est alors décodé au plus 500us après son dernier octet au lieu d'attendre un tour de loop().
+//#define GPF_CRSF_RX_IN_CONTROL_LOOP_ENABLED
+
+//Décommentez pour lisser les consignes roll, pitch, yaw et gaz entre deux frames du récepteur (Voir gpf_rc_smoothing.cpp).
+//La coupure suit la fréquence mesurée des frames.
+//#define GPF_RC_SMOOTHING_ENABLED
+#define GPF_RC_SMOOTHING_FILTER_TYPE          GPF_FILTER_TYPE_PT2 //Voir gpf_filter.h
+
+//Décommentez pour ajouter à la sortie des PIDs un terme feed-forward sur la dérivée des consignes lissées (moins de retard
+//sur les manches). Demande GPF_RC_SMOOTHING_ENABLED.
+//#define GPF_RC_SMOOTHING_FEED_FORWARD_ENABLED
+#define GPF_CONTROLLER_FEED_FORWARD_GAIN_ROLL   0.005 //Même échelle que les gains des PIDs (sortie * 0.01)
+#define GPF_CONTROLLER_FEED_FORWARD_GAIN_PITCH  0.005
+#define GPF_CONTROLLER_FEED_FORWARD_GAIN_YAW    0.0
+
+#if defined GPF_RC_SMOOTHING_FEED_FORWARD_ENABLED && !defined GPF_RC_SMOOTHING_ENABLED
+  #error "GPF_RC_SMOOTHING_FEED_FORWARD_ENABLED demande GPF_RC_SMOOTHING_ENABLED"
+#endif
 #define GPF_FAILSAFE_MOTORS_DECELERATION_DURATION 5000000 //us
 
 
 //Controller parameters (take note of defaults before modifying!): 
 #define GPF_CONTROLLER_I_LIMIT           25.0     //Integrator saturation level, mostly for safety (default 25.0)
+#define GPF_CONTROLLER_OUTPUT_LIMIT      1.0      //Sortie d'un PID (-1 à 1) au delà de laquelle le terme I n'est plus accumulé (anti-windup, Voir GPF_PID)
 
 #define GPF_CONTROLLER_MAX_DEGREE_ROLL   30.0     //Max roll  angle in degrees for angle mode (maximum ~70 degrees), deg/sec for rate mode 
 #define GPF_CONTROLLER_MAX_DEGREE_PITCH  30.0     //Max pitch angle in degrees for angle mode (maximum ~70 degrees), deg/sec for rate mode
 #define GPF_CONTROLLER_MAX_DEGREE_YAW   160.0     //Max yaw rate in deg/sec
 
+//Décommentez pour que le mode angle calcule l'erreur de roll et pitch directement sur le quaternion de l'estimateur (fm-3).
+//Les angles d'Euler ne sont alors calculés que pour la black box et l'écran. fm-2 (Complementary filter) reste sur les angles.
+//#define GPF_CONTROLLER_QUATERNION_ANGLE_ENABLED
+
+//Décommentez pour un contrôleur en cascade. La boucle d'angle (étage PID, après la fusion) donne une consigne de vitesse en deg/sec
+//à une boucle de vitesse sur le gyro filtré qui roule dans l'étage gyro à tous les GPF_CONTROLLER_RATE_LOOP_DIVIDER tours.
+//Le mixer et l'envoi aux moteurs suivent alors la boucle de vitesse. Le PID de yaw (config) passe aussi dans la boucle de vitesse.
+//#define GPF_CONTROLLER_CASCADE_ENABLED
+#define GPF_CONTROLLER_RATE_LOOP_DIVIDER     1      //Nombre entier entre 1 et GPF_PID_LOOP_DIVIDER. Étage gyro / 1 = boucle de vitesse à chaque tour de l'étage gyro
+#define GPF_CONTROLLER_CASCADE_MAX_RATE      240.0  //deg/sec //Consigne maximale donnée par la boucle d'angle
+
+#define GPF_CONTROLLER_Kp_roll_angle_ol      5.0    //Roll P-gain - boucle d'angle (deg/sec de consigne par degré d'erreur)
+#define GPF_CONTROLLER_Kp_pitch_angle_ol     5.0    //Pitch P-gain - boucle d'angle
+
+#define GPF_CONTROLLER_Kp_roll_rate          0.15   //Roll P-gain - boucle de vitesse
+#define GPF_CONTROLLER_Ki_roll_rate          0.2    //Roll I-gain - boucle de vitesse
+#define GPF_CONTROLLER_Kd_roll_rate          0.0002 //Roll D-gain - boucle de vitesse (be careful when increasing too high, motors will begin to overheat!)
+#define GPF_CONTROLLER_Kp_pitch_rate         0.15   //Pitch P-gain - boucle de vitesse
+#define GPF_CONTROLLER_Ki_pitch_rate         0.2    //Pitch I-gain - boucle de vitesse
+#define GPF_CONTROLLER_Kd_pitch_rate         0.0002 //Pitch D-gain - boucle de vitesse
+
+//Décommentez pour que la position basse de la switch mode de vol soit le mode acro (vitesse seulement) plutôt que le mode test.
+//Demande GPF_CONTROLLER_CASCADE_ENABLED.
+//#define GPF_CONTROLLER_ACRO_ON_LOW_POSITION
+#define GPF_CONTROLLER_ACRO_MAX_RATE_ROLL    360.0  //deg/sec
+#define GPF_CONTROLLER_ACRO_MAX_RATE_PITCH   360.0  //deg/sec
+
+#if defined GPF_CONTROLLER_ACRO_ON_LOW_POSITION && !defined GPF_CONTROLLER_CASCADE_ENABLED
+  #error "GPF_CONTROLLER_ACRO_ON_LOW_POSITION demande GPF_CONTROLLER_CASCADE_ENABLED"
+#endif
+
+#define GPF_CONTROLLER_FILTER_DTERM_TYPE    GPF_FILTER_TYPE_PT1 //Filtre des termes D (Voir gpf_filter.h)
+#define GPF_CONTROLLER_FILTER_DTERM_CUTOFF  70.0                //hz
+
 /*
 #define GPF_CONTROLLER_Kp_roll_angle   0.2    //Roll P-gain - angle mode 
 #define GPF_CONTROLLER_Ki_roll_angle   0.3    //Roll I-gain - angle mode
@@ -183,8 +278,63 @@ typedef enum {
 
 } gpf_rc_channel_position_type_enum;
 
-#define GPF_MAIN_LOOP_RATE             2000 //500 //1000 //500 //us (250=4000hz, 500=2000hz, 1000=1000hz, 2000=500hz, ...) //Maximum atteignable d'environ 6000hz avec un Teensy 4.1
+// La boucle de contrôle roule à deux vitesses. À chaque GPF_GYRO_LOOP_RATE us on lit et filtre le IMU (étage gyro).
+// À tous les GPF_PID_LOOP_DIVIDER tours de l'étage gyro, on fait aussi la fusion, les PIDs, le mixer et on envoie les commandes aux moteurs (étage PID).
+// En I2C, la lecture bloquante du IMU prend environ 400us: l'étage gyro reste à 2000us (500hz) sinon loop() n'a presque plus de temps.
+// Avec GPF_IMU_BMI088_TRANSPORT_SPI ou GPF_IMU_FIFO_ENABLED (Voir gpf_imu.h), on peut utiliser 500us et GPF_PID_LOOP_DIVIDER à 4 (2000hz / 4 = 500hz).
+#define GPF_GYRO_LOOP_RATE             2000 //500 //250 //us (250=4000hz, 500=2000hz, 2000=500hz) //Idéalement égal à 1/ODR du gyro (GPF_IMU_GYRO_ODR)
+#define GPF_PID_LOOP_DIVIDER           1    //4 //Nombre entier. 500hz / 1 = 500hz pour l'étage PID
+#define GPF_MAIN_LOOP_RATE             (GPF_GYRO_LOOP_RATE * GPF_PID_LOOP_DIVIDER) //us //Période de l'étage PID (2000=500hz, ...) //Maximum atteignable d'environ 6000hz avec un Teensy 4.1
+#if defined GPF_CONTROLLER_CASCADE_ENABLED
+  #define GPF_OUTPUT_LOOP_RATE         (GPF_GYRO_LOOP_RATE * GPF_CONTROLLER_RATE_LOOP_DIVIDER) //us //Période du mixer et de l'envoi aux moteurs (boucle de vitesse)
+  #if (GPF_CONTROLLER_RATE_LOOP_DIVIDER < 1) || (GPF_CONTROLLER_RATE_LOOP_DIVIDER > GPF_PID_LOOP_DIVIDER)
+    #error "GPF_CONTROLLER_RATE_LOOP_DIVIDER doit être entre 1 et GPF_PID_LOOP_DIVIDER"
+  #endif
+#else
+  #define GPF_OUTPUT_LOOP_RATE         GPF_MAIN_LOOP_RATE //us //Période du mixer et de l'envoi aux moteurs (étage PID)
+#endif
+#define GPF_MAIN_LOOP_TIMER_PRIORITY   128  //Priorité NVIC du timer de la boucle de contrôle (0=plus haute). Doit rester moins prioritaire que Serial7 (CRSF, priorité 64) pour ne pas perdre d'octets.
 #define GPF_MAIN_LED_TOGGLE_DURATION   500 //ms
+// Tâches d'arrière plan de loop() (Voir GPF_SCHEDULER). Périodes et budgets en us. Priorité 0 = plus prioritaire.
+#define GPF_SCHEDULER_SLOT_DURATION    GPF_MAIN_LOOP_RATE //us //Temps alloué aux tâches à chaque tour de loop()
+#define GPF_INFO_LOG_QUEUE_SIZE        8       //Lignes du log d'information en attente d'écriture par la tâche BlackBox
+#define GPF_INFO_LOG_LINE_MAX_LENGTH   192     //Caractères par ligne, date comprise
+#define GPF_TASK_BLACK_BOX_PERIOD      0       //À chaque tour de loop() lorsqu'armé
+#define GPF_TASK_BLACK_BOX_PRIORITY    0
+#define GPF_TASK_BLACK_BOX_BUDGET      500
+#define GPF_TASK_MENU_PERIOD           10000   //100hz suffit pour l'écran tactile
+#define GPF_TASK_MENU_PRIORITY         1
+#define GPF_TASK_MENU_BUDGET           5000    //Dessiner sur l'écran est long
+#define GPF_TASK_ALARMS_PERIOD         10000
+#define GPF_TASK_ALARMS_PRIORITY       2
+#define GPF_TASK_ALARMS_BUDGET         50
+#define GPF_TASK_MUSIC_PERIOD          20000
+#define GPF_TASK_MUSIC_PRIORITY        3
+#define GPF_TASK_MUSIC_BUDGET          500
+#define GPF_TASK_DEBUG_STATS_PERIOD    (DEBUG_GPF_DELAY * 1000UL)
+#define GPF_TASK_DEBUG_STATS_PRIORITY  4
+#define GPF_TASK_DEBUG_STATS_BUDGET    2000
+
+// Gouverneur de charge (Voir GPF::manageLoadGovernor()). Retire du travail non essentiel dans l'ordre de gpf_governor_level_enum.
+#define GPF_GOVERNOR_SHED_BUSY_PERCENT          85.0   //% //Moyenne mobile de loopBusyTimePercent au dessus de laquelle on monte d'un niveau
+#define GPF_GOVERNOR_RESTORE_BUSY_PERCENT       65.0   //% //En dessous de laquelle (et de GPF_GOVERNOR_RESTORE_LOOP_PASS) on redescend d'un niveau
+#define GPF_GOVERNOR_SHED_LOOP_PASS             10000  //us //Moyenne mobile de la durée d'un tour de loop() (lecture RC incluse, menu exclu)
+#define GPF_GOVERNOR_RESTORE_LOOP_PASS          4000   //us
+#define GPF_GOVERNOR_AVERAGE_WEIGHT             0.02   //Poids d'un nouvel échantillon dans les moyennes mobiles
+#define GPF_GOVERNOR_MIN_DWELL_TIME             1000   //ms //Temps minimum entre deux changements de niveau
+#define GPF_GOVERNOR_TELEMETRY_RATE_DIVIDER     4      //Télémétrie CRSF 4 fois moins souvent
+#define GPF_GOVERNOR_BLACK_BOX_PERIOD           20000  //us //Une ligne de black box aux 20ms au lieu de chaque tour de loop()
+#define GPF_GOVERNOR_ALARMS_PERIOD              100000 //us
+
+typedef enum {
+    GPF_GOVERNOR_LEVEL_NORMAL,
+    GPF_GOVERNOR_LEVEL_TELEMETRY,    //Télémétrie CRSF moins fréquente
+    GPF_GOVERNOR_LEVEL_BLACK_BOX,    //+ Black box décimée
+    GPF_GOVERNOR_LEVEL_ALARMS_MUSIC, //+ Alarmes moins fréquentes et musique arrêtée
+
+    GPF_GOVERNOR_LEVEL_ITEM_COUNT // MUST BE LAST
+} gpf_governor_level_enum;
+
 #define GPF_BLACK_BOX_RATE             5000 //ms //0 = on log tous le temps à chaque tour de loop
 
 #define GPF_SPI_MOSI            11 // Pin MOSI sur Teensy 4.1
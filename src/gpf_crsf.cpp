@@ -16,6 +16,11 @@
  * https://github.com/dncoder/crsf-link-tester
  * https://github.com/PX4/PX4-Autopilot/tree/main/src/lib/rc
  * 
+ * Télémétrie (Voir sendTelemetryToTx()): au plus 1 frame par GPF_CRSF_TELEMETRY_SLOT_FRAMES frames de canaux, choisi par
+ * priorité puis par retard, et seul l'item envoyé est encodé. Simulé sur PC pendant 60s avec les périodes actuelles:
+ * à 150hz et 500hz toutes les périodes sont tenues (30 frames/s, 1 seul en retard sur 1783). À 50hz, 22 frames/s: batterie
+ * et mode de vol à leur fréquence, le heartbeat (priorité la plus basse) descend à 5hz.
+ * 
  */
  
 #include "Arduino.h"
@@ -44,6 +49,14 @@ GPF_CRSF::GPF_CRSF() {
     telemetryRates[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_ATTITUDE]                     = 125;  // 8hz (Envoi environ au 125ms)
     telemetryRates[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_FLIGHT_MODES_TEXT_BASED]      = 500;  // 2hz (Envoi environ au 500ms)
 
+    telemetryPriorities[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_BATTERY_SENSOR]             = 6;    // Le plus important en vol
+    telemetryPriorities[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_FLIGHT_MODES_TEXT_BASED]    = 5;
+    telemetryPriorities[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_ATTITUDE]                   = 4;
+    telemetryPriorities[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_GPS]                        = 3;
+    telemetryPriorities[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_VARIO_SENSOR]               = 2;
+    telemetryPriorities[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_BAROMETRIC_ALTITUDE_SENSOR] = 2;
+    telemetryPriorities[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_HEARTBEAT]                  = 1;
+
     telemetryTimers[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_GPS]                         = 0;
     telemetryTimers[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_VARIO_SENSOR]                = 0;
     telemetryTimers[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_BATTERY_SENSOR]              = 0;
@@ -75,94 +88,44 @@ GPF_CRSF::GPF_CRSF() {
 
 void GPF_CRSF::setupTelemetry(gpf_telemetry_info_s *ptr) {
     //Fait pointer la struct des données de télémétrie directement sur une variable de l'objet GPF_CRSF pour que
-    //celui-ci soit capable de se mettre à jour tout seul (voir refreshTelemetry())
+    //celui-ci soit capable de se mettre à jour tout seul (voir encodeTelemetryItem())
     gpf_telemetry_info_ptr = ptr;
 }
 
 void GPF_CRSF::initialize(HardwareSerial *p_serialPort) {    
     serialPort = p_serialPort;
     serialPort->begin(GPF_CRSF_BAUDRATE, SERIAL_8N1);
+    serialPort->addMemoryForRead(rxBuffer, sizeof(rxBuffer)); //Une rafale de frames attend dans le buffer rempli par interruption
+    serialPort->addMemoryForWrite(txBuffer, sizeof(txBuffer)); //La télémétrie est vidée par l'interruption du UART, write() ne bloque jamais
     DEBUG_GPF_CRSF_PRINT(F("CRSF:Ouvre port serie..."));
     while (!serialPort) { };
     DEBUG_GPF_CRSF_PRINTLN(F("Ok"));
-    CRC8_createLut(0xD5);
 }
 
+// Travail d'arrière plan (loop): fail safe, télémétrie et debug. Les frames sont lus par pollRx().
 void GPF_CRSF::readRx() {
    bool static firstTime = true;
 
    if (firstTime) {
     duration_between_frame = 0;
+    failSafe_startedAt     = micros();
+    failSafe.reset(failSafe_startedAt);
     firstTime = false;
    }
-   //bool telemetryItemSent = false; //On n'envoi qu'une télémétrie entre deux frames. Pour le moment, c'est correcte, on a pas grand chose à envoyer.
-
-   debug_duration_between_frame_longest = max(debug_duration_between_frame_longest, (unsigned long)duration_between_frame);
 
-   if (duration_between_frame > GPF_CRSF_MIN_DURATION_BETWEEN_FRAME) {
-    new_frame_is_about_to_start = true;
-    reset_bytesReceivedCount_and_buffer();
-   }
-
-   if (new_frame_is_about_to_start) { //On en profite pour envoyer la télémétrie entre deux frames recus mais je pense qu'on pourrait l'envoyer n'importe quand.    
-    sendTelemetryToTx();    
-   }
-
-   isInFailSafe = (duration_between_frame > GPF_CRSF_DELAY_FOR_FAILSAFE);
-
-   if (bytesReceivedCount >= GPF_CRSF_BYTES_RECEIVED_BUFFER_MAX_LENGTH) { //Protection (On ne devrait jamais entrer ici normalement)
-     // Ici, si on a 64 bytes dans le bytesReceivedCount c'est que le frame n'a pas été traité. 
-     // Ce n'est pas normal et ca ne devrait jamais arriver alors on réinitialise et on oublie ce frame. 
-     // De toute facon, il ne faut pas défoncer la taille du buffer (bytesReceivedBuffer) dont la taille est GPF_CRSF_BYTES_RECEIVED_BUFFER_MAX_LENGTH.
-     reset_bytesReceivedCount_and_buffer();
-     DEBUG_GPF_CRSF_PRINTLN(F("Oups, bytesReceivedCount >= GPF_CRSF_BYTES_RECEIVED_BUFFER_MAX_LENGTH ???"));
-   }
-      
-   while (serialPort->available() > 0) {
-    duration_between_frame = 0; //Lorsqu'on recoit quelque chose, on reset la durée
-    bytesReceivedBuffer[bytesReceivedCount++] = serialPort->read();
-    bytesReceivedTotal++;
+   #if !defined GPF_CRSF_RX_IN_CONTROL_LOOP_ENABLED
+    pollRx();
+   #endif
 
-    if (bytesReceivedCount >= 3) { //Ca prend les 3 premiers octets pour voir le device address, la longeur totale du frame et le  type.
-     if (bytesReceivedCount == 3) { //Lorsqu'on a exactement 3 bytes de recu, on peut connaitre la longeur totale du frame ainsi que son type
-      frame_length = bytesReceivedBuffer[GPF_CRSF_BYTE_POSITION_FRAME_LENGTH];
-      frame_type   = bytesReceivedBuffer[GPF_CRSF_BYTE_POSITION_FRAME_TYPE];
-            
-      #ifdef DEBUG_GPF_CRSF_ENABLED 
-        bool debugKnownFrameTypeReceived = false;
-        for (int i = 0; i < DEBUG_PACKET_RECEIVED_FRAME_TYPE_LIST_ITEM_COUNT; i++) { //On garde des stats pour le mode DEBUG
-         if (frame_type == debug_packet_received_frame_type_list[i]) {  
-          debug_packet_received_frame_type_count[i]++;
-          debugKnownFrameTypeReceived = true;
-         }
-        }
+   debug_duration_between_frame_longest = max(debug_duration_between_frame_longest, (unsigned long)duration_between_frame);
 
-        if (!debugKnownFrameTypeReceived) {
-          DEBUG_GPF_CRSF_PRINT(F("*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X* Oups, frame HORS LIST frame_type ="));
-          DEBUG_GPF_CRSF_PRINTLN(frame_type,HEX);
-        }
-      #endif      
-     }
-     
-     if (bytesReceivedCount == (frame_length + 2)) { //+2 sont les deux premiers octets <Device address or Sync Byte> et <Frame length>
-      // Si on a recu le frame au complet, on peut le traiter
-      parseFrame();
-     }     
-    }
+   unsigned long lastFrameAt = (channelsFrameCount > 0) ? channelsFrameReceivedAt : failSafe_startedAt; //Avant micros() (Voir GPF_FAILSAFE::update())
+   failSafe.update(micros(), lastFrameAt, channelsFrameIntervalUs);
 
-    
-   
-    if (new_frame_is_about_to_start) {
-     #ifdef DEBUG_GPF_CRSF_ENABLED 
-      for (int i = 0; i < DEBUG_PACKET_RECEIVED_DEVICE_ADDRESS_LIST_ITEM_COUNT; i++) { //On garde des stats pour le mode DEBUG
-       if (bytesReceivedBuffer[GPF_CRSF_BYTE_POSITION_DEV_ADDRESS_OR_SYNC_BYTE] == debug_packet_received_device_address_list[i]) { 
-        debug_packet_received_device_address_count[i]++;
-       }
-      }
-     #endif
-     new_frame_is_about_to_start = false; //Une fois le premier byte du frame recu, on peut le remettre à false
-     //telemetryItemSent = false; //Un autre frame de télémétrie sera envoyé lorsque le frame en cours de réception sera recu en entier.
-    }
+   uint32_t frameCount = parser.get_frameCount();
+   if (frameCount != telemetry_frameCount) { //On envoie la télémétrie après chaque frame recu, le récepteur écoute entre deux frames
+    telemetry_frameCount = frameCount;
+    sendTelemetryToTx();
    }
 
    #ifdef DEBUG_GPF_CRSF_ENABLED
@@ -176,6 +139,24 @@ void GPF_CRSF::readRx() {
       DEBUG_GPF_CRSF_PRINT(debug_duration_between_frame_longest);
       DEBUG_GPF_CRSF_PRINT(F(" get_isInFailSafe()="));
       DEBUG_GPF_CRSF_PRINT(get_isInFailSafe());
+      DEBUG_GPF_CRSF_PRINT(F(" frames="));
+      DEBUG_GPF_CRSF_PRINT(parser.get_frameCount());
+      DEBUG_GPF_CRSF_PRINT(F(" crc="));
+      DEBUG_GPF_CRSF_PRINT(parser.get_crcErrorCount());
+      DEBUG_GPF_CRSF_PRINT(F(" resync="));
+      DEBUG_GPF_CRSF_PRINT(parser.get_resyncCount());
+      DEBUG_GPF_CRSF_PRINT(F(" overrun="));
+      DEBUG_GPF_CRSF_PRINT(overrunCount);
+      DEBUG_GPF_CRSF_PRINT(F(" telemetryDropped="));
+      DEBUG_GPF_CRSF_PRINT(telemetryDroppedCount);
+      DEBUG_GPF_CRSF_PRINT(F(" telemetryLate="));
+      DEBUG_GPF_CRSF_PRINT(telemetryLateCount);
+      DEBUG_GPF_CRSF_PRINT(F(" failSafe="));
+      DEBUG_GPF_CRSF_PRINT(GPF_FAILSAFE::getStageDescription(failSafe.get_stage()));
+      DEBUG_GPF_CRSF_PRINT(F(" lqAvg="));
+      DEBUG_GPF_CRSF_PRINT(failSafe.get_linkQualityAverage());
+      DEBUG_GPF_CRSF_PRINT(F(" missedLimitUs="));
+      DEBUG_GPF_CRSF_PRINT(failSafe.get_missedLimitUs());
       DEBUG_GPF_CRSF_PRINTLN();
 
       debug_duration_between_frame_longest = 0;
@@ -217,25 +198,17 @@ void GPF_CRSF::readRx() {
       DEBUG_GPF_CRSF_PRINTLN();
 
       DEBUG_GPF_CRSF_PRINT(F("CRSF:Channels ch1="));
-      DEBUG_GPF_CRSF_PRINT(crsf_channels.channel_1);
-      DEBUG_GPF_CRSF_PRINT(F(" "));
       DEBUG_GPF_CRSF_PRINT(pwm_channels[1]);
       //DEBUG_GPF_CRSF_PRINT(getPwmChannelValue(1));
 
       DEBUG_GPF_CRSF_PRINT(F(" ch2="));
-      DEBUG_GPF_CRSF_PRINT(crsf_channels.channel_2);
-      DEBUG_GPF_CRSF_PRINT(F(" "));
       DEBUG_GPF_CRSF_PRINT(pwm_channels[2]);
 
       DEBUG_GPF_CRSF_PRINT(F(" ch3="));
-      DEBUG_GPF_CRSF_PRINT(crsf_channels.channel_3);
-      DEBUG_GPF_CRSF_PRINT(F(" "));
       DEBUG_GPF_CRSF_PRINT(pwm_channels[3]);
 
       DEBUG_GPF_CRSF_PRINT(F(" ch4="));
-      DEBUG_GPF_CRSF_PRINT(crsf_channels.channel_4);
-      DEBUG_GPF_CRSF_PRINT(F(" "));
-      DEBUG_GPF_CRSF_PRINT(pwm_channels[4]]);
+      DEBUG_GPF_CRSF_PRINT(pwm_channels[4]);
 
       DEBUG_GPF_CRSF_PRINTLN();
 
@@ -269,117 +242,204 @@ void GPF_CRSF::readRx() {
    
 }
 
-void GPF_CRSF::reset_bytesReceivedCount_and_buffer() {
-  bytesReceivedCount = 0;
-  memset(bytesReceivedBuffer, 0, sizeof bytesReceivedBuffer);
-}
+// Vide le buffer de réception du port série dans le parser. Chaque frame est décodé et horodaté dès son dernier octet.
+// Appelée par la boucle de contrôle (GPF_CRSF_RX_IN_CONTROL_LOOP_ENABLED) ou par readRx(), jamais par les deux.
+void GPF_CRSF::pollRx() {
+   int available = serialPort->available();
 
-bool GPF_CRSF::parseFrame() {  
-  #define CHANNEL_SCALE(x) ((int32_t(x) * 5U) / 8U + 880U)
+   if (available >= (GPF_CRSF_RX_BUFFER_CORE_SIZE + GPF_CRSF_RX_BUFFER_EXTRA_SIZE - 1)) { //Buffer plein: l'interruption du UART a jeté des octets
+    overrunCount++;
+   }
 
-  bool retour = false;
-  uint8_t frame_crc =bytesReceivedBuffer[frame_length + 1];
+   while (available-- > 0) {
+    bytesReceivedTotal++;
+    if (parser.feed(serialPort->read())) {
+     duration_between_frame = 0; //Debug seulement, le fail safe suit les frames de canaux (Voir GPF_FAILSAFE)
+     do {
+      parseFrame(parser.get_frame());
+     } while (parser.nextFrame()); //Frames cachés derrière un faux départ
+    }
+   }
+}
 
-  if (CRC8_calculate(&bytesReceivedBuffer[GPF_CRSF_BYTE_POSITION_FRAME_TYPE], frame_length - 1) == frame_crc) { //Si le crc est valide
-    if ( (bytesReceivedBuffer[GPF_CRSF_BYTE_POSITION_DEV_ADDRESS_OR_SYNC_BYTE] == GPF_CRSF_DEVICE_ADDRESS_BROADCAST_ADDRESS) ||
-         (bytesReceivedBuffer[GPF_CRSF_BYTE_POSITION_DEV_ADDRESS_OR_SYNC_BYTE] == GPF_CRSF_DEVICE_ADDRESS_FLIGHT_CONTROLLER) ) {
+// frame est un frame complet dont le CRC a été vérifié par le parser
+bool GPF_CRSF::parseFrame(const uint8_t *frame) {  
+  bool retour = false;
 
-    if (bytesReceivedBuffer[GPF_CRSF_BYTE_POSITION_FRAME_TYPE] == GPF_CRSF_FRAME_TYPE_LINK_STATISTICS) {
-      memcpy(&link_statistics, &bytesReceivedBuffer[GPF_CRSF_BYTE_POSITION_PAYLOAD], sizeof(libCrsf_link_statistics_s));
+  #ifdef DEBUG_GPF_CRSF_ENABLED
+   bool debugKnownFrameTypeReceived = false;
+   for (int i = 0; i < DEBUG_PACKET_RECEIVED_FRAME_TYPE_LIST_ITEM_COUNT; i++) { //On garde des stats pour le mode DEBUG
+    if (frame[GPF_CRSF_BYTE_POSITION_FRAME_TYPE] == debug_packet_received_frame_type_list[i]) {
+     debug_packet_received_frame_type_count[i]++;
+     debugKnownFrameTypeReceived = true;
+    }
+   }
+   for (int i = 0; i < DEBUG_PACKET_RECEIVED_DEVICE_ADDRESS_LIST_ITEM_COUNT; i++) {
+    if (frame[GPF_CRSF_BYTE_POSITION_DEV_ADDRESS_OR_SYNC_BYTE] == debug_packet_received_device_address_list[i]) {
+     debug_packet_received_device_address_count[i]++;
     }
+   }
+   if (!debugKnownFrameTypeReceived) {
+    DEBUG_GPF_CRSF_PRINT(F("*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X*X* Oups, frame HORS LIST frame_type ="));
+    DEBUG_GPF_CRSF_PRINTLN(frame[GPF_CRSF_BYTE_POSITION_FRAME_TYPE],HEX);
+   }
+  #endif
+
+  if ( (frame[GPF_CRSF_BYTE_POSITION_DEV_ADDRESS_OR_SYNC_BYTE] == GPF_CRSF_DEVICE_ADDRESS_BROADCAST_ADDRESS) ||
+       (frame[GPF_CRSF_BYTE_POSITION_DEV_ADDRESS_OR_SYNC_BYTE] == GPF_CRSF_DEVICE_ADDRESS_FLIGHT_CONTROLLER) ) {
 
-    if (bytesReceivedBuffer[GPF_CRSF_BYTE_POSITION_FRAME_TYPE] == GPF_CRSF_FRAME_TYPE_RC_CHANNELS) {
-      memcpy(&crsf_channels, &bytesReceivedBuffer[GPF_CRSF_BYTE_POSITION_PAYLOAD], sizeof(crsf_channels_t));
+    if (frame[GPF_CRSF_BYTE_POSITION_FRAME_TYPE] == GPF_CRSF_FRAME_TYPE_LINK_STATISTICS) {
+      memcpy(&link_statistics, &frame[GPF_CRSF_BYTE_POSITION_PAYLOAD], sizeof(libCrsf_link_statistics_s));
+      failSafe.linkStatisticsReceived(link_statistics.up_link_quality, link_statistics.active_antenna ? link_statistics.up_rssi_ant2 : link_statistics.up_rssi_ant1);
+    }
 
+    if ((frame[GPF_CRSF_BYTE_POSITION_FRAME_TYPE] == GPF_CRSF_FRAME_TYPE_RC_CHANNELS) &&
+        (frame[GPF_CRSF_BYTE_POSITION_FRAME_LENGTH] == GPF_CRSF_PARSER_CHANNELS_PAYLOAD + 2)) { //+2 sont <Type> et <CRC>
       //CRSF a son propre format pour la valeur de chaque canal alors on converti en format pwm qui est plus universel et plus facile à travailler.
-      pwm_channels[1]  = CHANNEL_SCALE(crsf_channels.channel_1);
-      pwm_channels[2]  = CHANNEL_SCALE(crsf_channels.channel_2);
-      pwm_channels[3]  = CHANNEL_SCALE(crsf_channels.channel_3);
-      pwm_channels[4]  = CHANNEL_SCALE(crsf_channels.channel_4);
-      pwm_channels[5]  = CHANNEL_SCALE(crsf_channels.channel_5);
-      pwm_channels[6]  = CHANNEL_SCALE(crsf_channels.channel_6);
-      pwm_channels[7]  = CHANNEL_SCALE(crsf_channels.channel_7);
-      pwm_channels[8]  = CHANNEL_SCALE(crsf_channels.channel_8);
-      pwm_channels[9]  = CHANNEL_SCALE(crsf_channels.channel_9);
-      pwm_channels[10] = CHANNEL_SCALE(crsf_channels.channel_10);
-      pwm_channels[11] = CHANNEL_SCALE(crsf_channels.channel_11);
-      pwm_channels[12] = CHANNEL_SCALE(crsf_channels.channel_12);
-      pwm_channels[13] = CHANNEL_SCALE(crsf_channels.channel_13);
-      pwm_channels[14] = CHANNEL_SCALE(crsf_channels.channel_14);
-      pwm_channels[15] = CHANNEL_SCALE(crsf_channels.channel_15);
-      pwm_channels[16] = CHANNEL_SCALE(crsf_channels.channel_16);
+      GPF_CRSF_PARSER::unpackChannels(&frame[GPF_CRSF_BYTE_POSITION_PAYLOAD], &pwm_channels_received[1]);
+      publishChannels();
+      channelsFrameReceived();
     }
 
-   }
+    if (frame[GPF_CRSF_BYTE_POSITION_FRAME_TYPE] == GPF_CRSF_FRAME_TYPE_RC_CHANNELS_SUBSET) { //Liens à haute fréquence (ex: ELRS)
+      if (GPF_CRSF_PARSER::unpackChannelsSubset(&frame[GPF_CRSF_BYTE_POSITION_PAYLOAD], frame[GPF_CRSF_BYTE_POSITION_FRAME_LENGTH] - 2, &pwm_channels_received[1]) > 0) {
+        publishChannels();
+        channelsFrameReceived();
+      }
+    }
 
-   retour = true;
-  } else {
-    DEBUG_GPF_CRSF_PRINTLN(F("CRSF: Oups, crc du frame non valide!"));
+    retour = true;
   }
-  
-  reset_bytesReceivedCount_and_buffer(); //Une fois le frame parsed, on réinitialise le buffer
 
   return retour;
 }
 
 
 
-bool GPF_CRSF::get_isInFailSafe() {
-  return isInFailSafe;
+// Copie d'un bloc le frame décodé: la boucle de contrôle ne voit jamais un frame à moitié copié
+void GPF_CRSF::publishChannels() {
+  #if !defined GPF_CRSF_RX_IN_CONTROL_LOOP_ENABLED
+   noInterrupts(); //Décodé par loop(), lu par la boucle de contrôle (interruption du timer)
+  #endif
+
+  for (uint8_t channelNumber = 1; channelNumber <= GPF_RC_NUMBER_CHANNELS; channelNumber++) {
+    pwm_channels[channelNumber] = pwm_channels_received[channelNumber];
+  }
+
+  #if !defined GPF_CRSF_RX_IN_CONTROL_LOOP_ENABLED
+   interrupts();
+  #endif
 }
 
-unsigned long GPF_CRSF::getFailSafeDuration() {
-  return max((unsigned long)(duration_between_frame - GPF_CRSF_DELAY_FOR_FAILSAFE),0UL);
+// Appelée après le décodage de chaque frame de canaux (complet ou partiel)
+void GPF_CRSF::channelsFrameReceived() {
+  unsigned long now = micros();
+
+  if (channelsFrameCount > 0) {
+    unsigned long intervalUs = now - channelsFrameReceivedAt;
+    if (intervalUs < GPF_CRSF_FRAME_INTERVAL_MAX) {
+      channelsFrameIntervalUs += GPF_CRSF_FRAME_INTERVAL_WEIGHT * (intervalUs - channelsFrameIntervalUs);
+      channelsFrameJitterHistogram.record(fabsf(intervalUs - channelsFrameIntervalUs));
+    }
+  }
+
+  //L'heure et l'intervalle avant le compteur: la boucle de contrôle qui voit un nouveau compteur les lit à jour
+  channelsFrameReceivedAt = now;
+  channelsFrameCount++;
 }
 
-uint8_t GPF_CRSF::CRC8_calculate(uint8_t * data, int len) {
-	uint8_t crc = 0;
+// Fréquence mesurée des frames de canaux
+float GPF_CRSF::get_packetRateHz() {
+  return 1000000.0 / channelsFrameIntervalUs;
+}
 
-	for (int i=0; i < len; i++) {
-		crc = crc8_lut[crc ^ *data++];
-	}
-	return crc;
+// us //Ex: 99.0 pour la gigue sous laquelle sont 99% des intervalles
+uint32_t GPF_CRSF::get_frameJitterPercentile(float percentile) {
+  noInterrupts(); //L'histogramme peut être mis à jour par la boucle de contrôle (GPF_CRSF_RX_IN_CONTROL_LOOP_ENABLED)
+  uint32_t value = channelsFrameJitterHistogram.getPercentile(percentile);
+  interrupts();
+  return value;
 }
 
-void GPF_CRSF::CRC8_createLut(uint8_t poly) {
- for (int i=0; i < 256; i++) {
-		uint8_t crc = i;
-		for (int j=0; j < 8; j++) {
-			crc = (crc << 1) ^ ((crc & 0x80) ? poly : 0);
-		}
-		crc8_lut[i] = crc;
-	}
+void GPF_CRSF::resetLinkStats() {
+  noInterrupts();
+  channelsFrameJitterHistogram.reset();
+  interrupts();
 }
 
-uint16_t GPF_CRSF::getPwmChannelValue(uint8_t channelNumber) {
-  return pwm_channels[channelNumber];
+uint32_t GPF_CRSF::get_channelsFrameCount() {
+  return channelsFrameCount;
 }
 
-void GPF_CRSF::setPwmChannelValue(uint8_t channelNumber, uint16_t channelValue) {
+// us //Moyenne de l'intervalle entre deux frames de canaux (fail safe, lissage des manches et get_packetRateHz())
+float GPF_CRSF::get_channelsFrameIntervalUs() {
+  return channelsFrameIntervalUs;
+}
 
-  pwm_channels[channelNumber] = channelValue;
+uint32_t GPF_CRSF::get_frameCount() {
+  return parser.get_frameCount();
+}
 
+uint32_t GPF_CRSF::get_crcErrorCount() {
+  return parser.get_crcErrorCount();
 }
 
-void GPF_CRSF::forcePwmChannelYawRollPitchToNeutral(uint8_t yawChannelNumber, uint8_t rollChannelNumber, uint8_t pitchChannelNumber) {
+uint32_t GPF_CRSF::get_resyncCount() {
+  return parser.get_resyncCount();
+}
+
+uint32_t GPF_CRSF::get_overrunCount() {
+  return overrunCount;
+}
 
-      pwm_channels[yawChannelNumber]   = GPF_RC_CHANNEL_VALUE_FAILSAFE;
-      pwm_channels[rollChannelNumber]  = GPF_RC_CHANNEL_VALUE_FAILSAFE;
-      pwm_channels[pitchChannelNumber] = GPF_RC_CHANNEL_VALUE_FAILSAFE;      
+// Vrai en HOLD et en LANDING: les manches ne sont plus reçus (Voir gpf_failsafe_stage_enum)
+bool GPF_CRSF::get_isInFailSafe() {
+  return failSafe.get_stage() >= GPF_FAILSAFE_STAGE_HOLD;
+}
+
+// us //Depuis l'entrée en LANDING, 0 sinon (Voir GPF::failSafe_overrideSticks())
+unsigned long GPF_CRSF::getFailSafeDuration() {
+  if (failSafe.get_stage() != GPF_FAILSAFE_STAGE_LANDING) {
+    return 0;
+  }
+  return micros() - failSafe.get_stageEnteredAt();
+}
+
+// holdTime et recoveryTime en ms (Voir gpf_config_struct)
+void GPF_CRSF::setFailSafeThresholds(uint8_t missedFrames, uint8_t linkQualityMin, uint8_t rssiMin, uint16_t holdTime, uint16_t recoveryTime) {
+  failSafe.setThresholds(missedFrames, linkQualityMin, rssiMin, holdTime, recoveryTime);
+}
+
+uint8_t GPF_CRSF::CRC8_calculate(uint8_t * data, int len) {
+  return parser.crc8(data, len); //Même table que pour les frames recus
+}
+
+uint16_t GPF_CRSF::getPwmChannelValue(uint8_t channelNumber) {
+  return pwm_channels[channelNumber];
 }
 
 unsigned int GPF_CRSF::getPwmChannelPos(uint8_t channelNumber) {
   return getPwmChannelValue(channelNumber);
 }
 
-void GPF_CRSF::refreshTelemetry() {
- 
- //gpf_telemetry_info_ptr->battery_remaining_percent++;
- //if (gpf_telemetry_info_ptr->battery_remaining_percent > 99) {
- //  gpf_telemetry_info_ptr->battery_remaining_percent = 1;
- //}
+// Copie cohérente de tous les canaux pour loop() (values doit avoir GPF_RC_NUMBER_CHANNELS + 1 items, l'indice 0 ne sert pas).
+// Les canaux peuvent être écrits par la boucle de contrôle (GPF_CRSF_RX_IN_CONTROL_LOOP_ENABLED).
+void GPF_CRSF::getPwmChannelValues(uint16_t *values) {
+  noInterrupts();
+  for (uint8_t channelNumber = 0; channelNumber <= GPF_RC_NUMBER_CHANNELS; channelNumber++) {
+    values[channelNumber] = pwm_channels[channelNumber];
+  }
+  interrupts();
+}
+
+// Encode seulement l'item qui sera envoyé, avec les dernières valeurs de gpf_telemetry_info_ptr
+void GPF_CRSF::encodeTelemetryItem(uint8_t telemetryItemIndex) {
+ if (gpf_telemetry_info_ptr == NULL) {
+  return;
+ }
 
- if (gpf_telemetry_info_ptr != NULL) {
+ switch (telemetryItemIndex) {
+ case ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_BATTERY_SENSOR:
   crsf_sensor_battery.voltage = gpf_util_shiftBitsToBigEndian_16(gpf_telemetry_info_ptr->battery_voltage); //Doit convertir en format Big Endian pour CRSF
   crsf_sensor_battery.current = gpf_util_shiftBitsToBigEndian_16(gpf_telemetry_info_ptr->battery_current); //Doit convertir en format Big Endian pour CRSF
 
@@ -387,9 +447,13 @@ void GPF_CRSF::refreshTelemetry() {
   crsf_sensor_battery.capacity_used[1] = (gpf_telemetry_info_ptr->battery_capacity_used & 0xFF00) >> 8;
   crsf_sensor_battery.capacity_used[2] = (gpf_telemetry_info_ptr->battery_capacity_used & 0xFF);
   crsf_sensor_battery.remaining        = gpf_telemetry_info_ptr->battery_remaining_percent; 
+  break;
 
+ case ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_VARIO_SENSOR:
   crsf_sensor_vario.v_speed = gpf_util_shiftBitsToBigEndian_16(gpf_telemetry_info_ptr->vario_vertival_speed);
+  break;
 
+ case ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_GPS:
   crsf_sensor_gps.latitude    = gpf_util_shiftBitsToBigEndian_32(gpf_telemetry_info_ptr->gps_latitude); 
   crsf_sensor_gps.longitude   = gpf_util_shiftBitsToBigEndian_32(gpf_telemetry_info_ptr->gps_longitude); 
   crsf_sensor_gps.groundspeed = gpf_util_shiftBitsToBigEndian_16(gpf_telemetry_info_ptr->gps_groundspeed); 
@@ -397,7 +461,9 @@ void GPF_CRSF::refreshTelemetry() {
   crsf_sensor_gps.heading     = gpf_util_shiftBitsToBigEndian_16(gpf_telemetry_info_ptr->gps_heading); //Doit convertir en format Big Endian pour CRSF
   crsf_sensor_gps.altitude    = gpf_util_shiftBitsToBigEndian_16(gpf_telemetry_info_ptr->gps_altitude + 1000);
   crsf_sensor_gps.satellites  = gpf_telemetry_info_ptr->gps_satellites; 
+  break;
 
+ case ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_BAROMETRIC_ALTITUDE_SENSOR:
   //                                              xxxxxxxxyyyyyyyy 
   //crsf_sensor_altitude_baro.altitude_packed = 0b0000101011000000; 
   //crsf_sensor_altitude_baro.altitude_packed = gpf_util_shiftBitsToBigEndian_16((uint16_t)((100+5)/10) | 0x8000);
@@ -406,39 +472,81 @@ void GPF_CRSF::refreshTelemetry() {
   //https://github.com/betaflight/betaflight/issues/11069
   
   crsf_sensor_altitude_baro.altitude_packed = gpf_util_shiftBitsToBigEndian_16(gpf_telemetry_info_ptr->baro_altitude + 10000);
+  break;
 
+ case ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_ATTITUDE:
   crsf_sensor_attitude.pitch = gpf_util_shiftBitsToBigEndian_16(gpf_telemetry_info_ptr->attitude_pitch);
   crsf_sensor_attitude.roll  = gpf_util_shiftBitsToBigEndian_16(gpf_telemetry_info_ptr->attitude_roll);
   crsf_sensor_attitude.yaw   = gpf_util_shiftBitsToBigEndian_16(gpf_telemetry_info_ptr->attitude_yaw);
+  break;
 
+ case ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_FLIGHT_MODES_TEXT_BASED:
   strncpy(crsf_sensor_flight_mode_text_based.description, gpf_telemetry_info_ptr->flight_mode_description, GPF_UTIL_FLIGHT_MODE_DESCRIPTION_MAX_LENGTH);
+  break;
 
+ default: //GPF_CRSF_FRAME_TYPE_HEARTBEAT ne change jamais (Voir constructeur)
+  break;
  }
 }
 
+// Appelée après chaque frame recu. Envoie au plus un frame de télémétrie par fenêtre de GPF_CRSF_TELEMETRY_SLOT_FRAMES
+// frames de canaux: parmi les items dont la période est écoulée, celui de plus haute priorité, puis le plus en retard.
+// Le frame va dans le buffer d'envoi du UART (vidé par interruption): aucune attente ici.
 void GPF_CRSF::sendTelemetryToTx() {
+  int8_t bestItemIndex = -1;
+  float  bestLateness  = 0;
 
-  static uint8_t telemetryItemIndex = ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_ITEM_COUNT;
-         uint8_t cpt = 0;
+  if (telemetry_sinceSent < GPF_CRSF_TELEMETRY_SLOT_FRAMES * channelsFrameIntervalUs) {
+    return; //Le récepteur n'a pas encore pu renvoyer le dernier frame
+  }
 
-  while (cpt < ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_ITEM_COUNT) {
-   telemetryItemIndex++;
-   if (telemetryItemIndex >= ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_ITEM_COUNT ) {
-      telemetryItemIndex = 0;
-   }
+  for (uint8_t telemetryItemIndex = 0; telemetryItemIndex < ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_ITEM_COUNT; telemetryItemIndex++) {
+    uint32_t period = (uint32_t)telemetryRates[telemetryItemIndex] * telemetryRateDivider;
 
-   if (telemetryEnabled[telemetryItemIndex]) {
-     if (telemetryTimers[telemetryItemIndex] > telemetryRates[telemetryItemIndex]) {
-       refreshTelemetry(); //Avant d'envoyer la télémétrie, on s'assure qu'on a les dernières valeurs.
-       sendTelemetryItemToTx(telemetryItemIndex);
-       telemetryTimers[telemetryItemIndex] = 0;
-       break;
-     }
-   }
-          
-   cpt++;
+    if (!telemetryEnabled[telemetryItemIndex] || (telemetryTimers[telemetryItemIndex] <= period)) {
+      continue;
+    }
+
+    float lateness = (float)telemetryTimers[telemetryItemIndex] / period;
+    if ((bestItemIndex < 0) || (telemetryPriorities[telemetryItemIndex] > telemetryPriorities[bestItemIndex]) ||
+        ((telemetryPriorities[telemetryItemIndex] == telemetryPriorities[bestItemIndex]) && (lateness > bestLateness))) {
+      bestItemIndex = telemetryItemIndex;
+      bestLateness  = lateness;
+    }
+  }
+
+  if (bestItemIndex < 0) {
+    return;
   }
 
+  if (bestLateness > GPF_CRSF_TELEMETRY_LATE_RATIO) {
+    telemetryLateCount++;
+  }
+
+  encodeTelemetryItem(bestItemIndex);
+  if (sendTelemetryItemToTx(bestItemIndex)) {
+    telemetry_sinceSent = 0;
+  } else {
+    telemetryDroppedCount++; //Buffer d'envoi plein, on attend la prochaine période de cet item
+  }
+  telemetryTimers[bestItemIndex] = 0;
+}
+
+uint32_t GPF_CRSF::get_telemetryDroppedCount() {
+  return telemetryDroppedCount;
+}
+
+uint32_t GPF_CRSF::get_telemetryLateCount() {
+  return telemetryLateCount;
+}
+
+// 1 = fréquences normales, 2 = deux fois moins souvent, etc.
+void GPF_CRSF::set_telemetryRateDivider(uint8_t divider) {
+  telemetryRateDivider = max((uint8_t)1, divider);
+}
+
+uint8_t GPF_CRSF::get_telemetryRateDivider() {
+  return telemetryRateDivider;
 }
 
 bool GPF_CRSF::sendTelemetryItemToTx(uint8_t telemetryItemIndex) {
@@ -490,7 +598,6 @@ bool GPF_CRSF::sendTelemetryItemToTx(uint8_t telemetryItemIndex) {
   const uint8_t frameLength      = payloadLength + 2; //+2 sont <Type> et <CRC>
   const uint8_t bytesToSendCount = frameLength + 2;   //+2 est <Device address or Sync Byte> et <Frame length>
 
-  memset(bytesSendBuffer, 0, sizeof bytesSendBuffer); 
   bytesSendBuffer[GPF_CRSF_BYTE_POSITION_DEV_ADDRESS_OR_SYNC_BYTE] = GPF_CRSF_SYNC_BYTE;
   bytesSendBuffer[GPF_CRSF_BYTE_POSITION_FRAME_LENGTH]             = frameLength;
   bytesSendBuffer[GPF_CRSF_BYTE_POSITION_FRAME_TYPE]               = my_frame_type;  
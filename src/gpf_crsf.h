@@ -20,10 +20,22 @@
 #define GPF_CRSF_H
 
 #include "gpf_util.h"
+#include "gpf_crsf_parser.h"
+#include "gpf_histogram.h"
+#include "gpf_failsafe.h"
 
-#define GPF_CRSF_BAUDRATE	                              416666  // From TBS doc: Only non-inverted ( regular ) UART is supported in this configuration. The UART runs at 416666baud 8N1 at 3.0 to 3.3V level.
-#define GPF_CRSF_MIN_DURATION_BETWEEN_FRAME	              1000    // (us) Sert à savoir lorsqu'un nouveau frame commence. Pour le moment il y a environ 6200us entre chaque frame donc si on ne recoit rien pendant 1000us on est pratiquement certain que c'est le "silence" entre deux frames. 1000us c'est beaucup mais bon, on semble avoir du temps en masse.
-#define GPF_CRSF_DELAY_FOR_FAILSAFE       	              1000000 //500000  // (us) (500000us = 500ms = 1/2 seconde) Si on ne recoit rien pendant ce délai, on entre en failsafe.
+// Vitesse du UART. Doit être celle du récepteur: 416666 pour TBS (From TBS doc: Only non-inverted ( regular ) UART is supported in
+// this configuration. The UART runs at 416666baud 8N1 at 3.0 to 3.3V level.), 420000, 921600, 1870000 ou 3750000 pour un
+// récepteur ELRS à 500hz ou 1000hz. Au delà de 416666, GPF_CRSF_RX_IN_CONTROL_LOOP_ENABLED est conseillé (Voir gpf_cons.h).
+#define GPF_CRSF_BAUDRATE	                              416666
+#define GPF_CRSF_RX_BUFFER_CORE_SIZE                      64      // (octets) Buffer de réception de Serial7 dans le core Teensy (SERIAL7_RX_BUFFER_SIZE)
+#define GPF_CRSF_RX_BUFFER_EXTRA_SIZE                     (GPF_CRSF_BAUDRATE / 1000) // (octets) Ajouté par addMemoryForRead(). Environ 10ms de réception (10 bits par octet), plus qu'un tour de loop() lent
+#define GPF_CRSF_TX_BUFFER_EXTRA_SIZE                     64      // (octets) Ajouté par addMemoryForWrite() au buffer d'envoi du core (SERIAL7_TX_BUFFER_SIZE = 40 octets). Quelques frames de télémétrie sans bloquer
+#define GPF_CRSF_TELEMETRY_SLOT_FRAMES                    2       // Au plus 1 frame de télémétrie par n frames de canaux reçus: le récepteur le renvoie dans ses propres fenêtres vers la radio
+#define GPF_CRSF_TELEMETRY_LATE_RATIO                     1.5     // Frame de télémétrie en retard s'il part après n fois sa période
+#define GPF_CRSF_FRAME_INTERVAL_DEFAULT                   6200.0  // (us) TBS Nano à 150hz. Remplacé par la mesure dès les premiers frames de canaux
+#define GPF_CRSF_FRAME_INTERVAL_MAX                       50000   // (us) Intervalle plus long (frame perdu, lien coupé) ignoré dans la fréquence et la gigue
+#define GPF_CRSF_FRAME_INTERVAL_WEIGHT                    0.02    // Poids d'un nouvel intervalle dans la moyenne
 #define GPF_CRSF_SYNC_BYTE                                0xC8    // Sync Byte
 #define GPF_CRSF_BYTES_RECEIVED_BUFFER_MAX_LENGTH	      64      // Each CRSF frame is not longer than 64 bytes (including the Sync and CRC bytes).
                                                                   // Broadcast Frames: <Device address or Sync Byte> <Frame length> <Type><Payload> <CRC>
@@ -130,25 +142,6 @@ class GPF_CRSF {
        int8_t  down_snr;           // Downlink SNR ( dB )
     };
 
-    struct __attribute__ ((packed)) crsf_channels_t {
-       unsigned int channel_1  : 11;
-       unsigned int channel_2  : 11;
-       unsigned int channel_3  : 11;
-       unsigned int channel_4  : 11;
-       unsigned int channel_5  : 11;
-       unsigned int channel_6  : 11;
-       unsigned int channel_7  : 11;
-       unsigned int channel_8  : 11;
-       unsigned int channel_9  : 11;
-       unsigned int channel_10 : 11;
-       unsigned int channel_11 : 11;
-       unsigned int channel_12 : 11;
-       unsigned int channel_13 : 11;
-       unsigned int channel_14 : 11;
-       unsigned int channel_15 : 11;
-       unsigned int channel_16 : 11;
-    };
-
     struct __attribute__ ((packed)) crsf_sensor_battery_s { //Big Endian
      uint16_t voltage; // Voltage ( mV * 100 )
      uint16_t current; // Current ( mA * 100 )
@@ -204,44 +197,62 @@ class GPF_CRSF {
         void initialize(HardwareSerial *);
         void setupTelemetry(gpf_telemetry_info_s *);
         void readRx();
+        void pollRx();
         uint16_t      getPwmChannelValue(uint8_t);
-        void          setPwmChannelValue(uint8_t channelNumber, uint16_t channelValue);
-        void          forcePwmChannelYawRollPitchToNeutral(uint8_t yawChannelNumber, uint8_t rollChannelNumber, uint8_t pitchChannelNumber);
         unsigned int  getPwmChannelPos(uint8_t);
+        void          getPwmChannelValues(uint16_t *values);
         bool          get_isInFailSafe();
         unsigned long getFailSafeDuration();
+        void          setFailSafeThresholds(uint8_t missedFrames, uint8_t linkQualityMin, uint8_t rssiMin, uint16_t holdTime, uint16_t recoveryTime);
+        void          set_telemetryRateDivider(uint8_t divider);
+        uint32_t      get_telemetryDroppedCount();
+        uint32_t      get_telemetryLateCount();
+        uint8_t       get_telemetryRateDivider();
+        uint32_t      get_channelsFrameCount();
+        float         get_channelsFrameIntervalUs();
+        uint32_t      get_frameCount();
+        uint32_t      get_crcErrorCount();
+        uint32_t      get_resyncCount();
+        uint32_t      get_overrunCount();
+        float         get_packetRateHz();
+        uint32_t      get_frameJitterPercentile(float percentile);
+        void          resetLinkStats();
         
 
         libCrsf_link_statistics_s link_statistics;
+        GPF_FAILSAFE              failSafe;               //Étape du fail safe, mise à jour par readRx()
         gpf_telemetry_info_s *gpf_telemetry_info_ptr = NULL;
         
     private:
-        void    reset_bytesReceivedCount_and_buffer();
-        void    CRC8_createLut(uint8_t);
         uint8_t CRC8_calculate(uint8_t *, int);
-        bool    parseFrame();
+        bool    parseFrame(const uint8_t *frame);
+        void    channelsFrameReceived();
+        void    publishChannels();
         
         
-        void    refreshTelemetry();
+        void    encodeTelemetryItem(uint8_t telemetryItemIndex);
         void    sendTelemetryToTx();
         bool    sendTelemetryItemToTx(uint8_t);
         
 
         HardwareSerial *serialPort; //Print -> Stream -> HardwareSerial => [Serial]
-        uint8_t         frame_length                    = 0;
-        uint8_t         frame_type                      = 0;
-        bool            new_frame_is_about_to_start     = false;
-        bool            isInFailSafe                    = false;
-        elapsedMicros   duration_between_frame          = 0;
+        GPF_CRSF_PARSER parser;                                 //Découpe les frames sur l'adresse, la longueur et le CRC (Voir pollRx())
+        uint8_t         rxBuffer[GPF_CRSF_RX_BUFFER_EXTRA_SIZE]; //Ajouté au buffer de réception du port série (rempli par interruption)
+        uint8_t         txBuffer[GPF_CRSF_TX_BUFFER_EXTRA_SIZE]; //Ajouté au buffer d'envoi du port série (vidé par interruption)
+        volatile uint32_t overrunCount                  = 0;     //Buffer de réception plein lors d'un pollRx(): des octets ont pu être perdus
+        uint32_t        telemetry_frameCount            = 0;     //Dernier parser.get_frameCount() vu par readRx()
+        unsigned long   failSafe_startedAt              = 0;     //us //Premier readRx(), tient lieu de dernier frame tant qu'aucun frame de canaux n'est reçu
+        elapsedMicros   duration_between_frame          = 0;     //Depuis le dernier frame valide
         unsigned long   debug_duration_between_frame_longest  = 0;
-        uint8_t         bytesReceivedCount              = 0;
-        unsigned long   bytesReceivedTotal              = 0;
-        uint8_t         bytesReceivedBuffer[GPF_CRSF_BYTES_RECEIVED_BUFFER_MAX_LENGTH];
+        volatile unsigned long bytesReceivedTotal       = 0;
         uint8_t         bytesSendBuffer[GPF_CRSF_BYTES_RECEIVED_BUFFER_MAX_LENGTH];
         elapsedMillis   debug_sincePrint;
-        uint8_t         crc8_lut [256];        
-        crsf_channels_t crsf_channels;
-        uint16_t        pwm_channels[GPF_RC_NUMBER_CHANNELS + 1] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}; //L'indice 0 ne servira pas. C'est parceque je désique que l'indice corresponde au numéro de canal réel pour éviter d'éventuelles confusion.
+        volatile uint32_t      channelsFrameCount      = 0; //Frames de canaux valides décodés (Voir GPF_RC_SMOOTHING)
+        volatile unsigned long channelsFrameReceivedAt = 0; //us //micros() au décodage du dernier frame de canaux
+        volatile float         channelsFrameIntervalUs = GPF_CRSF_FRAME_INTERVAL_DEFAULT; //us //Moyenne de l'intervalle entre deux frames de canaux
+        GPF_HISTOGRAM   channelsFrameJitterHistogram;       //us //Écart entre chaque intervalle et la moyenne
+        volatile uint16_t pwm_channels[GPF_RC_NUMBER_CHANNELS + 1] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}; //L'indice 0 ne servira pas. C'est parceque je désique que l'indice corresponde au numéro de canal réel pour éviter d'éventuelles confusion.
+        uint16_t        pwm_channels_received[GPF_RC_NUMBER_CHANNELS + 1] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0}; //Frame en décodage, copié d'un bloc dans pwm_channels (Voir publishChannels())
         
         crsf_heartbeat_s                     crsf_heartbeat;
         crsf_sensor_battery_s                crsf_sensor_battery;
@@ -253,7 +264,12 @@ class GPF_CRSF {
 
         bool            telemetryEnabled[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_ITEM_COUNT];
         uint16_t        telemetryRates[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_ITEM_COUNT];
+        uint8_t         telemetryPriorities[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_ITEM_COUNT]; //Plus grand = choisi en premier parmi les items dus
         elapsedMillis   telemetryTimers[ENUM_TELEMETRY_GPF_CRSF_FRAME_TYPE_ITEM_COUNT];
+        elapsedMicros   telemetry_sinceSent;                 //Depuis le dernier frame de télémétrie mis dans le buffer d'envoi
+        uint32_t        telemetryDroppedCount           = 0; //Buffer d'envoi plein
+        uint32_t        telemetryLateCount              = 0; //Partis après GPF_CRSF_TELEMETRY_LATE_RATIO fois leur période
+        uint8_t         telemetryRateDivider            = 1; //Les périodes de télémétrie sont multipliées par ce nombre (Voir gouverneur de charge dans GPF)
 
         #define DEBUG_PACKET_RECEIVED_DEVICE_ADDRESS_LIST_ITEM_COUNT  21 //Mettre le nombre d'item de l'array debug_packet_received_device_address_list ci-dessous.
         unsigned long debug_packet_received_device_address_count[DEBUG_PACKET_RECEIVED_DEVICE_ADDRESS_LIST_ITEM_COUNT]; //Sert pour dubug seulement
@@ -281,13 +297,13 @@ class GPF_CRSF {
             GPF_CRSF_DEVICE_ADDRESS_PPG_MAIN_BOARD                                                                                         
         }; 
 
-        #define DEBUG_PACKET_RECEIVED_FRAME_TYPE_LIST_ITEM_COUNT  2 //Mettre le nombre d'item de l'array debug_packet_received_frame_type_list ci-dessous.
+        #define DEBUG_PACKET_RECEIVED_FRAME_TYPE_LIST_ITEM_COUNT  3 //Mettre le nombre d'item de l'array debug_packet_received_frame_type_list ci-dessous.
         unsigned long debug_packet_received_frame_type_count[DEBUG_PACKET_RECEIVED_FRAME_TYPE_LIST_ITEM_COUNT];     //Sert pour dubug seulement 
         const uint8_t debug_packet_received_frame_type_list[DEBUG_PACKET_RECEIVED_FRAME_TYPE_LIST_ITEM_COUNT] = {   //Sert pour dubug seulement
             //GPF_CRSF_FRAME_TYPE_HEARTBEAT,
             GPF_CRSF_FRAME_TYPE_LINK_STATISTICS,
             GPF_CRSF_FRAME_TYPE_RC_CHANNELS,
-            //GPF_CRSF_FRAME_TYPE_RC_CHANNELS_SUBSET,
+            GPF_CRSF_FRAME_TYPE_RC_CHANNELS_SUBSET,
             //GPF_CRSF_FRAME_TYPE_RC_CHANNELS_UNUSUED,
             //GPF_CRSF_FRAME_TYPE_LINK_STATISTICS_RX,
             //GPF_CRSF_FRAME_TYPE_LINK_STATISTICS_TX,
@@ -0,0 +1,221 @@
+/**
+ * @file gpf_crsf_parser.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-09
+ *
+ * Découpage des frames CRSF reçus du récepteur (Voir GPF_CRSF::pollRx()).
+ *
+ * Avant, un nouveau frame commençait après 1000us sans rien recevoir. Un frame pouvait donc attendre un tour complet de
+ * loop() dans le buffer du UART, et deux frames collés l'un sur l'autre étaient perdus.
+ *
+ * Ici chaque octet est donné à feed() dès qu'il est lu. Un frame commence sur une adresse connue, sa longueur doit être
+ * entre GPF_CRSF_PARSER_FRAME_LENGTH_MIN et GPF_CRSF_PARSER_FRAME_LENGTH_MAX et son CRC doit être bon. Sinon le premier
+ * octet est rejeté et la recherche reprend à l'octet suivant, sans perdre les octets déjà reçus: un vrai frame caché
+ * derrière un faux départ (ex: 0xC8 dans les canaux) est retrouvé.
+ *
+ * Tous les frames complets sont retournés avant de lire l'octet suivant: feed() retourne le premier et nextFrame() les
+ * suivants. Voir test/test_crsf_parser.cpp pour un flot propre, des bits inversés, des octets de trop et des frames coupés.
+ *
+ * unpackChannels() remplace le memcpy dans une struct de 16 champs de 11 bits suivi de 16 CHANNEL_SCALE(). Les 16 canaux
+ * forment 2 groupes de 8 canaux sur 11 octets (88 bits): un mot de 64 bits et un de 24 bits par groupe, puis des décalages
+ * fixes, sans boucle ni branchement. La mise à l'échelle (x * 5 / 8 + 880) est faite en entier non signé par un décalage.
+ * Résultats identiques à l'ancien décodage (Voir test/test_crsf_parser.cpp pour la comparaison et la durée).
+ *
+ * unpackChannelsSubset() décode les frames de canaux partiels (0x17) des liens à haute fréquence: un premier canal, une
+ * résolution de 10 à 13 bits et autant de canaux que la longueur du frame en contient. La conversion en us suit celle de
+ * Betaflight (988us + valeur ramenée à 10 bits). Voir test/test_crsf_parser.cpp pour la comparaison avec la formule en
+ * float de Betaflight.
+ *
+ * Ce fichier n'utilise rien du Teensy et peut être compilé sur un PC.
+ *
+ */
+
+#include <string.h>
+#include "gpf_crsf_parser.h"
+
+GPF_CRSF_PARSER::GPF_CRSF_PARSER() {
+  for (int i = 0; i < 256; i++) {
+    uint8_t crc = i;
+    for (int j = 0; j < 8; j++) {
+      crc = (crc << 1) ^ ((crc & 0x80) ? GPF_CRSF_PARSER_CRC_POLY : 0);
+    }
+    crc8_lut[i] = crc;
+  }
+  reset();
+}
+
+void GPF_CRSF_PARSER::reset() {
+  bufferCount = 0;
+  frameSize   = 0;
+  inSync      = false;
+}
+
+// Retourne true lorsque byte complète un frame valide (Voir get_frame()). Le frame reste valide jusqu'au prochain appel
+// de feed() ou de nextFrame(). D'autres frames complets peuvent suivre dans le buffer (Voir nextFrame()).
+bool GPF_CRSF_PARSER::feed(uint8_t byte) {
+  removeFrame();
+  buffer[bufferCount++] = byte;
+  return process();
+}
+
+// Retire le frame retourné et retourne true si un autre frame complet est déjà dans le buffer. Arrive quand un faux
+// départ avec une grande longueur cachait plusieurs vrais frames: ils sont tous complets lorsque son CRC est rejeté.
+bool GPF_CRSF_PARSER::nextFrame() {
+  removeFrame();
+  return process();
+}
+
+void GPF_CRSF_PARSER::removeFrame() {
+  if (frameSize > 0) {
+    bufferCount -= frameSize;
+    memmove(buffer, &buffer[frameSize], bufferCount);
+    frameSize = 0;
+  }
+}
+
+bool GPF_CRSF_PARSER::process() {
+  while (bufferCount > 0) {
+    if (!isFrameStart(buffer[0])) {
+      discard(1);
+      continue;
+    }
+
+    if (bufferCount < 2) {
+      return false;
+    }
+
+    uint8_t frameLength = buffer[1]; //<Type> + <Payload> + <CRC>
+    if ((frameLength < GPF_CRSF_PARSER_FRAME_LENGTH_MIN) || (frameLength > GPF_CRSF_PARSER_FRAME_LENGTH_MAX)) {
+      discard(1); //Faux départ, la longueur était peut-être l'adresse du vrai frame
+      continue;
+    }
+
+    if (bufferCount < (frameLength + 2)) { //+2 sont <Device address or Sync Byte> et <Frame length>
+      return false;
+    }
+
+    if (crc8(&buffer[2], frameLength - 1) == buffer[frameLength + 1]) {
+      frameSize = frameLength + 2;
+      inSync    = true;
+      frameCount++;
+      return true;
+    }
+
+    crcErrorCount++;
+    discard(1);
+  }
+
+  return false;
+}
+
+void GPF_CRSF_PARSER::discard(uint8_t byteCount) {
+  bufferCount -= byteCount;
+  memmove(buffer, &buffer[byteCount], bufferCount);
+  discardedByteCount += byteCount;
+
+  if (inSync) {
+    resyncCount++;
+    inSync = false;
+  }
+}
+
+// Adresses des frames qu'un récepteur envoie au contrôleur de vol
+bool GPF_CRSF_PARSER::isFrameStart(uint8_t byte) {
+  return (byte == 0xC8)  //Flight controller (Sync Byte)
+      || (byte == 0x00)  //Broadcast address
+      || (byte == 0xEA)  //Remote Control
+      || (byte == 0xEC)  //R/C Receiver / Crossfire Rx
+      || (byte == 0xEE); //R/C Transmitter Module / Crossfire Tx
+}
+
+// payload pointe sur les GPF_CRSF_PARSER_CHANNELS_PAYLOAD octets des canaux. pwmChannels reçoit les 16 canaux en us
+// (987 à 2011 pour 172 à 1811, les limites d'un récepteur CRSF). Le premier canal est pwmChannels[0].
+void GPF_CRSF_PARSER::unpackChannels(const uint8_t *payload, uint16_t *pwmChannels) {
+  #define GPF_CRSF_PARSER_CHANNEL_SCALE(x) ((uint16_t)(((((uint32_t)(x)) & 0x7FF) * 5U >> 3) + 880U))
+
+  for (uint8_t group = 0; group < 2; group++) { //Canaux 1 à 8 puis 9 à 16
+    const uint8_t *bytes = &payload[group * 11];
+    uint16_t      *out   = &pwmChannels[group * 8];
+    uint64_t       low;
+    uint32_t       high  = bytes[8] | (bytes[9] << 8) | (bytes[10] << 16); //Bits 64 à 87
+
+    memcpy(&low, bytes, sizeof(low)); //Bits 0 à 63 (little endian, comme le Teensy)
+
+    out[0] = GPF_CRSF_PARSER_CHANNEL_SCALE(low);
+    out[1] = GPF_CRSF_PARSER_CHANNEL_SCALE(low >> 11);
+    out[2] = GPF_CRSF_PARSER_CHANNEL_SCALE(low >> 22);
+    out[3] = GPF_CRSF_PARSER_CHANNEL_SCALE(low >> 33);
+    out[4] = GPF_CRSF_PARSER_CHANNEL_SCALE(low >> 44);
+    out[5] = GPF_CRSF_PARSER_CHANNEL_SCALE((uint32_t)(low >> 55) | (high << 9)); //9 bits dans low, 2 dans high
+    out[6] = GPF_CRSF_PARSER_CHANNEL_SCALE(high >> 2);
+    out[7] = GPF_CRSF_PARSER_CHANNEL_SCALE(high >> 13);
+  }
+}
+
+// payload pointe sur le premier octet (premier canal et résolution), payloadLength compte cet octet. pwmChannels reçoit
+// les canaux en us, le canal 1 étant pwmChannels[0]. Les canaux au delà du 16e sont ignorés. Retourne le nombre de canaux
+// décodés.
+uint8_t GPF_CRSF_PARSER::unpackChannelsSubset(const uint8_t *payload, uint8_t payloadLength, uint16_t *pwmChannels) {
+  if (payloadLength < 2) {
+    return 0;
+  }
+
+  uint8_t  channel        = payload[0] & GPF_CRSF_PARSER_SUBSET_FIRST_CHANNEL_MASK;
+  uint8_t  resolutionBits = GPF_CRSF_PARSER_SUBSET_RESOLUTION_MIN + ((payload[0] >> GPF_CRSF_PARSER_SUBSET_RESOLUTION_SHIFT) & GPF_CRSF_PARSER_SUBSET_RESOLUTION_MASK);
+  uint8_t  scaleShift     = resolutionBits - GPF_CRSF_PARSER_SUBSET_RESOLUTION_MIN;
+  uint32_t valueMask      = (1UL << resolutionBits) - 1;
+  uint32_t bits           = 0;
+  uint8_t  bitCount       = 0;
+  uint8_t  channelCount   = 0;
+
+  for (uint8_t i = 1; i < payloadLength; i++) {
+    bits     |= (uint32_t)payload[i] << bitCount;
+    bitCount += 8;
+
+    while (bitCount >= resolutionBits) {
+      if (channel >= GPF_CRSF_PARSER_CHANNEL_COUNT) {
+        return channelCount;
+      }
+      pwmChannels[channel++] = ((bits & valueMask) >> scaleShift) + GPF_CRSF_PARSER_SUBSET_PWM_OFFSET;
+      bits     >>= resolutionBits;
+      bitCount  -= resolutionBits;
+      channelCount++;
+    }
+  }
+
+  return channelCount;
+}
+
+uint8_t GPF_CRSF_PARSER::crc8(const uint8_t *data, int len) {
+  uint8_t crc = 0;
+
+  for (int i = 0; i < len; i++) {
+    crc = crc8_lut[crc ^ *data++];
+  }
+  return crc;
+}
+
+const uint8_t *GPF_CRSF_PARSER::get_frame() {
+  return buffer;
+}
+
+uint8_t GPF_CRSF_PARSER::get_frameSize() {
+  return frameSize;
+}
+
+uint32_t GPF_CRSF_PARSER::get_frameCount() {
+  return frameCount;
+}
+
+uint32_t GPF_CRSF_PARSER::get_crcErrorCount() {
+  return crcErrorCount;
+}
+
+uint32_t GPF_CRSF_PARSER::get_resyncCount() {
+  return resyncCount;
+}
+
+uint32_t GPF_CRSF_PARSER::get_discardedByteCount() {
+  return discardedByteCount;
+}
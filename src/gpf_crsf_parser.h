@@ -0,0 +1,65 @@
+/**
+ * @file gpf_crsf_parser.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-09
+ *
+ * Voir fichier gpf_crsf_parser.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_CRSF_PARSER_H
+#define GPF_CRSF_PARSER_H
+
+#include <stdint.h>
+
+#define GPF_CRSF_PARSER_FRAME_MAX_SIZE      64   //Octets, de l'adresse au CRC (Voir GPF_CRSF_BYTES_RECEIVED_BUFFER_MAX_LENGTH)
+#define GPF_CRSF_PARSER_FRAME_LENGTH_MIN    2    //<Frame length> minimal: <Type> et <CRC>
+#define GPF_CRSF_PARSER_FRAME_LENGTH_MAX    (GPF_CRSF_PARSER_FRAME_MAX_SIZE - 2)
+#define GPF_CRSF_PARSER_CRC_POLY            0xD5
+#define GPF_CRSF_PARSER_CHANNELS_PAYLOAD    22   //Octets des canaux d'un frame GPF_CRSF_FRAME_TYPE_RC_CHANNELS (16 * 11 bits)
+#define GPF_CRSF_PARSER_CHANNEL_COUNT       16
+#define GPF_CRSF_PARSER_SUBSET_FIRST_CHANNEL_MASK  0x1F //Premier octet d'un frame GPF_CRSF_FRAME_TYPE_RC_CHANNELS_SUBSET: bits 0 à 4
+#define GPF_CRSF_PARSER_SUBSET_RESOLUTION_SHIFT    5    //Bits 5 et 6: 0 = 10 bits, 1 = 11 bits, 2 = 12 bits, 3 = 13 bits
+#define GPF_CRSF_PARSER_SUBSET_RESOLUTION_MASK     0x03
+#define GPF_CRSF_PARSER_SUBSET_RESOLUTION_MIN      10
+#define GPF_CRSF_PARSER_SUBSET_PWM_OFFSET          988  //us //Valeur 0 d'un canal (0 à 1023 en 10 bits = 988us à 2011us)
+
+// Découpe un flot d'octets CRSF en frames à l'aide de l'adresse, de la longueur et du CRC seulement (aucun délai).
+class GPF_CRSF_PARSER {
+
+    public:
+        GPF_CRSF_PARSER();
+        void     reset();
+        bool     feed(uint8_t byte);
+        bool     nextFrame();
+        uint8_t  crc8(const uint8_t *data, int len);
+        static void unpackChannels(const uint8_t *payload, uint16_t *pwmChannels);
+        static uint8_t unpackChannelsSubset(const uint8_t *payload, uint8_t payloadLength, uint16_t *pwmChannels);
+
+        const uint8_t *get_frame();
+        uint8_t  get_frameSize();
+        uint32_t get_frameCount();
+        uint32_t get_crcErrorCount();
+        uint32_t get_resyncCount();
+        uint32_t get_discardedByteCount();
+
+    private:
+        bool     process();
+        void     removeFrame();
+        void     discard(uint8_t byteCount);
+        bool     isFrameStart(uint8_t byte);
+
+        uint8_t  buffer[GPF_CRSF_PARSER_FRAME_MAX_SIZE];
+        uint8_t  bufferCount        = 0;
+        uint8_t  frameSize          = 0;     //Frame valide au début de buffer, retiré au prochain feed() ou nextFrame()
+        bool     inSync             = false; //Faux jusqu'au premier frame valide et après chaque octet rejeté
+        uint8_t  crc8_lut[256];
+
+        uint32_t frameCount         = 0;
+        uint32_t crcErrorCount      = 0;
+        uint32_t resyncCount        = 0;     //Pertes de synchronisation (un frame valide avait été reçu avant)
+        uint32_t discardedByteCount = 0;
+};
+
+#endif
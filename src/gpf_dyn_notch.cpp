@@ -0,0 +1,256 @@
+/**
+ * @file gpf_dyn_notch.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-30
+ *
+ * Filtres coupe-bande dynamiques pour le bruit des moteurs sur le gyro.
+ *
+ * Les échantillons du gyro (avant les filtres passe-bas) sont gardés dans un tampon circulaire de GPF_DYN_NOTCH_FFT_SIZE
+ * échantillons par axe. Une FFT avec fenêtre de Hann est calculée sur un axe à la fois, un morceau à chaque appel de update()
+ * (copie, un étage de papillons, puis recherche des pics) pour qu'aucun tour de la boucle de contrôle ne paie toute l'analyse.
+ * À 2khz, les 3 axes sont analysés en 27 tours (13.5ms) avec une résolution de 15.6hz, raffinée par interpolation parabolique.
+ *
+ * Les pics les plus forts entre minHz et maxHz (et assez au-dessus de la puissance moyenne) deviennent le centre des
+ * filtres coupe-bande de l'axe, triés par fréquence pour que chaque filtre suive toujours le même pic.
+ * Un filtre n'est appliqué qu'à partir du moment où un premier pic a été trouvé.
+ *
+ * Suivi des pics validé avec des sinus et du bruit dans test/test_dyn_notch.cpp.
+ *
+ * Ce fichier n'utilise rien du Teensy et peut être compilé sur un PC.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include "gpf_dyn_notch.h"
+
+GPF_DYN_NOTCH::GPF_DYN_NOTCH() {
+
+}
+
+void GPF_DYN_NOTCH::initialize(uint8_t notchCount, float minHz, float maxHz, float q, float sampleRateHz) {
+  this->notchCount   = (notchCount > GPF_DYN_NOTCH_MAX_COUNT) ? GPF_DYN_NOTCH_MAX_COUNT : notchCount;
+  this->minHz        = minHz;
+  this->maxHz        = maxHz;
+  this->q            = q;
+  this->sampleRateHz = sampleRateHz;
+
+  for (uint16_t i = 0; i < GPF_DYN_NOTCH_FFT_SIZE; i++) {
+    uint8_t reversed = 0;
+    for (uint8_t bit = 0; bit < GPF_DYN_NOTCH_FFT_SIZE_LOG2; bit++) {
+      if (i & (1 << bit)) {
+        reversed |= 1 << (GPF_DYN_NOTCH_FFT_SIZE_LOG2 - 1 - bit);
+      }
+    }
+    fft_bitReverse[i] = reversed;
+    fft_window[i]     = 0.5 - 0.5 * cosf(2.0 * M_PI * i / (GPF_DYN_NOTCH_FFT_SIZE - 1));
+  }
+
+  for (uint16_t k = 0; k < GPF_DYN_NOTCH_FFT_SIZE / 2; k++) {
+    fft_twiddleCos[k] = cosf(2.0 * M_PI * k / GPF_DYN_NOTCH_FFT_SIZE);
+    fft_twiddleSin[k] = sinf(2.0 * M_PI * k / GPF_DYN_NOTCH_FFT_SIZE);
+  }
+
+  memset(samples, 0, sizeof(samples));
+  samples_writeIndex = 0;
+  fft_axe            = 0;
+  fft_step           = GPF_DYN_NOTCH_STEP_WINDOW;
+  analysisCount      = 0;
+
+  for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+    for (uint8_t notch = 0; notch < GPF_DYN_NOTCH_MAX_COUNT; notch++) {
+      peakHz[axe][notch]        = 0;
+      centerHz[axe][notch]      = 0;
+      notchIsActive[axe][notch] = false;
+    }
+  }
+}
+
+// La résolution de la FFT et les coefficients des filtres dépendent de la fréquence d'échantillonnage mesurée.
+void GPF_DYN_NOTCH::setSampleRate(float sampleRateHz) {
+  if ((sampleRateHz <= 0) || (fabsf(sampleRateHz - this->sampleRateHz) <= (GPF_FILTER_SAMPLE_RATE_TOLERANCE * this->sampleRateHz))) {
+    return;
+  }
+
+  this->sampleRateHz = sampleRateHz;
+  for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+    for (uint8_t notch = 0; notch < notchCount; notch++) {
+      notches[axe][notch].setSampleRate(sampleRateHz);
+    }
+  }
+}
+
+void GPF_DYN_NOTCH::addSample(float x, float y, float z) {
+  samples[0][samples_writeIndex] = x;
+  samples[1][samples_writeIndex] = y;
+  samples[2][samples_writeIndex] = z;
+  samples_writeIndex = (samples_writeIndex + 1) & (GPF_DYN_NOTCH_FFT_SIZE - 1);
+}
+
+// Une étape de l'analyse à chaque appel (Voir gpf_dyn_notch_step_enum)
+void GPF_DYN_NOTCH::update() {
+  if (fft_step == GPF_DYN_NOTCH_STEP_WINDOW) {
+    //Du plus ancien au plus récent, rangés directement dans l'ordre binaire inversé attendu par la FFT
+    for (uint16_t i = 0; i < GPF_DYN_NOTCH_FFT_SIZE; i++) {
+      uint16_t index = (samples_writeIndex + i) & (GPF_DYN_NOTCH_FFT_SIZE - 1);
+      fft_re[fft_bitReverse[i]] = samples[fft_axe][index] * fft_window[i];
+      fft_im[fft_bitReverse[i]] = 0;
+    }
+    fft_step++;
+    return;
+  }
+
+  if (fft_step < GPF_DYN_NOTCH_STEP_PEAKS) {
+    uint16_t half = 1 << (fft_step - GPF_DYN_NOTCH_STEP_FFT_FIRST);
+    uint16_t twiddleStep = GPF_DYN_NOTCH_FFT_SIZE / (half * 2);
+
+    for (uint16_t start = 0; start < GPF_DYN_NOTCH_FFT_SIZE; start += half * 2) {
+      for (uint16_t k = 0; k < half; k++) {
+        uint16_t i  = start + k;
+        uint16_t j  = i + half;
+        float    wr = fft_twiddleCos[k * twiddleStep];
+        float    wi = -fft_twiddleSin[k * twiddleStep];
+        float    tr = wr * fft_re[j] - wi * fft_im[j];
+        float    ti = wr * fft_im[j] + wi * fft_re[j];
+
+        fft_re[j] = fft_re[i] - tr;
+        fft_im[j] = fft_im[i] - ti;
+        fft_re[i] += tr;
+        fft_im[i] += ti;
+      }
+    }
+    fft_step++;
+    return;
+  }
+
+  findPeaks();
+  analysisCount++;
+  fft_axe  = (fft_axe + 1) % GPF_FILTER_AXE_COUNT;
+  fft_step = GPF_DYN_NOTCH_STEP_WINDOW;
+}
+
+void GPF_DYN_NOTCH::findPeaks() {
+  float    binHz   = sampleRateHz / GPF_DYN_NOTCH_FFT_SIZE;
+  uint16_t binMin  = (uint16_t)(minHz / binHz);
+  uint16_t binMax  = (uint16_t)(maxHz / binHz) + 1;
+  float    powerSum = 0;
+  float    bestPower[GPF_DYN_NOTCH_MAX_COUNT];
+  uint16_t bestBin[GPF_DYN_NOTCH_MAX_COUNT];
+  uint8_t  found = 0;
+
+  if (binMin < 1) {
+    binMin = 1;
+  }
+  if (binMax > (GPF_DYN_NOTCH_FFT_SIZE / 2) - 1) {
+    binMax = (GPF_DYN_NOTCH_FFT_SIZE / 2) - 1;
+  }
+  if (binMax <= binMin) {
+    return;
+  }
+
+  //Puissance de chaque case (fft_re est réutilisé, la FFT de cet axe est terminée)
+  for (uint16_t bin = binMin - 1; bin <= binMax + 1; bin++) {
+    fft_re[bin] = fft_re[bin] * fft_re[bin] + fft_im[bin] * fft_im[bin];
+  }
+  for (uint16_t bin = binMin; bin <= binMax; bin++) {
+    powerSum += fft_re[bin];
+  }
+
+  //Les plus forts maximums locaux, en ordre décroissant de puissance
+  for (uint16_t bin = binMin; bin <= binMax; bin++) {
+    float power = fft_re[bin];
+    if ((power <= fft_re[bin - 1]) || (power < fft_re[bin + 1]) || (power < GPF_DYN_NOTCH_PEAK_THRESHOLD * powerSum / (binMax - binMin + 1))) {
+      continue;
+    }
+
+    uint8_t position = found;
+    while ((position > 0) && (bestPower[position - 1] < power)) {
+      if (position < notchCount) {
+        bestPower[position] = bestPower[position - 1];
+        bestBin[position]   = bestBin[position - 1];
+      }
+      position--;
+    }
+    if (position < notchCount) {
+      bestPower[position] = power;
+      bestBin[position]   = bin;
+      if (found < notchCount) {
+        found++;
+      }
+    }
+  }
+
+  //Interpolation parabolique sur l'amplitude des cases voisines pour être plus précis que la largeur d'une case
+  float peaks[GPF_DYN_NOTCH_MAX_COUNT];
+  for (uint8_t peak = 0; peak < found; peak++) {
+    float y0    = sqrtf(fft_re[bestBin[peak] - 1]);
+    float y1    = sqrtf(fft_re[bestBin[peak]]);
+    float y2    = sqrtf(fft_re[bestBin[peak] + 1]);
+    float denom = y0 - 2 * y1 + y2;
+    float delta = (denom != 0) ? 0.5 * (y0 - y2) / denom : 0;
+
+    peaks[peak] = (bestBin[peak] + delta) * binHz;
+  }
+
+  //Triés par fréquence pour que chaque filtre suive le même pic d'une analyse à l'autre
+  for (uint8_t i = 1; i < found; i++) {
+    for (uint8_t j = i; (j > 0) && (peaks[j - 1] > peaks[j]); j--) {
+      float temp   = peaks[j - 1];
+      peaks[j - 1] = peaks[j];
+      peaks[j]     = temp;
+    }
+  }
+
+  //peakHz[n] est le pic suivi par le filtre n (même ordre que centerHz pour le debug et le black box)
+  for (uint8_t notch = 0; notch < notchCount; notch++) {
+    peakHz[fft_axe][notch] = (notch < found) ? peaks[notch] : 0;
+  }
+
+  for (uint8_t notch = 0; notch < found; notch++) {
+    float center = fminf(fmaxf(peaks[notch], minHz), maxHz);
+
+    if (!notchIsActive[fft_axe][notch]) {
+      centerHz[fft_axe][notch] = center;
+      notches[fft_axe][notch].initializeNotch(center, q, sampleRateHz);
+      notchIsActive[fft_axe][notch] = true;
+    } else {
+      centerHz[fft_axe][notch] += GPF_DYN_NOTCH_CENTER_WEIGHT * (center - centerHz[fft_axe][notch]);
+      notches[fft_axe][notch].setCenter(centerHz[fft_axe][notch]);
+    }
+  }
+}
+
+void GPF_DYN_NOTCH::apply(float *x, float *y, float *z) {
+  for (uint8_t notch = 0; notch < notchCount; notch++) {
+    if (notchIsActive[0][notch]) {
+      *x = notches[0][notch].applyOneAxe(0, *x);
+    }
+    if (notchIsActive[1][notch]) {
+      *y = notches[1][notch].applyOneAxe(0, *y);
+    }
+    if (notchIsActive[2][notch]) {
+      *z = notches[2][notch].applyOneAxe(0, *z);
+    }
+  }
+}
+
+uint8_t GPF_DYN_NOTCH::get_notchCount() {
+  return notchCount;
+}
+
+float GPF_DYN_NOTCH::get_peakHz(uint8_t axe, uint8_t peak) {
+  return peakHz[axe][peak];
+}
+
+float GPF_DYN_NOTCH::get_centerHz(uint8_t axe, uint8_t notch) {
+  return centerHz[axe][notch];
+}
+
+bool GPF_DYN_NOTCH::get_notchIsActive(uint8_t axe, uint8_t notch) {
+  return notchIsActive[axe][notch];
+}
+
+unsigned long GPF_DYN_NOTCH::get_analysisCount() {
+  return analysisCount;
+}
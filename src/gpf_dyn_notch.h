@@ -0,0 +1,76 @@
+/**
+ * @file gpf_dyn_notch.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-30
+ *
+ * Voir fichier gpf_dyn_notch.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_DYN_NOTCH_H
+#define GPF_DYN_NOTCH_H
+
+#include <stdint.h>
+#include "gpf_filter.h"
+
+#define GPF_DYN_NOTCH_FFT_SIZE          128  //Échantillons par analyse (puissance de 2)
+#define GPF_DYN_NOTCH_FFT_SIZE_LOG2     7
+#define GPF_DYN_NOTCH_MAX_COUNT         3    //Filtres coupe-bande par axe
+#define GPF_DYN_NOTCH_PEAK_THRESHOLD    4.0  //Un pic doit avoir au moins n fois la puissance moyenne de la bande analysée
+#define GPF_DYN_NOTCH_CENTER_WEIGHT     0.3  //Poids d'un nouveau pic dans la moyenne du centre d'un filtre coupe-bande
+
+typedef enum {
+    GPF_DYN_NOTCH_STEP_WINDOW,                                      //Copie du tampon circulaire avec fenêtre de Hann
+    GPF_DYN_NOTCH_STEP_FFT_FIRST,                                   //Un étage de papillons par appel
+    GPF_DYN_NOTCH_STEP_PEAKS = GPF_DYN_NOTCH_STEP_FFT_FIRST + GPF_DYN_NOTCH_FFT_SIZE_LOG2, //Recherche des pics et ajustement des filtres
+} gpf_dyn_notch_step_enum;
+
+// Analyseur de spectre du gyro et filtres coupe-bande qui suivent les pics de bruit de chaque axe.
+class GPF_DYN_NOTCH {
+
+    public:
+        GPF_DYN_NOTCH();
+        void  initialize(uint8_t notchCount, float minHz, float maxHz, float q, float sampleRateHz);
+        void  setSampleRate(float sampleRateHz);
+        void  addSample(float x, float y, float z);
+        void  update();
+        void  apply(float *x, float *y, float *z);
+
+        uint8_t       get_notchCount();
+        float         get_peakHz(uint8_t axe, uint8_t peak);
+        float         get_centerHz(uint8_t axe, uint8_t notch);
+        bool          get_notchIsActive(uint8_t axe, uint8_t notch);
+        unsigned long get_analysisCount();
+
+    private:
+        void findPeaks();
+
+        uint8_t notchCount   = 1;
+        float   minHz        = 0;
+        float   maxHz        = 0;
+        float   q            = 1;
+        float   sampleRateHz = 0;
+
+        //Tampon circulaire des derniers échantillons de chaque axe
+        float    samples[GPF_FILTER_AXE_COUNT][GPF_DYN_NOTCH_FFT_SIZE];
+        uint16_t samples_writeIndex = 0;
+
+        //FFT en cours (un axe à la fois)
+        float    fft_re[GPF_DYN_NOTCH_FFT_SIZE];
+        float    fft_im[GPF_DYN_NOTCH_FFT_SIZE];
+        float    fft_window[GPF_DYN_NOTCH_FFT_SIZE];
+        float    fft_twiddleCos[GPF_DYN_NOTCH_FFT_SIZE / 2];
+        float    fft_twiddleSin[GPF_DYN_NOTCH_FFT_SIZE / 2];
+        uint8_t  fft_bitReverse[GPF_DYN_NOTCH_FFT_SIZE];
+        uint8_t  fft_axe  = 0;
+        uint8_t  fft_step = GPF_DYN_NOTCH_STEP_WINDOW;
+        unsigned long analysisCount = 0;
+
+        float            peakHz[GPF_FILTER_AXE_COUNT][GPF_DYN_NOTCH_MAX_COUNT];   //Dernier pic trouvé pour chaque filtre, en ordre de fréquence
+        float            centerHz[GPF_FILTER_AXE_COUNT][GPF_DYN_NOTCH_MAX_COUNT];
+        bool             notchIsActive[GPF_FILTER_AXE_COUNT][GPF_DYN_NOTCH_MAX_COUNT];
+        GPF_FILTER_3AXES notches[GPF_FILTER_AXE_COUNT][GPF_DYN_NOTCH_MAX_COUNT]; //Coefficients propres à chaque axe, on se sert seulement de applyOneAxe()
+};
+
+#endif
@@ -0,0 +1,519 @@
+/**
+ * @file gpf_estimator.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-05
+ *
+ * Estimateurs d'attitude interchangeables (quaternion) utilisés par GPF_IMU pour le mode de vol fm-3.
+ * Le choix se fait dans le menu Configuration -> Estimateur (sauvegardé dans le EEPROM), sans recompiler.
+ *
+ *  - Madgwick: descente de gradient, provient du projet dRehmFlight (Voir GPF_ESTIMATOR_MADGWICK::update()).
+ *  - Mahony:   correction proportionnelle et intégrale (PI) de la vitesse angulaire par l'erreur entre la gravité
+ *              mesurée et la gravité estimée. L'intégrale compense le bias du gyro.
+ *  - EKF:      filtre de Kalman étendu multiplicatif. L'état est l'erreur d'attitude (3 petits angles) et le bias du gyro
+ *              (3 axes), le quaternion lui-même n'est jamais dans la covariance (pas de contrainte de norme à gérer).
+ *              La correction avec l'accéléromètre est sautée quand la norme de l'accélération s'éloigne trop de 1g.
+ *
+ * Précision comparée en rejouant le même vol synthétique dans les trois estimateurs (Voir test/test_estimator.cpp): avec un bias
+ * du gyro et des accélérations linéaires, l'EKF est le plus précis et Madgwick le moins (aucune compensation du bias).
+ * Un estimateur choisi en vol part de l'attitude de celui qu'il remplace (Voir setQuaternion() et GPF_IMU::set_fusion_type()).
+ * Le coût réel sur le Teensy est mesuré en cycles par GPF_IMU (DWT) et affiché par la commande 'e' du port USB.
+ *
+ * Ce fichier n'utilise rien du Teensy et peut être compilé sur un PC.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include "gpf_estimator.h"
+#include "gpf_fast_math.h"
+
+void GPF_ESTIMATOR::reset() {
+  q0 = 1.0f;
+  q1 = 0.0f;
+  q2 = 0.0f;
+  q3 = 0.0f;
+}
+
+void GPF_ESTIMATOR::normalizeQuaternion() {
+  float recipNorm = gpf_fast_math_invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+  q0 *= recipNorm;
+  q1 *= recipNorm;
+  q2 *= recipNorm;
+  q3 *= recipNorm;
+}
+
+// Mêmes conventions que l'ancien GPF_IMU::doFusion_madgwick6DOF()
+void GPF_ESTIMATOR::getEulerDegrees(float *roll, float *pitch, float *yaw) {
+  *roll  =  gpf_fast_math_atan2(q0*q1 + q2*q3, 0.5f - q1*q1 - q2*q2)*GPF_FAST_MATH_RAD_TO_DEG;
+  *pitch = -gpf_fast_math_asin(-2.0f * (q1*q3 - q0*q2))*GPF_FAST_MATH_RAD_TO_DEG;
+  *yaw   = -gpf_fast_math_atan2(q1*q2 + q0*q3, 0.5f - q2*q2 - q3*q3)*GPF_FAST_MATH_RAD_TO_DEG;
+}
+
+void GPF_ESTIMATOR::getQuaternion(float *w, float *x, float *y, float *z) {
+  *w = q0;
+  *x = q1;
+  *y = q2;
+  *z = q3;
+}
+
+// Part de l'attitude d'un autre estimateur quand on change d'estimateur en vol (Voir GPF_IMU::set_fusion_type()).
+// Le bias du gyro (Mahony, EKF) est gardé, c'est le même capteur.
+void GPF_ESTIMATOR::setQuaternion(float w, float x, float y, float z) {
+  q0 = w;
+  q1 = x;
+  q2 = y;
+  q3 = z;
+  normalizeQuaternion();
+}
+
+// Inverse de getEulerDegrees() (mêmes conventions). Pour partir des angles du Complementary filter (fm-2), qui n'a pas de quaternion.
+void GPF_ESTIMATOR::setEulerDegrees(float roll, float pitch, float yaw) {
+  float sinRoll, cosRoll, sinPitch, cosPitch, sinYaw, cosYaw;
+
+  //pitch et yaw de getEulerDegrees() sont les opposés des angles autour de y et z
+  sinRoll  = sinf( 0.5f * roll  * GPF_FAST_MATH_DEG_TO_RAD);
+  cosRoll  = cosf( 0.5f * roll  * GPF_FAST_MATH_DEG_TO_RAD);
+  sinPitch = sinf(-0.5f * pitch * GPF_FAST_MATH_DEG_TO_RAD);
+  cosPitch = cosf(-0.5f * pitch * GPF_FAST_MATH_DEG_TO_RAD);
+  sinYaw   = sinf(-0.5f * yaw   * GPF_FAST_MATH_DEG_TO_RAD);
+  cosYaw   = cosf(-0.5f * yaw   * GPF_FAST_MATH_DEG_TO_RAD);
+
+  //yaw * pitch * roll
+  setQuaternion(cosYaw * cosPitch * cosRoll + sinYaw * sinPitch * sinRoll,
+                cosYaw * cosPitch * sinRoll - sinYaw * sinPitch * cosRoll,
+                cosYaw * sinPitch * cosRoll + sinYaw * cosPitch * sinRoll,
+                sinYaw * cosPitch * cosRoll - cosYaw * sinPitch * sinRoll);
+}
+
+// Erreur d'attitude pour le mode angle calculée directement sur les quaternions, sans atan2() ni asin(), dans les conventions de
+// getEulerDegrees() (roll et pitch en degrés). Le yaw est contrôlé en vitesse, la consigne garde donc le yaw actuel:
+//  - consigne = yaw actuel * pitch désiré * roll désiré (même ordre que getEulerDegrees(), demi angles par gpf_fast_math_sinCosSmall())
+//  - erreur   = q^-1 * consigne, dans le repère de l'avion, puis 2 * partie vectorielle (~ axe * angle pour les petits angles)
+// Le demi angle du yaw vient de la direction de l'axe x de l'avion projeté à l'horizontale (cos et sin du yaw) et non de q0 et q3:
+// ceux-ci ne donnent le yaw que si roll ou pitch est à 0, l'erreur ne serait alors pas nulle à la consigne (9.7 degrés à 40/40).
+// Aucune division (Voir test/test_estimator.cpp).
+void GPF_ESTIMATOR::getTiltErrorDegrees(float rollDesired, float pitchDesired, float *errorRoll, float *errorPitch) {
+  float sinRoll, cosRoll, sinPitch, cosPitch;
+  float headingW = 1.0f;
+  float headingZ = 0.0f;
+  float yawCos   = 1.0f - 2.0f * (q2 * q2 + q3 * q3); //Mêmes termes que le yaw de getEulerDegrees() (au signe près)
+  float yawSin   = 2.0f * (q0 * q3 + q1 * q2);
+  float yawNormSquared = yawCos * yawCos + yawSin * yawSin;
+
+  //pitch de getEulerDegrees() est l'opposé de l'angle autour de l'axe y
+  gpf_fast_math_sinCosSmall( 0.5f * rollDesired  * GPF_FAST_MATH_DEG_TO_RAD, &sinRoll,  &cosRoll);
+  gpf_fast_math_sinCosSmall(-0.5f * pitchDesired * GPF_FAST_MATH_DEG_TO_RAD, &sinPitch, &cosPitch);
+
+  //Demi angle: (cos(y/2), sin(y/2)) est dans la direction de (1 + cos(y), sin(y))
+  if (yawNormSquared > (float)GPF_ESTIMATOR_TILT_ERROR_MIN_HEADING_NORM) {
+    float recipYawNorm    = gpf_fast_math_invSqrt(yawNormSquared);
+    float halfW           = yawCos * recipYawNorm + 1.0f;
+    float halfZ           = yawSin * recipYawNorm;
+    float halfNormSquared = halfW * halfW + halfZ * halfZ;
+
+    if (halfNormSquared > (float)GPF_ESTIMATOR_TILT_ERROR_MIN_HEADING_NORM) {
+      float recipNorm = gpf_fast_math_invSqrt(halfNormSquared);
+      headingW = halfW * recipNorm;
+      headingZ = halfZ * recipNorm;
+    } else {
+      headingW = 0.0f; //Yaw de 180 degrés
+      headingZ = 1.0f;
+    }
+  }
+
+  //Inclinaison désirée (pitch puis roll)
+  float tiltW =  cosPitch * cosRoll;
+  float tiltX =  cosPitch * sinRoll;
+  float tiltY =  sinPitch * cosRoll;
+  float tiltZ = -sinPitch * sinRoll;
+
+  //Consigne = yaw * inclinaison
+  float desiredW = headingW * tiltW - headingZ * tiltZ;
+  float desiredX = headingW * tiltX - headingZ * tiltY;
+  float desiredY = headingW * tiltY + headingZ * tiltX;
+  float desiredZ = headingW * tiltZ + headingZ * tiltW;
+
+  //Erreur = conjugué(q) * consigne (partie vectorielle seulement, et w pour choisir le plus court chemin)
+  float errorW =  q0 * desiredW + q1 * desiredX + q2 * desiredY + q3 * desiredZ;
+  float errorX =  q0 * desiredX - q1 * desiredW - q2 * desiredZ + q3 * desiredY;
+  float errorY =  q0 * desiredY + q1 * desiredZ - q2 * desiredW - q3 * desiredX;
+  float scale  = (errorW < 0.0f) ? -2.0f * GPF_FAST_MATH_RAD_TO_DEG : 2.0f * GPF_FAST_MATH_RAD_TO_DEG;
+
+  *errorRoll  =  errorX * scale;
+  *errorPitch = -errorY * scale;
+}
+
+void GPF_ESTIMATOR::recordCycles(uint32_t cycles) {
+  cyclesLast   = cycles;
+  cyclesTotal += cycles;
+  updateCount++;
+  if (cycles > cyclesMax) {
+    cyclesMax = cycles;
+  }
+}
+
+void GPF_ESTIMATOR::resetCycleStats() {
+  cyclesLast  = 0;
+  cyclesMax   = 0;
+  cyclesTotal = 0;
+  updateCount = 0;
+}
+
+uint32_t GPF_ESTIMATOR::get_cyclesLast() {
+  return cyclesLast;
+}
+
+uint32_t GPF_ESTIMATOR::get_cyclesMax() {
+  return cyclesMax;
+}
+
+float GPF_ESTIMATOR::get_cyclesAverage() {
+  return (updateCount == 0) ? 0 : (float)cyclesTotal / updateCount;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+GPF_ESTIMATOR_MADGWICK::GPF_ESTIMATOR_MADGWICK(float *beta_ptr) {
+  this->beta_ptr = beta_ptr;
+}
+
+const char *GPF_ESTIMATOR_MADGWICK::getName() {
+  return "Madgwick";
+}
+
+void GPF_ESTIMATOR_MADGWICK::update(float gx, float gy, float gz, float ax, float ay, float az, float dt) {
+  // Cette fonction, légèrement adaptée pour ce projet, provient du projet dRehmFlight VTOL Flight Controller de Nicholas Rehm à https://github.com/nickrehm/dRehmFlight
+
+  //DESCRIPTION: Attitude estimation through sensor fusion - 6DOF
+  /*
+   * See description of Madgwick() for more information. This is a 6DOF implimentation for when magnetometer data is not
+   * available (for example when using the recommended MPU6050 IMU for the default setup).
+   * https://github.com/nickrehm/dRehmFlight/blob/master/dRehmFlight%20VTOL%20Documentation.pdf
+   */
+
+  float beta = *beta_ptr;
+  float recipNorm;
+  float s0, s1, s2, s3;
+  float qDot1, qDot2, qDot3, qDot4;
+  float _2q0, _2q1, _2q2, _2q3, _4q0, _4q1, _4q2 ,_8q1, _8q2, q0q0, q1q1, q2q2, q3q3;
+
+  //Rate of change of quaternion from gyroscope
+  qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+  qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+  qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+  qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+  //Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
+  if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+    //Normalise accelerometer measurement
+    recipNorm = gpf_fast_math_invSqrt(ax * ax + ay * ay + az * az);
+    ax *= recipNorm;
+    ay *= recipNorm;
+    az *= recipNorm;
+
+    //Auxiliary variables to avoid repeated arithmetic
+    _2q0 = 2.0f * q0;
+    _2q1 = 2.0f * q1;
+    _2q2 = 2.0f * q2;
+    _2q3 = 2.0f * q3;
+    _4q0 = 4.0f * q0;
+    _4q1 = 4.0f * q1;
+    _4q2 = 4.0f * q2;
+    _8q1 = 8.0f * q1;
+    _8q2 = 8.0f * q2;
+    q0q0 = q0 * q0;
+    q1q1 = q1 * q1;
+    q2q2 = q2 * q2;
+    q3q3 = q3 * q3;
+
+    //Gradient decent algorithm corrective step
+    s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+    s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+    s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+    s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+    recipNorm = gpf_fast_math_invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); //normalise step magnitude
+    s0 *= recipNorm;
+    s1 *= recipNorm;
+    s2 *= recipNorm;
+    s3 *= recipNorm;
+
+    //Apply feedback step
+    qDot1 -= beta * s0;
+    qDot2 -= beta * s1;
+    qDot3 -= beta * s2;
+    qDot4 -= beta * s3;
+  }
+
+  //Integrate rate of change of quaternion to yield quaternion
+  q0 += qDot1 * dt;
+  q1 += qDot2 * dt;
+  q2 += qDot3 * dt;
+  q3 += qDot4 * dt;
+
+  normalizeQuaternion();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const char *GPF_ESTIMATOR_MAHONY::getName() {
+  return "Mahony";
+}
+
+void GPF_ESTIMATOR_MAHONY::reset() {
+  GPF_ESTIMATOR::reset();
+  integralFBx = 0.0f;
+  integralFBy = 0.0f;
+  integralFBz = 0.0f;
+}
+
+void GPF_ESTIMATOR_MAHONY::update(float gx, float gy, float gz, float ax, float ay, float az, float dt) {
+  float recipNorm;
+  float halfvx, halfvy, halfvz;
+  float halfex, halfey, halfez;
+  float qa, qb, qc;
+
+  if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+    recipNorm = gpf_fast_math_invSqrt(ax * ax + ay * ay + az * az);
+    ax *= recipNorm;
+    ay *= recipNorm;
+    az *= recipNorm;
+
+    //Demi gravité estimée dans le repère du capteur
+    halfvx = q1 * q3 - q0 * q2;
+    halfvy = q0 * q1 + q2 * q3;
+    halfvz = q0 * q0 - 0.5f + q3 * q3;
+
+    //Erreur = produit vectoriel entre la gravité mesurée et la gravité estimée
+    halfex = (ay * halfvz - az * halfvy);
+    halfey = (az * halfvx - ax * halfvz);
+    halfez = (ax * halfvy - ay * halfvx);
+
+    if (GPF_ESTIMATOR_MAHONY_TWO_KI > 0.0f) {
+      integralFBx += (float)GPF_ESTIMATOR_MAHONY_TWO_KI * halfex * dt;
+      integralFBy += (float)GPF_ESTIMATOR_MAHONY_TWO_KI * halfey * dt;
+      integralFBz += (float)GPF_ESTIMATOR_MAHONY_TWO_KI * halfez * dt;
+      gx += integralFBx;
+      gy += integralFBy;
+      gz += integralFBz;
+    }
+
+    gx += (float)GPF_ESTIMATOR_MAHONY_TWO_KP * halfex;
+    gy += (float)GPF_ESTIMATOR_MAHONY_TWO_KP * halfey;
+    gz += (float)GPF_ESTIMATOR_MAHONY_TWO_KP * halfez;
+  }
+
+  //Intégration de q' = 0.5 * q * w
+  gx *= 0.5f * dt;
+  gy *= 0.5f * dt;
+  gz *= 0.5f * dt;
+  qa = q0;
+  qb = q1;
+  qc = q2;
+  q0 += (-qb * gx - qc * gy - q3 * gz);
+  q1 += ( qa * gx + qc * gz - q3 * gy);
+  q2 += ( qa * gy - qb * gz + q3 * gx);
+  q3 += ( qa * gz + qb * gy - qc * gx);
+
+  normalizeQuaternion();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+GPF_ESTIMATOR_EKF::GPF_ESTIMATOR_EKF() {
+  reset();
+}
+
+const char *GPF_ESTIMATOR_EKF::getName() {
+  return "EKF";
+}
+
+void GPF_ESTIMATOR_EKF::reset() {
+  GPF_ESTIMATOR::reset();
+  memset(P, 0, sizeof(P));
+  for (uint8_t i = 0; i < 3; i++) {
+    bias[i]         = 0.0f;
+    P[i][i]         = GPF_ESTIMATOR_EKF_INITIAL_ANGLE;
+    P[i + 3][i + 3] = GPF_ESTIMATOR_EKF_INITIAL_BIAS;
+  }
+}
+
+void GPF_ESTIMATOR_EKF::getGyroBias(float *x, float *y, float *z) {
+  *x = bias[0];
+  *y = bias[1];
+  *z = bias[2];
+}
+
+// L'attitude reçue vient d'un estimateur qui a déjà convergé. Avec l'incertitude initiale (GPF_ESTIMATOR_EKF_INITIAL_ANGLE), la
+// première correction sauterait presque entièrement sur l'accéléromètre, accélérations linéaires comprises.
+void GPF_ESTIMATOR_EKF::setQuaternion(float w, float x, float y, float z) {
+  GPF_ESTIMATOR::setQuaternion(w, x, y, z);
+  for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t j = 0; j < 6; j++) {
+      P[i][j] = 0.0f;
+      P[j][i] = 0.0f;
+    }
+    P[i][i] = GPF_ESTIMATOR_EKF_SEEDED_ANGLE;
+  }
+}
+
+void GPF_ESTIMATOR_EKF::update(float gx, float gy, float gz, float ax, float ay, float az, float dt) {
+  float wx = gx - bias[0];
+  float wy = gy - bias[1];
+  float wz = gz - bias[2];
+  float hx = 0.5f * wx * dt;
+  float hy = 0.5f * wy * dt;
+  float hz = 0.5f * wz * dt;
+  float qa = q0;
+  float qb = q1;
+  float qc = q2;
+  float qd = q3;
+
+  //Prédiction: q = q * [1, w*dt/2]
+  q0 = qa - qb * hx - qc * hy - qd * hz;
+  q1 = qb + qa * hx + qc * hz - qd * hy;
+  q2 = qc + qa * hy - qb * hz + qd * hx;
+  q3 = qd + qa * hz + qb * hy - qc * hx;
+  normalizeQuaternion();
+
+  predictCovariance(wx, wy, wz, dt);
+
+  if (!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
+    correctWithAccel(ax, ay, az);
+  }
+}
+
+// P = F * P * Ft + Q avec F = [[I - [w x]dt, -I*dt], [0, I]]
+// Calculé par blocs de 3x3 (P = [[A, B], [Bt, C]]) plutôt qu'avec des produits de matrices 6x6 complètes.
+void GPF_ESTIMATOR_EKF::predictCovariance(float wx, float wy, float wz, float dt) {
+  float R[3][3] = {{ 1.0f,     wz * dt, -wy * dt},
+                   {-wz * dt,  1.0f,     wx * dt},
+                   { wy * dt, -wx * dt,  1.0f   }};
+  float RA[3][3], RB[3][3], A[3][3], B[3][3];
+
+  for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t j = 0; j < 3; j++) {
+      RA[i][j] = R[i][0] * P[0][j]     + R[i][1] * P[1][j]     + R[i][2] * P[2][j];
+      RB[i][j] = R[i][0] * P[0][j + 3] + R[i][1] * P[1][j + 3] + R[i][2] * P[2][j + 3];
+    }
+  }
+
+  //B' = R*B - C*dt
+  for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t j = 0; j < 3; j++) {
+      B[i][j] = RB[i][j] - P[i + 3][j + 3] * dt;
+    }
+  }
+
+  //A' = R*A*Rt - dt*(R*B + (R*B)t) + dt²*C
+  for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t j = i; j < 3; j++) {
+      A[i][j] = RA[i][0] * R[j][0] + RA[i][1] * R[j][1] + RA[i][2] * R[j][2]
+              - dt * (RB[i][j] + RB[j][i]) + dt * dt * P[i + 3][j + 3];
+      A[j][i] = A[i][j];
+    }
+  }
+
+  for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t j = 0; j < 3; j++) {
+      P[i][j]     = A[i][j];
+      P[i][j + 3] = B[i][j];
+      P[j + 3][i] = B[i][j];
+    }
+    P[i][i]         += (float)(GPF_ESTIMATOR_EKF_GYRO_NOISE * GPF_ESTIMATOR_EKF_GYRO_NOISE) * dt;
+    P[i + 3][i + 3] += (float)(GPF_ESTIMATOR_EKF_BIAS_NOISE * GPF_ESTIMATOR_EKF_BIAS_NOISE) * dt;
+  }
+}
+
+// Mesure = gravité normalisée. Prévision g = Rt * [0, 0, 1], jacobienne H = [[g x], 0] (l'erreur d'attitude tourne g).
+void GPF_ESTIMATOR_EKF::correctWithAccel(float ax, float ay, float az) {
+  float normSquared = ax * ax + ay * ay + az * az;
+  float recipNorm   = gpf_fast_math_invSqrt(normSquared);
+  float norm        = normSquared * recipNorm;
+
+  if (fabsf(norm - 1.0f) > (float)GPF_ESTIMATOR_EKF_ACCEL_GATE) {
+    return; //Accélération linéaire trop forte, la mesure ne représente plus la gravité
+  }
+  ax *= recipNorm;
+  ay *= recipNorm;
+  az *= recipNorm;
+
+  float g[3] = {2.0f * (q1 * q3 - q0 * q2),
+                2.0f * (q0 * q1 + q2 * q3),
+                q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3};
+  float H[3][3] = {{ 0.0f, -g[2],  g[1]},
+                   { g[2],  0.0f, -g[0]},
+                   {-g[1],  g[0],  0.0f}};
+  float residual[3] = {ax - g[0], ay - g[1], az - g[2]};
+  float PHt[6][3];
+  float S[3][3];
+  float Sinv[3][3];
+  float K[6][3];
+  float delta[6];
+
+  //P * Ht (seules les 3 premières colonnes de H ne sont pas nulles)
+  for (uint8_t i = 0; i < 6; i++) {
+    for (uint8_t j = 0; j < 3; j++) {
+      PHt[i][j] = P[i][0] * H[j][0] + P[i][1] * H[j][1] + P[i][2] * H[j][2];
+    }
+  }
+
+  //S = H * P * Ht + R
+  for (uint8_t i = 0; i < 3; i++) {
+    for (uint8_t j = 0; j < 3; j++) {
+      S[i][j] = H[i][0] * PHt[0][j] + H[i][1] * PHt[1][j] + H[i][2] * PHt[2][j];
+    }
+    S[i][i] += (float)(GPF_ESTIMATOR_EKF_ACCEL_NOISE * GPF_ESTIMATOR_EKF_ACCEL_NOISE);
+  }
+
+  //Inverse de S par les cofacteurs
+  Sinv[0][0] = S[1][1] * S[2][2] - S[1][2] * S[2][1];
+  Sinv[0][1] = S[0][2] * S[2][1] - S[0][1] * S[2][2];
+  Sinv[0][2] = S[0][1] * S[1][2] - S[0][2] * S[1][1];
+  Sinv[1][0] = S[1][2] * S[2][0] - S[1][0] * S[2][2];
+  Sinv[1][1] = S[0][0] * S[2][2] - S[0][2] * S[2][0];
+  Sinv[1][2] = S[0][2] * S[1][0] - S[0][0] * S[1][2];
+  Sinv[2][0] = S[1][0] * S[2][1] - S[1][1] * S[2][0];
+  Sinv[2][1] = S[0][1] * S[2][0] - S[0][0] * S[2][1];
+  Sinv[2][2] = S[0][0] * S[1][1] - S[0][1] * S[1][0];
+
+  float determinant = S[0][0] * Sinv[0][0] + S[0][1] * Sinv[1][0] + S[0][2] * Sinv[2][0];
+  if (determinant <= 0.0f) {
+    return; //S doit être définie positive, une valeur nulle ou négative indique une covariance corrompue
+  }
+  float recipDeterminant = 1.0f / determinant;
+
+  //K = P * Ht * S^-1, puis correction de l'état
+  for (uint8_t i = 0; i < 6; i++) {
+    for (uint8_t j = 0; j < 3; j++) {
+      K[i][j] = (PHt[i][0] * Sinv[0][j] + PHt[i][1] * Sinv[1][j] + PHt[i][2] * Sinv[2][j]) * recipDeterminant;
+    }
+    delta[i] = K[i][0] * residual[0] + K[i][1] * residual[1] + K[i][2] * residual[2];
+  }
+
+  //P = P - K * H * P (H * P = (P * Ht)t puisque P est symétrique), symétrique gardée en recopiant le triangle supérieur
+  for (uint8_t i = 0; i < 6; i++) {
+    for (uint8_t j = i; j < 6; j++) {
+      P[i][j] -= K[i][0] * PHt[j][0] + K[i][1] * PHt[j][1] + K[i][2] * PHt[j][2];
+      P[j][i]  = P[i][j];
+    }
+  }
+
+  //q = q * [1, delta/2]
+  float hx = 0.5f * delta[0];
+  float hy = 0.5f * delta[1];
+  float hz = 0.5f * delta[2];
+  float qa = q0;
+  float qb = q1;
+  float qc = q2;
+  float qd = q3;
+  q0 = qa - qb * hx - qc * hy - qd * hz;
+  q1 = qb + qa * hx + qc * hz - qd * hy;
+  q2 = qc + qa * hy - qb * hz + qd * hx;
+  q3 = qd + qa * hz + qb * hy - qc * hx;
+  normalizeQuaternion();
+
+  bias[0] += delta[3];
+  bias[1] += delta[4];
+  bias[2] += delta[5];
+}
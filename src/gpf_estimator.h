@@ -0,0 +1,107 @@
+/**
+ * @file gpf_estimator.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-05
+ *
+ * Voir fichier gpf_estimator.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_ESTIMATOR_H
+#define GPF_ESTIMATOR_H
+
+#include <stdint.h>
+
+#define GPF_ESTIMATOR_MAHONY_TWO_KP        1.0     //2 * gain proportionnel //Plus grand = se fie plus vite à l'accéléromètre
+#define GPF_ESTIMATOR_MAHONY_TWO_KI        0.02    //2 * gain intégral //Corrige la dérive (bias) du gyro, 0 pour désactiver
+
+#define GPF_ESTIMATOR_EKF_GYRO_NOISE       0.005   //rad/s //Bruit du gyro
+#define GPF_ESTIMATOR_EKF_BIAS_NOISE       0.0002  //rad/s //Marche aléatoire du bias du gyro par racine(seconde)
+#define GPF_ESTIMATOR_EKF_ACCEL_NOISE      0.15    //g //Bruit de l'accéléromètre (vibrations comprises)
+#define GPF_ESTIMATOR_EKF_ACCEL_GATE       0.25    //g //Pas de correction si la norme de l'accélération s'éloigne de plus de n de 1g
+#define GPF_ESTIMATOR_EKF_INITIAL_ANGLE    0.1     //rad² //Incertitude initiale de l'attitude
+#define GPF_ESTIMATOR_EKF_INITIAL_BIAS     0.0004  //(rad/s)² //Incertitude initiale du bias du gyro
+#define GPF_ESTIMATOR_EKF_SEEDED_ANGLE     0.001   //rad² //Incertitude de l'attitude reçue d'un autre estimateur (Voir setQuaternion())
+
+#define GPF_ESTIMATOR_TILT_ERROR_MIN_HEADING_NORM 0.001 //Sous ce seuil (pitch presque à +/-90 degrés), le yaw n'est plus défini et on garde celui du repère de la terre
+
+// Interface commune des estimateurs d'attitude qui travaillent avec un quaternion.
+// gx, gy, gz en rad/s, ax, ay, az en g, dt en secondes. Axes déjà remis dans la convention de doFusion() (Voir GPF_IMU::doFusion_estimator()).
+class GPF_ESTIMATOR {
+
+    public:
+        virtual ~GPF_ESTIMATOR() {}
+        virtual void        reset();
+        virtual void        update(float gx, float gy, float gz, float ax, float ay, float az, float dt) = 0;
+        virtual const char *getName() = 0;
+
+        void     getEulerDegrees(float *roll, float *pitch, float *yaw);
+        void     getQuaternion(float *w, float *x, float *y, float *z);
+        virtual void setQuaternion(float w, float x, float y, float z);
+        void     setEulerDegrees(float roll, float pitch, float yaw);
+        void     getTiltErrorDegrees(float rollDesired, float pitchDesired, float *errorRoll, float *errorPitch);
+
+        //Coût mesuré par l'appelant (Voir GPF_IMU::doFusion_estimator())
+        void     recordCycles(uint32_t cycles);
+        void     resetCycleStats();
+        uint32_t get_cyclesLast();
+        uint32_t get_cyclesMax();
+        float    get_cyclesAverage();
+
+    protected:
+        void  normalizeQuaternion();
+
+        float q0 = 1.0f;
+        float q1 = 0.0f;
+        float q2 = 0.0f;
+        float q3 = 0.0f;
+
+    private:
+        uint32_t cyclesLast  = 0;
+        uint32_t cyclesMax   = 0;
+        uint64_t cyclesTotal = 0;
+        uint32_t updateCount = 0;
+};
+
+class GPF_ESTIMATOR_MADGWICK : public GPF_ESTIMATOR {
+    public:
+        GPF_ESTIMATOR_MADGWICK(float *beta_ptr);
+        void        update(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+        const char *getName();
+
+    private:
+        float *beta_ptr; //GPF_IMU::B_madgwick
+};
+
+class GPF_ESTIMATOR_MAHONY : public GPF_ESTIMATOR {
+    public:
+        void        reset();
+        void        update(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+        const char *getName();
+
+    private:
+        float integralFBx = 0.0f;
+        float integralFBy = 0.0f;
+        float integralFBz = 0.0f;
+};
+
+// Filtre de Kalman étendu multiplicatif (erreur d'attitude de 3 angles + bias du gyro sur 3 axes)
+class GPF_ESTIMATOR_EKF : public GPF_ESTIMATOR {
+    public:
+        GPF_ESTIMATOR_EKF();
+        void        reset();
+        void        update(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+        const char *getName();
+        void        getGyroBias(float *x, float *y, float *z);
+        void        setQuaternion(float w, float x, float y, float z);
+
+    private:
+        void  predictCovariance(float wx, float wy, float wz, float dt);
+        void  correctWithAccel(float ax, float ay, float az);
+
+        float bias[3];
+        float P[6][6];
+};
+
+#endif
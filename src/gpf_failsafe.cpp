@@ -0,0 +1,155 @@
+/**
+ * @file gpf_failsafe.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-10
+ *
+ * Détection de perte du lien radio par étapes (Voir gpf_failsafe_stage_enum, GPF_CRSF::readRx() et GPF::manageFailSafe()).
+ *
+ * Avant, le fail safe partait seulement après 1 seconde sans aucun frame, et le LQ, le RSSI et le SNR des frames link
+ * statistics (0x14) n'étaient pas utilisés.
+ *
+ * Ici le silence est compté en frames de canaux manqués à la fréquence mesurée par GPF_CRSF: après missedFrames intervalles
+ * sans frame (jamais moins que GPF_FAILSAFE_MISSED_TIME_MIN), on passe en HOLD. Lorsque la moyenne du LQ ou du RSSI est sous
+ * son seuil, le lien est faible (DEGRADED) et on tolère GPF_FAILSAFE_WEAK_LINK_DIVIDER fois moins de frames manqués: une
+ * perte qui arrive après une dégradation est détectée plus vite. Le lien redevient bon seulement lorsque la moyenne dépasse le
+ * seuil d'une marge (GPF_FAILSAFE_LINK_QUALITY_HYSTERESIS, GPF_FAILSAFE_RSSI_HYSTERESIS): un LQ qui oscille autour du seuil
+ * ne fait pas changer d'étape à chaque frame link statistics. Un trou bref se termine en HOLD, sans toucher aux gaz,
+ * et le contrôle revient dès le frame suivant. Après holdTime en HOLD, on passe en LANDING. En LANDING il faut recevoir
+ * des frames sans trou pendant recoveryTime avant de redonner le contrôle.
+ *
+ * Chaque changement d'étape incrémente get_transitionCount(): GPF::logFailSafeStage() le met dans la queue du log
+ * d'information avec les stats du lien à ce moment.
+ *
+ * Voir test/test_failsafe.cpp pour les délais de détection simulés avec les seuils par défaut.
+ *
+ * Ce fichier n'utilise rien du Teensy et peut être compilé sur un PC.
+ *
+ */
+
+#include "gpf_failsafe.h"
+
+GPF_FAILSAFE::GPF_FAILSAFE() {
+  //Rien de spécial dans le constructeur pour le moment
+}
+
+// holdTime et recoveryTime en ms. linkQualityMin et rssiMin à 0 pour ne pas les utiliser.
+void GPF_FAILSAFE::setThresholds(uint8_t missedFrames, uint8_t linkQualityMin, uint8_t rssiMin, uint16_t holdTime, uint16_t recoveryTime) {
+  this->missedFrames   = (missedFrames < 1) ? 1 : missedFrames;
+  this->linkQualityMin = linkQualityMin;
+  this->rssiMin        = rssiMin;
+  holdTimeUs           = holdTime * 1000UL;
+  recoveryTimeUs       = recoveryTime * 1000UL;
+  updateLinkIsWeak();
+}
+
+// now en us (micros()) au démarrage de la réception
+void GPF_FAILSAFE::reset(unsigned long now) {
+  stageEnteredAt     = now;
+  stage              = GPF_FAILSAFE_STAGE_OK;
+  previousStage      = GPF_FAILSAFE_STAGE_OK;
+  recoveryIsStarted  = false;
+  linkIsWeak         = false;
+  linkQualityAverage = 100.0;
+  rssiAverage        = 0.0;
+}
+
+// linkQuality en %, rssi en -dBm de l'antenne active
+void GPF_FAILSAFE::linkStatisticsReceived(uint8_t linkQuality, uint8_t rssi) {
+  linkQualityAverage += GPF_FAILSAFE_LINK_STATISTICS_WEIGHT * (linkQuality - linkQualityAverage);
+  rssiAverage         = (rssiAverage == 0) ? rssi : rssiAverage + GPF_FAILSAFE_LINK_STATISTICS_WEIGHT * (rssi - rssiAverage);
+  updateLinkIsWeak();
+}
+
+// Un lien faible doit dépasser son seuil d'une marge pour redevenir bon
+void GPF_FAILSAFE::updateLinkIsWeak() {
+  float linkQualityLimit = linkQualityMin + (linkIsWeak ? GPF_FAILSAFE_LINK_QUALITY_HYSTERESIS : 0);
+  float rssiLimit        = rssiMin - (linkIsWeak ? GPF_FAILSAFE_RSSI_HYSTERESIS : 0);
+
+  linkIsWeak = ((linkQualityMin > 0) && (linkQualityAverage < linkQualityLimit))
+            || ((rssiMin > 0) && (rssiAverage > rssiLimit)); //-dBm: plus grand = plus faible
+}
+
+// now et lastFrameAt en us (micros()). lastFrameAt doit être lu avant now. Retourne l'étape (gpf_failsafe_stage_enum).
+uint8_t GPF_FAILSAFE::update(unsigned long now, unsigned long lastFrameAt, float frameIntervalUs) {
+  silenceUs     = ((long)(now - lastFrameAt) > 0) ? now - lastFrameAt : 0;
+  missedLimitUs = (unsigned long)(missedFrames * frameIntervalUs) / (linkIsWeak ? GPF_FAILSAFE_WEAK_LINK_DIVIDER : 1);
+  missedLimitUs = (missedLimitUs < GPF_FAILSAFE_MISSED_TIME_MIN) ? GPF_FAILSAFE_MISSED_TIME_MIN : missedLimitUs;
+
+  if (silenceUs > missedLimitUs) {
+    recoveryIsStarted = false;
+
+    if (stage == GPF_FAILSAFE_STAGE_LANDING) {
+      return stage;
+    }
+    if (silenceUs > (missedLimitUs + holdTimeUs)) {
+      setStage(GPF_FAILSAFE_STAGE_LANDING, now);
+    } else if (stage != GPF_FAILSAFE_STAGE_HOLD) {
+      setStage(GPF_FAILSAFE_STAGE_HOLD, now);
+    }
+    return stage;
+  }
+
+  if (stage == GPF_FAILSAFE_STAGE_LANDING) { //Le lien doit être stable avant de redonner le contrôle
+    if (!recoveryIsStarted) {
+      recoveryStartedAt = now;
+      recoveryIsStarted = true;
+    }
+    if ((now - recoveryStartedAt) < recoveryTimeUs) {
+      return stage;
+    }
+    recoveryIsStarted = false;
+  }
+
+  setStage(linkIsWeak ? GPF_FAILSAFE_STAGE_DEGRADED : GPF_FAILSAFE_STAGE_OK, now);
+  return stage;
+}
+
+void GPF_FAILSAFE::setStage(uint8_t newStage, unsigned long now) {
+  if (newStage == stage) {
+    return;
+  }
+
+  previousStage  = stage;
+  stageEnteredAt = now; //Avant stage: la boucle de contrôle qui voit la nouvelle étape lit aussi la bonne heure
+  stage          = newStage;
+  transitionCount++;
+}
+
+uint8_t GPF_FAILSAFE::get_stage() {
+  return stage;
+}
+
+unsigned long GPF_FAILSAFE::get_stageEnteredAt() {
+  return stageEnteredAt;
+}
+
+uint32_t GPF_FAILSAFE::get_transitionCount() {
+  return transitionCount;
+}
+
+uint8_t GPF_FAILSAFE::get_previousStage() {
+  return previousStage;
+}
+
+float GPF_FAILSAFE::get_linkQualityAverage() {
+  return linkQualityAverage;
+}
+
+float GPF_FAILSAFE::get_rssiAverage() {
+  return rssiAverage;
+}
+
+unsigned long GPF_FAILSAFE::get_silenceUs() {
+  return silenceUs;
+}
+
+unsigned long GPF_FAILSAFE::get_missedLimitUs() {
+  return missedLimitUs;
+}
+
+const char *GPF_FAILSAFE::getStageDescription(uint8_t stage) {
+  const char *descriptions[GPF_FAILSAFE_STAGE_ITEM_COUNT] = {"Ok", "Degraded", "Hold", "Landing"};
+
+  return (stage < GPF_FAILSAFE_STAGE_ITEM_COUNT) ? descriptions[stage] : "?";
+}
@@ -0,0 +1,76 @@
+/**
+ * @file gpf_failsafe.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-10
+ *
+ * Voir fichier gpf_failsafe.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_FAILSAFE_H
+#define GPF_FAILSAFE_H
+
+#include <stdint.h>
+
+#define GPF_FAILSAFE_MISSED_TIME_MIN          10000  //us //Jamais moins, peu importe la fréquence des frames
+#define GPF_FAILSAFE_WEAK_LINK_DIVIDER        2      //Frames manqués tolérés divisés par n lorsque le lien est faible
+#define GPF_FAILSAFE_LINK_STATISTICS_WEIGHT   0.3    //Poids d'un nouveau frame link statistics dans les moyennes LQ et RSSI
+#define GPF_FAILSAFE_LINK_QUALITY_HYSTERESIS  10     //% //Le lien faible (DEGRADED) redevient bon seulement à linkQualityMin + n
+#define GPF_FAILSAFE_RSSI_HYSTERESIS          5      //dBm //Le lien faible redevient bon seulement à rssiMin - n (-dBm)
+
+typedef enum {
+    GPF_FAILSAFE_STAGE_OK,       //Lien normal
+    GPF_FAILSAFE_STAGE_DEGRADED, //Frames reçus mais LQ ou RSSI sous les seuils. Rien de changé, seulement signalé
+    GPF_FAILSAFE_STAGE_HOLD,     //Plus de frames: roll, pitch et yaw au neutre, gaz gardés. Les frames qui reviennent reprennent tout de suite
+    GPF_FAILSAFE_STAGE_LANDING,  //Plus de frames depuis le délai de HOLD: les gaz descendent puis les moteurs arrêtent (Voir GPF::failSafe_overrideSticks())
+
+    GPF_FAILSAFE_STAGE_ITEM_COUNT // MUST BE LAST
+} gpf_failsafe_stage_enum;
+
+// Fail safe par étapes selon les frames de canaux manqués et la tendance de LQ et RSSI (Voir GPF_CRSF::readRx()).
+class GPF_FAILSAFE {
+
+    public:
+        GPF_FAILSAFE();
+        void     setThresholds(uint8_t missedFrames, uint8_t linkQualityMin, uint8_t rssiMin, uint16_t holdTime, uint16_t recoveryTime);
+        void     reset(unsigned long now);
+        void     linkStatisticsReceived(uint8_t linkQuality, uint8_t rssi);
+        uint8_t  update(unsigned long now, unsigned long lastFrameAt, float frameIntervalUs);
+
+        uint8_t       get_stage();
+        unsigned long get_stageEnteredAt();
+        uint32_t      get_transitionCount();
+        uint8_t       get_previousStage();
+        float         get_linkQualityAverage();
+        float         get_rssiAverage();
+        unsigned long get_silenceUs();
+        unsigned long get_missedLimitUs();
+
+        static const char *getStageDescription(uint8_t stage);
+
+    private:
+        void     setStage(uint8_t newStage, unsigned long now);
+        void     updateLinkIsWeak();
+
+        uint8_t  missedFrames       = 10;
+        uint8_t  linkQualityMin     = 0;     //% //0 = pas de seuil
+        uint8_t  rssiMin            = 0;     //-dBm (ex: 105 pour -105dBm) //0 = pas de seuil
+        unsigned long holdTimeUs     = 0;
+        unsigned long recoveryTimeUs = 0;
+
+        volatile uint8_t       stage         = GPF_FAILSAFE_STAGE_OK;  //Lu par la boucle de contrôle
+        volatile unsigned long stageEnteredAt = 0;                     //us //Écrit avant stage
+        uint8_t       previousStage         = GPF_FAILSAFE_STAGE_OK;
+        uint32_t      transitionCount       = 0;
+        unsigned long recoveryStartedAt     = 0;     //us //Premier frame d'une suite sans trou pendant LANDING
+        bool          recoveryIsStarted     = false;
+
+        bool          linkIsWeak            = false; //LQ ou RSSI sous son seuil (Voir updateLinkIsWeak())
+        float         linkQualityAverage    = 100.0; //%
+        float         rssiAverage           = 0.0;   //-dBm //0 = aucun frame link statistics reçu
+        unsigned long silenceUs             = 0;     //Au dernier update()
+        unsigned long missedLimitUs         = 0;     //Au dernier update()
+};
+
+#endif
@@ -0,0 +1,112 @@
+/**
+ * @file gpf_fast_math.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-03
+ *
+ * Fonctions mathématiques rapides en simple précision pour l'estimation de l'attitude (boucle de contrôle).
+ *
+ * Les fonctions de la librairie standard (atan2, asin, atan, sqrt) sont appelées en double précision quand on leur passe
+ * un double (ex: constante 57.29577951), ce qui est émulé en logiciel sur le Teensy 4.1 (FPU simple précision seulement).
+ * Ici tout reste en float et les fonctions sont des polynômes sans branchement coûteux.
+ *
+ * Erreur maximale sur tout le domaine comparé à la version double de la librairie standard (Voir test/test_fast_math.cpp):
+ *   gpf_fast_math_atan()     1.9e-06 rad  (0.0001 degré)
+ *   gpf_fast_math_atan2()    2.0e-06 rad  (0.0001 degré)
+ *   gpf_fast_math_asin()     3.0e-07 rad  (0.00002 degré) //Valeurs hors de [-1, 1] ramenées à +/-1 plutôt que NaN
+ *   gpf_fast_math_invSqrt()  4.7e-06 erreur relative      //Deux itérations de Newton
+ *   gpf_fast_math_sinCosSmall() 3.7e-07 entre -pi/4 et pi/4 //Demi angles des consignes (Voir GPF_ESTIMATOR::getTiltErrorDegrees())
+ *
+ * Les durées comparées à la librairie standard en double sont mesurées par make -C test bench. Sur le Teensy l'écart est
+ * plus grand pour atan2, asin et atan puisque la version double n'a pas de FPU.
+ *
+ */
+
+#ifndef GPF_FAST_MATH_H
+#define GPF_FAST_MATH_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#define GPF_FAST_MATH_PI           3.14159265f
+#define GPF_FAST_MATH_HALF_PI      1.57079633f
+#define GPF_FAST_MATH_RAD_TO_DEG   57.2957795f
+#define GPF_FAST_MATH_DEG_TO_RAD   0.0174532925f
+
+// atan() sur [-1, 1] (polynôme minimax de degré 11, Hastings)
+static inline float gpf_fast_math_atanUnit(float x) {
+  float x2 = x * x;
+  return x * (0.99997726f + x2 * (-0.33262347f + x2 * (0.19354346f + x2 * (-0.11643287f + x2 * (0.05265332f + x2 * -0.01172120f)))));
+}
+
+static inline float gpf_fast_math_atan(float x) {
+  if (x > 1.0f) {
+    return GPF_FAST_MATH_HALF_PI - gpf_fast_math_atanUnit(1.0f / x);
+  }
+  if (x < -1.0f) {
+    return -GPF_FAST_MATH_HALF_PI - gpf_fast_math_atanUnit(1.0f / x);
+  }
+  return gpf_fast_math_atanUnit(x);
+}
+
+// Même convention que atan2(): résultat entre -pi et pi, 0 si x et y sont à 0
+static inline float gpf_fast_math_atan2(float y, float x) {
+  float absX = (x < 0) ? -x : x;
+  float absY = (y < 0) ? -y : y;
+  float angle;
+
+  if ((absX == 0) && (absY == 0)) {
+    return 0;
+  }
+
+  if (absX >= absY) {
+    angle = gpf_fast_math_atanUnit(absY / absX);
+  } else {
+    angle = GPF_FAST_MATH_HALF_PI - gpf_fast_math_atanUnit(absX / absY);
+  }
+
+  if (x < 0) {
+    angle = GPF_FAST_MATH_PI - angle;
+  }
+  return (y < 0) ? -angle : angle;
+}
+
+// Réciproque de la racine carrée (approximation par les bits du float puis deux itérations de Newton)
+static inline float gpf_fast_math_invSqrt(float x) {
+  float    halfX = 0.5f * x;
+  float    y;
+  uint32_t i;
+
+  memcpy(&i, &x, sizeof(i));
+  i = 0x5f375a86 - (i >> 1);
+  memcpy(&y, &i, sizeof(y));
+  y = y * (1.5f - halfX * y * y);
+  y = y * (1.5f - halfX * y * y);
+  return y;
+}
+
+// asin(x) = pi/2 - racine(1 - x) * polynôme (Abramowitz et Stegun 4.4.46). sqrtf() est une seule instruction (VSQRT) sur le Teensy 4.1.
+static inline float gpf_fast_math_asin(float x) {
+  float absX = (x < 0) ? -x : x;
+  float angle;
+
+  if (absX >= 1.0f) {
+    angle = GPF_FAST_MATH_HALF_PI;
+  } else {
+    float oneMinusX = 1.0f - absX;
+    angle = GPF_FAST_MATH_HALF_PI - sqrtf(oneMinusX) *
+            (1.5707963050f + absX * (-0.2145988016f + absX * (0.0889789874f + absX * (-0.0501743046f +
+             absX * (0.0308918810f + absX * (-0.0170881256f + absX * (0.0066700901f + absX * -0.0012624911f)))))));
+  }
+  return (x < 0) ? -angle : angle;
+}
+
+// sin et cos d'un petit angle (séries de Taylor jusqu'à x^7 et x^8), précis seulement entre -pi/4 et pi/4
+static inline void gpf_fast_math_sinCosSmall(float x, float *sinX, float *cosX) {
+  float x2 = x * x;
+  *sinX = x * (1.0f + x2 * (-1.0f / 6.0f + x2 * (1.0f / 120.0f + x2 * (-1.0f / 5040.0f))));
+  *cosX = 1.0f + x2 * (-0.5f + x2 * (1.0f / 24.0f + x2 * (-1.0f / 720.0f + x2 * (1.0f / 40320.0f))));
+}
+
+#endif
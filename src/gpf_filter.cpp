@@ -0,0 +1,278 @@
+/**
+ * @file gpf_filter.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-28
+ *
+ * Filtres passe-bas PT1, PT2 et biquad (Butterworth) configurés par fréquence de coupure en Hz.
+ *
+ * Les anciens filtres (B_gyro, B_accel) étaient des moyennes mobiles exponentielles dont le coefficient était fixe.
+ * Leur fréquence de coupure dépendait donc de la vitesse de la boucle (B=0.1 donne environ 34hz à 2khz mais 8hz à 500hz).
+ * Ici on donne la fréquence de coupure voulue et les coefficients sont recalculés à partir de la fréquence d'échantillonnage
+ * mesurée (Voir setSampleRate()).
+ *
+ * Si les paramètres sont invalides (coupure ou fréquence d'échantillonnage à 0), le filtre laisse passer le signal sans
+ * changer le type configuré. Il reprend dès qu'un appel à setSampleRate() ou setCenter() donne des paramètres valides.
+ *
+ * Au premier échantillon (et après reset()), les états sont placés en régime permanent pour cette valeur. Sinon la sortie
+ * partirait de 0 et le gyro ou l'accéléromètre afficheraient une rampe au démarrage.
+ *
+ * Réponse en fréquence (délai à 10hz, atténuation à 300hz) comparée à l'ancien EMA dans test/test_filter.cpp.
+ *
+ * Ce fichier n'utilise rien du Teensy et peut être compilé sur un PC.
+ *
+ */
+
+#include <math.h>
+#include "gpf_filter.h"
+
+GPF_FILTER_3AXES::GPF_FILTER_3AXES() {
+  reset();
+}
+
+void GPF_FILTER_3AXES::initialize(uint8_t type, float cutoffHz, float sampleRateHz) {
+  this->type         = type;
+  this->cutoffHz     = cutoffHz;
+  this->sampleRateHz = sampleRateHz;
+  this->q            = GPF_FILTER_BIQUAD_Q;
+  computeCoefficients();
+  reset();
+}
+
+// Coupe-bande centré sur centerHz. Plus q est grand, plus la bande coupée est étroite (largeur d'environ centerHz/q).
+void GPF_FILTER_3AXES::initializeNotch(float centerHz, float q, float sampleRateHz) {
+  this->type         = GPF_FILTER_TYPE_NOTCH;
+  this->cutoffHz     = centerHz;
+  this->sampleRateHz = sampleRateHz;
+  this->q            = q;
+  computeCoefficients();
+  reset();
+}
+
+// Déplace le centre d'un coupe-bande sans remettre les états à 0 pour ne pas créer de saut dans le signal.
+void GPF_FILTER_3AXES::setCenter(float centerHz) {
+  if (centerHz <= 0) {
+    return;
+  }
+
+  this->cutoffHz = centerHz;
+  computeCoefficients();
+}
+
+// À appeler avec la fréquence d'échantillonnage mesurée. Les coefficients sont recalculés seulement si elle a vraiment changé.
+void GPF_FILTER_3AXES::setSampleRate(float sampleRateHz) {
+  if ((sampleRateHz <= 0) || (fabsf(sampleRateHz - this->sampleRateHz) <= (GPF_FILTER_SAMPLE_RATE_TOLERANCE * this->sampleRateHz))) {
+    return;
+  }
+
+  this->sampleRateHz = sampleRateHz;
+  computeCoefficients();
+}
+
+// Comme setCenter() mais avec cos et sin de 2*pi*centerHz/sampleRateHz déjà calculés (Voir gpf_harmonic_notch.cpp).
+// Aucune fonction trigonométrique, seulement une division.
+void GPF_FILTER_3AXES::setNotchCenter(float centerHz, float cosOmega, float sinOmega) {
+  float alpha = sinOmega / (2.0 * q);
+  float a0inv = 1.0 / (1.0 + alpha);
+
+  if (isBypassed && (type == GPF_FILTER_TYPE_NOTCH) && (centerHz > 0)) {
+    isBypassed = false;
+    reset();
+  }
+
+  cutoffHz = centerHz;
+  b0 = a0inv;
+  b1 = -2.0 * cosOmega * a0inv;
+  b2 = b0;
+  a1 = b1;
+  a2 = (1.0 - alpha) * a0inv;
+}
+
+void GPF_FILTER_3AXES::reset() {
+  for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+    state1[axe]   = 0;
+    state2[axe]   = 0;
+    isSeeded[axe] = false;
+  }
+}
+
+// Place les états d'un axe en régime permanent pour une entrée constante égale à input.
+void GPF_FILTER_3AXES::seedOneAxe(uint8_t axe, float input) {
+  float output;
+
+  switch (type) {
+    case GPF_FILTER_TYPE_PT1:
+    case GPF_FILTER_TYPE_PT2:
+      state1[axe] = input;
+      state2[axe] = input;
+      break;
+
+    case GPF_FILTER_TYPE_BIQUAD:
+    case GPF_FILTER_TYPE_NOTCH:
+      output      = input * (b0 + b1 + b2) / (1.0 + a1 + a2); //Gain DC, 1 pour le passe-bas et le coupe-bande
+      state2[axe] = b2 * input - a2 * output;
+      state1[axe] = b1 * input - a1 * output + state2[axe];
+      break;
+  }
+
+  isSeeded[axe] = true;
+}
+
+void GPF_FILTER_3AXES::computeCoefficients() {
+  float cutoff = cutoffHz;
+
+  if ((type == GPF_FILTER_TYPE_NONE) || (cutoffHz <= 0) || (sampleRateHz <= 0)) {
+    isBypassed = true;
+    return;
+  }
+
+  if (isBypassed) {
+    //Les états n'ont pas suivi le signal pendant qu'on le laissait passer, on repart du prochain échantillon.
+    isBypassed = false;
+    reset();
+  }
+
+  cutoff = fminf(cutoff, sampleRateHz * 0.45); //Sous Nyquist
+
+  switch (type) {
+    case GPF_FILTER_TYPE_PT1:
+    case GPF_FILTER_TYPE_PT2: {
+      if (type == GPF_FILTER_TYPE_PT2) {
+        cutoff = cutoff * 1.553774; //Chaque étage plus haut pour que la cascade coupe à -3dB à cutoffHz (1/racine(racine(2)-1))
+      }
+      float rc = 1.0 / (2.0 * M_PI * cutoff);
+      float dt = 1.0 / sampleRateHz;
+      k = dt / (rc + dt);
+      break;
+    }
+
+    case GPF_FILTER_TYPE_BIQUAD:
+    case GPF_FILTER_TYPE_NOTCH: {
+      float omega = 2.0 * M_PI * cutoff / sampleRateHz;
+      float sn    = sinf(omega);
+      float cs    = cosf(omega);
+      float alpha = sn / (2.0 * q);
+      float a0    = 1.0 + alpha;
+
+      if (type == GPF_FILTER_TYPE_NOTCH) {
+        b0 = 1.0 / a0;
+        b1 = (-2.0 * cs) / a0;
+      } else {
+        b0 = ((1.0 - cs) / 2.0) / a0;
+        b1 = (1.0 - cs) / a0;
+      }
+      b2 = b0;
+      a1 = (-2.0 * cs) / a0;
+      a2 = (1.0 - alpha) / a0;
+      break;
+    }
+  }
+}
+
+float GPF_FILTER_3AXES::applyOneAxe(uint8_t axe, float input) {
+  float output;
+
+  if (isBypassed) {
+    return input;
+  }
+
+  if (!isSeeded[axe]) {
+    seedOneAxe(axe, input);
+  }
+
+  switch (type) {
+    case GPF_FILTER_TYPE_PT1:
+      state1[axe] += k * (input - state1[axe]);
+      return state1[axe];
+
+    case GPF_FILTER_TYPE_PT2:
+      state1[axe] += k * (input - state1[axe]);
+      state2[axe] += k * (state1[axe] - state2[axe]);
+      return state2[axe];
+
+    case GPF_FILTER_TYPE_BIQUAD:
+    case GPF_FILTER_TYPE_NOTCH:
+      output      = b0 * input + state1[axe];
+      state1[axe] = b1 * input - a1 * output + state2[axe];
+      state2[axe] = b2 * input - a2 * output;
+      return output;
+
+    default:
+      return input;
+  }
+}
+
+// Filtre les 3 axes en place. Un seul choix de type pour les 3 axes puis les mêmes coefficients sur chaque tableau d'états.
+void GPF_FILTER_3AXES::apply(float *x, float *y, float *z) {
+  float input[GPF_FILTER_AXE_COUNT] = {*x, *y, *z};
+  float output[GPF_FILTER_AXE_COUNT];
+
+  if (isBypassed) {
+    return;
+  }
+
+  if (!isSeeded[0]) {
+    for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+      seedOneAxe(axe, input[axe]);
+    }
+  }
+
+  switch (type) {
+    case GPF_FILTER_TYPE_PT1:
+      for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+        state1[axe] += k * (input[axe] - state1[axe]);
+        output[axe]  = state1[axe];
+      }
+      break;
+
+    case GPF_FILTER_TYPE_PT2:
+      for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+        state1[axe] += k * (input[axe] - state1[axe]);
+        state2[axe] += k * (state1[axe] - state2[axe]);
+        output[axe]  = state2[axe];
+      }
+      break;
+
+    case GPF_FILTER_TYPE_BIQUAD:
+    case GPF_FILTER_TYPE_NOTCH:
+      for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+        output[axe] = b0 * input[axe] + state1[axe];
+        state1[axe] = b1 * input[axe] - a1 * output[axe] + state2[axe];
+        state2[axe] = b2 * input[axe] - a2 * output[axe];
+      }
+      break;
+
+    default:
+      return;
+  }
+
+  *x = output[0];
+  *y = output[1];
+  *z = output[2];
+}
+
+uint8_t GPF_FILTER_3AXES::get_type() {
+  return type;
+}
+
+bool GPF_FILTER_3AXES::get_isBypassed() {
+  return isBypassed;
+}
+
+float GPF_FILTER_3AXES::get_cutoffHz() {
+  return cutoffHz;
+}
+
+float GPF_FILTER_3AXES::get_sampleRateHz() {
+  return sampleRateHz;
+}
+
+const char *GPF_FILTER_3AXES::getTypeDescription(uint8_t type) {
+  switch (type) {
+    case GPF_FILTER_TYPE_PT1:    return "PT1";
+    case GPF_FILTER_TYPE_PT2:    return "PT2";
+    case GPF_FILTER_TYPE_BIQUAD: return "Biquad";
+    case GPF_FILTER_TYPE_NOTCH:  return "Notch";
+    default:                     return "None";
+  }
+}
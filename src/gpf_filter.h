@@ -0,0 +1,71 @@
+/**
+ * @file gpf_filter.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-28
+ *
+ * Voir fichier gpf_filter.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_FILTER_H
+#define GPF_FILTER_H
+
+#include <stdint.h>
+
+#define GPF_FILTER_AXE_COUNT                3
+#define GPF_FILTER_SAMPLE_RATE_TOLERANCE    0.02 //On recalcule les coefficients seulement si la fréquence d'échantillonnage a changé de plus de 2%
+#define GPF_FILTER_BIQUAD_Q                 0.70710678 //Butterworth (1/racine(2))
+
+typedef enum {
+    GPF_FILTER_TYPE_NONE,
+    GPF_FILTER_TYPE_PT1,      //Premier ordre (-20dB/décade), le moins de délai
+    GPF_FILTER_TYPE_PT2,      //Deux PT1 en série (-40dB/décade)
+    GPF_FILTER_TYPE_BIQUAD,   //Butterworth deuxième ordre (-40dB/décade), coupure plus franche que PT2
+    GPF_FILTER_TYPE_NOTCH,    //Coupe-bande biquad centré sur cutoffHz (Voir initializeNotch())
+
+    GPF_FILTER_TYPE_ITEM_COUNT // MUST BE LAST
+} gpf_filter_type_enum;
+
+// Filtre passe-bas appliqué aux 3 axes d'un coup. Les états sont rangés par terme (struct of arrays) pour que les 3 axes
+// soient mis à jour ensemble avec les mêmes coefficients.
+class GPF_FILTER_3AXES {
+
+    public:
+        GPF_FILTER_3AXES();
+        void  initialize(uint8_t type, float cutoffHz, float sampleRateHz);
+        void  initializeNotch(float centerHz, float q, float sampleRateHz);
+        void  setCenter(float centerHz);
+        void  setNotchCenter(float centerHz, float cosOmega, float sinOmega);
+        void  setSampleRate(float sampleRateHz);
+        void  reset();
+        void  apply(float *x, float *y, float *z);
+        float applyOneAxe(uint8_t axe, float input);
+
+        uint8_t     get_type();
+        bool        get_isBypassed();
+        float       get_cutoffHz();
+        float       get_sampleRateHz();
+        static const char *getTypeDescription(uint8_t type);
+
+    private:
+        void computeCoefficients();
+        void seedOneAxe(uint8_t axe, float input);
+
+        uint8_t type         = GPF_FILTER_TYPE_NONE;
+        float   cutoffHz     = 0;
+        float   sampleRateHz = 0;
+        float   q            = GPF_FILTER_BIQUAD_Q; //Biquad et coupe-bande
+        bool    isBypassed   = true; //Paramètres invalides, le signal passe sans filtre mais type est conservé
+
+        //PT1 et PT2
+        float   k = 1;
+        //Biquad (forme directe II transposée)
+        float   b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+
+        float   state1[GPF_FILTER_AXE_COUNT];
+        float   state2[GPF_FILTER_AXE_COUNT];
+        bool    isSeeded[GPF_FILTER_AXE_COUNT]; //Faux jusqu'au premier échantillon (Voir seedOneAxe())
+};
+
+#endif
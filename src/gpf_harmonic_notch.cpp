@@ -0,0 +1,152 @@
+/**
+ * @file gpf_harmonic_notch.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-01
+ *
+ * Filtres coupe-bande sur le bruit des moteurs dont la fréquence suit les gaz. Alternative peu coûteuse à gpf_dyn_notch.cpp.
+ *
+ * La fréquence du fondamental est lue sur une courbe gaz -> hz (points également espacés de 0 à 1, interpolation linéaire)
+ * et les harmoniques sont des multiples du fondamental.
+ *
+ * Pour que le coût soit constant, update() ne fait aucun calcul trigonométrique:
+ *  - cos et sin du fondamental sont tournés de l'écart depuis le dernier appel (approximation des petits angles, puis
+ *    renormalisation d'un pas de Newton). L'écart est limité à GPF_HARMONIC_NOTCH_MAX_STEP_HZ par appel.
+ *  - cos et sin de chaque harmonique viennent de la récurrence cos((n+1)w) = 2cos(w)cos(nw) - cos((n-1)w) (idem pour sin).
+ *  - Les coefficients de chaque filtre sont ensuite obtenus avec une seule division (GPF_FILTER_3AXES::setNotchCenter()).
+ * Les erreurs d'arrondi s'accumulent lentement (0.08hz après 100000 déplacements aléatoires), cos et sin sont donc recalculés
+ * avec cosf() et sinf() à tous les GPF_HARMONIC_NOTCH_RESYNC_INTERVAL déplacements ou si la fréquence d'échantillonnage change.
+ *
+ * Réponse en fréquence et dérive vérifiées dans test/test_harmonic_notch.cpp (make -C test, durées avec make -C test bench).
+ *
+ * Ce fichier n'utilise rien du Teensy et peut être compilé sur un PC.
+ *
+ */
+
+#include <math.h>
+#include "gpf_harmonic_notch.h"
+
+GPF_HARMONIC_NOTCH::GPF_HARMONIC_NOTCH() {
+
+}
+
+void GPF_HARMONIC_NOTCH::initialize(const float *curveHz, uint8_t curvePointCount, uint8_t harmonicCount, float q, float sampleRateHz) {
+  this->curvePointCount = (curvePointCount > GPF_HARMONIC_NOTCH_MAX_CURVE_POINTS) ? GPF_HARMONIC_NOTCH_MAX_CURVE_POINTS : curvePointCount;
+  this->harmonicCount   = (harmonicCount > GPF_HARMONIC_NOTCH_MAX_HARMONICS) ? GPF_HARMONIC_NOTCH_MAX_HARMONICS : harmonicCount;
+  this->sampleRateHz    = sampleRateHz;
+
+  for (uint8_t point = 0; point < this->curvePointCount; point++) {
+    this->curveHz[point] = curveHz[point];
+  }
+
+  fundamentalHz = getCurveHz(0);
+  computeFundamental();
+
+  for (uint8_t harmonic = 0; harmonic < this->harmonicCount; harmonic++) {
+    notches[harmonic].initializeNotch(fundamentalHz * (harmonic + 1), q, sampleRateHz);
+  }
+  computeHarmonics();
+}
+
+void GPF_HARMONIC_NOTCH::setSampleRate(float sampleRateHz) {
+  if ((sampleRateHz <= 0) || (fabsf(sampleRateHz - this->sampleRateHz) <= (GPF_FILTER_SAMPLE_RATE_TOLERANCE * this->sampleRateHz))) {
+    return;
+  }
+
+  this->sampleRateHz = sampleRateHz;
+  computeFundamental();
+  computeHarmonics();
+}
+
+// Calcul exact de cos et sin du fondamental
+void GPF_HARMONIC_NOTCH::computeFundamental() {
+  fundamental_cos = cosf(2.0 * M_PI * fundamentalHz / sampleRateHz);
+  fundamental_sin = sinf(2.0 * M_PI * fundamentalHz / sampleRateHz);
+  stepCount       = 0;
+}
+
+// throttle entre 0 et 1
+void GPF_HARMONIC_NOTCH::update(float throttle) {
+  float step = getCurveHz(throttle) - fundamentalHz;
+
+  if (step == 0) {
+    return;
+  }
+  step = fminf(fmaxf(step, -GPF_HARMONIC_NOTCH_MAX_STEP_HZ), GPF_HARMONIC_NOTCH_MAX_STEP_HZ);
+
+  float delta       = 2.0 * M_PI * step / sampleRateHz;
+  float delta2      = delta * delta;
+  float delta_cos   = 1.0 - delta2 / 2.0;
+  float delta_sin   = delta * (1.0 - delta2 / 6.0);
+  float rotated_cos = fundamental_cos * delta_cos - fundamental_sin * delta_sin;
+  float rotated_sin = fundamental_sin * delta_cos + fundamental_cos * delta_sin;
+  float norm        = (3.0 - (rotated_cos * rotated_cos + rotated_sin * rotated_sin)) / 2.0; //Approximation de 1/racine(x) près de 1
+
+  fundamental_cos = rotated_cos * norm;
+  fundamental_sin = rotated_sin * norm;
+  fundamentalHz  += step;
+
+  if (++stepCount >= GPF_HARMONIC_NOTCH_RESYNC_INTERVAL) {
+    computeFundamental();
+  }
+  computeHarmonics();
+}
+
+void GPF_HARMONIC_NOTCH::computeHarmonics() {
+  float cos_previous = 1; //Harmonique 0
+  float sin_previous = 0;
+  float cos_current  = fundamental_cos;
+  float sin_current  = fundamental_sin;
+
+  for (uint8_t harmonic = 0; harmonic < harmonicCount; harmonic++) {
+    float centerHz = fundamentalHz * (harmonic + 1);
+
+    harmonicIsActive[harmonic] = (centerHz < sampleRateHz * GPF_HARMONIC_NOTCH_NYQUIST_MARGIN);
+    if (harmonicIsActive[harmonic]) {
+      notches[harmonic].setNotchCenter(centerHz, cos_current, sin_current);
+    }
+
+    float cos_next = 2.0 * fundamental_cos * cos_current - cos_previous;
+    float sin_next = 2.0 * fundamental_cos * sin_current - sin_previous;
+    cos_previous = cos_current;
+    sin_previous = sin_current;
+    cos_current  = cos_next;
+    sin_current  = sin_next;
+  }
+}
+
+float GPF_HARMONIC_NOTCH::getCurveHz(float throttle) {
+  float position;
+  uint8_t point;
+
+  if (curvePointCount == 0) {
+    return 0;
+  }
+  if (curvePointCount == 1) {
+    return curveHz[0];
+  }
+
+  position = fminf(fmaxf(throttle, 0.0), 1.0) * (curvePointCount - 1);
+  point    = (uint8_t)position;
+  if (point >= curvePointCount - 1) {
+    return curveHz[curvePointCount - 1];
+  }
+
+  return curveHz[point] + (position - point) * (curveHz[point + 1] - curveHz[point]);
+}
+
+void GPF_HARMONIC_NOTCH::apply(float *x, float *y, float *z) {
+  for (uint8_t harmonic = 0; harmonic < harmonicCount; harmonic++) {
+    if (harmonicIsActive[harmonic]) {
+      notches[harmonic].apply(x, y, z);
+    }
+  }
+}
+
+float GPF_HARMONIC_NOTCH::get_fundamentalHz() {
+  return fundamentalHz;
+}
+
+uint8_t GPF_HARMONIC_NOTCH::get_harmonicCount() {
+  return harmonicCount;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file gpf_harmonic_notch.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-01
+ *
+ * Voir fichier gpf_harmonic_notch.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_HARMONIC_NOTCH_H
+#define GPF_HARMONIC_NOTCH_H
+
+#include <stdint.h>
+#include "gpf_filter.h"
+
+#define GPF_HARMONIC_NOTCH_MAX_HARMONICS     4    //Fondamental compris
+#define GPF_HARMONIC_NOTCH_MAX_CURVE_POINTS  9
+#define GPF_HARMONIC_NOTCH_MAX_STEP_HZ       10.0 //hz //Déplacement maximum du fondamental par update(), garde la rotation incrémentale précise
+#define GPF_HARMONIC_NOTCH_NYQUIST_MARGIN    0.45 //Une harmonique au-dessus de sampleRateHz * n n'est pas filtrée
+#define GPF_HARMONIC_NOTCH_RESYNC_INTERVAL   1000 //Déplacements du fondamental entre deux recalculs exacts de cos et sin (accumulation des erreurs d'arrondi)
+
+// Banc de filtres coupe-bande sur le fondamental du bruit des moteurs et ses harmoniques. Le fondamental suit les gaz.
+class GPF_HARMONIC_NOTCH {
+
+    public:
+        GPF_HARMONIC_NOTCH();
+        void  initialize(const float *curveHz, uint8_t curvePointCount, uint8_t harmonicCount, float q, float sampleRateHz);
+        void  setSampleRate(float sampleRateHz);
+        void  update(float throttle);
+        void  apply(float *x, float *y, float *z);
+
+        float   get_fundamentalHz();
+        uint8_t get_harmonicCount();
+
+    private:
+        float getCurveHz(float throttle);
+        void  computeFundamental();
+        void  computeHarmonics();
+
+        float   curveHz[GPF_HARMONIC_NOTCH_MAX_CURVE_POINTS];
+        uint8_t curvePointCount = 0;
+        uint8_t harmonicCount   = 0;
+        float   sampleRateHz    = 0;
+
+        float   fundamentalHz   = 0;
+        float   fundamental_cos = 1; //cos(2*pi*fundamentalHz/sampleRateHz)
+        float   fundamental_sin = 0; //sin(2*pi*fundamentalHz/sampleRateHz)
+        uint16_t stepCount      = 0; //Depuis le dernier recalcul exact
+
+        bool             harmonicIsActive[GPF_HARMONIC_NOTCH_MAX_HARMONICS];
+        GPF_FILTER_3AXES notches[GPF_HARMONIC_NOTCH_MAX_HARMONICS];
+};
+
+#endif
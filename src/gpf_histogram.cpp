@@ -0,0 +1,103 @@
+/**
+ * @file gpf_histogram.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-21
+ *
+ * Histogramme log-linéaire (style HDR) de taille fixe, sans allocation dynamique.
+ *
+ * Les valeurs de 0 à 15 ont chacune leur case. Ensuite chaque puissance de 2 est divisée en 8 cases égales.
+ * L'erreur relative sur un percentile est donc d'au plus 1/8 (environ 6% en moyenne) peu importe la valeur,
+ * ce qui permet de voir autant une gigue de quelques us qu'un blocage de la carte SD de plusieurs ms.
+ * record() ne fait qu'un calcul d'index (clz) et une incrémentation, on peut donc l'appeler dans la boucle de contrôle.
+ *
+ * Cases et percentiles vérifiés dans test/test_histogram.cpp.
+ *
+ * Ce fichier n'utilise rien du Teensy et peut être compilé sur un PC.
+ *
+ */
+
+#include <string.h>
+#include <math.h>
+#include "gpf_histogram.h"
+
+GPF_HISTOGRAM::GPF_HISTOGRAM() {
+  reset();
+}
+
+void GPF_HISTOGRAM::reset() {
+  memset(buckets, 0, sizeof(buckets));
+  count    = 0;
+  maxValue = 0;
+}
+
+void GPF_HISTOGRAM::record(uint32_t value) {
+  if (value > GPF_HISTOGRAM_MAX_VALUE) {
+    value = GPF_HISTOGRAM_MAX_VALUE;
+  }
+
+  buckets[valueToBucket(value)]++;
+  count++;
+  if (value > maxValue) {
+    maxValue = value;
+  }
+}
+
+// Retourne la plus grande valeur de la case qui contient le percentile demandé (ex: 99.9). Résultat pessimiste mais jamais plus grand que le max.
+uint32_t GPF_HISTOGRAM::getPercentile(float percentile) {
+  uint32_t target;
+  uint32_t cumulative = 0;
+
+  if (count == 0) {
+    return 0;
+  }
+
+  target = (uint32_t)ceil((percentile / 100.0) * count);
+  if (target < 1) {
+    target = 1;
+  }
+
+  for (uint16_t bucket = 0; bucket < GPF_HISTOGRAM_BUCKET_COUNT; bucket++) {
+    cumulative += buckets[bucket];
+    if (cumulative >= target) {
+      uint32_t upperValue = bucketUpperValue(bucket);
+      return (upperValue < maxValue) ? upperValue : maxValue;
+    }
+  }
+
+  return maxValue;
+}
+
+uint32_t GPF_HISTOGRAM::get_count() {
+  return count;
+}
+
+uint32_t GPF_HISTOGRAM::get_max() {
+  return maxValue;
+}
+
+uint16_t GPF_HISTOGRAM::valueToBucket(uint32_t value) {
+  uint8_t msb;
+  uint8_t shift;
+
+  if (value < GPF_HISTOGRAM_SUB_BUCKET_COUNT) {
+    return value;
+  }
+
+  msb   = 31 - __builtin_clz(value);
+  shift = msb - (GPF_HISTOGRAM_SUB_BUCKET_BITS - 1); //value >> shift est entre 8 et 15
+  return GPF_HISTOGRAM_SUB_BUCKET_COUNT + (shift - 1) * GPF_HISTOGRAM_SUB_BUCKET_HALF + ((value >> shift) - GPF_HISTOGRAM_SUB_BUCKET_HALF);
+}
+
+uint32_t GPF_HISTOGRAM::bucketUpperValue(uint16_t bucket) {
+  uint8_t  shift;
+  uint32_t subBucket;
+
+  if (bucket < GPF_HISTOGRAM_SUB_BUCKET_COUNT) {
+    return bucket;
+  }
+
+  shift     = ((bucket - GPF_HISTOGRAM_SUB_BUCKET_COUNT) / GPF_HISTOGRAM_SUB_BUCKET_HALF) + 1;
+  subBucket = ((bucket - GPF_HISTOGRAM_SUB_BUCKET_COUNT) % GPF_HISTOGRAM_SUB_BUCKET_HALF) + GPF_HISTOGRAM_SUB_BUCKET_HALF;
+  return ((subBucket + 1) << shift) - 1;
+}
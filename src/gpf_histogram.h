@@ -0,0 +1,42 @@
+/**
+ * @file gpf_histogram.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-21
+ *
+ * Voir fichier gpf_histogram.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_HISTOGRAM_H
+#define GPF_HISTOGRAM_H
+
+#include <stdint.h>
+
+#define GPF_HISTOGRAM_SUB_BUCKET_BITS   4                                    //16 cases linéaires puis 8 cases par puissance de 2 (précision d'environ 6%)
+#define GPF_HISTOGRAM_SUB_BUCKET_COUNT  (1 << GPF_HISTOGRAM_SUB_BUCKET_BITS)
+#define GPF_HISTOGRAM_SUB_BUCKET_HALF   (GPF_HISTOGRAM_SUB_BUCKET_COUNT / 2)
+#define GPF_HISTOGRAM_MAX_VALUE_BITS    20                                   //Valeurs plus grandes ramenées à 2^20-1 (environ 1 seconde en us)
+#define GPF_HISTOGRAM_MAX_VALUE         ((1UL << GPF_HISTOGRAM_MAX_VALUE_BITS) - 1)
+#define GPF_HISTOGRAM_BUCKET_COUNT      (GPF_HISTOGRAM_SUB_BUCKET_COUNT + (GPF_HISTOGRAM_MAX_VALUE_BITS - GPF_HISTOGRAM_SUB_BUCKET_BITS) * GPF_HISTOGRAM_SUB_BUCKET_HALF)
+
+class GPF_HISTOGRAM {
+
+    public:
+        GPF_HISTOGRAM();
+        void     reset();
+        void     record(uint32_t value);
+        uint32_t getPercentile(float percentile);
+        uint32_t get_count();
+        uint32_t get_max();
+
+    private:
+        static uint16_t valueToBucket(uint32_t value);
+        static uint32_t bucketUpperValue(uint16_t bucket);
+
+        uint32_t buckets[GPF_HISTOGRAM_BUCKET_COUNT];
+        uint32_t count    = 0;
+        uint32_t maxValue = 0;
+};
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ * @file gpf_i2c_async.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-12
+ *
+ * Lecture I2C non bloquante (par interruption) sur le LPI2C1 du Teensy 4.1 (celui utilisé par Wire).
+ *
+ * La librairie Wire du Teensy 4 attend (polling) la fin de chaque transfert. À 400 kHz, lire l'accéléromètre et le gyro
+ * du BMI088 prend plusieurs centaines de micro secondes pendant lesquelles la boucle de contrôle ne fait rien.
+ * Ici on met les commandes dans le FIFO du LPI2C puis on retourne immédiatement. L'interruption du LPI2C se charge de
+ * compléter le FIFO, de vider les octets reçus et d'enchaîner les lectures. La boucle de contrôle calcule donc la
+ * fusion et les PIDs sur l'échantillon précédent pendant que le bus transfert le suivant.
+ *
+ * Wire doit quand même avoir été initialisé avant (begin() et setClock()) car on réutilise sa configuration du bus.
+ * On ne doit pas utiliser Wire pendant qu'un transfert est en cours. (Voir waitUntilIdle())
+ *
+ * Référence: i.MX RT1060 Processor Reference Manual, chapitre 47 LPI2C (Master Transmit Data Register MTDR)
+ *
+ */
+
+#include "Arduino.h"
+#include "gpf_i2c_async.h"
+#include "gpf_debug.h"
+
+GPF_I2C_ASYNC *GPF_I2C_ASYNC::instance = NULL;
+
+GPF_I2C_ASYNC::GPF_I2C_ASYNC() {
+
+}
+
+void GPF_I2C_ASYNC::initialize() {
+  instance  = this;
+  readCount = 0;
+
+  port->MIER = 0;
+  attachInterruptVector(IRQ_LPI2C1, GPF_I2C_ASYNC::isr);
+  NVIC_SET_PRIORITY(IRQ_LPI2C1, GPF_I2C_ASYNC_PRIORITY);
+  NVIC_ENABLE_IRQ(IRQ_LPI2C1);
+}
+
+// Ajoute une lecture de count octets à partir du registre subAddress. Les lectures sont faites dans l'ordre d'ajout à chaque start().
+bool GPF_I2C_ASYNC::addRead(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t *dest) {
+  if ((readCount >= GPF_I2C_ASYNC_MAX_READS) || (count == 0)) {
+    return false;
+  }
+
+  reads[readCount].address    = address;
+  reads[readCount].subAddress = subAddress;
+  reads[readCount].count      = count;
+  reads[readCount].dest       = dest;
+  readCount++;
+  return true;
+}
+
+// Démarre toutes les lectures et retourne immédiatement.
+bool GPF_I2C_ASYNC::start() {
+  if (busy || (readCount == 0)) {
+    return false;
+  }
+
+  lastTransferOk = false; //Même si le départ échoue: le résultat précédent a déjà été lu
+
+  if (port->MSR & LPI2C_MSR_MBF) { //Quelqu'un d'autre (Wire) utilise encore le bus
+    startFailedCount++;
+    return false;
+  }
+
+  busy           = true;
+  transferCount++;
+
+  port->MCR |= LPI2C_MCR_RTF | LPI2C_MCR_RRF; //Vide les FIFOs
+  port->MSR  = LPI2C_MSR_SDF | LPI2C_MSR_NDF | LPI2C_MSR_ALF | LPI2C_MSR_FEF | LPI2C_MSR_PLTF; //Efface les flags (write 1 to clear)
+  port->MFCR = 0; //TXWATER=0, RXWATER=0 //TDF quand le FIFO de transmission est vide, RDF dès qu'un octet est reçu
+
+  startRead(0);
+  return true;
+}
+
+bool GPF_I2C_ASYNC::isBusy() {
+  return busy;
+}
+
+bool GPF_I2C_ASYNC::get_lastTransferOk() {
+  return lastTransferOk;
+}
+
+// À appeler avant de redonner le bus à Wire (ex: calibration du IMU)
+bool GPF_I2C_ASYNC::waitUntilIdle(unsigned long timeout_us) {
+  elapsedMicros sinceStart = 0;
+
+  while (busy) {
+    if (sinceStart > timeout_us) {
+      noInterrupts();
+      port->MIER = 0;
+      port->MCR |= LPI2C_MCR_RTF | LPI2C_MCR_RRF;
+      port->MTDR = LPI2C_MTDR_CMD_STOP;
+      busy           = false;
+      lastTransferOk = false;
+      errorCount++;
+      interrupts();
+      return false;
+    }
+  }
+  return true;
+}
+
+void GPF_I2C_ASYNC::isr() {
+  instance->handleInterrupt();
+}
+
+void GPF_I2C_ASYNC::startRead(uint8_t readIndex) {
+  currentRead  = readIndex;
+  rxIndex      = 0;
+  commandIndex = 0;
+
+  commands[0] = LPI2C_MTDR_CMD_START    | (reads[readIndex].address << 1);
+  commands[1] = LPI2C_MTDR_CMD_TRANSMIT | reads[readIndex].subAddress;
+  commands[2] = LPI2C_MTDR_CMD_START    | (reads[readIndex].address << 1) | 1;
+  commands[3] = LPI2C_MTDR_CMD_RECEIVE  | (reads[readIndex].count - 1);
+  commands[4] = LPI2C_MTDR_CMD_STOP;
+
+  feedTxFifo();
+  port->MIER = LPI2C_MIER_RDIE | LPI2C_MIER_SDIE | LPI2C_MIER_NDIE | LPI2C_MIER_ALIE | LPI2C_MIER_FEIE | LPI2C_MIER_PLTIE | ((commandIndex < GPF_I2C_ASYNC_COMMANDS_BY_READ) ? LPI2C_MIER_TDIE : 0);
+}
+
+void GPF_I2C_ASYNC::feedTxFifo() {
+  while ((commandIndex < GPF_I2C_ASYNC_COMMANDS_BY_READ) && ((port->MFSR & 0x07) < GPF_I2C_ASYNC_TX_FIFO_SIZE)) {
+    port->MTDR = commands[commandIndex];
+    commandIndex++;
+  }
+
+  if (commandIndex >= GPF_I2C_ASYNC_COMMANDS_BY_READ) {
+    port->MIER &= ~LPI2C_MIER_TDIE; //Sinon TDF reste actif et on revient dans l'interruption sans arrêt
+  }
+}
+
+void GPF_I2C_ASYNC::endTransfer(bool ok) {
+  port->MIER     = 0;
+  lastTransferOk = ok;
+  busy           = false;
+
+  if (!ok) {
+    errorCount++;
+  }
+}
+
+void GPF_I2C_ASYNC::handleInterrupt() {
+  uint32_t msr = port->MSR;
+
+  if (msr & (LPI2C_MSR_NDF | LPI2C_MSR_ALF | LPI2C_MSR_FEF | LPI2C_MSR_PLTF)) {
+    //Même traitement que WireIMXRT: on vide le FIFO puis on libère le bus
+    port->MCR |= LPI2C_MCR_RTF | LPI2C_MCR_RRF;
+    port->MSR  = LPI2C_MSR_NDF | LPI2C_MSR_ALF | LPI2C_MSR_FEF | LPI2C_MSR_PLTF;
+    if (port->MSR & LPI2C_MSR_MBF) {
+      port->MTDR = LPI2C_MTDR_CMD_STOP;
+    }
+    endTransfer(false);
+    return;
+  }
+
+  while (true) {
+    uint32_t mrdr = port->MRDR;
+    if (mrdr & LPI2C_MRDR_RXEMPTY) {
+      break;
+    }
+    if (rxIndex < reads[currentRead].count) {
+      reads[currentRead].dest[rxIndex] = mrdr & 0xFF;
+      rxIndex++;
+    }
+  }
+
+  if (msr & LPI2C_MSR_TDF) {
+    feedTxFifo();
+  }
+
+  if (msr & LPI2C_MSR_SDF) {
+    port->MSR = LPI2C_MSR_SDF;
+
+    if (rxIndex < reads[currentRead].count) {
+      endTransfer(false); //STOP reçu avant d'avoir tous les octets
+    } else if ((currentRead + 1) < readCount) {
+      startRead(currentRead + 1);
+    } else {
+      endTransfer(true);
+    }
+  }
+}
@@ -0,0 +1,64 @@
+/**
+ * @file gpf_i2c_async.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-12
+ *
+ * Voir fichier gpf_i2c_async.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_I2C_ASYNC_H
+#define GPF_I2C_ASYNC_H
+
+#include "Arduino.h"
+
+#define GPF_I2C_ASYNC_MAX_READS        2  //Nombre maximum de lectures enchaînées par transfert (ex: accel + gyro du BMI088)
+#define GPF_I2C_ASYNC_COMMANDS_BY_READ 5  //START+adr(W), registre, START+adr(R), RECEIVE n, STOP
+#define GPF_I2C_ASYNC_TX_FIFO_SIZE     4  //Taille du FIFO de transmission du LPI2C sur i.MX RT1062
+#define GPF_I2C_ASYNC_PRIORITY         48 //Priorité NVIC de l'interruption LPI2C1. Plus prioritaire que la boucle de contrôle (GPF_MAIN_LOOP_TIMER_PRIORITY)
+
+class GPF_I2C_ASYNC {
+
+    public:
+        GPF_I2C_ASYNC();
+        void initialize();
+        bool addRead(uint8_t address, uint8_t subAddress, uint8_t count, uint8_t *dest);
+        bool start();
+        bool isBusy();
+        bool get_lastTransferOk();
+        bool waitUntilIdle(unsigned long timeout_us);
+        static void isr();
+
+        unsigned long transferCount = 0;
+        unsigned long errorCount    = 0; //NACK, perte d'arbitrage, erreur de FIFO, timeout
+        unsigned long startFailedCount = 0; //start() refusé parce que le bus était occupé par Wire
+
+    private:
+        typedef struct {
+          uint8_t  address;
+          uint8_t  subAddress;
+          uint8_t  count;
+          uint8_t *dest;
+        } gpf_i2c_async_read_struct;
+
+        void handleInterrupt();
+        void startRead(uint8_t readIndex);
+        void feedTxFifo();
+        void endTransfer(bool ok);
+
+        static GPF_I2C_ASYNC *instance;
+        IMXRT_LPI2C_t        *port = &IMXRT_LPI2C1; //Wire sur les pins 18/19 du Teensy 4.1
+
+        gpf_i2c_async_read_struct reads[GPF_I2C_ASYNC_MAX_READS];
+        uint8_t                   readCount = 0;
+
+        volatile bool     busy            = false;
+        volatile bool     lastTransferOk  = false;
+        volatile uint8_t  currentRead     = 0;
+        volatile uint8_t  rxIndex         = 0;
+        uint32_t          commands[GPF_I2C_ASYNC_COMMANDS_BY_READ];
+        volatile uint8_t  commandIndex    = 0;
+};
+
+#endif
@@ -15,9 +15,13 @@
 #include "MPU6050.h"
 #include "BMI088.h"
 #include "gpf_imu.h"
+#include "gpf_imu_fifo.h"
 #include "gpf_util.h"
+#include "gpf_fast_math.h"
 #include "gpf_debug.h"
 
+GPF_IMU *GPF_IMU::drdyInstance = NULL;
+
 GPF_IMU::GPF_IMU() {
     //
 }
@@ -63,8 +67,19 @@ void GPF_IMU::initialize(gpf_config_struct *ptr) {
      bool status_b;
 
       #if defined GPF_IMU_SENSOR_INSTALLED_BMI088_A
-       theImu_bmi088_accel = new Bmi088Accel(Wire,0x19); //0x18
-       theImu_bmi088_gyro  = new Bmi088Gyro(Wire,0x69); //0x68
+       #if defined GPF_IMU_BMI088_TRANSPORT_SPI
+        //Le accel du BMI088 démarre en mode I2C. Un front montant sur CSB1 le fait passer en mode SPI (datasheet section 6.1)
+        pinMode(GPF_IMU_BMI088_SPI_CS_ACCEL, OUTPUT);
+        digitalWrite(GPF_IMU_BMI088_SPI_CS_ACCEL, LOW);
+        delayMicroseconds(1);
+        digitalWrite(GPF_IMU_BMI088_SPI_CS_ACCEL, HIGH);
+
+        theImu_bmi088_accel = new Bmi088Accel(SPI1,GPF_IMU_BMI088_SPI_CS_ACCEL);
+        theImu_bmi088_gyro  = new Bmi088Gyro(SPI1,GPF_IMU_BMI088_SPI_CS_GYRO);
+       #else
+        theImu_bmi088_accel = new Bmi088Accel(Wire,GPF_IMU_BMI088_ACCEL_I2C_ADDRESS);
+        theImu_bmi088_gyro  = new Bmi088Gyro(Wire,GPF_IMU_BMI088_GYRO_I2C_ADDRESS);
+       #endif
 
        status_i = theImu_bmi088_accel->begin();
        status_b = theImu_bmi088_accel->setOdr(Bmi088Accel::ODR_1600HZ_BW_280HZ);
@@ -85,7 +100,7 @@ void GPF_IMU::initialize(gpf_config_struct *ptr) {
          #endif
        }
 
-       status_b = theImu_bmi088_gyro->setOdr(Bmi088Gyro::ODR_2000HZ_BW_532HZ);
+       status_b = theImu_bmi088_gyro->setOdr(GPF_IMU_GYRO_ODR_SETTING);
        status_b = theImu_bmi088_gyro->setRange(GPF_IMU_BMI088_GYRO_SCALE); 
 
        if (status_b) {
@@ -112,7 +127,41 @@ void GPF_IMU::initialize(gpf_config_struct *ptr) {
       #endif
     
     #endif
-    
+
+    #if defined GPF_IMU_FIFO_ENABLED
+     if (!theImu_bmi088_gyro->setFifoStream(true)) {
+       DEBUG_GPF_IMU_PRINTLN("Gyro FIFO Initialization Error");
+     }
+     if (!theImu_bmi088_accel->setFifoStream(true)) {
+       DEBUG_GPF_IMU_PRINTLN("Accel FIFO Initialization Error");
+     }
+    #endif
+
+    #if defined GPF_IMU_I2C_ASYNC_ENABLED
+     i2cAsync.initialize();
+
+     #if defined GPF_IMU_SENSOR_INSTALLED_MPU6050
+      i2cAsync.addRead(MPU6050_DEFAULT_ADDRESS, MPU6050_RA_ACCEL_XOUT_H, 14, &buffer[0]); //Accel, température et gyro d'un seul coup
+     #endif
+
+     #if defined GPF_IMU_SENSOR_INSTALLED_BMI088_A
+      i2cAsync.addRead(GPF_IMU_BMI088_ACCEL_I2C_ADDRESS, GPF_IMU_BMI088_ACCEL_DATA_REGISTER, 6, &buffer[0]);
+      i2cAsync.addRead(GPF_IMU_BMI088_GYRO_I2C_ADDRESS,  GPF_IMU_BMI088_GYRO_DATA_REGISTER,  6, &buffer[6]);
+     #endif
+    #endif
+
+    #if defined GPF_IMU_FIFO_ENABLED
+     filter_sampleRateHz = GPF_IMU_GYRO_ODR; //Chaque échantillon du FIFO passe dans les filtres
+    #endif
+    gyroFilter.initialize(GPF_IMU_FILTER_GYRO_TYPE, GPF_IMU_FILTER_GYRO_CUTOFF, filter_sampleRateHz);
+    accelFilter.initialize(GPF_IMU_FILTER_ACCEL_TYPE, GPF_IMU_FILTER_ACCEL_CUTOFF, filter_sampleRateHz);
+    #if defined GPF_IMU_DYN_NOTCH_ENABLED
+     dynNotch.initialize(GPF_IMU_DYN_NOTCH_COUNT, GPF_IMU_DYN_NOTCH_MIN_HZ, GPF_IMU_DYN_NOTCH_MAX_HZ, GPF_IMU_DYN_NOTCH_Q, filter_sampleRateHz);
+    #endif
+    #if defined GPF_IMU_HARMONIC_NOTCH_ENABLED
+     const float harmonicNotchCurveHz[] = GPF_IMU_HARMONIC_NOTCH_CURVE_HZ;
+     harmonicNotch.initialize(harmonicNotchCurveHz, sizeof(harmonicNotchCurveHz) / sizeof(harmonicNotchCurveHz[0]), GPF_IMU_HARMONIC_NOTCH_HARMONICS, GPF_IMU_HARMONIC_NOTCH_Q, filter_sampleRateHz);
+    #endif
 }
 
 
@@ -127,10 +176,21 @@ bool GPF_IMU::getIMUData() {
      * These values are scaled according to the IMU datasheet to put them into correct units of g's, deg/sec, and uT. A simple first-order
      * low-pass filter is used to get rid of high frequency noise in these raw signals. Generally you want to cut
      * off everything past 80Hz, but if your loop rate is not fast enough, the low pass filter will cause a lag in
-     * the readings. The filter parameters B_gyro and B_accel are set to be good for a 2kHz loop rate. Finally,
+     * the readings. The filters (gyroFilter, accelFilter) are set by cutoff frequency and follow the measured sample rate. Finally,
      * the constant errors found in calculate_IMU_error() on startup are subtracted from the accelerometer and gyro readings.
      */
 
+    unsigned long readStartedAt = micros();
+
+    #if defined GPF_IMU_FIFO_ENABLED
+    if (!getIMUData_fifo()) {
+      return false;
+    }
+    #elif defined GPF_IMU_I2C_ASYNC_ENABLED
+    if (!getIMUData_async()) {
+      return false;
+    }
+    #else
     accX_raw_no_offsets = 0;
     accY_raw_no_offsets = 0;
     accZ_raw_no_offsets = 0;
@@ -144,10 +204,9 @@ bool GPF_IMU::getIMUData() {
 
     #if defined GPF_IMU_SENSOR_INSTALLED_BMI088
      #if defined GPF_IMU_SENSOR_INSTALLED_BMI088_A
-       theImu_bmi088_accel->readSensor();
-       theImu_bmi088_accel->getSensorRawValues(&accX_raw_no_offsets, &accY_raw_no_offsets, &accZ_raw_no_offsets);
-       theImu_bmi088_gyro->readSensor();
-       theImu_bmi088_gyro->getSensorRawValues(&gyrX_raw_no_offsets, &gyrY_raw_no_offsets, &gyrZ_raw_no_offsets);
+       //Une seule transaction (burst de 6 octets) par sensor. readSensor() lisait aussi le sensor time et la température.
+       theImu_bmi088_accel->readSensorRawValues(&accX_raw_no_offsets, &accY_raw_no_offsets, &accZ_raw_no_offsets);
+       theImu_bmi088_gyro->readSensorRawValues(&gyrX_raw_no_offsets, &gyrY_raw_no_offsets, &gyrZ_raw_no_offsets);
      #endif
 
      #if defined GPF_IMU_SENSOR_INSTALLED_BMI088_B
@@ -155,7 +214,61 @@ bool GPF_IMU::getIMUData() {
       theImu_bmi088_bmi->getSensorRawValues(&accX_raw_no_offsets, &accY_raw_no_offsets, &accZ_raw_no_offsets, &gyrX_raw_no_offsets, &gyrY_raw_no_offsets, &gyrZ_raw_no_offsets);
      #endif
     #endif
-    
+
+    sample_timestamp = takeSampleTimestamp();
+    #endif
+
+    readDuration    = micros() - readStartedAt;
+    readDurationMax = max(readDurationMax, readDuration);
+
+    #if !defined GPF_IMU_FIFO_ENABLED //En mode FIFO, chaque échantillon a déjà été validé et filtré dans getIMUData_fifo()
+    if (!checkRawSample()) {
+      return false;
+    }
+
+    //Les coefficients des filtres suivent la fréquence réelle des échantillons (étage gyro, DRDY ou lecture I2C non bloquante)
+    if ((filter_sampleTimestamp_previous != 0) && (sample_timestamp != filter_sampleTimestamp_previous)) {
+      filter_sampleRateHz = (1.0 - GPF_IMU_FILTER_SAMPLE_RATE_WEIGHT) * filter_sampleRateHz + GPF_IMU_FILTER_SAMPLE_RATE_WEIGHT * (1000000.0 / (sample_timestamp - filter_sampleTimestamp_previous));
+      gyroFilter.setSampleRate(filter_sampleRateHz);
+      accelFilter.setSampleRate(filter_sampleRateHz);
+      #if defined GPF_IMU_DYN_NOTCH_ENABLED
+       dynNotch.setSampleRate(filter_sampleRateHz);
+      #endif
+      #if defined GPF_IMU_HARMONIC_NOTCH_ENABLED
+       harmonicNotch.setSampleRate(filter_sampleRateHz);
+      #endif
+    }
+    filter_sampleTimestamp_previous = sample_timestamp;
+
+    processRawSample();
+    #endif
+
+    #if defined GPF_IMU_DYN_NOTCH_ENABLED
+     dynNotch.update(); //Une étape de l'analyse par tour de l'étage gyro
+    #endif
+
+/*
+    #ifdef DEBUG_GPF_IMU_ENABLED
+     if (debug_sincePrint > DEBUG_GPF_IMU_DELAY) {
+       DEBUG_GPF_IMU_PRINT(accX_output);            DEBUG_GPF_IMU_PRINT(F(", "));       
+       DEBUG_GPF_IMU_PRINT(accY_output);            DEBUG_GPF_IMU_PRINT(F(", "));       
+       DEBUG_GPF_IMU_PRINT(accZ_output);            DEBUG_GPF_IMU_PRINT(F(", "));       
+
+       //DEBUG_GPF_IMU_PRINT(GyroX);            DEBUG_GPF_IMU_PRINT(F(", "));       
+       //DEBUG_GPF_IMU_PRINT(GyroY);            DEBUG_GPF_IMU_PRINT(F(", "));       
+       //DEBUG_GPF_IMU_PRINT(GyroZ);            DEBUG_GPF_IMU_PRINT(F(", "));       
+       
+       DEBUG_GPF_IMU_PRINTLN();
+
+       debug_sincePrint = 0;
+     }
+    #endif
+*/
+    return true;
+}
+
+// Protection contre les lectures invalides. Retourne false si on ne doit pas se servir des valeurs *_raw_no_offsets.
+bool GPF_IMU::checkRawSample() {
     // *** Protection *** 
     //Protection si on ne peu pas lire le IMU. C'est mieux de sortir de la fonction que de faire des calculs erronés
     #if defined GPF_IMU_SENSOR_INSTALLED_MPU6050
@@ -171,7 +284,9 @@ bool GPF_IMU::getIMUData() {
     // On dirait que des fois, la fonction getMotion6() retournait des valeurs à 0 puis ensuite les calculs donnaient comme résultat Nan.
     // Puisque dans la boucle, on se sert toujours des valauers des calculs précédents pour refaire les nouveaux calculs et bien les nouveaux calculs restaient toujours à Nan.
     // Donc au lieu d'obtenir des calculs à Nan on ne fait pas les calculs puis on sort immédiatement de la fonction.
-    if (isnan(atan(accX_raw_no_offsets/sqrt((accY_raw_no_offsets*accY_raw_no_offsets)+(accZ_raw_no_offsets*accZ_raw_no_offsets))))) {
+    // atan(accX/racine(accY²+accZ²)) donnait NaN seulement pour 0/0, c'est à dire quand les 3 axes du accel sont à 0. On le vérifie directement plutôt
+    // que de calculer atan et sqrt en double à chaque échantillon.
+    if ((accX_raw_no_offsets == 0) && (accY_raw_no_offsets == 0) && (accZ_raw_no_offsets == 0)) {
      DEBUG_GPF_IMU_PRINT(F("GPF_IMU:"));
      DEBUG_GPF_IMU_PRINTLN(F("***** ERREUR (Calcul donne NAN) ******"));
      errorCount++;
@@ -179,7 +294,11 @@ bool GPF_IMU::getIMUData() {
     }
     // *** Fin Protection *** 
 
+    return true;
+}
 
+// Applique les offsets de calibration, l'échelle et les filtres passe-bas aux valeurs *_raw_no_offsets.
+void GPF_IMU::processRawSample() {
     //Accelerometer
     //Correct the outputs with the calculated error values
     accX_raw_plus_offsets = accX_raw_no_offsets - (myConfig_ptr->imuOffsets[GPF_IMU_SENSOR_ACCELEROMETER][GPF_IMU_AXE_X]  );
@@ -191,15 +310,8 @@ bool GPF_IMU::getIMUData() {
     accY_output = accY_raw_plus_offsets / GPF_IMU_ACCEL_SCALE_FACTOR; //G's
     accZ_output = accZ_raw_plus_offsets / GPF_IMU_ACCEL_SCALE_FACTOR; //G's
   
-    if (fusion_type == GPF_IMU_FUSION_TYPE_MADGWICK) {
-     //LP filter accelerometer data
-     accX_output = (1.0 - B_accel)*accX_output_prev + B_accel*accX_output;
-     accY_output = (1.0 - B_accel)*accY_output_prev + B_accel*accY_output;
-     accZ_output = (1.0 - B_accel)*accZ_output_prev + B_accel*accZ_output;
-     accX_output_prev = accX_output;
-     accY_output_prev = accY_output;
-     accZ_output_prev = accZ_output;
-    }
+    //LP filter accelerometer data
+    accelFilter.apply(&accX_output, &accY_output, &accZ_output);
 
     //Gyro
     //Correct the outputs with the calculated error values
@@ -211,154 +323,312 @@ bool GPF_IMU::getIMUData() {
     gyrY_output = gyrY_raw_plus_offsets / GPF_IMU_GYRO_SCALE_FACTOR; //deg/sec
     gyrZ_output = gyrZ_raw_plus_offsets / GPF_IMU_GYRO_SCALE_FACTOR; //deg/sec
     
-    if (fusion_type == GPF_IMU_FUSION_TYPE_MADGWICK) {
-     //LP filter gyro data
-     gyrX_output = (1.0 - B_gyro)*gyrX_output_prev + B_gyro*gyrX_output;
-     gyrY_output = (1.0 - B_gyro)*gyrY_output_prev + B_gyro*gyrY_output;
-     gyrZ_output = (1.0 - B_gyro)*gyrZ_output_prev + B_gyro*gyrZ_output;
-     gyrX_output_prev = gyrX_output;
-     gyrY_output_prev = gyrY_output;
-     gyrZ_output_prev = gyrZ_output;
-    }
+    #if defined GPF_IMU_DYN_NOTCH_ENABLED
+     dynNotch.addSample(gyrX_output, gyrY_output, gyrZ_output); //Avant les filtres pour voir le bruit tel quel
+    #endif
 
+    //Dans tous les modes de vol: le gyro filtré sert aussi au terme D du PID (fm-2, fm-1 et acro) et les états des filtres restent à jour
+    #if defined GPF_IMU_DYN_NOTCH_ENABLED
+     dynNotch.apply(&gyrX_output, &gyrY_output, &gyrZ_output);
+    #endif
+    #if defined GPF_IMU_HARMONIC_NOTCH_ENABLED
+     harmonicNotch.apply(&gyrX_output, &gyrY_output, &gyrZ_output);
+    #endif
+    //LP filter gyro data
+    gyroFilter.apply(&gyrX_output, &gyrY_output, &gyrZ_output);
+}
 
-/*
-    #ifdef DEBUG_GPF_IMU_ENABLED
-     if (debug_sincePrint > DEBUG_GPF_IMU_DELAY) {
-       DEBUG_GPF_IMU_PRINT(accX_output);            DEBUG_GPF_IMU_PRINT(F(", "));       
-       DEBUG_GPF_IMU_PRINT(accY_output);            DEBUG_GPF_IMU_PRINT(F(", "));       
-       DEBUG_GPF_IMU_PRINT(accZ_output);            DEBUG_GPF_IMU_PRINT(F(", "));       
+// Retourne le moment où l'échantillon qu'on s'apprête à lire a été produit et compte les échantillons perdus ou lus en double.
+unsigned long GPF_IMU::takeSampleTimestamp() {
+  #if defined GPF_IMU_GYRO_DRDY_SYNC_ENABLED
+   unsigned long drdy_count_now;
+   unsigned long drdy_timestamp_now;
+   unsigned long newSamples;
+
+   noInterrupts();
+   drdy_count_now     = drdy_count;
+   drdy_timestamp_now = drdy_timestamp;
+   interrupts();
+
+   newSamples = drdy_count_now - drdy_count_lastRead;
+   if (newSamples == 0) {
+     drdy_duplicatedSampleCount++; //Même échantillon que la fois précédente
+   } else if ((drdy_count_lastRead != 0) && (newSamples > GPF_IMU_GYRO_DRDY_SAMPLES_PER_LOOP)) {
+     drdy_missedSampleCount += newSamples - GPF_IMU_GYRO_DRDY_SAMPLES_PER_LOOP; //La boucle de contrôle a pris du retard
+   }
+   drdy_count_lastRead = drdy_count_now;
+   return drdy_timestamp_now;
+  #else
+   return micros();
+  #endif
+}
 
-       //DEBUG_GPF_IMU_PRINT(GyroX);            DEBUG_GPF_IMU_PRINT(F(", "));       
-       //DEBUG_GPF_IMU_PRINT(GyroY);            DEBUG_GPF_IMU_PRINT(F(", "));       
-       //DEBUG_GPF_IMU_PRINT(GyroZ);            DEBUG_GPF_IMU_PRINT(F(", "));       
-       
-       DEBUG_GPF_IMU_PRINTLN();
+#if defined GPF_IMU_FIFO_ENABLED
+// Pour gpf_imu_fifo_readAccel()
+static uint16_t readAccelFifo(void *context, uint16_t count, uint8_t *dest) {
+  return ((Bmi088Accel *)context)->readFifo(count, dest);
+}
+#endif
+
+// Vide les FIFO du gyro et du accel d'un seul coup puis valide et filtre chacun des échantillons.
+// Chaque échantillon du gyro est jumelé au échantillon du accel le plus proche dans le temps (le accel roule à 1600hz et le gyro à 2000hz).
+bool GPF_IMU::getIMUData_fifo() {
+  #if defined GPF_IMU_FIFO_ENABLED
+   uint8_t  gyroStatus;
+   uint8_t  gyroFrameCount;
+   uint16_t accelLength;
+   gpf_imu_fifo_accel_decode_result_struct accelResult;
+
+   gyroStatus     = theImu_bmi088_gyro->getFifoStatus();
+   gyroFrameCount = min(gyroStatus & GPF_IMU_FIFO_GYRO_STATUS_FRAME_COUNT, GPF_IMU_FIFO_GYRO_MAX_FRAMES);
+   if (gyroFrameCount > 0) {
+     theImu_bmi088_gyro->readFifo(gyroFrameCount * GPF_IMU_FIFO_GYRO_FRAME_LENGTH, fifo_gyroBuffer);
+   }
+   if (gyroStatus & GPF_IMU_FIFO_GYRO_STATUS_OVERRUN) { //Des échantillons ont été perdus, le flag reste actif tant qu'on ne reset pas le FIFO
+     fifo_gyroOverflowCount++;
+     fifo_gyroDroppedFrameCount += theImu_bmi088_gyro->getFifoStatus() & GPF_IMU_FIFO_GYRO_STATUS_FRAME_COUNT; //Arrivées depuis la lecture, jetées par le reset
+     theImu_bmi088_gyro->resetFifo();
+   }
+   gyroFrameCount = gpf_imu_fifo_decodeGyro(fifo_gyroBuffer, gyroFrameCount * GPF_IMU_FIFO_GYRO_FRAME_LENGTH, fifo_gyroFrames, GPF_IMU_FIFO_GYRO_MAX_FRAMES);
+
+   accelLength = min(theImu_bmi088_accel->getFifoLength(), (uint16_t)GPF_IMU_FIFO_ACCEL_READ_MAX_LENGTH);
+   if (accelLength > 0) {
+     accelLength = gpf_imu_fifo_readAccel(readAccelFifo, theImu_bmi088_accel, accelLength, fifo_accelBuffer); //Frames complètes seulement, une frame coupée par la limite reste dans le FIFO
+   }
+   gpf_imu_fifo_decodeAccel(fifo_accelBuffer, accelLength, fifo_accelFrames, GPF_IMU_FIFO_ACCEL_MAX_FRAMES, &accelResult);
+   fifo_accelSkippedFrameCount += accelResult.skippedFrameCount;
+   if (accelResult.unknownHeaderCount > 0) {
+     fifo_accelDecodeErrorCount++;
+   }
+
+   fifo_gyroDepth    = gyroFrameCount;
+   fifo_gyroDepthMax = max(fifo_gyroDepthMax, fifo_gyroDepth);
+   sample_timestamp  = takeSampleTimestamp();
+
+   uint8_t sampleCountBefore = fifo_sampleCount; //Les échantillons s'ajoutent jusqu'au prochain doFusion()
+   if ((fifo_sampleCount + gyroFrameCount) > GPF_IMU_FIFO_GYRO_MAX_FRAMES) { //doFusion() en retard, les plus récents ne rentrent pas
+     fifo_gyroDroppedFrameCount += (fifo_sampleCount + gyroFrameCount) - GPF_IMU_FIFO_GYRO_MAX_FRAMES;
+   }
+   for (uint8_t i = 0; (i < gyroFrameCount) && (fifo_sampleCount < GPF_IMU_FIFO_GYRO_MAX_FRAMES); i++) {
+     if (accelResult.frameCount > 0) {
+       uint16_t accelIndex = ((uint16_t)i * accelResult.frameCount) / gyroFrameCount;
+       fifo_accelLast[0] = fifo_accelFrames[accelIndex][0];
+       fifo_accelLast[1] = fifo_accelFrames[accelIndex][1];
+       fifo_accelLast[2] = fifo_accelFrames[accelIndex][2];
+     }
 
-       debug_sincePrint = 0;
+     accX_raw_no_offsets = fifo_accelLast[0];
+     accY_raw_no_offsets = fifo_accelLast[1];
+     accZ_raw_no_offsets = fifo_accelLast[2];
+     gyrX_raw_no_offsets = fifo_gyroFrames[i][0];
+     gyrY_raw_no_offsets = fifo_gyroFrames[i][1];
+     gyrZ_raw_no_offsets = fifo_gyroFrames[i][2];
+
+     if (!checkRawSample()) {
+       continue;
      }
+
+     processRawSample();
+
+     fifo_samples[fifo_sampleCount][0] = accX_output;
+     fifo_samples[fifo_sampleCount][1] = accY_output;
+     fifo_samples[fifo_sampleCount][2] = accZ_output;
+     fifo_samples[fifo_sampleCount][3] = gyrX_output;
+     fifo_samples[fifo_sampleCount][4] = gyrY_output;
+     fifo_samples[fifo_sampleCount][5] = gyrZ_output;
+     fifo_sampleCount++;
+   }
+
+   return (fifo_sampleCount > sampleCountBefore);
+  #else
+   return false;
+  #endif
+}
+
+// Récupère l'échantillon lu en arrière plan depuis le tour de boucle précédent puis lance tout de suite la lecture du suivant.
+// Retourne false si la lecture précédente n'est pas terminée, a échoué ou n'a pas pu démarrer (aucun nouvel échantillon,
+// la fusion est alors sautée).
+bool GPF_IMU::getIMUData_async() {
+  bool ok;
+
+  if (i2cAsync.isBusy()) {
+    i2cAsync_notReadyCount++;
+    return false;
+  }
+
+  ok = i2cAsync_isStarted && i2cAsync.get_lastTransferOk();
+
+  if (ok) {
+    #if defined GPF_IMU_SENSOR_INSTALLED_MPU6050 //Big endian
+     accX_raw_no_offsets = (((int16_t)buffer[0])  << 8) | buffer[1];
+     accY_raw_no_offsets = (((int16_t)buffer[2])  << 8) | buffer[3];
+     accZ_raw_no_offsets = (((int16_t)buffer[4])  << 8) | buffer[5];
+     gyrX_raw_no_offsets = (((int16_t)buffer[8])  << 8) | buffer[9];
+     gyrY_raw_no_offsets = (((int16_t)buffer[10]) << 8) | buffer[11];
+     gyrZ_raw_no_offsets = (((int16_t)buffer[12]) << 8) | buffer[13];
     #endif
-*/
-    return true;
+
+    #if defined GPF_IMU_SENSOR_INSTALLED_BMI088_A //Little endian
+     accX_raw_no_offsets = (((int16_t)buffer[1])  << 8) | buffer[0];
+     accY_raw_no_offsets = (((int16_t)buffer[3])  << 8) | buffer[2];
+     accZ_raw_no_offsets = (((int16_t)buffer[5])  << 8) | buffer[4];
+     gyrX_raw_no_offsets = (((int16_t)buffer[7])  << 8) | buffer[6];
+     gyrY_raw_no_offsets = (((int16_t)buffer[9])  << 8) | buffer[8];
+     gyrZ_raw_no_offsets = (((int16_t)buffer[11]) << 8) | buffer[10];
+    #endif
+
+    sample_timestamp = i2cAsync_sampleTimestamp;
+  } else if (i2cAsync_isStarted) {
+    errorCount++;
+  }
+
+  i2cAsync_sampleTimestamp = takeSampleTimestamp();
+  i2cAsync_isStarted       = i2cAsync.start(); //Sinon on réessaie au prochain tour (Voir GPF_I2C_ASYNC::startFailedCount)
+
+  return ok;
+}
+
+const char *GPF_IMU::get_transportDescription() {
+  #if defined GPF_IMU_I2C_ASYNC_ENABLED
+   return "I2C async";
+  #elif defined GPF_IMU_SENSOR_INSTALLED_BMI088 && defined GPF_IMU_BMI088_TRANSPORT_SPI
+   return "SPI";
+  #else
+   return "I2C";
+  #endif
 }
 
+void GPF_IMU::resetReadDurationStats() {
+  readDurationMax   = 0;
+  fifo_gyroDepthMax = 0;
+}
+
+// Avant de se servir de Wire directement (ex: calibration), on attend la fin de la lecture en arrière plan.
+void GPF_IMU::waitForPendingRead() {
+  #if defined GPF_IMU_I2C_ASYNC_ENABLED
+   i2cAsync.waitUntilIdle(GPF_IMU_I2C_ASYNC_WAIT_TIMEOUT);
+  #endif
+}
+
+// Appelé à chaque tour de la boucle de contrôle, l'estimateur peut donc être changé dans le menu sans recompiler ni redémarrer.
+// Un estimateur qui prend le relais part de l'attitude actuelle et non de celle où il s'était arrêté (ou de l'horizontale au démarrage).
 void GPF_IMU::set_fusion_type(uint8_t flight_mode) {
+  uint8_t        fusion_type_previous = fusion_type;
+  GPF_ESTIMATOR *estimator_previous   = estimator;
+
   if (flight_mode == GPF_FLIGHT_MODE_3_FUSION_TYPE_MADGWICK) {
-   fusion_type = GPF_IMU_FUSION_TYPE_MADGWICK; //fm-3
+   //fm-3, estimateur choisi dans la config
+   switch (myConfig_ptr->estimator) {
+    case GPF_ESTIMATOR_TYPE_MAHONY:
+     fusion_type = GPF_IMU_FUSION_TYPE_MAHONY;
+     break;
+    case GPF_ESTIMATOR_TYPE_EKF:
+     fusion_type = GPF_IMU_FUSION_TYPE_EKF;
+     break;
+    default:
+     fusion_type = GPF_IMU_FUSION_TYPE_MADGWICK;
+     break;
+   }
+   estimator = get_estimator(myConfig_ptr->estimator);
   } else {
-   fusion_type = GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER; //fm-2 et fm-1
+   fusion_type = GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER; //fm-2, fm-1 et acro (attitude seulement pour la black box et l'écran)
+  }
+
+  if (fusion_type == GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER) {
+   return; //Le Complementary filter part déjà des angles de l'estimateur (Voir doFusion_complementaryFilter())
+  }
+  if (fusion_type_previous == GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER) {
+   estimator->setEulerDegrees(fusion_degree_roll, fusion_degree_pitch, 0); //Le yaw du Complementary filter n'est pas un cap
+  } else if (estimator != estimator_previous) {
+   float w, x, y, z;
+   estimator_previous->getQuaternion(&w, &x, &y, &z);
+   estimator->setQuaternion(w, x, y, z);
+  }
+}
+
+GPF_ESTIMATOR *GPF_IMU::get_estimator(uint8_t estimatorType) {
+  switch (estimatorType) {
+   case GPF_ESTIMATOR_TYPE_MAHONY:
+    return &estimator_mahony;
+   case GPF_ESTIMATOR_TYPE_EKF:
+    return &estimator_ekf;
+   default:
+    return &estimator_madgwick;
+  }
+}
+
+void GPF_IMU::resetEstimatorCycleStats() {
+  for (uint8_t estimatorType = 0; estimatorType < GPF_ESTIMATOR_TYPE_ITEM_COUNT; estimatorType++) {
+   get_estimator(estimatorType)->resetCycleStats();
   }
 }
 
 void GPF_IMU::doFusion() {
+ #if defined GPF_IMU_FIFO_ENABLED
+  //On intègre chacun des échantillons sortis du FIFO avec son propre dt (1/ODR du gyro) et non seulement le dernier.
+  //Les échantillons s'accumulent depuis la dernière fusion (étage gyro plus rapide que l'étage PID).
+  fusion_dt = 1.0 / GPF_IMU_GYRO_ODR;
+  for (uint8_t i = 0; i < fifo_sampleCount; i++) {
+   accX_output = fifo_samples[i][0];
+   accY_output = fifo_samples[i][1];
+   accZ_output = fifo_samples[i][2];
+   gyrX_output = fifo_samples[i][3];
+   gyrY_output = fifo_samples[i][4];
+   gyrZ_output = fifo_samples[i][5];
+   doFusion_oneSample();
+  }
+  fifo_sampleCount = 0;
+ #else
+  //La fusion roule à la vitesse de l'étage PID sur le dernier échantillon filtré. Le dt est donc celui entre deux fusions.
+  fusion_dt                 = (sample_timestamp - sample_timestamp_previous)/1000000.0; //Selon le moment où l'échantillon a été produit et non le moment du calcul
+  sample_timestamp_previous = sample_timestamp;
+  doFusion_oneSample();
+ #endif
+}
+
+void GPF_IMU::doFusion_oneSample() {
   
- if (fusion_type == GPF_IMU_FUSION_TYPE_MADGWICK) {
-  doFusion_madgwick6DOF();
- } else {
+ if (fusion_type == GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER) {
   doFusion_complementaryFilter();
+ } else {
+  doFusion_estimator();
  }
 
 }
 
-void GPF_IMU::doFusion_madgwick6DOF() {
-  // Cette fonction, légèrement adaptée pour ce projet, provient du projet dRehmFlight VTOL Flight Controller de Nicholas Rehm à https://github.com/nickrehm/dRehmFlight
-
-  //DESCRIPTION: Attitude estimation through sensor fusion - 6DOF
-  /*
-   * See description of Madgwick() for more information. This is a 6DOF implimentation for when magnetometer data is not
-   * available (for example when using the recommended MPU6050 IMU for the default setup).
-   * https://github.com/nickrehm/dRehmFlight/blob/master/dRehmFlight%20VTOL%20Documentation.pdf
-   */
-
-  float gx =  gyrX_output;
-  float gy = -gyrY_output; 
-  float gz = -gyrZ_output;
-  float ax = -accX_output; 
-  float ay =  accY_output; 
-  float az =  accZ_output; 
-
-  static unsigned long micros_previous = 0;
-  unsigned long current_time = micros();
-  float time_elapsed = (current_time - micros_previous)/1000000.0;
-  micros_previous = micros();
-
-  float recipNorm;
-  float s0, s1, s2, s3;
-  float qDot1, qDot2, qDot3, qDot4;
-  float _2q0, _2q1, _2q2, _2q3, _4q0, _4q1, _4q2 ,_8q1, _8q2, q0q0, q1q1, q2q2, q3q3;
-
-  //Convert gyroscope degrees/sec to radians/sec
-  gx *= 0.0174533f;
-  gy *= 0.0174533f;
-  gz *= 0.0174533f;
-
-  //Rate of change of quaternion from gyroscope
-  qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
-  qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
-  qDot3 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
-  qDot4 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
-
-  //Compute feedback only if accelerometer measurement valid (avoids NaN in accelerometer normalisation)
-  if(!((ax == 0.0f) && (ay == 0.0f) && (az == 0.0f))) {
-    //Normalise accelerometer measurement
-    recipNorm = gpf_util_invSqrt(ax * ax + ay * ay + az * az);
-    ax *= recipNorm;
-    ay *= recipNorm;
-    az *= recipNorm;
-
-    //Auxiliary variables to avoid repeated arithmetic
-    _2q0 = 2.0f * q0;
-    _2q1 = 2.0f * q1;
-    _2q2 = 2.0f * q2;
-    _2q3 = 2.0f * q3;
-    _4q0 = 4.0f * q0;
-    _4q1 = 4.0f * q1;
-    _4q2 = 4.0f * q2;
-    _8q1 = 8.0f * q1;
-    _8q2 = 8.0f * q2;
-    q0q0 = q0 * q0;
-    q1q1 = q1 * q1;
-    q2q2 = q2 * q2;
-    q3q3 = q3 * q3;
-
-    //Gradient decent algorithm corrective step
-    s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
-    s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
-    s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
-    s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
-    recipNorm = gpf_util_invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3); //normalise step magnitude
-    s0 *= recipNorm;
-    s1 *= recipNorm;
-    s2 *= recipNorm;
-    s3 *= recipNorm;
-
-    //Apply feedback step
-    qDot1 -= B_madgwick * s0;
-    qDot2 -= B_madgwick * s1;
-    qDot3 -= B_madgwick * s2;
-    qDot4 -= B_madgwick * s3;
-  }
-
-  //Integrate rate of change of quaternion to yield quaternion
-  q0 += qDot1 * time_elapsed;
-  q1 += qDot2 * time_elapsed;
-  q2 += qDot3 * time_elapsed;
-  q3 += qDot4 * time_elapsed;
-
-  //Normalise quaternion
-  recipNorm = gpf_util_invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
-  q0 *= recipNorm;
-  q1 *= recipNorm;
-  q2 *= recipNorm;
-  q3 *= recipNorm;
+// Madgwick, Mahony ou EKF (Voir gpf_estimator.cpp). Le coût de chaque update() est mesuré en cycles (DWT, Voir GPF_PROFILER::initialize()).
+void GPF_IMU::doFusion_estimator() {
+  //Axes remis dans la convention du filtre de Madgwick de dRehmFlight, gyro en rad/s
+  float gx =  gyrX_output * GPF_FAST_MATH_DEG_TO_RAD;
+  float gy = -gyrY_output * GPF_FAST_MATH_DEG_TO_RAD;
+  float gz = -gyrZ_output * GPF_FAST_MATH_DEG_TO_RAD;
+  float ax = -accX_output;
+  float ay =  accY_output;
+  float az =  accZ_output;
+  uint32_t startedAt;
+
+  #if defined GPF_IMU_ESTIMATOR_COMPARE_ENABLED
+   for (uint8_t estimatorType = 0; estimatorType < GPF_ESTIMATOR_TYPE_ITEM_COUNT; estimatorType++) {
+    GPF_ESTIMATOR *compared = get_estimator(estimatorType);
+    startedAt = ARM_DWT_CYCCNT;
+    compared->update(gx, gy, gz, ax, ay, az, fusion_dt);
+    compared->recordCycles(ARM_DWT_CYCCNT - startedAt);
+   }
+  #else
+   startedAt = ARM_DWT_CYCCNT;
+   estimator->update(gx, gy, gz, ax, ay, az, fusion_dt);
+   estimator->recordCycles(ARM_DWT_CYCCNT - startedAt);
+  #endif
 
-  //Compute angles
-  fusion_degree_roll = atan2(q0*q1 + q2*q3, 0.5f - q1*q1 - q2*q2)*57.29577951; //degrees
-  fusion_degree_pitch = -asin(-2.0f * (q1*q3 - q0*q2))*57.29577951; //degrees
-  fusion_degree_yaw = -atan2(q1*q2 + q0*q3, 0.5f - q2*q2 - q3*q3)*57.29577951; //degrees
+  #if defined GPF_CONTROLLER_QUATERNION_ANGLE_ENABLED
+   fusion_degreesAreStale = true; //Le contrôle se sert du quaternion, les angles sont calculés seulement au besoin
+  #else
+   computeFusionDegrees();
+  #endif
 
   #ifdef DEBUG_GPF_IMU_ENABLED
      if (debug_sincePrint > DEBUG_GPF_IMU_DELAY) {
+       computeFusionDegrees();
        DEBUG_GPF_IMU_PRINT(fusion_degree_roll);            DEBUG_GPF_IMU_PRINT(F(", "));       
        DEBUG_GPF_IMU_PRINT(fusion_degree_pitch);           DEBUG_GPF_IMU_PRINT(F(", "));       
        DEBUG_GPF_IMU_PRINT(fusion_degree_yaw);             DEBUG_GPF_IMU_PRINT(F(", "));       
@@ -371,6 +641,30 @@ void GPF_IMU::doFusion_madgwick6DOF() {
 
 }
 
+void GPF_IMU::computeFusionDegrees() {
+  estimator->getEulerDegrees(&fusion_degree_roll, &fusion_degree_pitch, &fusion_degree_yaw); //degrees
+  fusion_degreesAreStale = false;
+}
+
+// Pour la black box et l'écran (loop()). Le quaternion est mis à jour par la boucle de contrôle (interruption du timer).
+void GPF_IMU::updateFusionDegrees() {
+  noInterrupts();
+  if (fusion_degreesAreStale) {
+   computeFusionDegrees();
+  }
+  interrupts();
+}
+
+// Erreur de roll et pitch du mode angle sans passer par les angles d'Euler (Voir GPF_ESTIMATOR::getTiltErrorDegrees()).
+// Retourne false avec le Complementary filter (fm-2) qui n'a pas de quaternion.
+bool GPF_IMU::getTiltErrorDegrees(float rollDesired, float pitchDesired, float *errorRoll, float *errorPitch) {
+  if (fusion_type == GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER) {
+   return false;
+  }
+  estimator->getTiltErrorDegrees(rollDesired, pitchDesired, errorRoll, errorPitch);
+  return true;
+}
+
 void GPF_IMU::doFusion_complementaryFilter() {
     // Simple filtre complémentaire par Guylain Plante:
     //
@@ -407,29 +701,31 @@ void GPF_IMU::doFusion_complementaryFilter() {
 
     float fusion_degree_pitch_temp, fusion_degree_roll_temp, fusion_degree_yaw_temp;
 
-    static unsigned long micros_previous = 0;
-    unsigned long current_time = micros();
-    float time_elapsed = (current_time - micros_previous)/1000000.0;
-    micros_previous = micros();
+    float time_elapsed = fusion_dt;
 
+    if (fusion_degreesAreStale) {
+     computeFusionDegrees(); //On part de l'attitude de l'estimateur en passant de fm-3 à fm-2
+    }
+
+    // atan(a/racine(b²+c²)) écrit avec atan2 en simple précision: même résultat mais pas de division par 0 (Voir gpf_fast_math.h)
     // Z Axis (-90 degrés à 90 degrés)
-    acc_yaw_radiant = atan(az/sqrt(pow(ax,2)+pow(ay,2))); 
-    acc_yaw_degree  = acc_yaw_radiant/2/PI*360;
+    acc_yaw_radiant = gpf_fast_math_atan2(az, sqrtf(ax*ax + ay*ay)); 
+    acc_yaw_degree  = acc_yaw_radiant*GPF_FAST_MATH_RAD_TO_DEG;
     fusion_degree_yaw_temp = acc_yaw_degree;
 
     // X Axis // Z Axis (-90 degrés à 90 degrés)
-    acc_pitch_radiant = atan(ax/sqrt(pow(ay,2)+pow(az,2)));
-    acc_pitch_degree  = acc_pitch_radiant/2/PI*360;
+    acc_pitch_radiant = gpf_fast_math_atan2(ax, sqrtf(ay*ay + az*az));
+    acc_pitch_degree  = acc_pitch_radiant*GPF_FAST_MATH_RAD_TO_DEG;
 
     // Y Axis // Z Axis (-90 degrés à 90 degrés)
-    acc_roll_radiant = atan(ay/sqrt(pow(ax,2)+pow(az,2)));
-    acc_roll_degree  = acc_roll_radiant/2/PI*360;
+    acc_roll_radiant = gpf_fast_math_atan2(ay, sqrtf(ax*ax + az*az));
+    acc_roll_degree  = acc_roll_radiant*GPF_FAST_MATH_RAD_TO_DEG;
 
     gyr_pitch_degree = -(gy * time_elapsed);
     gyr_roll_degree  =   gx * time_elapsed;
 
-    fusion_degree_pitch_temp = (GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER*(fusion_degree_pitch + gyr_pitch_degree)) + ((1.0 - GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER)*acc_pitch_degree);
-    fusion_degree_roll_temp  = (GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER*(fusion_degree_roll  + gyr_roll_degree))  + ((1.0 - GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER)*acc_roll_degree);
+    fusion_degree_pitch_temp = (GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER*(fusion_degree_pitch + gyr_pitch_degree)) + ((1.0f - GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER)*acc_pitch_degree);
+    fusion_degree_roll_temp  = (GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER*(fusion_degree_roll  + gyr_roll_degree))  + ((1.0f - GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER)*acc_roll_degree);
 
     if ( (!isnan(fusion_degree_pitch_temp)) && (!isnan(fusion_degree_roll_temp)) && (!isnan(fusion_degree_yaw_temp)) ) {
       fusion_degree_pitch = fusion_degree_pitch_temp;
@@ -458,6 +754,55 @@ void GPF_IMU::doFusion_complementaryFilter() {
 
 }
 
+// Branche l'interruption DRDY du gyro (INT3) pour qu'elle déclenche la boucle de contrôle.
+// Le front DRDY ne fait que prendre l'heure et compter. La boucle de contrôle roule ensuite dans une interruption logicielle 
+// (IRQ_SOFTWARE) moins prioritaire pour que les fronts suivants soient comptés même si un tour de boucle est en retard.
+bool GPF_IMU::drdySyncStart(void (*controlLoopFunction)()) {
+ #if defined GPF_IMU_GYRO_DRDY_SYNC_ENABLED
+  drdyInstance        = this;
+  drdy_count          = 0;
+  drdy_count_lastRead = 0;
+
+  if (!theImu_bmi088_gyro->pinModeInt3(Bmi088Gyro::PUSH_PULL, Bmi088Gyro::ACTIVE_HIGH)) {
+    DEBUG_GPF_IMU_PRINTLN("Gyro pinModeInt3 Error");
+    return false;
+  }
+
+  if (!theImu_bmi088_gyro->mapDrdyInt3(true)) {
+    DEBUG_GPF_IMU_PRINTLN("Gyro mapDrdyInt3 Error");
+    return false;
+  }
+
+  attachInterruptVector(IRQ_SOFTWARE, controlLoopFunction);
+  NVIC_SET_PRIORITY(IRQ_SOFTWARE, GPF_MAIN_LOOP_TIMER_PRIORITY);
+  NVIC_ENABLE_IRQ(IRQ_SOFTWARE);
+
+  pinMode(GPF_IMU_PIN_GYRO_DRDY_INT3, INPUT);
+  attachInterrupt(digitalPinToInterrupt(GPF_IMU_PIN_GYRO_DRDY_INT3), GPF_IMU::drdyISR, RISING);
+  NVIC_SET_PRIORITY(IRQ_GPIO6789, GPF_IMU_GYRO_DRDY_PRIORITY); //Vecteur commun à toutes les pins (Voir GPF_IMU_GYRO_DRDY_PRIORITY)
+  return true;
+ #else
+  (void)controlLoopFunction;
+  return false;
+ #endif
+}
+
+void GPF_IMU::drdySyncStop() {
+ #if defined GPF_IMU_GYRO_DRDY_SYNC_ENABLED
+  detachInterrupt(digitalPinToInterrupt(GPF_IMU_PIN_GYRO_DRDY_INT3));
+  NVIC_DISABLE_IRQ(IRQ_SOFTWARE);
+ #endif
+}
+
+void GPF_IMU::drdyISR() {
+  drdyInstance->drdy_timestamp = micros();
+  drdyInstance->drdy_count++;
+
+  if ((drdyInstance->drdy_count % GPF_IMU_GYRO_DRDY_SAMPLES_PER_LOOP) == 0) {
+    NVIC_SET_PENDING(IRQ_SOFTWARE); //Déclenche la boucle de contrôle
+  }
+}
+
 // Fonction qui fait plusieurs séries de lecture et garde le min/max de chaque série de lecture puis ensuite
 // fait une moyenne qui sera l'offset final.
 void GPF_IMU::calibrate() {
@@ -15,6 +15,12 @@
 #include "gpf_cons.h"
 #include "MPU6050.h"
 #include "BMI088.h"
+#include "gpf_i2c_async.h"
+#include "gpf_imu_fifo.h"
+#include "gpf_filter.h"
+#include "gpf_dyn_notch.h"
+#include "gpf_harmonic_notch.h"
+#include "gpf_estimator.h"
 
 
 //***Décommentez seulement un GPF_IMU_SENSOR_INSTALLED_? ci-dessous                        ***Choisir seulement 1***
@@ -25,6 +31,17 @@
 #define GPF_IMU_SENSOR_INSTALLED_BMI088_A   1 
 //#define GPF_IMU_SENSOR_INSTALLED_BMI088_B   2 //Pour fin de tests seulement
 
+//***Décommentez seulement un GPF_IMU_BMI088_TRANSPORT_? ci-dessous                      ***Choisir seulement 1***
+#define GPF_IMU_BMI088_TRANSPORT_I2C        1 //Wire (pins 18/19) à 400 kHz
+//#define GPF_IMU_BMI088_TRANSPORT_SPI        2 //SPI1 dédié au IMU (pas celui de l'écran et du touch) à 10 MHz. Nécessaire pour une boucle gyro de 4-8 kHz.
+
+#define GPF_IMU_BMI088_SPI_CS_ACCEL         38 //Chip Select du accel (CSB1) sur SPI1 (MOSI1=26, MISO1=1, SCK1=27)
+#define GPF_IMU_BMI088_SPI_CS_GYRO          37 //Chip Select du gyro  (CSB2) sur SPI1
+
+#if defined GPF_IMU_BMI088_TRANSPORT_SPI && defined GPF_IMU_BMI088_TRANSPORT_I2C
+  #error "Choisir seulement un GPF_IMU_BMI088_TRANSPORT_?"
+#endif
+
 //MPU6050 Accel
 //***Uncomment only one full scale accelerometer range (G's)                               ***Choisir seulement 1***
 #define GPF_IMU_MPU6050_ACCEL_2G //Default
@@ -144,11 +161,122 @@
   #define GPF_IMU_GYRO_SCALE_FACTOR 16.384
 #endif
 
+//BMI088 Gyro DRDY (data ready)
+//Décommentez pour que chaque tour de la boucle de contrôle soit déclenché par l'interruption DRDY du gyro (pin INT3 du BMI088)
+//plutôt que par le timer. Les lectures sont alors en phase avec le gyro. (Voir GPF::controlLoopStart())
+//#define GPF_IMU_GYRO_DRDY_SYNC_ENABLED
+#define GPF_IMU_PIN_GYRO_DRDY_INT3           32   //Pin du Teensy branchée sur INT3 du BMI088
+//Priorité NVIC de IRQ_GPIO6789. Doit être plus prioritaire que la boucle de contrôle (GPF_MAIN_LOOP_TIMER_PRIORITY).
+//Sur le Teensy 4.1 toutes les pins passent par ce même vecteur (GPIO6 à 9): cette priorité s'applique donc à tout attachInterrupt().
+//Aujourd'hui DRDY est le seul (le XPT2046 est construit sans pin IRQ, voir gpf_touch.h). Une autre pin en interruption doit
+//rester très courte puisqu'elle passera devant la boucle de contrôle.
+#define GPF_IMU_GYRO_DRDY_PRIORITY           32
+
+#if defined GPF_IMU_GYRO_DRDY_SYNC_ENABLED && !defined GPF_IMU_SENSOR_INSTALLED_BMI088_A
+  #error "GPF_IMU_GYRO_DRDY_SYNC_ENABLED est disponible seulement avec GPF_IMU_SENSOR_INSTALLED_BMI088_A"
+#endif
+
+//Lecture I2C non bloquante
+//Décommentez pour que getIMUData() lance la lecture du prochain échantillon et retourne immédiatement (interruption LPI2C, voir gpf_i2c_async.cpp).
+//La fusion et les PIDs sont alors calculés sur l'échantillon précédent pendant que le bus transfert le suivant.
+//#define GPF_IMU_I2C_ASYNC_ENABLED
+#define GPF_IMU_BMI088_ACCEL_I2C_ADDRESS     0x19 //0x18
+#define GPF_IMU_BMI088_GYRO_I2C_ADDRESS      0x69 //0x68
+#define GPF_IMU_BMI088_ACCEL_DATA_REGISTER   0x12 //ACC_X_LSB
+#define GPF_IMU_BMI088_GYRO_DATA_REGISTER    0x02 //RATE_X_LSB
+#define GPF_IMU_I2C_ASYNC_WAIT_TIMEOUT       2000 //us
+
+#if defined GPF_IMU_I2C_ASYNC_ENABLED && defined GPF_IMU_SENSOR_INSTALLED_BMI088 && defined GPF_IMU_BMI088_TRANSPORT_SPI
+  #error "GPF_IMU_I2C_ASYNC_ENABLED n'a pas de sens avec GPF_IMU_BMI088_TRANSPORT_SPI"
+#endif
+
+#if defined GPF_IMU_I2C_ASYNC_ENABLED && defined GPF_IMU_SENSOR_INSTALLED_BMI088_B
+  #error "GPF_IMU_I2C_ASYNC_ENABLED n'est pas disponible avec GPF_IMU_SENSOR_INSTALLED_BMI088_B"
+#endif
+
+//FIFO du BMI088
+//Décommentez pour vider les FIFO du gyro et du accel à chaque tour de boucle plutôt que de lire seulement le dernier échantillon.
+//Aucun échantillon du gyro n'est alors perdu même si la boucle de contrôle prend du retard et chacun passe par les filtres et la fusion.
+//#define GPF_IMU_FIFO_ENABLED
+#define GPF_IMU_FIFO_ACCEL_READ_MAX_LENGTH   (GPF_IMU_FIFO_ACCEL_MAX_FRAMES * 7) //octets //Header + 6 octets par frame accel
+
+#if defined GPF_IMU_FIFO_ENABLED && !defined GPF_IMU_SENSOR_INSTALLED_BMI088_A
+  #error "GPF_IMU_FIFO_ENABLED est disponible seulement avec GPF_IMU_SENSOR_INSTALLED_BMI088_A"
+#endif
+
+#if defined GPF_IMU_FIFO_ENABLED && defined GPF_IMU_I2C_ASYNC_ENABLED
+  #error "Choisir GPF_IMU_FIFO_ENABLED ou GPF_IMU_I2C_ASYNC_ENABLED mais pas les deux"
+#endif
+
+#if (GPF_GYRO_LOOP_RATE < 2000) && !defined GPF_IMU_BMI088_TRANSPORT_SPI && !defined GPF_IMU_FIFO_ENABLED
+  #error "En I2C, une lecture bloquante de ~400us à chaque tour de moins de 2000us ne laisse presque plus rien à loop(). Utiliser GPF_IMU_BMI088_TRANSPORT_SPI ou GPF_IMU_FIFO_ENABLED (Voir GPF_GYRO_LOOP_RATE)"
+#endif
+
+//Avec DRDY, le ODR du gyro suit l'étage gyro (GPF_GYRO_LOOP_RATE): un front DRDY par tour, aucun échantillon sauté.
+//Avec le FIFO, chaque échantillon est lu de toute facon alors le gyro reste à 2000hz.
+#if defined GPF_IMU_GYRO_DRDY_SYNC_ENABLED && !defined GPF_IMU_FIFO_ENABLED
+  #if GPF_GYRO_LOOP_RATE == 500
+    #define GPF_IMU_GYRO_ODR                 2000 //hz
+    #define GPF_IMU_GYRO_ODR_SETTING         Bmi088Gyro::ODR_2000HZ_BW_532HZ
+  #elif GPF_GYRO_LOOP_RATE == 1000
+    #define GPF_IMU_GYRO_ODR                 1000 //hz
+    #define GPF_IMU_GYRO_ODR_SETTING         Bmi088Gyro::ODR_1000HZ_BW_116HZ
+  #elif GPF_GYRO_LOOP_RATE == 2500
+    #define GPF_IMU_GYRO_ODR                 400  //hz
+    #define GPF_IMU_GYRO_ODR_SETTING         Bmi088Gyro::ODR_400HZ_BW_47HZ
+  #elif GPF_GYRO_LOOP_RATE == 5000
+    #define GPF_IMU_GYRO_ODR                 200  //hz
+    #define GPF_IMU_GYRO_ODR_SETTING         Bmi088Gyro::ODR_200HZ_BW_64HZ
+  #else
+    #error "Avec GPF_IMU_GYRO_DRDY_SYNC_ENABLED, GPF_GYRO_LOOP_RATE doit correspondre à un ODR du gyro (500, 1000, 2500 ou 5000us)"
+  #endif
+#else
+  #define GPF_IMU_GYRO_ODR                   2000 //hz
+  #define GPF_IMU_GYRO_ODR_SETTING           Bmi088Gyro::ODR_2000HZ_BW_532HZ
+#endif
+#define GPF_IMU_GYRO_DRDY_SAMPLES_PER_LOOP   ((GPF_IMU_GYRO_ODR * GPF_GYRO_LOOP_RATE) / 1000000) //Un tour de l'étage gyro à tous les n échantillons du gyro (1 sauf avec le FIFO)
+
+#if defined GPF_IMU_GYRO_DRDY_SYNC_ENABLED && (GPF_IMU_GYRO_DRDY_SAMPLES_PER_LOOP < 1)
+  #error "GPF_GYRO_LOOP_RATE est plus court que la période du gyro (GPF_IMU_GYRO_ODR)"
+#endif
+
+//Filtres passe-bas du gyro et du accel (Voir gpf_filter.cpp)
+//La fréquence de coupure est en hz et les coefficients suivent la fréquence d'échantillonnage mesurée (étage gyro ou ODR en mode FIFO).
+#define GPF_IMU_FILTER_GYRO_TYPE             GPF_FILTER_TYPE_BIQUAD
+#define GPF_IMU_FILTER_GYRO_CUTOFF           80   //hz
+#define GPF_IMU_FILTER_ACCEL_TYPE            GPF_FILTER_TYPE_PT2
+#define GPF_IMU_FILTER_ACCEL_CUTOFF          30   //hz
+#define GPF_IMU_FILTER_SAMPLE_RATE_WEIGHT    0.01 //Poids d'une nouvelle mesure dans la moyenne de la fréquence d'échantillonnage
+
+//Filtres coupe-bande dynamiques du gyro (Voir gpf_dyn_notch.cpp)
+//Décommentez pour analyser le spectre du gyro (FFT étalée sur plusieurs tours de boucle) et placer des filtres coupe-bande sur les pics de bruit des moteurs.
+//#define GPF_IMU_DYN_NOTCH_ENABLED
+#define GPF_IMU_DYN_NOTCH_COUNT              2    //Filtres par axe (1 à GPF_DYN_NOTCH_MAX_COUNT)
+#define GPF_IMU_DYN_NOTCH_MIN_HZ             80   //hz //Sous cette fréquence, c'est le mouvement de l'avion et non du bruit
+#define GPF_IMU_DYN_NOTCH_MAX_HZ             600  //hz
+#define GPF_IMU_DYN_NOTCH_Q                  3.5  //Largeur de la bande coupée d'environ centre/Q
+
+//Filtres coupe-bande harmoniques du gyro selon les gaz (Voir gpf_harmonic_notch.cpp)
+//Décommentez pour placer des filtres coupe-bande sur le bruit des moteurs (fondamental et harmoniques) d'après une courbe gaz -> hz.
+//Beaucoup moins coûteux que GPF_IMU_DYN_NOTCH_ENABLED mais la courbe doit être mesurée (black box) pour chaque avion.
+//#define GPF_IMU_HARMONIC_NOTCH_ENABLED
+#define GPF_IMU_HARMONIC_NOTCH_CURVE_HZ      {90, 130, 170, 210, 250} //hz //Fondamental à gaz de 0 à 100%, points également espacés
+#define GPF_IMU_HARMONIC_NOTCH_HARMONICS     3    //Fondamental compris (1 à GPF_HARMONIC_NOTCH_MAX_HARMONICS)
+#define GPF_IMU_HARMONIC_NOTCH_Q             3.5
+//Décommentez pour suivre la moyenne des commandes DSHOT envoyées aux moteurs plutôt que desired_state_throttle
+//#define GPF_IMU_HARMONIC_NOTCH_SOURCE_DSHOT
+
 //Fusion type
 #define GPF_IMU_FUSION_TYPE_MADGWICK              0
 #define GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER  1
+#define GPF_IMU_FUSION_TYPE_MAHONY                2
+#define GPF_IMU_FUSION_TYPE_EKF                   3
+
+//Décommentez pour faire rouler les 3 estimateurs (Voir gpf_estimator.cpp) sur chaque échantillon et les comparer sur le même vol
+//(black box et commande 'e' du port USB). Seul celui choisi dans la config sert au contrôle.
+//#define GPF_IMU_ESTIMATOR_COMPARE_ENABLED
 
-#define GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER  0.995 // Min 0, Max 1
+#define GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER  0.995f // Min 0, Max 1 //float pour que doFusion_complementaryFilter() reste en simple précision
 
 class GPF_IMU {
     public:
@@ -158,17 +286,29 @@ class GPF_IMU {
         bool getIMUData();
         void set_fusion_type(uint8_t flight_mode);
         void doFusion();
-        void doFusion_madgwick6DOF();
+        void doFusion_estimator();
         void doFusion_complementaryFilter();
+        GPF_ESTIMATOR *get_estimator(uint8_t estimatorType); //gpf_estimator_type_enum
+        bool getTiltErrorDegrees(float rollDesired, float pitchDesired, float *errorRoll, float *errorPitch);
+        void updateFusionDegrees();
+        void resetEstimatorCycleStats();
 
         void calibrate();
         void meansensors();
 
+        void waitForPendingRead();
+        const char *get_transportDescription();
+        void resetReadDurationStats();
+
+        bool drdySyncStart(void (*controlLoopFunction)());
+        void drdySyncStop();
+        static void drdyISR();
+
         uint8_t fusion_type = GPF_IMU_FUSION_TYPE_MADGWICK; //GPF_IMU_FUSION_TYPE_COMPLEMENTARY_FILTER; //GPF_IMU_FUSION_TYPE_MADGWICK;
         int16_t calibration_offset_ax, calibration_offset_ay, calibration_offset_az, calibration_offset_gx, calibration_offset_gy, calibration_offset_gz;
         int16_t accX_raw_no_offsets,   accY_raw_no_offsets,   accZ_raw_no_offsets,   gyrX_raw_no_offsets,   gyrY_raw_no_offsets,   gyrZ_raw_no_offsets;
         int16_t accX_raw_plus_offsets, accY_raw_plus_offsets, accZ_raw_plus_offsets, gyrX_raw_plus_offsets, gyrY_raw_plus_offsets, gyrZ_raw_plus_offsets;
-        float fusion_degree_roll, fusion_degree_pitch, fusion_degree_yaw; //degres
+        float fusion_degree_roll, fusion_degree_pitch, fusion_degree_yaw; //degres //Avec GPF_CONTROLLER_QUATERNION_ANGLE_ENABLED, appelez updateFusionDegrees() avant de les lire
 
         float accX_output,      accY_output,      accZ_output;
         float gyrX_output,      gyrY_output,      gyrZ_output;
@@ -176,10 +316,38 @@ class GPF_IMU {
         
         unsigned long errorCount = 0;
 
+        unsigned long sample_timestamp              = 0; //us //Moment où l'échantillon lu par getIMUData() a été produit (front DRDY si disponible)
+        unsigned long drdy_missedSampleCount        = 0; //Échantillons du gyro perdus en plus de ceux sautés volontairement (GPF_IMU_GYRO_DRDY_SAMPLES_PER_LOOP)
+        unsigned long drdy_duplicatedSampleCount    = 0; //Lectures faites sans nouvel échantillon depuis la lecture précédente
+
+        uint8_t       fifo_gyroDepth                = 0; //Nombre d'échantillons du gyro sortis du FIFO au dernier tour de boucle
+        uint8_t       fifo_gyroDepthMax             = 0;
+        unsigned long fifo_gyroOverflowCount        = 0; //Nombre de fois où le FIFO du gyro était plein (échantillons perdus)
+        unsigned long fifo_gyroDroppedFrameCount    = 0; //Frames du gyro jetées par le reset du FIFO après un overflow ou faute de place avant doFusion()
+        unsigned long fifo_accelSkippedFrameCount   = 0; //Frames perdues par le FIFO du accel
+        unsigned long fifo_accelDecodeErrorCount    = 0;
+
+        unsigned long readDuration                  = 0; //us //Temps pris par la lecture du IMU dans getIMUData() (pour comparer I2C et SPI)
+        unsigned long readDurationMax               = 0; //us
+
+        GPF_I2C_ASYNC i2cAsync;
+        unsigned long i2cAsync_notReadyCount        = 0; //Tours de boucle où la lecture précédente n'était pas terminée
+
         //Filter parameters - Defaults tuned for 2kHz loop rate; Do not touch unless you know what you are doing:
         float B_madgwick = 0.04; //0.99; //0.04 //Madgwick filter parameter //Higher B madgwick leads to a noisier estimate, while lower B madgwick leads to a slower to respond estimate.
-        float B_accel = 0.14;    //Accelerometer LP filter paramter, (MPU6050 default: 0.14. MPU9250 default: 0.2)
-        float B_gyro = 0.1;      //Gyro LP filter paramter, (MPU6050 default: 0.1. MPU9250 default: 0.17)
+        GPF_ESTIMATOR_MADGWICK estimator_madgwick = GPF_ESTIMATOR_MADGWICK(&B_madgwick);
+        GPF_ESTIMATOR_MAHONY   estimator_mahony;
+        GPF_ESTIMATOR_EKF      estimator_ekf;
+        GPF_ESTIMATOR         *estimator = &estimator_madgwick; //Celui de fusion_type (fm-3)
+        GPF_FILTER_3AXES gyroFilter;
+        GPF_FILTER_3AXES accelFilter;
+        float            filter_sampleRateHz = 1000000.0 / GPF_GYRO_LOOP_RATE; //hz //Fréquence mesurée des échantillons qui passent dans les filtres
+        #if defined GPF_IMU_DYN_NOTCH_ENABLED
+         GPF_DYN_NOTCH   dynNotch;
+        #endif
+        #if defined GPF_IMU_HARMONIC_NOTCH_ENABLED
+         GPF_HARMONIC_NOTCH harmonicNotch;
+        #endif
     private:
         gpf_config_struct *myConfig_ptr = NULL;
 
@@ -196,13 +364,36 @@ class GPF_IMU {
         uint8_t buffer[14];
         elapsedMillis debug_sincePrint;
 
-        float accX_output_prev, accY_output_prev, accZ_output_prev;        
-        float gyrX_output_prev, gyrY_output_prev, gyrZ_output_prev;
-        
-        float q0 = 1.0f; //Initialize quaternion for madgwick filter
-        float q1 = 0.0f;
-        float q2 = 0.0f;
-        float q3 = 0.0f;
+        bool          getIMUData_async();
+        bool          getIMUData_fifo();
+        bool          checkRawSample();
+        void          processRawSample();
+        void          doFusion_oneSample();
+        void          computeFusionDegrees();
+
+        float         fusion_dt                 = 0.0; //secondes
+        volatile bool fusion_degreesAreStale    = false; //Le quaternion de l'estimateur a changé depuis le dernier calcul des fusion_degree_*
+        unsigned long sample_timestamp_previous = 0;   //us
+
+        #if defined GPF_IMU_FIFO_ENABLED
+         uint8_t fifo_gyroBuffer[GPF_IMU_FIFO_GYRO_MAX_FRAMES * GPF_IMU_FIFO_GYRO_FRAME_LENGTH];
+         uint8_t fifo_accelBuffer[GPF_IMU_FIFO_ACCEL_READ_MAX_LENGTH];
+         int16_t fifo_gyroFrames[GPF_IMU_FIFO_GYRO_MAX_FRAMES][3];
+         int16_t fifo_accelFrames[GPF_IMU_FIFO_ACCEL_MAX_FRAMES][3];
+         int16_t fifo_accelLast[3] = {0, 0, 0};
+         float   fifo_samples[GPF_IMU_FIFO_GYRO_MAX_FRAMES][6]; //accX, accY, accZ, gyrX, gyrY, gyrZ filtrés
+        #endif
+        uint8_t fifo_sampleCount = 0;
+        unsigned long takeSampleTimestamp();
+        unsigned long i2cAsync_sampleTimestamp = 0; //us
+        bool          i2cAsync_isStarted       = false; //Une lecture a été lancée et pas encore récupérée
+
+        static GPF_IMU         *drdyInstance;
+        volatile unsigned long  drdy_count          = 0; //Nombre de fronts DRDY reçus du gyro
+        volatile unsigned long  drdy_timestamp      = 0; //us
+        unsigned long           drdy_count_lastRead = 0;
+
+        unsigned long filter_sampleTimestamp_previous = 0; //us
         
 };
 
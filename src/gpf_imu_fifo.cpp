@@ -0,0 +1,126 @@
+/**
+ * @file gpf_imu_fifo.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-19
+ * 
+ * Décodage des octets lus dans les FIFO du gyro et du accel du BMI088.
+ * 
+ * Ces fonctions ne touchent pas au sensor. Elles reçoivent seulement les octets lus. On peut donc les vérifier sur
+ * un PC en leur passant un flux d'octets enregistré (ex: capture du FIFO écrite dans le DEBUG_LOG de la carte SD).
+ * Voir test/test_imu_fifo.cpp.
+ * 
+ * Gyro:  Frames de 6 octets sans header (X, Y, Z little endian) en mode x/y/z.
+ * Accel: Frames avec header. Seules les frames accel (0x84) contiennent des données. Les autres sont sautées
+ *        mais les frames "skip" (0x40) indiquent combien de frames ont été perdues lorsque le FIFO était plein.
+ * 
+ * Lecture du accel: lorsqu'une lecture s'arrête au milieu d'une frame, le sensor redonne cette frame au complet à la
+ * lecture suivante. En I2C, le FIFO est lu par bouts de 30 octets (buffer de Wire) et les frames ont 2 à 7 octets:
+ * gpf_imu_fifo_readAccel() garde seulement les frames complètes de chaque bout. Simplement coller les bouts un après
+ * l'autre ferait apparaître la frame coupée deux fois et décalerait les headers. En SPI, tout est lu d'un seul coup.
+ * 
+ */
+
+#include "gpf_imu_fifo.h"
+
+// Retourne le nombre de frames complètes décodées.
+uint8_t gpf_imu_fifo_decodeGyro(const uint8_t *data, uint16_t length, int16_t frames[][3], uint8_t maxFrames) {
+  uint8_t  frameCount = 0;
+  uint16_t i          = 0;
+
+  while (((i + GPF_IMU_FIFO_GYRO_FRAME_LENGTH) <= length) && (frameCount < maxFrames)) {
+    frames[frameCount][0] = (int16_t)((data[i + 1] << 8) | data[i + 0]);
+    frames[frameCount][1] = (int16_t)((data[i + 3] << 8) | data[i + 2]);
+    frames[frameCount][2] = (int16_t)((data[i + 5] << 8) | data[i + 4]);
+    frameCount++;
+    i += GPF_IMU_FIFO_GYRO_FRAME_LENGTH;
+  }
+
+  return frameCount;
+}
+
+// Nombre d'octets qui suivent le header, 0xFF pour une frame vide ou un header invalide.
+static uint8_t gpf_imu_fifo_getAccelPayloadSize(uint8_t header) {
+  switch (header & GPF_IMU_FIFO_ACCEL_HEADER_MASK) {
+    case GPF_IMU_FIFO_ACCEL_HEADER_ACCEL:
+      return 6;
+    case GPF_IMU_FIFO_ACCEL_HEADER_SKIP:
+    case GPF_IMU_FIFO_ACCEL_HEADER_CONFIG:
+    case GPF_IMU_FIFO_ACCEL_HEADER_DROP:
+      return 1;
+    case GPF_IMU_FIFO_ACCEL_HEADER_SENSORTIME:
+      return 3;
+    default:
+      return 0xFF;
+  }
+}
+
+// Lit length octets du FIFO du accel dans dest, bout par bout, en gardant seulement les frames complètes.
+// Retourne le nombre d'octets gardés. Une frame coupée par la limite de length reste dans le FIFO pour la prochaine fois.
+uint16_t gpf_imu_fifo_readAccel(gpf_imu_fifo_read_function readFifo, void *context, uint16_t length, uint8_t *dest) {
+  uint16_t keptLength = 0;
+
+  while (keptLength < length) {
+    uint16_t readLength     = readFifo(context, length - keptLength, dest + keptLength);
+    uint16_t completeLength = 0;
+    uint8_t  payloadSize    = 0;
+
+    while (completeLength < readLength) {
+      payloadSize = gpf_imu_fifo_getAccelPayloadSize(dest[keptLength + completeLength]);
+      if ((payloadSize == 0xFF) || ((completeLength + 1 + payloadSize) > readLength)) {
+        break;
+      }
+      completeLength += 1 + payloadSize;
+    }
+
+    if (payloadSize == 0xFF) { //Fin des données ou header invalide: on le garde pour que gpf_imu_fifo_decodeAccel() le voit
+      return keptLength + readLength;
+    }
+    keptLength += completeLength;
+    if ((readLength == 0) || (completeLength == 0)) { //Rien de plus à lire ou frame plus longue que ce qui reste
+      break;
+    }
+  }
+
+  return keptLength;
+}
+
+void gpf_imu_fifo_decodeAccel(const uint8_t *data, uint16_t length, int16_t frames[][3], uint16_t maxFrames, gpf_imu_fifo_accel_decode_result_struct *result) {
+  uint16_t i = 0;
+
+  result->frameCount         = 0;
+  result->skippedFrameCount  = 0;
+  result->unknownHeaderCount = 0;
+  result->truncated          = false;
+
+  while (i < length) {
+    uint8_t header      = data[i];
+    uint8_t payloadSize = gpf_imu_fifo_getAccelPayloadSize(header);
+
+    if ((header & GPF_IMU_FIFO_ACCEL_HEADER_MASK) == GPF_IMU_FIFO_ACCEL_HEADER_EMPTY) {
+      return; //Fin des données valides
+    }
+    if (payloadSize == 0xFF) {
+      result->unknownHeaderCount++;
+      return; //On a perdu la synchronisation, on ne peut plus se fier au reste
+    }
+
+    if ((i + 1 + payloadSize) > length) {
+      result->truncated = true;
+      return;
+    }
+
+    if ((header & GPF_IMU_FIFO_ACCEL_HEADER_MASK) == GPF_IMU_FIFO_ACCEL_HEADER_ACCEL) {
+      if (result->frameCount < maxFrames) {
+        frames[result->frameCount][0] = (int16_t)((data[i + 2] << 8) | data[i + 1]);
+        frames[result->frameCount][1] = (int16_t)((data[i + 4] << 8) | data[i + 3]);
+        frames[result->frameCount][2] = (int16_t)((data[i + 6] << 8) | data[i + 5]);
+        result->frameCount++;
+      }
+    } else if ((header & GPF_IMU_FIFO_ACCEL_HEADER_MASK) == GPF_IMU_FIFO_ACCEL_HEADER_SKIP) {
+      result->skippedFrameCount += data[i + 1];
+    }
+
+    i += 1 + payloadSize;
+  }
+}
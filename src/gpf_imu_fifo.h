@@ -0,0 +1,47 @@
+/**
+ * @file gpf_imu_fifo.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-19
+ * 
+ * Voir fichier gpf_imu_fifo.cpp pour plus d'informations.
+ * 
+ */
+
+#ifndef GPF_IMU_FIFO_H
+#define GPF_IMU_FIFO_H
+
+#include <stdint.h> //Volontairement sans Arduino.h pour pouvoir compiler le décodeur sur un PC
+
+#define GPF_IMU_FIFO_GYRO_FRAME_LENGTH        6   //X, Y, Z little endian
+#define GPF_IMU_FIFO_GYRO_MAX_FRAMES          100 //Capacité du FIFO du gyro du BMI088
+#define GPF_IMU_FIFO_GYRO_STATUS_OVERRUN      0x80
+#define GPF_IMU_FIFO_GYRO_STATUS_FRAME_COUNT  0x7F
+
+#define GPF_IMU_FIFO_ACCEL_MAX_LENGTH         1024 //octets //Capacité du FIFO du accel du BMI088
+#define GPF_IMU_FIFO_ACCEL_MAX_FRAMES         32   //Maximum de frames accel gardées par lecture
+
+//Headers des frames du FIFO du accel (datasheet BMI088 section 4.9.2)
+#define GPF_IMU_FIFO_ACCEL_HEADER_MASK        0xFC //Les 2 bits de poids faible sont les tags d'interruption
+#define GPF_IMU_FIFO_ACCEL_HEADER_ACCEL       0x84 //+6 octets
+#define GPF_IMU_FIFO_ACCEL_HEADER_SKIP        0x40 //+1 octet (nombre de frames perdues)
+#define GPF_IMU_FIFO_ACCEL_HEADER_SENSORTIME  0x44 //+3 octets
+#define GPF_IMU_FIFO_ACCEL_HEADER_CONFIG      0x48 //+1 octet
+#define GPF_IMU_FIFO_ACCEL_HEADER_DROP        0x50 //+1 octet
+#define GPF_IMU_FIFO_ACCEL_HEADER_EMPTY       0x80 //Lecture au delà de la fin du FIFO
+
+typedef struct {
+  uint16_t frameCount;         //Frames accel décodées
+  uint16_t skippedFrameCount;  //Frames perdues par le sensor (FIFO plein)
+  uint16_t unknownHeaderCount; //Octets invalides (décodage arrêté)
+  bool     truncated;          //Dernière frame incomplète
+} gpf_imu_fifo_accel_decode_result_struct;
+
+//Lit au plus count octets du FIFO et retourne le nombre d'octets lus (context: le sensor)
+typedef uint16_t (*gpf_imu_fifo_read_function)(void *context, uint16_t count, uint8_t *dest);
+
+uint8_t gpf_imu_fifo_decodeGyro(const uint8_t *data, uint16_t length, int16_t frames[][3], uint8_t maxFrames);
+uint16_t gpf_imu_fifo_readAccel(gpf_imu_fifo_read_function readFifo, void *context, uint16_t length, uint8_t *dest);
+void    gpf_imu_fifo_decodeAccel(const uint8_t *data, uint16_t length, int16_t frames[][3], uint16_t maxFrames, gpf_imu_fifo_accel_decode_result_struct *result);
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * @file gpf_mixer.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-08
+ *
+ * Mixer des sorties des PIDs vers les moteurs (Voir GPF::controlMixer()).
+ *
+ * Chaque moteur est une ligne de la matrice de la config (gaz, roll, pitch, yaw). La commande d'un moteur est le produit de
+ * sa ligne par les entrées. Les coefficients sont en int16_t * GPF_MIXER_STORAGE_MULTIPLIER dans la config et sont convertis
+ * en float par loadMatrix() au démarrage et dans saveConfig().
+ *
+ * Convention des signes (celle de l'ancien controlMixer() de dRehmFlight): roll positif = moteurs de gauche plus forts,
+ * pitch positif = moteurs arrière plus forts, yaw positif = moteurs qui tournent comme avant gauche et arrière droit.
+ * Les préréglages hex et octo sont calculés avec l'angle de chaque bras, en partant du bras avant droit et en tournant
+ * dans le sens horaire. Chaque colonne est ramenée à un maximum de 1.
+ *
+ * Saturation: lorsqu'un moteur dépasse 100%, les termes roll, pitch et yaw sont réduits si leur écart entre moteurs
+ * dépasse 1. Tous les moteurs sont ensuite descendus ensemble pour que le plus fort soit à 100%. La différence entre
+ * les moteurs (l'attitude) est gardée au prix des gaz. Les gaz ne sont jamais montés pour un moteur sous 0%. Au sol, avec les
+ * gaz au minimum, les moteurs ne partent donc pas d'eux-mêmes.
+ *
+ * Le quad X donne les mêmes sorties bit à bit que l'ancien controlMixer() (même ordre des termes). Les colonnes roll, pitch
+ * et yaw des préréglages hex et octo ont une somme nulle. Voir test/test_mixer.cpp pour la comparaison et la durée.
+ *
+ * Ce fichier n'utilise rien du Teensy et peut être compilé sur un PC.
+ *
+ */
+
+#include "gpf_mixer.h"
+
+typedef struct {
+    const char *description;
+    uint8_t     motorCount;
+    int16_t     matrix[GPF_MIXER_MAX_MOTORS][GPF_MIXER_INPUT_ITEM_COUNT];
+} gpf_mixer_preset_struct;
+
+// Gaz, roll, pitch, yaw (* GPF_MIXER_STORAGE_MULTIPLIER)
+static const gpf_mixer_preset_struct gpf_mixer_presets[GPF_MIXER_PRESET_CUSTOM] = {
+    {"Quad X", 4, { //Même ordre que GPF_MOTOR_1 à GPF_MOTOR_4
+        {1000, -1000,  1000,  1000}, //Back Right  //m1 //dRehmFlight m3
+        {1000, -1000, -1000, -1000}, //Front Right //m2 //dRehmFlight m2
+        {1000,  1000,  1000, -1000}, //Back Left   //m3 //dRehmFlight m4
+        {1000,  1000, -1000,  1000}, //Front Left  //m4 //dRehmFlight m1
+    }},
+    {"Hex X", 6, { //Bras à 30, 90, 150, 210, 270 et 330 degrés
+        {1000,  -500, -1000, -1000},
+        {1000, -1000,     0,  1000},
+        {1000,  -500,  1000, -1000},
+        {1000,   500,  1000,  1000},
+        {1000,  1000,     0, -1000},
+        {1000,   500, -1000,  1000},
+    }},
+    {"Octo X", 8, { //Bras à 22.5 degrés puis à tous les 45 degrés
+        {1000,  -414, -1000, -1000},
+        {1000, -1000,  -414,  1000},
+        {1000, -1000,   414, -1000},
+        {1000,  -414,  1000,  1000},
+        {1000,   414,  1000, -1000},
+        {1000,  1000,   414,  1000},
+        {1000,  1000,  -414, -1000},
+        {1000,   414, -1000,  1000},
+    }},
+};
+
+GPF_MIXER::GPF_MIXER() {
+  for (uint8_t motor = 0; motor < GPF_MIXER_MAX_MOTORS; motor++) {
+    for (uint8_t input = 0; input < GPF_MIXER_INPUT_ITEM_COUNT; input++) {
+      matrix[motor][input] = 0;
+    }
+  }
+}
+
+void GPF_MIXER::loadMatrix(const int16_t matrix[][GPF_MIXER_INPUT_ITEM_COUNT], uint8_t motorCount) {
+  this->motorCount = (motorCount > GPF_MIXER_MAX_MOTORS) ? GPF_MIXER_MAX_MOTORS : motorCount;
+
+  for (uint8_t motor = 0; motor < GPF_MIXER_MAX_MOTORS; motor++) {
+    for (uint8_t input = 0; input < GPF_MIXER_INPUT_ITEM_COUNT; input++) {
+      this->matrix[motor][input] = (motor < this->motorCount) ? matrix[motor][input] / GPF_MIXER_STORAGE_MULTIPLIER : 0;
+    }
+  }
+}
+
+// output doit avoir au moins get_motorCount() éléments. Commandes entre 0 et 1 sauf sous 0% (Voir scaleCommands()).
+void GPF_MIXER::mix(float throttle, float roll, float pitch, float yaw, float *output) {
+  float outputMax = -1.0e30f;
+
+  for (uint8_t motor = 0; motor < motorCount; motor++) { //Même ordre des termes que l'ancien mixer: gaz, pitch, roll, yaw
+    output[motor] = matrix[motor][GPF_MIXER_INPUT_THROTTLE] * throttle + matrix[motor][GPF_MIXER_INPUT_PITCH] * pitch
+                  + matrix[motor][GPF_MIXER_INPUT_ROLL] * roll + matrix[motor][GPF_MIXER_INPUT_YAW] * yaw;
+    outputMax = (output[motor] > outputMax) ? output[motor] : outputMax;
+  }
+
+  if (outputMax <= 1.0f) {
+    return;
+  }
+
+  //Saturation: on garde l'attitude au prix des gaz
+  float attitude[GPF_MIXER_MAX_MOTORS];
+  float attitudeMin = 1.0e30f;
+  float attitudeMax = -1.0e30f;
+  float scale       = 1.0f;
+
+  saturationCount++;
+
+  for (uint8_t motor = 0; motor < motorCount; motor++) {
+    attitude[motor] = output[motor] - matrix[motor][GPF_MIXER_INPUT_THROTTLE] * throttle;
+    attitudeMin     = (attitude[motor] < attitudeMin) ? attitude[motor] : attitudeMin;
+    attitudeMax     = (attitude[motor] > attitudeMax) ? attitude[motor] : attitudeMax;
+  }
+
+  if ((attitudeMax - attitudeMin) > 1.0f) { //Impossible de tout garder, on réduit roll, pitch et yaw ensemble
+    scale = 1.0f / (attitudeMax - attitudeMin);
+  }
+
+  outputMax = -1.0e30f;
+  for (uint8_t motor = 0; motor < motorCount; motor++) {
+    output[motor] = matrix[motor][GPF_MIXER_INPUT_THROTTLE] * throttle + attitude[motor] * scale;
+    outputMax     = (output[motor] > outputMax) ? output[motor] : outputMax;
+  }
+
+  if (outputMax > 1.0f) {
+    for (uint8_t motor = 0; motor < motorCount; motor++) {
+      output[motor] -= outputMax - 1.0f;
+    }
+  }
+}
+
+uint8_t GPF_MIXER::get_motorCount() {
+  return motorCount;
+}
+
+uint32_t GPF_MIXER::get_saturationCount() {
+  return saturationCount;
+}
+
+// Copie un préréglage dans une matrice de la config. Retourne false si le préréglage n'existe pas (ex: GPF_MIXER_PRESET_CUSTOM).
+bool GPF_MIXER::loadPreset(uint8_t preset, int16_t matrix[][GPF_MIXER_INPUT_ITEM_COUNT], uint8_t *motorCount) {
+  if (preset >= GPF_MIXER_PRESET_CUSTOM) {
+    return false;
+  }
+
+  *motorCount = gpf_mixer_presets[preset].motorCount;
+  for (uint8_t motor = 0; motor < GPF_MIXER_MAX_MOTORS; motor++) {
+    for (uint8_t input = 0; input < GPF_MIXER_INPUT_ITEM_COUNT; input++) {
+      matrix[motor][input] = gpf_mixer_presets[preset].matrix[motor][input];
+    }
+  }
+  return true;
+}
+
+const char *GPF_MIXER::getPresetDescription(uint8_t preset) {
+  if (preset >= GPF_MIXER_PRESET_CUSTOM) {
+    return (preset == GPF_MIXER_PRESET_CUSTOM) ? "Custom" : "?";
+  }
+  return gpf_mixer_presets[preset].description;
+}
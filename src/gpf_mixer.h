@@ -0,0 +1,37 @@
+/**
+ * @file gpf_mixer.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-08
+ *
+ * Voir fichier gpf_mixer.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_MIXER_H
+#define GPF_MIXER_H
+
+#include <stdint.h>
+#include "gpf_cons.h"
+
+// Mixer par matrice: une ligne par moteur, une colonne par entrée (gaz, roll, pitch, yaw. Voir gpf_mixer_input_enum).
+class GPF_MIXER {
+
+    public:
+        GPF_MIXER();
+        void     loadMatrix(const int16_t matrix[][GPF_MIXER_INPUT_ITEM_COUNT], uint8_t motorCount);
+        void     mix(float throttle, float roll, float pitch, float yaw, float *output);
+
+        uint8_t  get_motorCount();
+        uint32_t get_saturationCount();
+
+        static bool loadPreset(uint8_t preset, int16_t matrix[][GPF_MIXER_INPUT_ITEM_COUNT], uint8_t *motorCount);
+        static const char *getPresetDescription(uint8_t preset);
+
+    private:
+        float    matrix[GPF_MIXER_MAX_MOTORS][GPF_MIXER_INPUT_ITEM_COUNT]; //Coefficients en float (Voir loadMatrix())
+        uint8_t  motorCount      = 0;
+        uint32_t saturationCount = 0; //Tours où un moteur dépassait 100%
+};
+
+#endif
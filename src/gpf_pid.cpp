@@ -0,0 +1,142 @@
+/**
+ * @file gpf_pid.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-06
+ *
+ * Contrôleur PID des 3 axes utilisé par controlANGLE() et controlRATE() (Voir gpf.cpp).
+ *
+ * Les gains sont convertis en float une seule fois (GPF::refreshPidGains() au démarrage et dans saveConfig()) plutôt qu'à
+ * chaque tour en divisant les uint32_t de la config par GPF_PID_STORAGE_MULTIPLIER. Ils sont aussi déjà multipliés par
+ * GPF_PID_OUTPUT_SCALE. dt est donné par la boucle qui appelle update() au lieu d'un appel à micros() ici.
+ *
+ * Pour chaque axe:
+ *  - Terme D sur la mesure (-Kd * dérivée de la mesure) plutôt que sur l'erreur. Un changement brusque de la consigne ne donne
+ *    donc pas de coup sur les moteurs. La dérivée est soit fournie (gyro pour un angle), soit calculée par différence.
+ *  - Filtre passe-bas optionnel sur la dérivée (GPF_FILTER_TYPE_NONE pour le retirer).
+ *  - Terme I saturé à integralLimit et remis à 0 sur demande (gaz au minimum). Anti-windup: lorsque la sortie dépasse
+ *    outputLimit dans le sens de l'erreur, le terme I n'est pas accumulé pour ce tour.
+ * Avec la même consigne et le filtre D au même endroit, la sortie du roll et du pitch en mode angle est la même que l'ancien
+ * controlANGLE(). Le yaw diffère seulement par le terme D (mesure plutôt qu'erreur).
+ *
+ * Comparé à une copie de l'ancien controlANGLE() dans test/test_pid.cpp (make -C test, durées avec make -C test bench).
+ *
+ * Ce fichier n'utilise rien du Teensy et peut être compilé sur un PC.
+ *
+ */
+
+#include <stddef.h>
+#include "gpf_pid.h"
+
+GPF_PID::GPF_PID() {
+  for (uint8_t axe = 0; axe < GPF_PID_AXE_COUNT; axe++) {
+    kp[axe]               = 0;
+    ki[axe]               = 0;
+    kd[axe]               = 0;
+    derivativeSource[axe] = GPF_PID_DERIVATIVE_FROM_MEASUREMENT;
+  }
+  reset();
+}
+
+// nominalDt en secondes, sert au premier tour et à la fréquence initiale du filtre D
+void GPF_PID::initialize(float integralLimit, float outputLimit, uint8_t dtermFilterType, float dtermFilterCutoffHz, float nominalDt) {
+  this->integralLimit = integralLimit;
+  this->outputLimit   = outputLimit;
+  this->nominalDt     = nominalDt;
+  this->sampleRateHz  = 1.0 / nominalDt;
+  dtermFilter.initialize(dtermFilterType, dtermFilterCutoffHz, sampleRateHz);
+  reset();
+}
+
+// Gains non multipliés (ex: 0.2 pour le P du roll)
+void GPF_PID::setGains(uint8_t axe, float kp, float ki, float kd) {
+  if (axe >= GPF_PID_AXE_COUNT) {
+    return;
+  }
+  this->kp[axe] = kp * GPF_PID_OUTPUT_SCALE;
+  this->ki[axe] = ki * GPF_PID_OUTPUT_SCALE;
+  this->kd[axe] = kd * GPF_PID_OUTPUT_SCALE;
+}
+
+void GPF_PID::setDerivativeSource(uint8_t axe, uint8_t source) {
+  if ((axe >= GPF_PID_AXE_COUNT) || (source >= GPF_PID_DERIVATIVE_ITEM_COUNT)) {
+    return;
+  }
+  derivativeSource[axe] = source;
+}
+
+void GPF_PID::reset() {
+  for (uint8_t axe = 0; axe < GPF_PID_AXE_COUNT; axe++) {
+    error[axe]               = 0;
+    integral[axe]            = 0;
+    measurementPrevious[axe] = 0;
+    output[axe]              = 0;
+  }
+  measurementPreviousIsValid = false;
+  dtermFilter.reset();
+}
+
+// setpoint, measurement et measurementRate ont GPF_PID_AXE_COUNT éléments. measurementRate peut être NULL si aucun axe
+// n'est GPF_PID_DERIVATIVE_FROM_RATE. dt en secondes.
+void GPF_PID::update(const float *setpoint, const float *measurement, const float *measurementRate, float dt, bool integralReset) {
+  float derivative[GPF_PID_AXE_COUNT];
+
+  if ((dt <= 0) || (dt > GPF_PID_DT_MAX)) {
+    dt = nominalDt; //Premier tour ou boucle arrêtée (calibration)
+  } else { //Le filtre D suit la vitesse réelle de la boucle
+    sampleRateHz = (1.0f - GPF_PID_SAMPLE_RATE_WEIGHT) * sampleRateHz + GPF_PID_SAMPLE_RATE_WEIGHT / dt;
+    dtermFilter.setSampleRate(sampleRateHz);
+  }
+
+  for (uint8_t axe = 0; axe < GPF_PID_AXE_COUNT; axe++) {
+    error[axe] = setpoint[axe] - measurement[axe];
+    if ((derivativeSource[axe] == GPF_PID_DERIVATIVE_FROM_RATE) && (measurementRate != NULL)) {
+      derivative[axe] = measurementRate[axe];
+    } else {
+      derivative[axe] = measurementPreviousIsValid ? (measurement[axe] - measurementPrevious[axe]) / dt : 0;
+    }
+    measurementPrevious[axe] = measurement[axe];
+  }
+  measurementPreviousIsValid = true;
+
+  dtermFilter.apply(&derivative[0], &derivative[1], &derivative[2]);
+
+  for (uint8_t axe = 0; axe < GPF_PID_AXE_COUNT; axe++) {
+    float partial     = kp[axe] * error[axe] - kd[axe] * derivative[axe];
+    float integralNew = 0;
+
+    if (!integralReset) {
+      integralNew = integral[axe] + error[axe] * dt;
+      integralNew = (integralNew > integralLimit) ? integralLimit : ((integralNew < -integralLimit) ? -integralLimit : integralNew);
+    }
+
+    float outputNew = partial + ki[axe] * integralNew;
+    if (!integralReset && (((outputNew > outputLimit) && (error[axe] > 0)) || ((outputNew < -outputLimit) && (error[axe] < 0)))) {
+      integralNew = integral[axe]; //Anti-windup: sortie saturée dans le sens de l'erreur, on n'accumule pas
+      outputNew   = partial + ki[axe] * integralNew;
+    }
+
+    integral[axe] = integralNew;
+    output[axe]   = outputNew;
+  }
+}
+
+float GPF_PID::get_output(uint8_t axe) {
+  return output[axe];
+}
+
+float GPF_PID::get_error(uint8_t axe) {
+  return error[axe];
+}
+
+float GPF_PID::get_integral(uint8_t axe) {
+  return integral[axe];
+}
+
+float GPF_PID::get_sampleRateHz() {
+  return sampleRateHz;
+}
+
+GPF_FILTER_3AXES *GPF_PID::get_dtermFilter() {
+  return &dtermFilter;
+}
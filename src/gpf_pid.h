@@ -0,0 +1,67 @@
+/**
+ * @file gpf_pid.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-06
+ *
+ * Voir fichier gpf_pid.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_PID_H
+#define GPF_PID_H
+
+#include <stdint.h>
+#include "gpf_filter.h"
+
+#define GPF_PID_AXE_COUNT                 3     //Roll, pitch et yaw (même ordre que GPF_AXE_ROLL, GPF_AXE_PITCH, GPF_AXE_YAW)
+#define GPF_PID_OUTPUT_SCALE              0.01f //Les gains de la config donnent une sortie entre -1 et 1 une fois multipliée par 0.01
+#define GPF_PID_SAMPLE_RATE_WEIGHT        0.01f //Poids d'une nouvelle mesure de dt dans la moyenne de la fréquence du filtre D
+#define GPF_PID_DT_MAX                    0.1f  //s //Au delà (boucle arrêtée), dt est remplacé par la période nominale
+
+typedef enum {
+    GPF_PID_DERIVATIVE_FROM_RATE,        //Dérivée de la mesure fournie par l'appelant (ex: gyro pour un angle)
+    GPF_PID_DERIVATIVE_FROM_MEASUREMENT, //Dérivée calculée par différence de la mesure (ex: gyro pour une vitesse)
+
+    GPF_PID_DERIVATIVE_ITEM_COUNT // MUST BE LAST
+} gpf_pid_derivative_source_enum;
+
+// Contrôleur PID de 3 axes. L'état et les gains de chaque axe sont dans des tableaux contigus (un élément par axe).
+class GPF_PID {
+
+    public:
+        GPF_PID();
+        void  initialize(float integralLimit, float outputLimit, uint8_t dtermFilterType, float dtermFilterCutoffHz, float nominalDt);
+        void  setGains(uint8_t axe, float kp, float ki, float kd);
+        void  setDerivativeSource(uint8_t axe, uint8_t source);
+        void  reset();
+        void  update(const float *setpoint, const float *measurement, const float *measurementRate, float dt, bool integralReset);
+
+        float get_output(uint8_t axe);
+        float get_error(uint8_t axe);
+        float get_integral(uint8_t axe);
+        float get_sampleRateHz();
+        GPF_FILTER_3AXES *get_dtermFilter();
+
+    private:
+        //Gains déjà multipliés par GPF_PID_OUTPUT_SCALE
+        float   kp[GPF_PID_AXE_COUNT];
+        float   ki[GPF_PID_AXE_COUNT];
+        float   kd[GPF_PID_AXE_COUNT];
+        uint8_t derivativeSource[GPF_PID_AXE_COUNT];
+
+        float   error[GPF_PID_AXE_COUNT];
+        float   integral[GPF_PID_AXE_COUNT];
+        float   measurementPrevious[GPF_PID_AXE_COUNT];
+        float   output[GPF_PID_AXE_COUNT];
+
+        float   integralLimit = 0;
+        float   outputLimit   = 0;
+        float   nominalDt     = 0; //s
+        float   sampleRateHz  = 0; //Moyenne de 1/dt //Fréquence du filtre D
+        bool    measurementPreviousIsValid = false;
+
+        GPF_FILTER_3AXES dtermFilter; //GPF_FILTER_TYPE_NONE pour ne pas filtrer les termes D
+};
+
+#endif
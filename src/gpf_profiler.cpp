@@ -0,0 +1,72 @@
+/**
+ * @file gpf_profiler.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-19
+ *
+ * Profileur par étape basé sur le compteur de cycles du Cortex-M7 (DWT CYCCNT, 600 MHz sur le Teensy 4.1).
+ *
+ * loopBusyTime donne seulement le temps total de la boucle de contrôle. Ici on mesure chaque étape séparément
+ * (min, moyenne et max en cycles) pour savoir qui mange le temps CPU. Une mesure coûte deux lectures de CYCCNT
+ * et quelques additions. Les étapes qui roulent dans loop() incluent le temps des interruptions qui les ont interrompues.
+ *
+ * Exemple:
+ *   {
+ *     GPF_PROFILE_STAGE(GPF_PROFILER_STAGE_RC_READ);
+ *     myRc.readRx();
+ *   }
+ *
+ */
+
+#include "Arduino.h"
+#include "gpf_profiler.h"
+
+gpf_profiler_stage_stats_struct GPF_PROFILER::stages[GPF_PROFILER_STAGE_ITEM_COUNT];
+
+void GPF_PROFILER::initialize() {
+  //Déjà fait par le startup du Teensy 4 mais on s'en assure
+  ARM_DEMCR    |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+  reset();
+}
+
+void GPF_PROFILER::reset() {
+  noInterrupts(); //Certaines étapes sont mises à jour dans la boucle de contrôle (interruption du timer)
+  for (uint8_t stage = 0; stage < GPF_PROFILER_STAGE_ITEM_COUNT; stage++) {
+    stages[stage].count       = 0;
+    stages[stage].cyclesMin   = 0xFFFFFFFF;
+    stages[stage].cyclesMax   = 0;
+    stages[stage].cyclesTotal = 0;
+  }
+  interrupts();
+}
+
+// Copie cohérente des statistiques d'une étape
+void GPF_PROFILER::getStats(uint8_t stage, gpf_profiler_stage_stats_struct *stats) {
+  noInterrupts();
+  *stats = stages[stage];
+  interrupts();
+
+  if (stats->count == 0) {
+    stats->cyclesMin = 0;
+  }
+}
+
+const char *GPF_PROFILER::getStageName(uint8_t stage) {
+  switch (stage) {
+    case GPF_PROFILER_STAGE_RC_READ:       return "RC";
+    case GPF_PROFILER_STAGE_IMU_READ:      return "IMU";
+    case GPF_PROFILER_STAGE_FUSION:        return "Fusion";
+    case GPF_PROFILER_STAGE_CONTROL_ANGLE: return "PID";
+    case GPF_PROFILER_STAGE_CONTROL_RATE:  return "PID Rate";
+    case GPF_PROFILER_STAGE_MIXER:         return "Mixer";
+    case GPF_PROFILER_STAGE_BLACK_BOX:     return "BlackBox";
+    case GPF_PROFILER_STAGE_MENU:          return "Menu";
+    case GPF_PROFILER_STAGE_RC_POLL:       return "RC Poll";
+    default:                               return "?";
+  }
+}
+
+float GPF_PROFILER::cyclesToMicros(float cycles) {
+  return cycles / (F_CPU_ACTUAL / 1000000.0);
+}
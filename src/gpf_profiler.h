@@ -0,0 +1,80 @@
+/**
+ * @file gpf_profiler.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-19
+ *
+ * Voir fichier gpf_profiler.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_PROFILER_H
+#define GPF_PROFILER_H
+
+#include "Arduino.h"
+
+//Commentez pour retirer complètement le profileur. GPF_PROFILE_STAGE() ne génère alors aucun code.
+#define GPF_PROFILER_ENABLED
+
+typedef enum {
+    GPF_PROFILER_STAGE_RC_READ,       // myRc.readRx()             (loop)
+    GPF_PROFILER_STAGE_IMU_READ,      // myImu.getIMUData()        (boucle de contrôle)
+    GPF_PROFILER_STAGE_FUSION,        // myImu.doFusion()          (boucle de contrôle)
+    GPF_PROFILER_STAGE_CONTROL_ANGLE, // controlANGLE()            (boucle de contrôle)
+    GPF_PROFILER_STAGE_CONTROL_RATE,  // controlRATE()             (boucle de contrôle, GPF_CONTROLLER_CASCADE_ENABLED)
+    GPF_PROFILER_STAGE_MIXER,         // controlMixer()            (boucle de contrôle)
+    GPF_PROFILER_STAGE_BLACK_BOX,     // black_box_writeRow()      (loop)
+    GPF_PROFILER_STAGE_MENU,          // displayAndProcessMenu()   (loop)
+    GPF_PROFILER_STAGE_RC_POLL,       // myRc.pollRx()             (boucle de contrôle, GPF_CRSF_RX_IN_CONTROL_LOOP_ENABLED)
+
+    GPF_PROFILER_STAGE_ITEM_COUNT // MUST BE LAST
+} gpf_profiler_stage_enum;
+
+struct gpf_profiler_stage_stats_struct {
+    uint32_t count;
+    uint32_t cyclesMin;
+    uint32_t cyclesMax;
+    uint64_t cyclesTotal;
+};
+
+class GPF_PROFILER {
+
+    public:
+        static void        initialize();
+        static void        reset();
+        static void        getStats(uint8_t stage, gpf_profiler_stage_stats_struct *stats);
+        static const char *getStageName(uint8_t stage);
+        static float       cyclesToMicros(float cycles);
+
+        // Appelé par GPF_PROFILER_SCOPE. Chaque étape n'est mise à jour que par un seul contexte (loop ou boucle de contrôle).
+        static inline void record(uint8_t stage, uint32_t cycles) {
+          gpf_profiler_stage_stats_struct *s = &stages[stage];
+          s->count++;
+          s->cyclesTotal += cycles;
+          if (cycles < s->cyclesMin) s->cyclesMin = cycles;
+          if (cycles > s->cyclesMax) s->cyclesMax = cycles;
+        }
+
+    private:
+        static gpf_profiler_stage_stats_struct stages[GPF_PROFILER_STAGE_ITEM_COUNT];
+};
+
+// Mesure le nombre de cycles CPU entre sa création et sa destruction (fin du bloc { }).
+class GPF_PROFILER_SCOPE {
+
+    public:
+        inline GPF_PROFILER_SCOPE(uint8_t stage) : stage(stage), startedAt(ARM_DWT_CYCCNT) {}
+        inline ~GPF_PROFILER_SCOPE() { GPF_PROFILER::record(stage, ARM_DWT_CYCCNT - startedAt); }
+
+    private:
+        uint8_t  stage;
+        uint32_t startedAt;
+};
+
+#if defined GPF_PROFILER_ENABLED
+ #define GPF_PROFILE_STAGE(stage) GPF_PROFILER_SCOPE gpf_profiler_scope(stage)
+#else
+ #define GPF_PROFILE_STAGE(stage)
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * @file gpf_rc_smoothing.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-07
+ *
+ * Lissage des consignes roll, pitch, yaw et gaz entre deux frames CRSF (Voir GPF::getDesiredState()).
+ *
+ * Les frames arrivent environ à toutes les 6.2ms mais l'étage PID relit les canaux à chaque tour. Sans lissage la consigne
+ * est un escalier dont chaque marche passe dans les termes P et D et fait chauffer les moteurs.
+ *
+ * newFrame() est appelée à chaque frame de canaux avec l'intervalle moyen entre les frames mesuré par GPF_CRSF (Voir
+ * GPF_CRSF::channelsFrameReceived()). La coupure des filtres passe-bas est une fraction de cette fréquence
+ * (GPF_RC_SMOOTHING_CUTOFF_RATIO) et s'ajuste donc seule si le récepteur change de fréquence (ex: 50hz, 150hz, 500hz).
+ *
+ * apply() roule à chaque tour de l'étage PID. En plus de filtrer, elle calcule la dérivée de chaque consigne lissée pour le
+ * terme feed-forward (Voir GPF_RC_SMOOTHING_FEED_FORWARD_ENABLED).
+ *
+ * Liens à haute fréquence (frames à 1 ou 2ms): la coupure calculée (150hz à 300hz) approcherait ou dépasserait la moitié de
+ * la fréquence de l'étage PID. Elle est donc plafonnée à GPF_RC_SMOOTHING_CUTOFF_MAX_RATIO de cette fréquence.
+ *
+ * Voir test/test_rc_smoothing.cpp pour la dérivée et le retard sur un mouvement du manche.
+ *
+ * Ce fichier n'utilise rien du Teensy et peut être compilé sur un PC.
+ *
+ */
+
+#include <math.h>
+#include "gpf_rc_smoothing.h"
+
+GPF_RC_SMOOTHING::GPF_RC_SMOOTHING() {
+  for (uint8_t item = 0; item < GPF_RC_SMOOTHING_ITEM_COUNT; item++) {
+    derivative[item] = 0;
+    previous[item]   = 0;
+  }
+}
+
+// frameIntervalUs: intervalle de départ entre les frames de canaux (Voir GPF_CRSF::get_channelsFrameIntervalUs())
+void GPF_RC_SMOOTHING::initialize(uint8_t filterType, float sampleRateHz, float frameIntervalUs) {
+  this->sampleRateHz = sampleRateHz;
+  cutoffHz           = targetCutoffHz(frameIntervalUs);
+  axesFilter.initialize(filterType, cutoffHz, sampleRateHz);
+  throttleFilter.initialize(filterType, cutoffHz, sampleRateHz);
+  previousIsValid = false;
+}
+
+// frameIntervalUs: moyenne de l'intervalle entre les frames de canaux, en us (Voir GPF_CRSF::get_channelsFrameIntervalUs())
+void GPF_RC_SMOOTHING::newFrame(float frameIntervalUs) {
+  float newCutoffHz = targetCutoffHz(frameIntervalUs);
+
+  if (fabsf(newCutoffHz - cutoffHz) <= (GPF_RC_SMOOTHING_CUTOFF_TOLERANCE * cutoffHz)) {
+    return;
+  }
+
+  cutoffHz = newCutoffHz;
+  axesFilter.setCenter(cutoffHz); //Sans remettre les états à 0
+  throttleFilter.setCenter(cutoffHz);
+}
+
+// Coupure selon la fréquence des frames, sans dépasser GPF_RC_SMOOTHING_CUTOFF_MAX_RATIO de la fréquence de l'étage PID
+float GPF_RC_SMOOTHING::targetCutoffHz(float frameIntervalUs) {
+  float cutoff = fmaxf(GPF_RC_SMOOTHING_CUTOFF_RATIO * 1000000.0 / frameIntervalUs, GPF_RC_SMOOTHING_CUTOFF_MIN);
+
+  if (sampleRateHz > 0) {
+    cutoff = fminf(cutoff, GPF_RC_SMOOTHING_CUTOFF_MAX_RATIO * sampleRateHz);
+  }
+  return cutoff;
+}
+
+// Filtre en place. dt en secondes depuis le dernier appel.
+void GPF_RC_SMOOTHING::apply(float *roll, float *pitch, float *yaw, float *throttle, float dt) {
+  bool dtIsValid = (dt > 0) && (dt < GPF_RC_SMOOTHING_DT_MAX);
+
+  if (dtIsValid) { //Les filtres suivent la vitesse réelle de l'étage PID
+    sampleRateHz = (1.0 - GPF_RC_SMOOTHING_SAMPLE_RATE_WEIGHT) * sampleRateHz + GPF_RC_SMOOTHING_SAMPLE_RATE_WEIGHT / dt;
+    axesFilter.setSampleRate(sampleRateHz);
+    throttleFilter.setSampleRate(sampleRateHz);
+  }
+
+  axesFilter.apply(roll, pitch, yaw);
+  *throttle = throttleFilter.applyOneAxe(0, *throttle);
+
+  float current[GPF_RC_SMOOTHING_ITEM_COUNT] = {*roll, *pitch, *yaw, *throttle};
+
+  for (uint8_t item = 0; item < GPF_RC_SMOOTHING_ITEM_COUNT; item++) {
+    derivative[item] = (previousIsValid && dtIsValid) ? (current[item] - previous[item]) / dt : 0;
+    previous[item]   = current[item];
+  }
+  previousIsValid = true;
+}
+
+float GPF_RC_SMOOTHING::get_derivative(uint8_t item) {
+  return derivative[item];
+}
+
+float GPF_RC_SMOOTHING::get_cutoffHz() {
+  return cutoffHz;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file gpf_rc_smoothing.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-07
+ *
+ * Voir fichier gpf_rc_smoothing.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_RC_SMOOTHING_H
+#define GPF_RC_SMOOTHING_H
+
+#include <stdint.h>
+#include "gpf_filter.h"
+
+#define GPF_RC_SMOOTHING_CUTOFF_RATIO             0.3     //Coupure = n * fréquence des frames (48hz à 160hz)
+#define GPF_RC_SMOOTHING_CUTOFF_MIN               5.0     //hz
+#define GPF_RC_SMOOTHING_CUTOFF_MAX_RATIO         0.25    //Coupure maximale = n * fréquence de l'étage PID (liens à 500hz et 1000hz)
+#define GPF_RC_SMOOTHING_CUTOFF_TOLERANCE         0.1     //On recalcule les coefficients seulement si la coupure a changé de plus de 10%
+#define GPF_RC_SMOOTHING_SAMPLE_RATE_WEIGHT       0.01    //Poids d'une nouvelle mesure de dt dans la moyenne de la fréquence des filtres
+#define GPF_RC_SMOOTHING_DT_MAX                   0.1     //s //Au delà (boucle arrêtée), pas de dérivée pour ce tour
+
+typedef enum {
+    GPF_RC_SMOOTHING_ROLL,
+    GPF_RC_SMOOTHING_PITCH,
+    GPF_RC_SMOOTHING_YAW,
+    GPF_RC_SMOOTHING_THROTTLE,
+
+    GPF_RC_SMOOTHING_ITEM_COUNT // MUST BE LAST
+} gpf_rc_smoothing_item_enum;
+
+// Lissage des consignes des manches entre deux frames du récepteur. La coupure suit la fréquence des frames mesurée par
+// GPF_CRSF (la même que celle du fail safe et de l'écran des stats).
+class GPF_RC_SMOOTHING {
+
+    public:
+        GPF_RC_SMOOTHING();
+        void  initialize(uint8_t filterType, float sampleRateHz, float frameIntervalUs);
+        void  newFrame(float frameIntervalUs);
+        void  apply(float *roll, float *pitch, float *yaw, float *throttle, float dt);
+
+        float get_derivative(uint8_t item);
+        float get_cutoffHz();
+
+    private:
+        float targetCutoffHz(float frameIntervalUs);
+
+        float            cutoffHz              = 0;
+        float            sampleRateHz          = 0;
+
+        float            derivative[GPF_RC_SMOOTHING_ITEM_COUNT]; //Unités de la consigne par seconde
+        float            previous[GPF_RC_SMOOTHING_ITEM_COUNT];
+        bool             previousIsValid       = false;
+
+        GPF_FILTER_3AXES axesFilter;     //Roll, pitch, yaw
+        GPF_FILTER_3AXES throttleFilter; //Un seul axe utilisé
+};
+
+#endif
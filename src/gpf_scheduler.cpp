@@ -0,0 +1,199 @@
+/**
+ * @file gpf_scheduler.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-24
+ *
+ * Ordonnanceur coopératif pour le travail d'arrière plan de loop() (alarmes, musique, menu, black box, etc.).
+ *
+ * Chaque tâche déclare une période, une priorité et un budget de temps par appel. À chaque appel de run(), on dispose
+ * d'une tranche de temps (slotDuration). Parmi les tâches dues, on démarre la plus prioritaire dont le budget entre dans
+ * le temps qui reste à la tranche, puis on recommence jusqu'à ce qu'il n'y ait plus rien qui entre.
+ * Une tâche dont le budget est plus grand que la tranche peut quand même démarrer si elle est la première de la tranche
+ * ou si elle attend depuis toute une période, sinon elle pourrait ne jamais rouler.
+ *
+ * On compte par tâche les échéances manquées (démarrée plus d'une période en retard) et les dépassements de budget.
+ * La boucle de contrôle roule par interruption et n'est pas affectée, mais ceci garde loop() (et donc la lecture RC
+ * et l'armement) réactif même si le menu ou la carte SD prennent beaucoup de temps.
+ *
+ */
+
+#include "Arduino.h"
+#include "gpf_scheduler.h"
+#include "gpf_debug.h"
+
+GPF_SCHEDULER::GPF_SCHEDULER() {
+
+}
+
+// Retourne l'identifiant de la tâche ou GPF_SCHEDULER_NO_TASK si il n'y a plus de place
+int8_t GPF_SCHEDULER::addTask(const char *name, gpf_scheduler_task_function function, uint32_t period, uint8_t priority, uint32_t budget) {
+  if (taskCount >= GPF_SCHEDULER_MAX_TASKS) {
+    return GPF_SCHEDULER_NO_TASK;
+  }
+
+  tasks[taskCount].name          = name;
+  tasks[taskCount].function      = function;
+  tasks[taskCount].period        = period;
+  tasks[taskCount].priority      = priority;
+  tasks[taskCount].budget        = budget;
+  tasks[taskCount].isEnabled     = true;
+  tasks[taskCount].countsInLoopPass = true;
+  tasks[taskCount].nextReleaseAt = micros();
+  tasks[taskCount].lastRunSlot   = slotCount;
+  taskCount++;
+
+  resetStats();
+  return taskCount - 1;
+}
+
+void GPF_SCHEDULER::run(uint32_t slotDuration) {
+  unsigned long slotStartedAt = micros();
+  unsigned long now           = slotStartedAt;
+  uint32_t      elapsed       = 0;
+  int8_t        taskId;
+
+  slotCount++;
+  lastRunUncountedDuration = 0;
+  while (true) {
+    taskId = findNextTask(now, (elapsed < slotDuration) ? slotDuration - elapsed : 0, (elapsed == 0));
+    if (taskId == GPF_SCHEDULER_NO_TASK) {
+      break;
+    }
+
+    gpf_scheduler_task_struct *task = &tasks[taskId];
+
+    if (task->period == 0) {
+      task->nextReleaseAt = now; //Due à chaque tranche: son retard repart de 0, sinon il grandirait sans fin et gagnerait toutes les égalités
+    } else {
+      if ((long)(now - task->nextReleaseAt) >= (long)task->period) {
+        task->deadlineMissCount++;
+        task->nextReleaseAt = now; //On se resynchronise plutôt que d'enchaîner les appels en retard
+      }
+      task->nextReleaseAt += task->period;
+    }
+    task->lastRunSlot    = slotCount;
+
+    task->function();
+
+    unsigned long endedAt = micros();
+    task->lastDuration = endedAt - now;
+    task->maxDuration  = max(task->maxDuration, task->lastDuration);
+    task->runCount++;
+    if (task->lastDuration > task->budget) {
+      task->budgetOverrunCount++;
+    }
+    if (!task->countsInLoopPass) {
+      lastRunUncountedDuration += task->lastDuration;
+    }
+
+    now     = endedAt;
+    elapsed = now - slotStartedAt;
+  }
+}
+
+// Tâche due la plus prioritaire (la plus en retard à priorité égale) dont le budget entre dans ce qui reste de la tranche
+int8_t GPF_SCHEDULER::findNextTask(unsigned long now, uint32_t remainingSlot, bool slotIsEmpty) {
+  int8_t bestTaskId   = GPF_SCHEDULER_NO_TASK;
+  long   bestLateness = 0;
+
+  for (uint8_t taskId = 0; taskId < taskCount; taskId++) {
+    gpf_scheduler_task_struct *task = &tasks[taskId];
+    long lateness = (long)(now - task->nextReleaseAt);
+
+    if (!task->isEnabled || (lateness < 0) || (task->lastRunSlot == slotCount)) { //Une tâche roule au plus une fois par tranche
+      continue;
+    }
+
+    //Une tâche qui attend depuis toute une période démarre quand même pour ne pas être affamée (son échéance manquée sera comptée)
+    if ((task->budget > remainingSlot) && !slotIsEmpty && (lateness < (long)task->period)) {
+      continue;
+    }
+
+    if ((bestTaskId == GPF_SCHEDULER_NO_TASK) ||
+        (task->priority < tasks[bestTaskId].priority) ||
+        ((task->priority == tasks[bestTaskId].priority) && (lateness > bestLateness))) {
+      bestTaskId   = taskId;
+      bestLateness = lateness;
+    }
+  }
+
+  return bestTaskId;
+}
+
+void GPF_SCHEDULER::set_taskIsEnabled(int8_t taskId, bool isEnabled) {
+  if ((taskId >= 0) && (taskId < taskCount)) {
+    if (isEnabled && !tasks[taskId].isEnabled) {
+      tasks[taskId].nextReleaseAt = micros();
+    }
+    tasks[taskId].isEnabled = isEnabled;
+  }
+}
+
+void GPF_SCHEDULER::set_taskPeriod(int8_t taskId, uint32_t period) {
+  if ((taskId >= 0) && (taskId < taskCount)) {
+    tasks[taskId].period = period;
+  }
+}
+
+void GPF_SCHEDULER::set_taskCountsInLoopPass(int8_t taskId, bool countsInLoopPass) {
+  if ((taskId >= 0) && (taskId < taskCount)) {
+    tasks[taskId].countsInLoopPass = countsInLoopPass;
+  }
+}
+
+// Durée des tâches du dernier run() marquées par set_taskCountsInLoopPass(taskId, false)
+uint32_t GPF_SCHEDULER::get_lastRunUncountedDuration() {
+  return lastRunUncountedDuration;
+}
+
+uint32_t GPF_SCHEDULER::get_taskPeriod(int8_t taskId) {
+  if ((taskId >= 0) && (taskId < taskCount)) {
+    return tasks[taskId].period;
+  }
+  return 0;
+}
+
+uint8_t GPF_SCHEDULER::get_taskCount() {
+  return taskCount;
+}
+
+const gpf_scheduler_task_struct *GPF_SCHEDULER::get_task(int8_t taskId) {
+  if ((taskId >= 0) && (taskId < taskCount)) {
+    return &tasks[taskId];
+  }
+  return NULL;
+}
+
+void GPF_SCHEDULER::resetStats() {
+  for (uint8_t taskId = 0; taskId < taskCount; taskId++) {
+    tasks[taskId].runCount           = 0;
+    tasks[taskId].deadlineMissCount  = 0;
+    tasks[taskId].budgetOverrunCount = 0;
+    tasks[taskId].lastDuration       = 0;
+    tasks[taskId].maxDuration        = 0;
+  }
+}
+
+void GPF_SCHEDULER::debugDisplayStats() {
+ #ifdef DEBUG_GPF_ENABLED
+  DEBUG_GPF_PRINTLN("GPF_SCHEDULER: (runs/deadline miss/budget overrun last/max/budget us)");
+  for (uint8_t taskId = 0; taskId < taskCount; taskId++) {
+    DEBUG_GPF_PRINT("  ");
+    DEBUG_GPF_PRINT(tasks[taskId].name);
+    DEBUG_GPF_PRINT("=");
+    DEBUG_GPF_PRINT(tasks[taskId].runCount);
+    DEBUG_GPF_PRINT("/");
+    DEBUG_GPF_PRINT(tasks[taskId].deadlineMissCount);
+    DEBUG_GPF_PRINT("/");
+    DEBUG_GPF_PRINT(tasks[taskId].budgetOverrunCount);
+    DEBUG_GPF_PRINT(" ");
+    DEBUG_GPF_PRINT(tasks[taskId].lastDuration);
+    DEBUG_GPF_PRINT("/");
+    DEBUG_GPF_PRINT(tasks[taskId].maxDuration);
+    DEBUG_GPF_PRINT("/");
+    DEBUG_GPF_PRINT(tasks[taskId].budget);
+    DEBUG_GPF_PRINTLN(tasks[taskId].isEnabled ? "" : " (off)");
+  }
+ #endif
+}
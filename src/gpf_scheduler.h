@@ -0,0 +1,64 @@
+/**
+ * @file gpf_scheduler.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-03-24
+ *
+ * Voir fichier gpf_scheduler.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_SCHEDULER_H
+#define GPF_SCHEDULER_H
+
+#include "Arduino.h"
+
+#define GPF_SCHEDULER_MAX_TASKS      8
+#define GPF_SCHEDULER_NO_TASK       -1
+
+typedef void (*gpf_scheduler_task_function)();
+
+struct gpf_scheduler_task_struct {
+    const char                 *name;
+    gpf_scheduler_task_function function;
+    uint32_t                    period;              //us //0 = à chaque tranche
+    uint8_t                     priority;            //0 = plus prioritaire
+    uint32_t                    budget;              //us //Temps maximum prévu pour un appel
+    bool                        isEnabled;
+    bool                        countsInLoopPass;    //Sa durée compte dans la durée d'un tour de loop() (Voir GPF::manageLoadGovernor())
+
+    unsigned long               nextReleaseAt;       //us //Moment où la tâche redevient due
+    unsigned long               lastRunSlot;
+    unsigned long               runCount;
+    unsigned long               deadlineMissCount;   //Démarrée plus d'une période après le moment où elle était due
+    unsigned long               budgetOverrunCount;  //Appel plus long que son budget
+    unsigned long               lastDuration;        //us
+    unsigned long               maxDuration;         //us
+};
+
+class GPF_SCHEDULER {
+
+    public:
+        GPF_SCHEDULER();
+        int8_t  addTask(const char *name, gpf_scheduler_task_function function, uint32_t period, uint8_t priority, uint32_t budget);
+        void    run(uint32_t slotDuration);
+        void    set_taskIsEnabled(int8_t taskId, bool isEnabled);
+        void    set_taskPeriod(int8_t taskId, uint32_t period);
+        void    set_taskCountsInLoopPass(int8_t taskId, bool countsInLoopPass);
+        uint32_t get_lastRunUncountedDuration();
+        uint32_t get_taskPeriod(int8_t taskId);
+        uint8_t get_taskCount();
+        const gpf_scheduler_task_struct *get_task(int8_t taskId);
+        void    resetStats();
+        void    debugDisplayStats();
+
+    private:
+        int8_t  findNextTask(unsigned long now, uint32_t remainingSlot, bool slotIsEmpty);
+
+        gpf_scheduler_task_struct tasks[GPF_SCHEDULER_MAX_TASKS];
+        uint8_t                   taskCount = 0;
+        unsigned long             slotCount = 0;
+        uint32_t                  lastRunUncountedDuration = 0; //us //Tâches du dernier run() qui ne comptent pas dans un tour de loop()
+};
+
+#endif
@@ -9,6 +9,8 @@
 #include "Arduino.h"
 #include "gpf_util.h"
 #include "gpf_cons.h"
+#include "gpf_fast_math.h"
+#include "gpf_mixer.h"
 #include <TimeLib.h>
 
 char   gpf_util_dateTimeString[30] = ""; //Augmenter au besoin si on ajoute des choses dans la fonction ci-dessous.
@@ -130,6 +132,17 @@ void  gpf_util_resetConfigToDefault(gpf_config_struct *ptr) {
    ptr->imuOffsets[GPF_IMU_SENSOR_GYROSCOPE][GPF_IMU_AXE_Y]      = 0;
    ptr->imuOffsets[GPF_IMU_SENSOR_GYROSCOPE][GPF_IMU_AXE_Z]      = 0;   
 
+   ptr->estimator = GPF_ESTIMATOR_TYPE_MADGWICK;
+
+   ptr->mixerPreset = GPF_MIXER_PRESET_QUAD_X;
+   GPF_MIXER::loadPreset(ptr->mixerPreset, ptr->mixerMatrix, &ptr->mixerMotorCount);
+
+   ptr->failSafeMissedFrames   = 10;  //67ms à 150hz, 20ms à 500hz
+   ptr->failSafeLinkQualityMin = 40;  //%
+   ptr->failSafeRssiMin        = 0;   //La sensibilité dépend du mode RF du récepteur, à régler pour chaque lien
+   ptr->failSafeHoldTime       = 500; //ms
+   ptr->failSafeRecoveryTime   = 300; //ms
+
 }
 
 time_t gpf_util_getTeensy3Time() {
@@ -162,7 +175,8 @@ float gpf_util_invSqrt(float x) {
   float y = tmp * (1.69000231f - 0.714158168f * x * tmp * tmp);
   return y;
   */
-  return 1.0/sqrtf(x); //Teensy is fast enough to just take the compute penalty lol suck it arduino nano
+  //return 1.0/sqrtf(x); //Teensy is fast enough to just take the compute penalty lol suck it arduino nano //1.0 est un double, la division était faite en double
+  return gpf_fast_math_invSqrt(x); //Voir gpf_fast_math.h
 }
 
 char* gpf_util_get_dateTimeString(uint8_t format, bool addSpace) {
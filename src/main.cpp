@@ -39,6 +39,12 @@ gpf_config_struct myConfig;
 
 GPF          myFc; //My Flight Controller GPFlight
 
+void task_blackBox();
+void task_menu();
+void task_alarms();
+void task_music();
+void task_debugStats();
+
 void setup() {
   elapsedMillis sinceDummy;
   
@@ -106,6 +112,13 @@ void setup() {
 
   myFc.initialize(&myConfig);
 
+  myFc.task_blackBox   = myFc.myScheduler.addTask("BlackBox", task_blackBox,   GPF_TASK_BLACK_BOX_PERIOD,   GPF_TASK_BLACK_BOX_PRIORITY,   GPF_TASK_BLACK_BOX_BUDGET);
+  myFc.task_menu       = myFc.myScheduler.addTask("Menu",     task_menu,       GPF_TASK_MENU_PERIOD,        GPF_TASK_MENU_PRIORITY,        GPF_TASK_MENU_BUDGET);
+  myFc.task_alarms     = myFc.myScheduler.addTask("Alarms",   task_alarms,     GPF_TASK_ALARMS_PERIOD,      GPF_TASK_ALARMS_PRIORITY,      GPF_TASK_ALARMS_BUDGET);
+  myFc.task_music      = myFc.myScheduler.addTask("Music",    task_music,      GPF_TASK_MUSIC_PERIOD,       GPF_TASK_MUSIC_PRIORITY,       GPF_TASK_MUSIC_BUDGET);
+  myFc.task_debugStats = myFc.myScheduler.addTask("Debug",    task_debugStats, GPF_TASK_DEBUG_STATS_PERIOD, GPF_TASK_DEBUG_STATS_PRIORITY, GPF_TASK_DEBUG_STATS_BUDGET);
+  myFc.myScheduler.set_taskCountsInLoopPass(myFc.task_menu, false); //Dessiner l'écran désarmé ne doit pas faire réagir le gouverneur de charge
+
   //myFc.genDummyTelemetryData(); //Pour fin de tests
   strncpy(myFc.gpf_telemetry_info.flight_mode_description, "GPFlight :-)", GPF_UTIL_FLIGHT_MODE_DESCRIPTION_MAX_LENGTH);
   
@@ -126,33 +139,23 @@ uint16_t      lastDshotCommandSent = 0;
 
 void loop() {
     static bool          isArmed_previous             = true;
-    static bool          isInFailSafe_local           = false;   
-    static bool          isInFailSafe_local_previous  = false;   
-    static unsigned long failSafeMotorDecelarationLoopCount = 0;
-    static float         failSafeMotorDecelarationStep = 0.0;
-    static int           failSafePwmThrottleValue = 0;
-    static unsigned long dummyCpt = 0;
-
-    dummyCpt++;
 
-    myFc.iAmStartingLoopNow(true);
-    myFc.debugDisplayLoopStats();
+    // La boucle de contrôle (IMU, fusion, PID, mixer, DShot et fail safe) roule dans l'interruption du timer
+    // démarré par myFc.initialize(). Voir GPF::controlLoop(). Ici on fait seulement le travail d'arrière plan.
+    myFc.manageLoadGovernor();
+    myFc.debugProcessUsbRequest();
 
     myFc.gpf_telemetry_info.battery_voltage = gpf_util_getVoltage(); 
     
-    myFc.myRc.readRx(); //Armé ou non, on va toujours lire la position des sticks
+    {
+      GPF_PROFILE_STAGE(GPF_PROFILER_STAGE_RC_READ);
+      myFc.myRc.readRx(); //Armé ou non, on va toujours lire la position des sticks
+    }
+    myFc.refreshRcSnapshot(); //Une seule copie cohérente des canaux pour ce tour
+    myFc.logFailSafeStage();
     myFc.set_arm_IsArmed(myFc.get_IsStickInPosition(GPF_RC_STICK_ARM, GPF_RC_CHANNEL_POSITION_HIGH)); //Dans certains cas, on ne permet pas d'armer
     myFc.set_black_box_IsEnabled(myFc.get_IsStickInPosition(GPF_RC_STICK_BLACK_BOX, GPF_RC_CHANNEL_POSITION_HIGH));
     myFc.get_set_flightMode();
-    myFc.myImu.set_fusion_type(myFc.flight_mode);
-
-    if (myFc.myImu.getIMUData()) { //Armé ou non, on va toujours lire le IMU
-      myFc.myImu.doFusion(); //Madwick ou Complementary filter selon la position de la switch mode de vol.
-    }
-
-    myFc.getDesiredState(); //Compute desired state //Convert raw commands to normalized values based on saturated control limits
-    myFc.controlANGLE();    //PID Controller //Stabilize on angle setpoint
-    myFc.controlMixer();    //Actuator mixing and scaling to PWM values //Mixes PID outputs to scaled actuator commands -- custom mixing assignments done here
 
     //myFc.set_arm_IsArmed(true); //test remporaire
 
@@ -168,7 +171,7 @@ void loop() {
         myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(gpf_util_get_dateTimeString(GPF_MISC_FORMAT_DATE_TIME_FRIENDLY_US,true));
         myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->println("Arm");
 
-        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->println("Kp_roll_angle,Ki_roll_angle,Kd_roll_angle,Kp_pitch_angle,Ki_pitch_angle,Kd_pitch_angle,Kp_yaw,Ki_yaw,Kd_yaw,GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER,B_madgwick,B_accel,B_gyro");
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->println("Kp_roll_angle,Ki_roll_angle,Kd_roll_angle,Kp_pitch_angle,Ki_pitch_angle,Kd_pitch_angle,Kp_yaw,Ki_yaw,Kd_yaw,GPF_IMU_FUSION_WEIGHT_GYRO_COMPLEMENTARY_FILTER,B_madgwick,Filter_accel,Filter_accel_hz,Filter_gyro,Filter_gyro_hz,Filter_dterm,Filter_dterm_hz,Filter_sample_rate_hz,Estimator");
 
         myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(myConfig.pids[GPF_AXE_ROLL][GPF_PID_TERM_PROPORTIONAL]  / GPF_PID_STORAGE_MULTIPLIER,6);
         myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
@@ -196,9 +199,21 @@ void loop() {
 
         myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(myFc.myImu.B_madgwick,6);
         myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
-        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(myFc.myImu.B_accel,6);
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(GPF_FILTER_3AXES::getTypeDescription(myFc.myImu.accelFilter.get_type()));
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(myFc.myImu.accelFilter.get_cutoffHz(),1);
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(GPF_FILTER_3AXES::getTypeDescription(myFc.myImu.gyroFilter.get_type()));
         myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
-        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(myFc.myImu.B_gyro,6);
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(myFc.myImu.gyroFilter.get_cutoffHz(),1);
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(GPF_FILTER_3AXES::getTypeDescription(myFc.pidController.get_dtermFilter()->get_type()));
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(myFc.pidController.get_dtermFilter()->get_cutoffHz(),1);
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(myFc.myImu.filter_sampleRateHz,1);
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
+        myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(myFc.myImu.get_estimator(myConfig.estimator)->getName());
         //myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(",");
 
         myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->println("");
@@ -212,68 +227,6 @@ void loop() {
 
         isArmed_previous = true;
       }
-            
-      myFc.scaleCommands();   //Scales motor commands to DSHOT commands
-
-      //Sécurité - Fail Safe
-      isInFailSafe_local_previous = isInFailSafe_local;
-      isInFailSafe_local = myFc.myRc.get_isInFailSafe();
-
-      if (isInFailSafe_local) {
-       //if ((dummyCpt % 250) == 0) {
-       // DEBUG_GPF_PRINTLN("isInFailSafe=oui"); 
-       //}
-
-       // Lorsqu'on entre en failSafe, on remet tous les channels à 1500 (sauf le throttle) pour laisser le drone se 
-       // stabiliser. Cependant pendant 5 secondes, je force le throttle à diminuer jusqu'à 0.
-       // Todo: Ajouter condition avec lidar si distance avec le sol est plus petite que 0.5 mètre environ.
- 
-       if (!isInFailSafe_local_previous) { //On entre en failSafe 
-         failSafeMotorDecelarationLoopCount = 0;
-
-         //Faudrait peut-être pas mettre tous les channels à 1500 genre Throttle, ARM et mode de vol, etc...
-         //Faudrait plutot forcer que le yaw, roll et pitch
-         myFc.myRc.forcePwmChannelYawRollPitchToNeutral(myConfig.channelMaps[GPF_RC_STICK_YAW],myConfig.channelMaps[GPF_RC_STICK_ROLL],myConfig.channelMaps[GPF_RC_STICK_PITCH]); 
-         failSafePwmThrottleValue       = myFc.myRc.getPwmChannelValue(myConfig.channelMaps[GPF_RC_STICK_THROTTLE]); 
-         failSafeMotorDecelarationStep  = max(0.0,failSafePwmThrottleValue - GPF_RC_CHANNEL_VALUE_MIN) / (GPF_FAILSAFE_MOTORS_DECELERATION_DURATION / GPF_MAIN_LOOP_RATE);
-       
-         DEBUG_GPF_PRINTLN("*****On entre en failSafe ******************************************************** ");
-         DEBUG_GPF_PRINT("***** failSafeMotorDecelarationStep=");
-         DEBUG_GPF_PRINTLN(failSafeMotorDecelarationStep);       
-       }     
-
-       if (myFc.myRc.getFailSafeDuration() < GPF_FAILSAFE_MOTORS_DECELERATION_DURATION) { //Pendant 5 secondes, on rallenti les moteurs jusqu'à 0.
-        myFc.myRc.setPwmChannelValue(myConfig.channelMaps[GPF_RC_STICK_THROTTLE],failSafePwmThrottleValue - (failSafeMotorDecelarationLoopCount * failSafeMotorDecelarationStep));
-
-        if ((dummyCpt % 250) == 0) {
-          DEBUG_GPF_PRINT("GPF_RC_STICK_THROTTLE=");
-          DEBUG_GPF_PRINT(myFc.myRc.getPwmChannelValue(myConfig.channelMaps[GPF_RC_STICK_THROTTLE]));
-        
-          DEBUG_GPF_PRINT(" (f..Count * f..Step)=");
-          DEBUG_GPF_PRINTLN((failSafeMotorDecelarationLoopCount * failSafeMotorDecelarationStep));
-        }
-       } else {
-         // Une fois qu'on a laissé le temps aux moteurs de ralentir pendant 5 secondes pour que le drone descendre/tombe en douceur,
-         // après ce délai on s'assure que les moteurs arrêtent complètement.
-         for (uint8_t motorNumber = 0; motorNumber < GPF_MOTOR_ITEM_COUNT; motorNumber++) { 
-          myFc.motor_command_DSHOT[motorNumber] = GPF_DSHOT_CMD_MOTOR_STOP; 
-         }
-       }
-
-       failSafeMotorDecelarationLoopCount++;
-      }
-
-      // On envoi les commandes aux ESC seulement lorsqu'on est armé.
-      // Lorsque la commande des moteurs ne change pas, ca ne donnerait normalement rien de réenvoyer la commande continuellement 
-      // puisque en réalité ce n'est pas la fonction sendCommand() qui envoi le signal aux ESC mais plutôt les DMA. 
-      // Mais j'appel cette fonction continuellement quand-même car c'est plus simple comme celà.
-      for (uint8_t motorNumber = 0; motorNumber < GPF_MOTOR_ITEM_COUNT; motorNumber++) { 
-       myFc.myDshot.sendCommand(motorNumber, myFc.motor_command_DSHOT[motorNumber], false);
-      }
-
-      if (myFc.get_black_box_IsEnabled()) {       
-       myFc.black_box_writeRow();
-      }
 
     } else {
       //Si pas armé, et bien on affiche le menu sur l'écran tactile.
@@ -295,6 +248,7 @@ void loop() {
         myFc.mySdCard.openFile(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG);
         myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->print(gpf_util_get_dateTimeString(GPF_MISC_FORMAT_DATE_TIME_FRIENDLY_US,true));
         myFc.mySdCard.getFileObject(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG)->println("Desarm");
+        myFc.info_log_writeLoopHistograms();
         myFc.mySdCard.closeFile(GPF_SDCARD_FILE_TYPE_INFORMATION_LOG);
 
         myFc.resetLoopStats();
@@ -302,12 +256,41 @@ void loop() {
       }
 
       myFc.update_arm_allowArming(); //Call cette fonction seulement lorsque désarmé sinon on ne pourra jamais armer. //Anyway, si on est armé on a plus besoin de savoir si on peut armer.
-      myFc.displayAndProcessMenu();
-
     }
 
-    myFc.manageAlarms();    
-    myFc.myMusicPlayer.updatePlaying(myFc.myRc.getPwmChannelValue(myConfig.channelMaps[GPF_RC_STICK_MUSIC_PLAYER_VOLUME]), myFc.myRc.getPwmChannelValue(myConfig.channelMaps[GPF_RC_STICK_MUSIC_PLAYER_TRACK]), myFc.myRc.getPwmChannelValue(myConfig.channelMaps[GPF_RC_STICK_MUSIC_PLAYER_LIST]));
+    // Black box, menu, alarmes, musique et stats de debug selon leur période, priorité et budget. Voir GPF_SCHEDULER.
+    myFc.myScheduler.run(GPF_SCHEDULER_SLOT_DURATION);
+}
+
+// *** Tâches d'arrière plan (Voir setup()) ***
+
+void task_blackBox() {
+  myFc.info_log_writeQueuedLines(); //Événements (gouverneur, fail safe) gardés pendant le tour de loop()
+
+  if (myFc.get_arm_IsArmed() && myFc.get_black_box_IsEnabled()) {
+    GPF_PROFILE_STAGE(GPF_PROFILER_STAGE_BLACK_BOX);
+    myFc.black_box_writeRow();
+  }
+}
+
+void task_menu() {
+  //Si pas armé, et bien on affiche le menu sur l'écran tactile. Si armé, on n'affiche rien (C'est beaucoup trop long afficher de toute facon)
+  if (!myFc.get_arm_IsArmed()) {
+    GPF_PROFILE_STAGE(GPF_PROFILER_STAGE_MENU);
+    myFc.displayAndProcessMenu();
+  }
+}
+
+void task_alarms() {
+  myFc.manageAlarms();    
+}
+
+void task_music() {
+  myFc.myMusicPlayer.updatePlaying(myFc.myRc.getPwmChannelValue(myConfig.channelMaps[GPF_RC_STICK_MUSIC_PLAYER_VOLUME]), myFc.myRc.getPwmChannelValue(myConfig.channelMaps[GPF_RC_STICK_MUSIC_PLAYER_TRACK]), myFc.myRc.getPwmChannelValue(myConfig.channelMaps[GPF_RC_STICK_MUSIC_PLAYER_LIST]));
+}
+
+void task_debugStats() {
+  myFc.debugDisplayLoopStats();
 }
 
 
@@ -0,0 +1,47 @@
+/**
+ * @file gpf_test.h
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * Voir fichier test_main.cpp pour plus d'informations.
+ *
+ */
+
+#ifndef GPF_TEST_H
+#define GPF_TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+typedef void (*gpf_test_function)();
+
+// Enregistre un test (ou une mesure de durée) au démarrage du programme. Voir GPF_TEST() et GPF_BENCH().
+struct GPF_TEST_REGISTER {
+    GPF_TEST_REGISTER(const char *name, gpf_test_function function, bool isBench);
+};
+
+void     gpf_test_fail(const char *file, int line, const char *expression, double actual, double expected);
+uint64_t gpf_test_nowNs();
+void     gpf_test_reportBench(const char *description, double nsPerCall);
+
+// Un test échoue au premier GPF_CHECK faux (les suivants du même test sont quand même évalués)
+#define GPF_TEST(name)  static void name(); static GPF_TEST_REGISTER name##_register(#name, name, false); static void name()
+#define GPF_BENCH(name) static void name(); static GPF_TEST_REGISTER name##_register(#name, name, true);  static void name()
+
+#define GPF_CHECK(condition) \
+    do { if (!(condition)) { gpf_test_fail(__FILE__, __LINE__, #condition, 0, 0); } } while (0)
+
+#define GPF_CHECK_EQUAL(actual, expected) \
+    do { double a_ = (double)(actual), e_ = (double)(expected); \
+         if (a_ != e_) { gpf_test_fail(__FILE__, __LINE__, #actual " == " #expected, a_, e_); } } while (0)
+
+#define GPF_CHECK_NEAR(actual, expected, tolerance) \
+    do { double a_ = (double)(actual), e_ = (double)(expected); \
+         if (!(fabs(a_ - e_) <= (double)(tolerance))) { gpf_test_fail(__FILE__, __LINE__, #actual " ~ " #expected, a_, e_); } } while (0)
+
+// Empêche le compilateur de retirer un calcul dont le résultat ne sert qu'à une mesure de durée
+extern volatile float gpf_test_sink;
+
+#endif
@@ -0,0 +1,425 @@
+/**
+ * @file test_crsf_parser.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * GPF_CRSF_PARSER sur un flot de 10 000 frames (canaux 0x16 et link statistics 0x14 en alternance, collés sans pause),
+ * propre puis abîmé. Chaque frame retourné est cherché parmi les frames envoyés: un frame qui n'y est pas serait un frame
+ * corrompu accepté.
+ *
+ * Résultats au moment d'écrire ces tests:
+ *  - Flot propre: 10 000 frames, aucune erreur CRC, aucune resynchronisation.
+ *  - 1 bit sur 4000 inversé au hasard: environ 96% des frames retrouvés intacts, aucun frame corrompu accepté.
+ *  - 1 à 8 octets au hasard (commençant par 0xC8) avant 1 frame sur 10 et 1 frame sur 37 coupé en deux: tous les frames
+ *    intacts retrouvés, aucun frame de trop.
+ *
+ * unpackChannels() est comparé à l'ancien décodage de GPF_CRSF::parseFrame() (struct de 16 champs de 11 bits) pour les
+ * 2048 valeurs de chacun des 16 canaux: résultats identiques. Durée par frame mesurée par make -C test bench: environ la
+ * moitié de l'ancien décodage.
+ *
+ * unpackChannelsSubset() (frames 0x17) est comparé à la conversion en float de Betaflight pour les 4 résolutions (10 à 13
+ * bits), tous les premiers canaux et toutes les valeurs sur chacun des canaux: résultats identiques. Un premier canal au
+ * delà du 16e, les canaux au delà du 16e et un payload de moins de 2 octets ne donnent aucun canal.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "gpf_test.h"
+#include "gpf_crsf_parser.h"
+
+#define TEST_CRSF_PARSER_FRAME_COUNT  10000
+#define TEST_CRSF_PARSER_SEARCH_AHEAD 20    //Frames envoyés où chercher un frame retourné (ceux perdus sont sautés)
+
+typedef std::vector<uint8_t> testCrsfParser_frame;
+
+typedef struct {
+  long frameCount;
+  long goodCount;    //Identiques à un frame envoyé
+  long badCount;     //Corrompus acceptés
+  long crcErrorCount;
+  long resyncCount;
+} testCrsfParser_result;
+
+static GPF_CRSF_PARSER testCrsfParser_crcParser; //Seulement pour crc8()
+
+static testCrsfParser_frame testCrsfParser_makeFrame(int index) {
+  testCrsfParser_frame frame;
+  bool                 isChannels = (index % 2 == 0);
+
+  frame.push_back(0xC8);
+  frame.push_back(isChannels ? 24 : 12);
+  frame.push_back(isChannels ? 0x16 : 0x14);
+  for (int i = 0; i < (isChannels ? 22 : 10); i++) {
+    frame.push_back(rand() & 0xFF);
+  }
+  frame.push_back(testCrsfParser_crcParser.crc8(&frame[2], frame[1] - 1));
+  return frame;
+}
+
+static void testCrsfParser_makeFrames(std::vector<testCrsfParser_frame> &frames, std::vector<uint8_t> &stream) {
+  srand(1);
+  for (int i = 0; i < TEST_CRSF_PARSER_FRAME_COUNT; i++) {
+    frames.push_back(testCrsfParser_makeFrame(i));
+    stream.insert(stream.end(), frames.back().begin(), frames.back().end());
+  }
+}
+
+// Même boucle que GPF_CRSF::pollRx(): tous les frames complets sont lus avant l'octet suivant
+static testCrsfParser_result testCrsfParser_run(const std::vector<testCrsfParser_frame> &frames, const std::vector<uint8_t> &stream) {
+  GPF_CRSF_PARSER       parser;
+  testCrsfParser_result result = {0, 0, 0, 0, 0};
+  size_t                next   = 0;
+
+  for (size_t i = 0; i < stream.size(); i++) {
+    if (!parser.feed(stream[i])) {
+      continue;
+    }
+    do {
+      testCrsfParser_frame frame(parser.get_frame(), parser.get_frame() + parser.get_frameSize());
+      bool                 found = false;
+
+      result.frameCount++;
+      for (size_t j = next; (j < frames.size()) && (j < next + TEST_CRSF_PARSER_SEARCH_AHEAD); j++) {
+        if (frames[j] == frame) {
+          found = true;
+          next  = j + 1;
+          break;
+        }
+      }
+      if (found) {
+        result.goodCount++;
+      } else {
+        result.badCount++;
+      }
+    } while (parser.nextFrame());
+  }
+
+  result.crcErrorCount = parser.get_crcErrorCount();
+  result.resyncCount   = parser.get_resyncCount();
+  return result;
+}
+
+GPF_TEST(crsfParser_cleanStream) {
+  std::vector<testCrsfParser_frame> frames;
+  std::vector<uint8_t>              stream;
+
+  testCrsfParser_makeFrames(frames, stream);
+  testCrsfParser_result result = testCrsfParser_run(frames, stream);
+
+  GPF_CHECK_EQUAL(result.frameCount, TEST_CRSF_PARSER_FRAME_COUNT);
+  GPF_CHECK_EQUAL(result.goodCount, TEST_CRSF_PARSER_FRAME_COUNT);
+  GPF_CHECK_EQUAL(result.crcErrorCount, 0);
+  GPF_CHECK_EQUAL(result.resyncCount, 0);
+}
+
+GPF_TEST(crsfParser_bitFlips) {
+  std::vector<testCrsfParser_frame> frames;
+  std::vector<uint8_t>              stream;
+
+  testCrsfParser_makeFrames(frames, stream);
+  for (size_t i = 0; i < stream.size(); i++) {
+    if (rand() % 500 == 0) {
+      stream[i] ^= 1 << (rand() % 8);
+    }
+  }
+  testCrsfParser_result result = testCrsfParser_run(frames, stream);
+
+  GPF_CHECK_EQUAL(result.badCount, 0);
+  GPF_CHECK(result.goodCount > TEST_CRSF_PARSER_FRAME_COUNT * 0.94);
+  GPF_CHECK(result.crcErrorCount > 0);
+  GPF_CHECK(result.resyncCount > 0);
+}
+
+GPF_TEST(crsfParser_junkAndTruncatedFrames) {
+  std::vector<testCrsfParser_frame> frames;
+  std::vector<uint8_t>              clean;
+  std::vector<uint8_t>              stream;
+  long                              intactCount = 0;
+
+  testCrsfParser_makeFrames(frames, clean);
+  for (int i = 0; i < TEST_CRSF_PARSER_FRAME_COUNT; i++) {
+    if (i % 10 == 3) {
+      int junkCount = 1 + rand() % 8;
+      for (int k = 0; k < junkCount; k++) {
+        stream.push_back((k == 0) ? 0xC8 : (rand() & 0xFF));
+      }
+    }
+    if (i % 37 == 5) { //Coupé en deux
+      stream.insert(stream.end(), frames[i].begin(), frames[i].begin() + frames[i].size() / 2);
+      continue;
+    }
+    intactCount++;
+    stream.insert(stream.end(), frames[i].begin(), frames[i].end());
+  }
+  testCrsfParser_result result = testCrsfParser_run(frames, stream);
+
+  GPF_CHECK_EQUAL(result.goodCount, intactCount);
+  GPF_CHECK_EQUAL(result.badCount, 0);
+}
+
+// Un faux départ avec une grande longueur cache 3 frames: les 3 sont retournés dès que son CRC est rejeté
+GPF_TEST(crsfParser_allFramesReturnedOnSameByte) {
+  GPF_CRSF_PARSER                   parser;
+  std::vector<testCrsfParser_frame> frames;
+  std::vector<uint8_t>              stream;
+  const uint8_t                     falseLength = 48;
+
+  srand(2);
+  stream.push_back(0xC8);
+  stream.push_back(falseLength);
+  for (int i = 0; i < 4; i++) {
+    frames.push_back(testCrsfParser_makeFrame(2 * i + 1)); //Link statistics, 14 octets
+    stream.insert(stream.end(), frames.back().begin(), frames.back().end());
+  }
+  GPF_CHECK(testCrsfParser_crcParser.crc8(&stream[2], falseLength - 1) != stream[falseLength + 1]);
+
+  size_t lastFalseByte = falseLength + 1;
+  for (size_t i = 0; i < lastFalseByte; i++) {
+    GPF_CHECK(!parser.feed(stream[i]));
+  }
+
+  int returnedCount = 0;
+  if (parser.feed(stream[lastFalseByte])) {
+    do {
+      GPF_CHECK(testCrsfParser_frame(parser.get_frame(), parser.get_frame() + parser.get_frameSize()) == frames[returnedCount]);
+      returnedCount++;
+    } while (parser.nextFrame());
+  }
+  GPF_CHECK_EQUAL(returnedCount, 3);
+
+  //Le 4e frame arrive normalement sur son dernier octet
+  for (size_t i = lastFalseByte + 1; i < stream.size() - 1; i++) {
+    GPF_CHECK(!parser.feed(stream[i]));
+  }
+  GPF_CHECK(parser.feed(stream.back()));
+  GPF_CHECK(testCrsfParser_frame(parser.get_frame(), parser.get_frame() + parser.get_frameSize()) == frames[3]);
+  GPF_CHECK(!parser.nextFrame());
+}
+
+// Ancien décodage de GPF_CRSF::parseFrame(): memcpy dans une struct de 16 champs de 11 bits puis CHANNEL_SCALE()
+struct __attribute__ ((packed)) testCrsfParser_oldChannels {
+  unsigned int channel_1  : 11;
+  unsigned int channel_2  : 11;
+  unsigned int channel_3  : 11;
+  unsigned int channel_4  : 11;
+  unsigned int channel_5  : 11;
+  unsigned int channel_6  : 11;
+  unsigned int channel_7  : 11;
+  unsigned int channel_8  : 11;
+  unsigned int channel_9  : 11;
+  unsigned int channel_10 : 11;
+  unsigned int channel_11 : 11;
+  unsigned int channel_12 : 11;
+  unsigned int channel_13 : 11;
+  unsigned int channel_14 : 11;
+  unsigned int channel_15 : 11;
+  unsigned int channel_16 : 11;
+};
+
+#define TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(x) ((int32_t(x) * 5U) / 8U + 880U)
+
+static void testCrsfParser_oldUnpackChannels(const uint8_t *payload, uint16_t *pwmChannels) {
+  testCrsfParser_oldChannels channels;
+
+  memcpy(&channels, payload, sizeof(channels));
+  pwmChannels[0]  = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_1);
+  pwmChannels[1]  = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_2);
+  pwmChannels[2]  = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_3);
+  pwmChannels[3]  = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_4);
+  pwmChannels[4]  = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_5);
+  pwmChannels[5]  = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_6);
+  pwmChannels[6]  = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_7);
+  pwmChannels[7]  = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_8);
+  pwmChannels[8]  = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_9);
+  pwmChannels[9]  = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_10);
+  pwmChannels[10] = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_11);
+  pwmChannels[11] = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_12);
+  pwmChannels[12] = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_13);
+  pwmChannels[13] = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_14);
+  pwmChannels[14] = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_15);
+  pwmChannels[15] = TEST_CRSF_PARSER_OLD_CHANNEL_SCALE(channels.channel_16);
+}
+
+// Écrit value (11 bits) dans le canal channel (0 à 15) du payload
+static void testCrsfParser_setChannel(uint8_t *payload, int channel, uint16_t value) {
+  for (int bit = 0; bit < 11; bit++) {
+    int     position = channel * 11 + bit;
+    uint8_t mask     = 1 << (position % 8);
+    payload[position / 8] = (value & (1 << bit)) ? (payload[position / 8] | mask) : (payload[position / 8] & ~mask);
+  }
+}
+
+// Les 2048 valeurs de chacun des 16 canaux, le reste du payload au hasard
+GPF_TEST(crsfParser_unpackChannelsMatchesOldDecoding) {
+  uint8_t  payload[GPF_CRSF_PARSER_CHANNELS_PAYLOAD];
+  uint16_t pwmChannels[GPF_CRSF_PARSER_CHANNEL_COUNT];
+  uint16_t pwmChannelsOld[GPF_CRSF_PARSER_CHANNEL_COUNT];
+  long     mismatchCount = 0;
+
+  srand(3);
+  for (int channel = 0; channel < GPF_CRSF_PARSER_CHANNEL_COUNT; channel++) {
+    for (uint16_t value = 0; value < 2048; value++) {
+      for (int i = 0; i < GPF_CRSF_PARSER_CHANNELS_PAYLOAD; i++) {
+        payload[i] = rand() & 0xFF;
+      }
+      testCrsfParser_setChannel(payload, channel, value);
+
+      GPF_CRSF_PARSER::unpackChannels(payload, pwmChannels);
+      testCrsfParser_oldUnpackChannels(payload, pwmChannelsOld);
+      if (memcmp(pwmChannels, pwmChannelsOld, sizeof(pwmChannels)) != 0) {
+        mismatchCount++;
+      }
+    }
+  }
+  GPF_CHECK_EQUAL(mismatchCount, 0);
+
+  //Limites des valeurs envoyées par un récepteur CRSF
+  memset(payload, 0, sizeof(payload));
+  testCrsfParser_setChannel(payload, 0, 172);
+  testCrsfParser_setChannel(payload, 15, 1811);
+  GPF_CRSF_PARSER::unpackChannels(payload, pwmChannels);
+  GPF_CHECK_EQUAL(pwmChannels[0], 987);
+  GPF_CHECK_EQUAL(pwmChannels[15], 2011);
+}
+
+// Frame 0x17: premier canal et résolution dans le premier octet puis count canaux de 10 + resolution bits collés
+static uint8_t testCrsfParser_packSubset(uint8_t *payload, uint8_t firstChannel, uint8_t resolution, const uint16_t *values, int count) {
+  int resolutionBits = GPF_CRSF_PARSER_SUBSET_RESOLUTION_MIN + resolution;
+  int bitPosition    = 0;
+
+  memset(payload, 0, 64);
+  payload[0] = firstChannel | (resolution << GPF_CRSF_PARSER_SUBSET_RESOLUTION_SHIFT);
+  for (int i = 0; i < count; i++) {
+    for (int bit = 0; bit < resolutionBits; bit++) {
+      if ((values[i] >> bit) & 1) {
+        payload[1 + (bitPosition >> 3)] |= 1 << (bitPosition & 7);
+      }
+      bitPosition++;
+    }
+  }
+  return 1 + (bitPosition + 7) / 8;
+}
+
+// Conversion de Betaflight (crsfReadRawRC()): 1.0, 0.5, 0.25 ou 0.125 fois la valeur + 988, en float
+static uint16_t testCrsfParser_betaflightSubsetPwm(uint8_t resolution, uint16_t value) {
+  float channelScale = 1.0f / (1 << resolution);
+  return (uint16_t)(channelScale * (float)value + 988);
+}
+
+// Les 4 résolutions, tous les premiers canaux et toutes les valeurs sur chacun des canaux
+GPF_TEST(crsfParser_unpackChannelsSubsetMatchesBetaflight) {
+  uint8_t  payload[64];
+  uint16_t values[GPF_CRSF_PARSER_CHANNEL_COUNT];
+  uint16_t pwmChannels[GPF_CRSF_PARSER_CHANNEL_COUNT];
+  long     mismatchCount = 0;
+  long     countErrors   = 0;
+
+  for (uint8_t resolution = 0; resolution <= GPF_CRSF_PARSER_SUBSET_RESOLUTION_MASK; resolution++) {
+    uint16_t valueCount = 1 << (GPF_CRSF_PARSER_SUBSET_RESOLUTION_MIN + resolution);
+
+    for (uint8_t firstChannel = 0; firstChannel < GPF_CRSF_PARSER_CHANNEL_COUNT; firstChannel++) {
+      int channelCount = GPF_CRSF_PARSER_CHANNEL_COUNT - firstChannel;
+
+      for (uint16_t value = 0; value < valueCount; value++) {
+        for (int i = 0; i < channelCount; i++) {
+          values[i] = (value + i * 37) & (valueCount - 1);
+        }
+        uint8_t payloadLength = testCrsfParser_packSubset(payload, firstChannel, resolution, values, channelCount);
+
+        memset(pwmChannels, 0, sizeof(pwmChannels));
+        if (GPF_CRSF_PARSER::unpackChannelsSubset(payload, payloadLength, pwmChannels) != channelCount) {
+          countErrors++;
+        }
+        for (int channel = 0; channel < GPF_CRSF_PARSER_CHANNEL_COUNT; channel++) {
+          uint16_t expected = (channel < firstChannel) ? 0 : testCrsfParser_betaflightSubsetPwm(resolution, values[channel - firstChannel]);
+          if (pwmChannels[channel] != expected) {
+            mismatchCount++;
+          }
+        }
+      }
+    }
+  }
+  GPF_CHECK_EQUAL(mismatchCount, 0);
+  GPF_CHECK_EQUAL(countErrors, 0);
+}
+
+GPF_TEST(crsfParser_unpackChannelsSubsetLimits) {
+  uint8_t  payload[64];
+  uint16_t values[GPF_CRSF_PARSER_CHANNEL_COUNT];
+  uint16_t pwmChannels[GPF_CRSF_PARSER_CHANNEL_COUNT + 4];
+  uint8_t  payloadLength;
+
+  for (int i = 0; i < GPF_CRSF_PARSER_CHANNEL_COUNT; i++) {
+    values[i] = 100 + i;
+  }
+
+  //10 canaux à partir du canal 11: les 6 premiers seulement, rien d'écrit après le 16e
+  payloadLength = testCrsfParser_packSubset(payload, 10, 1, values, 10);
+  memset(pwmChannels, 0, sizeof(pwmChannels));
+  GPF_CHECK_EQUAL(GPF_CRSF_PARSER::unpackChannelsSubset(payload, payloadLength, pwmChannels), 6);
+  GPF_CHECK_EQUAL(pwmChannels[9], 0);
+  GPF_CHECK_EQUAL(pwmChannels[10], 988 + 50);
+  GPF_CHECK_EQUAL(pwmChannels[15], 988 + 52);
+  for (int channel = GPF_CRSF_PARSER_CHANNEL_COUNT; channel < GPF_CRSF_PARSER_CHANNEL_COUNT + 4; channel++) {
+    GPF_CHECK_EQUAL(pwmChannels[channel], 0);
+  }
+
+  //Premiers canaux 17 à 32 (5 bits): aucun canal
+  for (uint8_t firstChannel = GPF_CRSF_PARSER_CHANNEL_COUNT; firstChannel <= GPF_CRSF_PARSER_SUBSET_FIRST_CHANNEL_MASK; firstChannel++) {
+    payloadLength = testCrsfParser_packSubset(payload, firstChannel, 0, values, 4);
+    memset(pwmChannels, 0, sizeof(pwmChannels));
+    GPF_CHECK_EQUAL(GPF_CRSF_PARSER::unpackChannelsSubset(payload, payloadLength, pwmChannels), 0);
+    for (int channel = 0; channel < GPF_CRSF_PARSER_CHANNEL_COUNT + 4; channel++) {
+      GPF_CHECK_EQUAL(pwmChannels[channel], 0);
+    }
+  }
+
+  //Payload sans canal: 0 ou 1 octet
+  payloadLength = testCrsfParser_packSubset(payload, 0, 0, values, 4);
+  memset(pwmChannels, 0, sizeof(pwmChannels));
+  GPF_CHECK_EQUAL(GPF_CRSF_PARSER::unpackChannelsSubset(payload, 0, pwmChannels), 0);
+  GPF_CHECK_EQUAL(GPF_CRSF_PARSER::unpackChannelsSubset(payload, 1, pwmChannels), 0);
+  GPF_CHECK_EQUAL(pwmChannels[0], 0);
+
+  //Dernier canal coupé: 2 octets en 13 bits = 1 canal
+  payloadLength = testCrsfParser_packSubset(payload, 0, 3, values, 2);
+  GPF_CHECK_EQUAL(GPF_CRSF_PARSER::unpackChannelsSubset(payload, payloadLength - 1, pwmChannels), 1);
+  GPF_CHECK_EQUAL(pwmChannels[0], 988 + 100 / 8);
+  GPF_CHECK_EQUAL(pwmChannels[1], 0);
+}
+
+GPF_BENCH(crsfParser_unpackChannels) {
+  const int      count       = 4096;
+  const int      repeatCount = 500;
+  static uint8_t payloads[count][GPF_CRSF_PARSER_CHANNELS_PAYLOAD];
+  uint16_t       pwmChannels[GPF_CRSF_PARSER_CHANNEL_COUNT];
+
+  srand(1);
+  for (int i = 0; i < count; i++) {
+    for (int k = 0; k < GPF_CRSF_PARSER_CHANNELS_PAYLOAD; k++) {
+      payloads[i][k] = rand() & 0xFF;
+    }
+  }
+
+  uint64_t start = gpf_test_nowNs();
+  for (int r = 0; r < repeatCount; r++) {
+    for (int i = 0; i < count; i++) {
+      testCrsfParser_oldUnpackChannels(payloads[i], pwmChannels);
+      gpf_test_sink += pwmChannels[r & 15];
+    }
+  }
+  uint64_t middle = gpf_test_nowNs();
+  for (int r = 0; r < repeatCount; r++) {
+    for (int i = 0; i < count; i++) {
+      GPF_CRSF_PARSER::unpackChannels(payloads[i], pwmChannels);
+      gpf_test_sink += pwmChannels[r & 15];
+    }
+  }
+  uint64_t end = gpf_test_nowNs();
+
+  gpf_test_reportBench("ancien décodage (struct de 11 bits), par frame", (double)(middle - start) / ((double)repeatCount * count));
+  gpf_test_reportBench("GPF_CRSF_PARSER::unpackChannels(), par frame", (double)(end - middle) / ((double)repeatCount * count));
+}
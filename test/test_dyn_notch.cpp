@@ -0,0 +1,140 @@
+/**
+ * @file test_dyn_notch.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * Suivi des pics de gpf_dyn_notch.cpp avec des sinus, du bruit et un mouvement lent de l'avion (sous minHz).
+ *
+ */
+
+#include <stdlib.h>
+#include "gpf_test.h"
+#include "gpf_dyn_notch.h"
+
+#define TEST_DYN_NOTCH_SAMPLE_RATE_HZ 2000.0
+
+// Pics fixes par axe. Le deuxième pic de l'axe 0 est le plus fort mais le plus haut en fréquence.
+static const float testDynNotch_frequencyHz[GPF_FILTER_AXE_COUNT][2] = {{173, 346}, {240, 480}, {310, 0}};
+static const float testDynNotch_amplitude[GPF_FILTER_AXE_COUNT][2]   = {{5, 10},    {10, 5},    {10, 0}};
+
+static float testDynNotch_noise() {
+  return 3.0f * ((rand() / (float)RAND_MAX) - 0.5f);
+}
+
+// Un tour de la boucle gyro: échantillon, une étape d'analyse puis les filtres. Retourne la sortie de chaque axe.
+static void testDynNotch_step(GPF_DYN_NOTCH &dynNotch, const float frequencyHz[][2], long t, float *output) {
+  float v[GPF_FILTER_AXE_COUNT];
+
+  for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+    v[axe] = 2.0f * sinf(2.0 * M_PI * 5.0 * t / TEST_DYN_NOTCH_SAMPLE_RATE_HZ) + testDynNotch_noise();
+    for (uint8_t i = 0; i < 2; i++) {
+      if (frequencyHz[axe][i] > 0) {
+        v[axe] += testDynNotch_amplitude[axe][i] * sinf(2.0 * M_PI * frequencyHz[axe][i] * t / TEST_DYN_NOTCH_SAMPLE_RATE_HZ);
+      }
+    }
+  }
+
+  dynNotch.addSample(v[0], v[1], v[2]);
+  dynNotch.update();
+  dynNotch.apply(&v[0], &v[1], &v[2]);
+  for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+    output[axe] = v[axe];
+  }
+}
+
+GPF_TEST(dynNotch_findsPeaksInFrequencyOrder) {
+  GPF_DYN_NOTCH dynNotch;
+  float         output[GPF_FILTER_AXE_COUNT];
+
+  srand(1);
+  dynNotch.initialize(2, 80, 600, 3.5, TEST_DYN_NOTCH_SAMPLE_RATE_HZ);
+  for (long t = 0; t < 20000; t++) {
+    testDynNotch_step(dynNotch, testDynNotch_frequencyHz, t, output);
+  }
+
+  GPF_CHECK(dynNotch.get_analysisCount() > 700);
+  for (uint8_t axe = 0; axe < GPF_FILTER_AXE_COUNT; axe++) {
+    for (uint8_t notch = 0; notch < 2; notch++) {
+      float expectedHz = testDynNotch_frequencyHz[axe][notch];
+      if (expectedHz == 0) {
+        continue;
+      }
+      //Même indice pour le pic et le centre, peu importe lequel est le plus fort (axe 0)
+      GPF_CHECK(dynNotch.get_notchIsActive(axe, notch));
+      GPF_CHECK_NEAR(dynNotch.get_centerHz(axe, notch), expectedHz, 5);
+      //Un pic faible peut manquer à la dernière analyse (0), mais jamais être rangé sous un autre filtre
+      if (dynNotch.get_peakHz(axe, notch) != 0) {
+        GPF_CHECK_NEAR(dynNotch.get_peakHz(axe, notch), expectedHz, 5);
+      }
+    }
+  }
+
+  //Un seul pic sur l'axe 2: le deuxième filtre n'a rien à suivre
+  GPF_CHECK_EQUAL(dynNotch.get_peakHz(2, 1), 0);
+}
+
+GPF_TEST(dynNotch_attenuatesNoise) {
+  GPF_DYN_NOTCH dynNotch;
+  float         output[GPF_FILTER_AXE_COUNT];
+  double        inputPower  = 0;
+  double        outputPower = 0;
+
+  srand(2);
+  dynNotch.initialize(2, 80, 600, 3.5, TEST_DYN_NOTCH_SAMPLE_RATE_HZ);
+  for (long t = 0; t < 20000; t++) {
+    testDynNotch_step(dynNotch, testDynNotch_frequencyHz, t, output);
+    if (t > 10000) {
+      double input = testDynNotch_amplitude[0][0] * sinf(2.0 * M_PI * testDynNotch_frequencyHz[0][0] * t / TEST_DYN_NOTCH_SAMPLE_RATE_HZ) +
+                     testDynNotch_amplitude[0][1] * sinf(2.0 * M_PI * testDynNotch_frequencyHz[0][1] * t / TEST_DYN_NOTCH_SAMPLE_RATE_HZ);
+      inputPower  += input * input;
+      outputPower += (double)output[0] * output[0];
+    }
+  }
+  //La sortie garde le mouvement à 5hz et le bruit blanc, mais presque plus les deux sinus
+  GPF_CHECK(sqrt(outputPower / inputPower) < 0.4);
+}
+
+// Le bruit des moteurs monte avec les gaz: le centre doit suivre une rampe de 150 à 300hz en 2 secondes.
+GPF_TEST(dynNotch_followsMovingPeak) {
+  GPF_DYN_NOTCH dynNotch;
+  double        phase      = 0;
+  float         maxErrorHz = 0;
+
+  srand(4);
+  dynNotch.initialize(1, 80, 600, 3.5, TEST_DYN_NOTCH_SAMPLE_RATE_HZ);
+  for (long t = 0; t < 8000; t++) {
+    float hz = (t < 2000) ? 150 : ((t < 6000) ? 150 + 150.0f * (t - 2000) / 4000 : 300);
+    phase += 2.0 * M_PI * hz / TEST_DYN_NOTCH_SAMPLE_RATE_HZ;
+
+    float x = 10.0f * sin(phase) + testDynNotch_noise();
+    float y = x;
+    float z = x;
+    dynNotch.addSample(x, y, z);
+    dynNotch.update();
+    dynNotch.apply(&x, &y, &z);
+    if (t > 1000) {
+      maxErrorHz = fmaxf(maxErrorHz, fabsf(dynNotch.get_centerHz(0, 0) - hz));
+    }
+  }
+
+  GPF_CHECK_NEAR(dynNotch.get_centerHz(0, 0), 300, 5);
+  GPF_CHECK(maxErrorHz < 12); //Retard de la moyenne et de la fenêtre de 64ms pendant la rampe
+}
+
+GPF_BENCH(dynNotch_update) {
+  GPF_DYN_NOTCH dynNotch;
+  float         output[GPF_FILTER_AXE_COUNT];
+  const int     repeatCount = 200000;
+
+  srand(5);
+  dynNotch.initialize(2, 80, 600, 3.5, TEST_DYN_NOTCH_SAMPLE_RATE_HZ);
+  uint64_t start = gpf_test_nowNs();
+  for (long t = 0; t < repeatCount; t++) {
+    testDynNotch_step(dynNotch, testDynNotch_frequencyHz, t, output);
+    gpf_test_sink += output[0];
+  }
+  uint64_t end = gpf_test_nowNs();
+
+  gpf_test_reportBench("échantillon + étape d'analyse + filtres, par tour", (double)(end - start) / repeatCount);
+}
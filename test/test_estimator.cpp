@@ -0,0 +1,295 @@
+/**
+ * @file test_estimator.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * Rejoue le même vol synthétique de 60 secondes à 500hz dans les trois estimateurs de gpf_estimator.cpp
+ * (rotations jusqu'à 400 deg/s, bias du gyro de 1 à 3 deg/s, bruit de 0.1g sur l'accéléromètre, accélérations linéaires de 0.3g).
+ *
+ * Erreur d'inclinaison (angle entre la gravité estimée et la vraie) après 5 secondes de convergence:
+ *   Madgwick  moyenne 6.74 deg, max 12.35 deg //Aucune compensation du bias du gyro
+ *   Mahony    moyenne 3.90 deg, max  7.77 deg
+ *   EKF       moyenne 1.59 deg, max  5.34 deg
+ * Sans bias ni accélération linéaire, les trois sont équivalents (moyenne de 0.30 à 0.34 deg).
+ *
+ * Vérifie aussi l'erreur du mode angle (GPF_ESTIMATOR::getTiltErrorDegrees()) à la consigne et autour.
+ *
+ */
+
+#include <vector>
+#include <random>
+#include "gpf_test.h"
+#include "gpf_estimator.h"
+
+#define TEST_ESTIMATOR_SAMPLE_RATE_HZ  500.0
+#define TEST_ESTIMATOR_DURATION_S      60
+#define TEST_ESTIMATOR_CONVERGENCE_S   5
+#define TEST_ESTIMATOR_SUBSTEPS        20    //Intégration de la vraie attitude plus fine que les échantillons
+#define TEST_ESTIMATOR_MADGWICK_BETA   0.04f
+
+// Un échantillon du vol: gyro (rad/s) et accel (g) dans la convention de doFusion(), puis la vraie gravité dans le repère de l'avion
+struct TEST_ESTIMATOR_SAMPLE {
+    float gx, gy, gz;
+    float ax, ay, az;
+    float trueGravityX, trueGravityY, trueGravityZ;
+};
+
+static void testEstimator_multiply(double *a, const double *b) {
+  double r[4] = {a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3],
+                 a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2],
+                 a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1],
+                 a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0]};
+  for (int i = 0; i < 4; i++) {
+    a[i] = r[i];
+  }
+}
+
+// Vol par rafales de 4 secondes sur 10. Le bias du gyro augmente de 50% après 30 secondes.
+static std::vector<TEST_ESTIMATOR_SAMPLE> testEstimator_makeFlight(bool withBiasAndLinearAcceleration) {
+  const double dt    = 1.0 / TEST_ESTIMATOR_SAMPLE_RATE_HZ;
+  const int    count = TEST_ESTIMATOR_DURATION_S * TEST_ESTIMATOR_SAMPLE_RATE_HZ;
+  double       q[4]  = {1, 0, 0, 0};
+  double       bias[3] = {0.02, -0.03, 0.035};
+  std::mt19937 random(1);
+  std::normal_distribution<double> noise(0, 1);
+  std::vector<TEST_ESTIMATOR_SAMPLE> flight;
+
+  flight.reserve(count);
+  for (int k = 0; k < count; k++) {
+    double t     = k * dt;
+    double burst = (fmod(t, 10) < 4) ? 1.0 : 0.15;
+    double w[3]  = {burst * (5.0 * sin(2 * M_PI * 0.7 * t) + 2 * sin(2 * M_PI * 2.3 * t)),
+                    burst * (4.0 * sin(2 * M_PI * 0.5 * t + 1) + 2 * sin(2 * M_PI * 1.9 * t)),
+                    burst * (3.0 * sin(2 * M_PI * 0.3 * t + 2))};
+
+    for (int s = 0; s < TEST_ESTIMATOR_SUBSTEPS; s++) {
+      double h = dt / TEST_ESTIMATOR_SUBSTEPS;
+      double d[4] = {1, 0.5 * w[0] * h, 0.5 * w[1] * h, 0.5 * w[2] * h};
+      testEstimator_multiply(q, d);
+      double norm = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+      for (int i = 0; i < 4; i++) {
+        q[i] /= norm;
+      }
+    }
+
+    //Force spécifique dans le repère de la terre (gravité + accélération linéaire), puis dans le repère de l'avion
+    double f[3] = {0, 0, 1.0};
+    if (withBiasAndLinearAcceleration) {
+      f[0] += 0.3 * sin(2 * M_PI * 0.9 * t) * burst;
+      f[1] += 0.3 * cos(2 * M_PI * 1.3 * t) * burst;
+      f[2] += 0.2 * sin(2 * M_PI * 0.4 * t) * burst;
+    }
+    double R[3][3] = {{1 - 2 * (q[2] * q[2] + q[3] * q[3]), 2 * (q[1] * q[2] - q[0] * q[3]), 2 * (q[1] * q[3] + q[0] * q[2])},
+                      {2 * (q[1] * q[2] + q[0] * q[3]), 1 - 2 * (q[1] * q[1] + q[3] * q[3]), 2 * (q[2] * q[3] - q[0] * q[1])},
+                      {2 * (q[1] * q[3] - q[0] * q[2]), 2 * (q[2] * q[3] + q[0] * q[1]), 1 - 2 * (q[1] * q[1] + q[2] * q[2])}};
+    double biasScale = !withBiasAndLinearAcceleration ? 0.0 : ((t > 30) ? 1.5 : 1.0);
+    TEST_ESTIMATOR_SAMPLE sample;
+
+    sample.ax = R[0][0] * f[0] + R[1][0] * f[1] + R[2][0] * f[2] + 0.1 * noise(random);
+    sample.ay = R[0][1] * f[0] + R[1][1] * f[1] + R[2][1] * f[2] + 0.1 * noise(random);
+    sample.az = R[0][2] * f[0] + R[1][2] * f[1] + R[2][2] * f[2] + 0.1 * noise(random);
+    sample.gx = w[0] + bias[0] * biasScale + 0.005 * noise(random);
+    sample.gy = w[1] + bias[1] * biasScale + 0.005 * noise(random);
+    sample.gz = w[2] + bias[2] * biasScale + 0.005 * noise(random);
+    sample.trueGravityX = R[2][0];
+    sample.trueGravityY = R[2][1];
+    sample.trueGravityZ = R[2][2];
+    flight.push_back(sample);
+  }
+  return flight;
+}
+
+// Angle en degrés entre la gravité estimée et la vraie
+static double testEstimator_tiltErrorDegrees(GPF_ESTIMATOR &estimator, const TEST_ESTIMATOR_SAMPLE &sample) {
+  float w, x, y, z;
+
+  estimator.getQuaternion(&w, &x, &y, &z);
+  double g[3] = {2 * (x * z - w * y), 2 * (w * x + y * z), w * w - x * x - y * y + z * z};
+  double c    = g[0] * sample.trueGravityX + g[1] * sample.trueGravityY + g[2] * sample.trueGravityZ;
+  return acos(fmin(c, 1.0)) * 180.0 / M_PI;
+}
+
+static void testEstimator_replay(GPF_ESTIMATOR &estimator, const std::vector<TEST_ESTIMATOR_SAMPLE> &flight, double *meanError, double *maxError) {
+  const double dt    = 1.0 / TEST_ESTIMATOR_SAMPLE_RATE_HZ;
+  double       sum   = 0;
+  int          count = 0;
+
+  *maxError = 0;
+  estimator.reset();
+  for (size_t k = 0; k < flight.size(); k++) {
+    const TEST_ESTIMATOR_SAMPLE &s = flight[k];
+    estimator.update(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, dt);
+    if (k < TEST_ESTIMATOR_CONVERGENCE_S * TEST_ESTIMATOR_SAMPLE_RATE_HZ) {
+      continue;
+    }
+    double error = testEstimator_tiltErrorDegrees(estimator, s);
+    sum += error;
+    count++;
+    *maxError = fmax(*maxError, error);
+  }
+  *meanError = sum / count;
+}
+
+GPF_TEST(estimator_replayWithBiasAndLinearAcceleration) {
+  std::vector<TEST_ESTIMATOR_SAMPLE> flight = testEstimator_makeFlight(true);
+  float                  beta = TEST_ESTIMATOR_MADGWICK_BETA;
+  GPF_ESTIMATOR_MADGWICK madgwick(&beta);
+  GPF_ESTIMATOR_MAHONY   mahony;
+  GPF_ESTIMATOR_EKF      ekf;
+  double                 meanError, maxError;
+
+  testEstimator_replay(madgwick, flight, &meanError, &maxError);
+  GPF_CHECK_NEAR(meanError, 6.74, 0.3);
+  GPF_CHECK(maxError < 13.0);
+  testEstimator_replay(mahony, flight, &meanError, &maxError);
+  GPF_CHECK_NEAR(meanError, 3.90, 0.3);
+  GPF_CHECK(maxError < 8.5);
+  testEstimator_replay(ekf, flight, &meanError, &maxError);
+  GPF_CHECK_NEAR(meanError, 1.59, 0.2);
+  GPF_CHECK(maxError < 6.0);
+
+  //L'EKF retrouve le bias de la deuxième moitié du vol (1.5 fois celui du début)
+  float biasX, biasY, biasZ;
+  ekf.getGyroBias(&biasX, &biasY, &biasZ);
+  GPF_CHECK_NEAR(biasX,  0.030, 0.015);
+  GPF_CHECK_NEAR(biasY, -0.045, 0.015);
+  GPF_CHECK_NEAR(biasZ,  0.0525, 0.015);
+}
+
+GPF_TEST(estimator_replayCalm) {
+  std::vector<TEST_ESTIMATOR_SAMPLE> flight = testEstimator_makeFlight(false);
+  float                  beta = TEST_ESTIMATOR_MADGWICK_BETA;
+  GPF_ESTIMATOR_MADGWICK madgwick(&beta);
+  GPF_ESTIMATOR_MAHONY   mahony;
+  GPF_ESTIMATOR_EKF      ekf;
+  GPF_ESTIMATOR         *estimators[3] = {&madgwick, &mahony, &ekf};
+  double                 meanError, maxError;
+
+  for (int i = 0; i < 3; i++) {
+    testEstimator_replay(*estimators[i], flight, &meanError, &maxError);
+    GPF_CHECK(meanError < 0.4);
+  }
+}
+
+GPF_TEST(estimator_eulerRoundTrip) {
+  float                  beta = TEST_ESTIMATOR_MADGWICK_BETA;
+  GPF_ESTIMATOR_MADGWICK estimator(&beta);
+  const float            angles[4][3] = {{10, 20, 30}, {-40, 15, -170}, {0, 0, 0}, {70, -60, 100}};
+  float                  roll, pitch, yaw;
+
+  for (int i = 0; i < 4; i++) {
+    estimator.setEulerDegrees(angles[i][0], angles[i][1], angles[i][2]);
+    estimator.getEulerDegrees(&roll, &pitch, &yaw);
+    GPF_CHECK_NEAR(roll,  angles[i][0], 0.01);
+    GPF_CHECK_NEAR(pitch, angles[i][1], 0.01);
+    GPF_CHECK_NEAR(yaw,   angles[i][2], 0.01);
+  }
+}
+
+// À la consigne, l'erreur du mode angle doit être nulle même avec roll et pitch combinés, peu importe le yaw.
+GPF_TEST(estimator_tiltErrorIsZeroAtSetpoint) {
+  float                  beta = TEST_ESTIMATOR_MADGWICK_BETA;
+  GPF_ESTIMATOR_MADGWICK estimator(&beta);
+  const float            setpoints[6][2] = {{20, 20}, {30, 30}, {40, 40}, {-25, 35}, {44, -10}, {0, -44}};
+  const float            yaws[5]         = {0, 73, -150, 180, -90};
+  float                  errorRoll, errorPitch;
+
+  for (int i = 0; i < 6; i++) {
+    for (int j = 0; j < 5; j++) {
+      estimator.setEulerDegrees(setpoints[i][0], setpoints[i][1], yaws[j]);
+      estimator.getTiltErrorDegrees(setpoints[i][0], setpoints[i][1], &errorRoll, &errorPitch);
+      GPF_CHECK_NEAR(errorRoll,  0, 0.01);
+      GPF_CHECK_NEAR(errorPitch, 0, 0.01);
+    }
+  }
+}
+
+// Près de la consigne, l'erreur a le signe et la grandeur de (consigne - angles d'Euler)
+GPF_TEST(estimator_tiltErrorNearSetpoint) {
+  float                  beta = TEST_ESTIMATOR_MADGWICK_BETA;
+  GPF_ESTIMATOR_MADGWICK estimator(&beta);
+  float                  errorRoll, errorPitch;
+
+  estimator.setEulerDegrees(0, 0, 40);
+  estimator.getTiltErrorDegrees(5, 0, &errorRoll, &errorPitch);
+  GPF_CHECK_NEAR(errorRoll, 5, 0.01);
+  GPF_CHECK_NEAR(errorPitch, 0, 0.01);
+  estimator.getTiltErrorDegrees(0, -5, &errorRoll, &errorPitch);
+  GPF_CHECK_NEAR(errorRoll, 0, 0.01);
+  GPF_CHECK_NEAR(errorPitch, -5, 0.01);
+
+  estimator.setEulerDegrees(30, 30, -120);
+  estimator.getTiltErrorDegrees(31, 29, &errorRoll, &errorPitch);
+  GPF_CHECK_NEAR(errorRoll, 1, 0.2);
+  GPF_CHECK_NEAR(errorPitch, -1, 0.2);
+}
+
+// Changement d'estimateur en vol (Voir GPF_IMU::set_fusion_type()): l'EKF part du quaternion de Madgwick.
+// Sans ça, il repartirait de l'horizontale et l'erreur du mode angle sauterait de toute l'inclinaison de l'avion.
+GPF_TEST(estimator_switchSeedsFromCurrentAttitude) {
+  std::vector<TEST_ESTIMATOR_SAMPLE> flight = testEstimator_makeFlight(true);
+  const double           dt         = 1.0 / TEST_ESTIMATOR_SAMPLE_RATE_HZ;
+  const int              switchAt   = 12 * TEST_ESTIMATOR_SAMPLE_RATE_HZ + 300; //Pendant une rafale
+  float                  beta       = TEST_ESTIMATOR_MADGWICK_BETA;
+  GPF_ESTIMATOR_MADGWICK madgwick(&beta);
+  GPF_ESTIMATOR_EKF      seeded;
+  GPF_ESTIMATOR_EKF      stale;
+  double                 seededFirstError = 0;
+  double                 seededMaxError   = 0;
+  double                 staleMaxError    = 0;
+  float                  w, x, y, z;
+
+  for (int k = 0; k < switchAt; k++) {
+    const TEST_ESTIMATOR_SAMPLE &s = flight[k];
+    madgwick.update(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, dt);
+  }
+  GPF_CHECK(testEstimator_tiltErrorDegrees(stale, flight[switchAt]) > 20); //L'avion est bien incliné au moment du changement
+
+  madgwick.getQuaternion(&w, &x, &y, &z);
+  seeded.setQuaternion(w, x, y, z);
+  for (int k = switchAt; k < switchAt + TEST_ESTIMATOR_SAMPLE_RATE_HZ / 2; k++) {
+    const TEST_ESTIMATOR_SAMPLE &s = flight[k];
+    seeded.update(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, dt);
+    stale.update(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, dt);
+    seededMaxError = fmax(seededMaxError, testEstimator_tiltErrorDegrees(seeded, s));
+    staleMaxError  = fmax(staleMaxError, testEstimator_tiltErrorDegrees(stale, s));
+    if (k == switchAt) {
+      seededFirstError = seededMaxError;
+    }
+  }
+
+  //Même erreur que Madgwick au changement. L'EKF n'a pas encore appris le bias mais ne saute pas sur l'accéléromètre.
+  GPF_CHECK_NEAR(seededFirstError, testEstimator_tiltErrorDegrees(madgwick, flight[switchAt]), 1.0);
+  GPF_CHECK(seededMaxError < 15);
+  GPF_CHECK(seededMaxError < 0.5 * staleMaxError);
+}
+
+GPF_BENCH(estimator_update) {
+  std::vector<TEST_ESTIMATOR_SAMPLE> flight = testEstimator_makeFlight(true);
+  const double           dt = 1.0 / TEST_ESTIMATOR_SAMPLE_RATE_HZ;
+  float                  beta = TEST_ESTIMATOR_MADGWICK_BETA;
+  GPF_ESTIMATOR_MADGWICK madgwick(&beta);
+  GPF_ESTIMATOR_MAHONY   mahony;
+  GPF_ESTIMATOR_EKF      ekf;
+  GPF_ESTIMATOR         *estimators[3] = {&madgwick, &mahony, &ekf};
+  const int              repeatCount = 20;
+  char                   description[64];
+
+  for (int i = 0; i < 3; i++) {
+    uint64_t start = gpf_test_nowNs();
+    for (int r = 0; r < repeatCount; r++) {
+      for (size_t k = 0; k < flight.size(); k++) {
+        const TEST_ESTIMATOR_SAMPLE &s = flight[k];
+        estimators[i]->update(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, dt);
+      }
+    }
+    uint64_t end = gpf_test_nowNs();
+    float w, x, y, z;
+    estimators[i]->getQuaternion(&w, &x, &y, &z);
+    gpf_test_sink += w;
+
+    snprintf(description, sizeof(description), "%s update()", estimators[i]->getName());
+    gpf_test_reportBench(description, (double)(end - start) / (repeatCount * flight.size()));
+  }
+}
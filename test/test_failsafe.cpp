@@ -0,0 +1,161 @@
+/**
+ * @file test_failsafe.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * GPF_FAILSAFE simulé avec les seuils par défaut (10 frames, LQ minimum de 40%, HOLD de 500ms, retour de 300ms) et update()
+ * à chaque 1ms. Délais comptés depuis le premier frame perdu:
+ *  - 150hz: HOLD en 61ms, 27ms si le LQ moyen était sous le seuil. LANDING 500ms plus tard.
+ *  - 500hz: HOLD en 19ms, 9ms si le lien était faible.
+ *  - 9 frames perdus de suite à 150hz, ou 1 frame sur 2 perdu pendant 10s (LQ de 50%): aucun changement d'étape.
+ *  - Retour des frames pendant LANDING: contrôle redonné 301ms après le premier frame.
+ *  - LQ qui oscille autour du seuil: une seule entrée en DEGRADED.
+ *
+ */
+
+#include "gpf_test.h"
+#include "gpf_failsafe.h"
+
+#define TEST_FAILSAFE_MISSED_FRAMES     10
+#define TEST_FAILSAFE_LINK_QUALITY_MIN  40   //%
+#define TEST_FAILSAFE_HOLD_TIME         500  //ms
+#define TEST_FAILSAFE_RECOVERY_TIME     300  //ms
+#define TEST_FAILSAFE_UPDATE_PERIOD     1000 //us
+#define TEST_FAILSAFE_RATE_150HZ        6666.7 //us
+#define TEST_FAILSAFE_RATE_500HZ        2000.0 //us
+#define TEST_FAILSAFE_STAGE_NEVER       0xFFFFFFFF
+
+typedef bool (*testFailSafe_isLostFunction)(unsigned long frameAt, int frameIndex);
+
+typedef struct {
+  unsigned long enteredAt[GPF_FAILSAFE_STAGE_ITEM_COUNT]; //ms //Dernière entrée dans chaque étape
+  uint32_t      transitionCount;
+} testFailSafe_result;
+
+static void testFailSafe_initialize(GPF_FAILSAFE &failSafe, uint8_t linkQuality) {
+  failSafe.setThresholds(TEST_FAILSAFE_MISSED_FRAMES, TEST_FAILSAFE_LINK_QUALITY_MIN, 0, TEST_FAILSAFE_HOLD_TIME, TEST_FAILSAFE_RECOVERY_TIME);
+  failSafe.reset(0);
+  for (int i = 0; i < 20; i++) {
+    failSafe.linkStatisticsReceived(linkQuality, 80);
+  }
+}
+
+// Frames à toutes les frameIntervalUs, isLost() décide si un frame est perdu
+static testFailSafe_result testFailSafe_run(float frameIntervalUs, uint8_t linkQuality, testFailSafe_isLostFunction isLost, unsigned long durationUs) {
+  GPF_FAILSAFE        failSafe;
+  testFailSafe_result result;
+  unsigned long       lastFrameAt = 0;
+  unsigned long       nextFrameAt = 0;
+  int                 frameIndex  = 0;
+
+  for (uint8_t stage = 0; stage < GPF_FAILSAFE_STAGE_ITEM_COUNT; stage++) {
+    result.enteredAt[stage] = TEST_FAILSAFE_STAGE_NEVER;
+  }
+  testFailSafe_initialize(failSafe, linkQuality);
+
+  uint32_t transitionCount = failSafe.get_transitionCount();
+  for (unsigned long now = 0; now < durationUs; now += TEST_FAILSAFE_UPDATE_PERIOD) {
+    while (nextFrameAt <= now) {
+      if (!isLost(nextFrameAt, frameIndex)) {
+        lastFrameAt = nextFrameAt;
+      }
+      nextFrameAt = (unsigned long)((++frameIndex) * frameIntervalUs);
+    }
+
+    failSafe.update(now, lastFrameAt, frameIntervalUs);
+    if (failSafe.get_transitionCount() != transitionCount) {
+      transitionCount = failSafe.get_transitionCount();
+      result.enteredAt[failSafe.get_stage()] = now / 1000;
+    }
+  }
+  result.transitionCount = transitionCount;
+  return result;
+}
+
+static bool testFailSafe_lostAfter1s(unsigned long frameAt, int frameIndex) {
+  return frameAt >= 1000000;
+}
+
+static bool testFailSafe_lostFrom1sTo2s(unsigned long frameAt, int frameIndex) {
+  return (frameAt >= 1000000) && (frameAt < 2000000);
+}
+
+static bool testFailSafe_lost9Frames(unsigned long frameAt, int frameIndex) {
+  return (frameIndex >= 150) && (frameIndex < 150 + TEST_FAILSAFE_MISSED_FRAMES - 1);
+}
+
+static bool testFailSafe_lostOneOfTwo(unsigned long frameAt, int frameIndex) {
+  return (frameIndex % 2) == 1;
+}
+
+GPF_TEST(failSafe_detectionDelays) {
+  testFailSafe_result result = testFailSafe_run(TEST_FAILSAFE_RATE_150HZ, 100, testFailSafe_lostAfter1s, 2000000);
+  GPF_CHECK_EQUAL(result.enteredAt[GPF_FAILSAFE_STAGE_HOLD], 1061u);
+  GPF_CHECK_EQUAL(result.enteredAt[GPF_FAILSAFE_STAGE_LANDING], 1561u);
+  GPF_CHECK_EQUAL(result.enteredAt[GPF_FAILSAFE_STAGE_DEGRADED], TEST_FAILSAFE_STAGE_NEVER);
+
+  //Lien faible: GPF_FAILSAFE_WEAK_LINK_DIVIDER fois moins de frames manqués
+  result = testFailSafe_run(TEST_FAILSAFE_RATE_150HZ, 30, testFailSafe_lostAfter1s, 2000000);
+  GPF_CHECK_EQUAL(result.enteredAt[GPF_FAILSAFE_STAGE_DEGRADED], 0u);
+  GPF_CHECK_EQUAL(result.enteredAt[GPF_FAILSAFE_STAGE_HOLD], 1027u);
+  GPF_CHECK_EQUAL(result.enteredAt[GPF_FAILSAFE_STAGE_LANDING], 1527u);
+
+  result = testFailSafe_run(TEST_FAILSAFE_RATE_500HZ, 100, testFailSafe_lostAfter1s, 2000000);
+  GPF_CHECK_EQUAL(result.enteredAt[GPF_FAILSAFE_STAGE_HOLD], 1019u);
+
+  //GPF_FAILSAFE_MISSED_TIME_MIN
+  result = testFailSafe_run(TEST_FAILSAFE_RATE_500HZ, 30, testFailSafe_lostAfter1s, 2000000);
+  GPF_CHECK_EQUAL(result.enteredAt[GPF_FAILSAFE_STAGE_HOLD], 1009u);
+}
+
+GPF_TEST(failSafe_noFalseAlarm) {
+  testFailSafe_result result = testFailSafe_run(TEST_FAILSAFE_RATE_150HZ, 100, testFailSafe_lost9Frames, 3000000);
+  GPF_CHECK_EQUAL(result.transitionCount, 0u);
+
+  result = testFailSafe_run(TEST_FAILSAFE_RATE_150HZ, 50, testFailSafe_lostOneOfTwo, 10000000);
+  GPF_CHECK_EQUAL(result.transitionCount, 0u);
+}
+
+GPF_TEST(failSafe_recoveryFromLanding) {
+  testFailSafe_result result = testFailSafe_run(TEST_FAILSAFE_RATE_150HZ, 100, testFailSafe_lostFrom1sTo2s, 4000000);
+
+  GPF_CHECK_EQUAL(result.enteredAt[GPF_FAILSAFE_STAGE_HOLD], 1061u);
+  GPF_CHECK_EQUAL(result.enteredAt[GPF_FAILSAFE_STAGE_LANDING], 1561u);
+  GPF_CHECK_EQUAL(result.enteredAt[GPF_FAILSAFE_STAGE_OK], 2301u);
+  GPF_CHECK_EQUAL(result.transitionCount, 3u);
+}
+
+// LQ de 38% et 42% en alternance: la moyenne passe sous et sur le seuil à chaque frame link statistics
+GPF_TEST(failSafe_degradedHysteresis) {
+  GPF_FAILSAFE  failSafe;
+  unsigned long now = 0;
+
+  testFailSafe_initialize(failSafe, 100);
+  failSafe.update(now, now, TEST_FAILSAFE_RATE_150HZ);
+  GPF_CHECK_EQUAL(failSafe.get_stage(), GPF_FAILSAFE_STAGE_OK);
+
+  for (int i = 0; i < 200; i++) {
+    now += 4000;
+    failSafe.linkStatisticsReceived((i % 2) ? 42 : 38, 80);
+    failSafe.update(now, now, TEST_FAILSAFE_RATE_150HZ);
+  }
+  GPF_CHECK_EQUAL(failSafe.get_stage(), GPF_FAILSAFE_STAGE_DEGRADED);
+  GPF_CHECK_EQUAL(failSafe.get_transitionCount(), 1u);
+
+  //Juste au dessus du seuil: toujours faible
+  for (int i = 0; i < 50; i++) {
+    now += 4000;
+    failSafe.linkStatisticsReceived(TEST_FAILSAFE_LINK_QUALITY_MIN + GPF_FAILSAFE_LINK_QUALITY_HYSTERESIS - 2, 80);
+    failSafe.update(now, now, TEST_FAILSAFE_RATE_150HZ);
+  }
+  GPF_CHECK_EQUAL(failSafe.get_stage(), GPF_FAILSAFE_STAGE_DEGRADED);
+
+  for (int i = 0; i < 50; i++) {
+    now += 4000;
+    failSafe.linkStatisticsReceived(100, 80);
+    failSafe.update(now, now, TEST_FAILSAFE_RATE_150HZ);
+  }
+  GPF_CHECK_EQUAL(failSafe.get_stage(), GPF_FAILSAFE_STAGE_OK);
+  GPF_CHECK_EQUAL(failSafe.get_transitionCount(), 2u);
+}
@@ -0,0 +1,107 @@
+/**
+ * @file test_fast_math.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * Erreur maximale des fonctions de gpf_fast_math.h sur tout leur domaine, comparées à la librairie standard en double,
+ * et durée comparée à la version double (ce que la boucle de contrôle appelait avant).
+ *
+ */
+
+#include <stdlib.h>
+#include "gpf_test.h"
+#include "gpf_fast_math.h"
+
+GPF_TEST(fastMath_atan) {
+  double maxError = 0;
+
+  for (double x = -1000; x <= 1000; x += 0.0005) {
+    maxError = fmax(maxError, fabs(gpf_fast_math_atan((float)x) - atan((double)(float)x)));
+  }
+  GPF_CHECK(maxError < 2.5e-6);
+}
+
+GPF_TEST(fastMath_atan2) {
+  const double radius[3] = {1e-3, 1.0, 100.0};
+  double       maxError  = 0;
+
+  for (double a = -M_PI; a < M_PI; a += 0.00005) {
+    for (int r = 0; r < 3; r++) {
+      float  x     = radius[r] * cos(a);
+      float  y     = radius[r] * sin(a);
+      double error = fabs(gpf_fast_math_atan2(y, x) - atan2((double)y, (double)x));
+      if (error > M_PI) {
+        error = 2 * M_PI - error; //pi et -pi sont le même angle
+      }
+      maxError = fmax(maxError, error);
+    }
+  }
+  GPF_CHECK(maxError < 2.5e-6);
+  GPF_CHECK_EQUAL(gpf_fast_math_atan2(0, 0), 0);
+  GPF_CHECK_NEAR(gpf_fast_math_atan2(0, -1), M_PI, 1e-6);
+  GPF_CHECK_NEAR(gpf_fast_math_atan2(-1, 0), -M_PI / 2, 1e-6);
+}
+
+GPF_TEST(fastMath_asin) {
+  double maxError = 0;
+
+  for (double x = -1; x <= 1; x += 0.000001) {
+    maxError = fmax(maxError, fabs(gpf_fast_math_asin((float)x) - asin((double)(float)x)));
+  }
+  GPF_CHECK(maxError < 5e-7);
+
+  //Hors de [-1, 1] (arrondis de la fusion): +/-90 degrés plutôt que NaN
+  GPF_CHECK_NEAR(gpf_fast_math_asin(1.0001f), M_PI / 2, 1e-6);
+  GPF_CHECK_NEAR(gpf_fast_math_asin(-1.0001f), -M_PI / 2, 1e-6);
+}
+
+GPF_TEST(fastMath_invSqrt) {
+  double maxError = 0;
+
+  for (double x = 1e-6; x < 1e6; x *= 1.0001) {
+    maxError = fmax(maxError, fabs(gpf_fast_math_invSqrt((float)x) * sqrt((double)(float)x) - 1.0));
+  }
+  GPF_CHECK(maxError < 6e-6);
+}
+
+GPF_TEST(fastMath_sinCosSmall) {
+  double maxError = 0;
+  float  s, c;
+
+  for (double x = -M_PI / 4; x <= M_PI / 4; x += 0.00001) {
+    gpf_fast_math_sinCosSmall((float)x, &s, &c);
+    maxError = fmax(maxError, fmax(fabs(s - sin((double)(float)x)), fabs(c - cos((double)(float)x))));
+  }
+  GPF_CHECK(maxError < 5e-7);
+}
+
+GPF_BENCH(fastMath_vsDouble) {
+  const int    count = 1 << 20;
+  static float a[count];
+  static float b[count];
+  float        sum;
+
+  srand(1);
+  for (int i = 0; i < count; i++) {
+    a[i] = (rand() / (float)RAND_MAX) * 2 - 1;
+    b[i] = (rand() / (float)RAND_MAX) * 2 - 1;
+  }
+
+  #define TEST_FAST_MATH_BENCH(description, expression) { \
+    sum = 0; \
+    uint64_t start = gpf_test_nowNs(); \
+    for (int i = 0; i < count; i++) { sum += (expression); } \
+    uint64_t end = gpf_test_nowNs(); \
+    gpf_test_sink += sum; \
+    gpf_test_reportBench(description, (double)(end - start) / count); }
+
+  TEST_FAST_MATH_BENCH("gpf_fast_math_atan2()",     gpf_fast_math_atan2(a[i], b[i]))
+  TEST_FAST_MATH_BENCH("atan2() double",            atan2(a[i], b[i]) * 57.29577951)
+  TEST_FAST_MATH_BENCH("gpf_fast_math_asin()",      gpf_fast_math_asin(a[i]))
+  TEST_FAST_MATH_BENCH("asin() double",             asin(a[i]) * 57.29577951)
+  TEST_FAST_MATH_BENCH("gpf_fast_math_atan()",      gpf_fast_math_atan(a[i] / (b[i] + 2)))
+  TEST_FAST_MATH_BENCH("atan() double",             atan(a[i] / (b[i] + 2)))
+  TEST_FAST_MATH_BENCH("gpf_fast_math_invSqrt()",   gpf_fast_math_invSqrt(a[i] + 2))
+  TEST_FAST_MATH_BENCH("1.0/sqrtf()",               1.0f / sqrtf(a[i] + 2))
+}
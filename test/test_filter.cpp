@@ -0,0 +1,164 @@
+/**
+ * @file test_filter.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * Réponse en fréquence des filtres de gpf_filter.cpp comparée à l'ancien EMA (B_gyro=0.1), passage sans filtre
+ * quand les paramètres sont invalides et départ en régime permanent au premier échantillon.
+ *
+ * Compromis délai vs atténuation à 2khz pour une coupure de 80hz (délai à 10hz, atténuation à 300hz):
+ *   PT1      2.0ms  -12.4dB
+ *   PT2      2.6ms  -18.6dB
+ *   Biquad   2.8ms  -24.2dB
+ *   EMA 0.1  4.4ms  -18.8dB (12.9ms à 500hz)
+ *
+ */
+
+#include "gpf_test.h"
+#include "gpf_filter.h"
+
+#define TEST_FILTER_SAMPLE_RATE_HZ 2000.0
+#define TEST_FILTER_CUTOFF_HZ      80.0
+#define TEST_FILTER_SAMPLE_COUNT   40000
+
+// Ancien filtre des données de l'IMU (coefficient fixe)
+struct TEST_FILTER_OLD_EMA {
+    float b;
+    float y = 0;
+    float apply(float x) { y = (1.0f - b) * y + b * x; return y; }
+};
+
+struct TEST_FILTER_NEW {
+    GPF_FILTER_3AXES filter;
+    float apply(float x) { return filter.applyOneAxe(0, x); }
+};
+
+// Sinus à frequencyHz. Gain en dB et délai en ms mesurés sur la deuxième moitié (après le transitoire).
+template <class F> static void testFilter_response(F filter, double frequencyHz, double sampleRateHz, double *gainDb, double *delayMs) {
+  double omega = 2.0 * M_PI * frequencyHz / sampleRateHz;
+  double re    = 0;
+  double im    = 0;
+
+  for (int t = 0; t < TEST_FILTER_SAMPLE_COUNT; t++) {
+    double y = filter.apply((float)sin(omega * t));
+    if (t >= TEST_FILTER_SAMPLE_COUNT / 2) {
+      re += y * sin(omega * t);
+      im += y * cos(omega * t);
+    }
+  }
+
+  *gainDb  = 20.0 * log10(2.0 * sqrt(re * re + im * im) / (TEST_FILTER_SAMPLE_COUNT / 2));
+  *delayMs = -atan2(im, re) / (2.0 * M_PI * frequencyHz) * 1000.0;
+}
+
+static void testFilter_check(uint8_t type, double expectedDelayMs, double expectedAttenuationDb, double expectedCutoffGainDb) {
+  TEST_FILTER_NEW f;
+  double gainDb, delayMs;
+
+  f.filter.initialize(type, TEST_FILTER_CUTOFF_HZ, TEST_FILTER_SAMPLE_RATE_HZ);
+  testFilter_response(f, 10, TEST_FILTER_SAMPLE_RATE_HZ, &gainDb, &delayMs);
+  GPF_CHECK_NEAR(delayMs, expectedDelayMs, 0.1);
+  testFilter_response(f, 300, TEST_FILTER_SAMPLE_RATE_HZ, &gainDb, &delayMs);
+  GPF_CHECK_NEAR(gainDb, expectedAttenuationDb, 0.2);
+
+  // Le biquad donne -3dB exactement à la coupure, PT1 et PT2 (k=dt/(rc+dt)) coupent un peu plus bas
+  testFilter_response(f, TEST_FILTER_CUTOFF_HZ, TEST_FILTER_SAMPLE_RATE_HZ, &gainDb, &delayMs);
+  GPF_CHECK_NEAR(gainDb, expectedCutoffGainDb, 0.1);
+}
+
+GPF_TEST(filter_frequencyResponse) {
+  testFilter_check(GPF_FILTER_TYPE_PT1,    2.0, -12.4, -3.5);
+  testFilter_check(GPF_FILTER_TYPE_PT2,    2.6, -18.6, -3.9);
+  testFilter_check(GPF_FILTER_TYPE_BIQUAD, 2.8, -24.2, -3.0);
+}
+
+GPF_TEST(filter_oldEmaReference) {
+  TEST_FILTER_OLD_EMA ema{0.1f};
+  double gainDb, delayMs;
+
+  testFilter_response(ema, 10, TEST_FILTER_SAMPLE_RATE_HZ, &gainDb, &delayMs);
+  GPF_CHECK_NEAR(delayMs, 4.4, 0.1);
+  testFilter_response(ema, 300, TEST_FILTER_SAMPLE_RATE_HZ, &gainDb, &delayMs);
+  GPF_CHECK_NEAR(gainDb, -18.8, 0.2);
+  testFilter_response(ema, 10, 500, &gainDb, &delayMs);
+  GPF_CHECK_NEAR(delayMs, 12.9, 0.2);
+}
+
+GPF_TEST(filter_notch) {
+  TEST_FILTER_NEW f;
+  double gainDb, delayMs;
+
+  f.filter.initializeNotch(200, 5, TEST_FILTER_SAMPLE_RATE_HZ);
+  testFilter_response(f, 200, TEST_FILTER_SAMPLE_RATE_HZ, &gainDb, &delayMs);
+  GPF_CHECK(gainDb < -40);
+  testFilter_response(f, 20, TEST_FILTER_SAMPLE_RATE_HZ, &gainDb, &delayMs);
+  GPF_CHECK_NEAR(gainDb, 0, 0.1);
+}
+
+// Paramètres invalides: le signal passe sans filtre mais le type configuré reste pour quand les paramètres redeviennent valides.
+GPF_TEST(filter_bypassWhileInvalid) {
+  GPF_FILTER_3AXES f;
+
+  f.initialize(GPF_FILTER_TYPE_BIQUAD, TEST_FILTER_CUTOFF_HZ, 0);
+  GPF_CHECK_EQUAL(f.get_type(), GPF_FILTER_TYPE_BIQUAD);
+  GPF_CHECK(f.get_isBypassed());
+  GPF_CHECK_EQUAL(f.applyOneAxe(0, 3.0f), 3.0f);
+  GPF_CHECK_EQUAL(f.applyOneAxe(0, -7.0f), -7.0f);
+
+  f.setSampleRate(TEST_FILTER_SAMPLE_RATE_HZ);
+  GPF_CHECK(!f.get_isBypassed());
+  GPF_CHECK_EQUAL(f.get_type(), GPF_FILTER_TYPE_BIQUAD);
+  GPF_CHECK_NEAR(f.applyOneAxe(0, 1.0f), 1.0f, 1e-6); //Départ en régime permanent
+  GPF_CHECK(f.applyOneAxe(0, 0.0f) > 0.5f);           //Puis filtré
+
+  GPF_FILTER_3AXES none;
+  none.initialize(GPF_FILTER_TYPE_NONE, TEST_FILTER_CUTOFF_HZ, TEST_FILTER_SAMPLE_RATE_HZ);
+  GPF_CHECK(none.get_isBypassed());
+  GPF_CHECK_EQUAL(none.applyOneAxe(1, 2.5f), 2.5f);
+}
+
+// Une entrée constante doit sortir telle quelle dès le premier échantillon (pas de rampe depuis 0).
+GPF_TEST(filter_seedOnFirstSample) {
+  for (uint8_t type = GPF_FILTER_TYPE_PT1; type <= GPF_FILTER_TYPE_NOTCH; type++) {
+    GPF_FILTER_3AXES f;
+    if (type == GPF_FILTER_TYPE_NOTCH) {
+      f.initializeNotch(200, 5, TEST_FILTER_SAMPLE_RATE_HZ);
+    } else {
+      f.initialize(type, TEST_FILTER_CUTOFF_HZ, TEST_FILTER_SAMPLE_RATE_HZ);
+    }
+
+    for (int i = 0; i < 50; i++) {
+      float x = 9.81f, y = -0.3f, z = 250.0f;
+      f.apply(&x, &y, &z);
+      GPF_CHECK_NEAR(x, 9.81f, 1e-4);
+      GPF_CHECK_NEAR(y, -0.3f, 1e-4);
+      GPF_CHECK_NEAR(z, 250.0f, 1e-3);
+    }
+
+    f.reset();
+    GPF_CHECK_NEAR(f.applyOneAxe(2, -42.0f), -42.0f, 1e-3);
+  }
+}
+
+GPF_BENCH(filter_apply) {
+  const int repeatCount = 10000000;
+
+  for (uint8_t type = GPF_FILTER_TYPE_PT1; type <= GPF_FILTER_TYPE_BIQUAD; type++) {
+    GPF_FILTER_3AXES f;
+    float x = 1, y = 2, z = 3;
+    char  description[64];
+
+    f.initialize(type, TEST_FILTER_CUTOFF_HZ, TEST_FILTER_SAMPLE_RATE_HZ);
+    uint64_t start = gpf_test_nowNs();
+    for (int i = 0; i < repeatCount; i++) {
+      f.apply(&x, &y, &z);
+      x += 1e-3f;
+    }
+    uint64_t end = gpf_test_nowNs();
+    gpf_test_sink += x + y + z;
+
+    snprintf(description, sizeof(description), "%s 3 axes, par appel", GPF_FILTER_3AXES::getTypeDescription(type));
+    gpf_test_reportBench(description, (double)(end - start) / repeatCount);
+  }
+}
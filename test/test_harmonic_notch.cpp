@@ -0,0 +1,172 @@
+/**
+ * @file test_harmonic_notch.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * Courbe gaz -> hz, limite de déplacement, réponse en fréquence et dérive de la rotation incrémentale de gpf_harmonic_notch.cpp.
+ *
+ * Gaz à 50% (fondamental 170hz, Q=3.5, 2khz): environ -74dB à 170hz, -68dB à 340hz, -67dB à 510hz,
+ * -1.1dB à 130hz, -2.5dB à 200hz et -1.0dB à 600hz. Mêmes chiffres après 100000 déplacements aléatoires.
+ *
+ * make -C test bench écrit la réponse de ce banc de 1hz à 999hz dans test/build/harmonic_notch_response.csv (hz, dB du
+ * banc neuf, dB après les déplacements) pour retrouver ces chiffres ou tracer la courbe.
+ *
+ */
+
+#include <stdlib.h>
+#include "gpf_test.h"
+#include "gpf_harmonic_notch.h"
+
+#define TEST_HARMONIC_NOTCH_SAMPLE_RATE_HZ 2000.0
+#define TEST_HARMONIC_NOTCH_Q              3.5
+#define TEST_HARMONIC_NOTCH_CSV_FILE       "build/harmonic_notch_response.csv" //make -C test roule les tests dans test/
+
+static const float testHarmonicNotch_curveHz[5] = {90, 130, 170, 210, 250};
+
+static void testHarmonicNotch_settle(GPF_HARMONIC_NOTCH &notch, float throttle) {
+  for (int i = 0; i < 100; i++) {
+    notch.update(throttle);
+  }
+}
+
+// Gain en dB d'un sinus à frequencyHz sur l'axe x. Copie du banc pour partir des mêmes états à chaque mesure.
+static double testHarmonicNotch_gainDb(GPF_HARMONIC_NOTCH notch, float frequencyHz, int sampleCount) {
+  double inputPower  = 0;
+  double outputPower = 0;
+
+  for (int i = 0; i < sampleCount; i++) {
+    float v = sinf(2.0 * M_PI * frequencyHz * i / TEST_HARMONIC_NOTCH_SAMPLE_RATE_HZ);
+    float x = v, y = 0, z = 0;
+    notch.apply(&x, &y, &z);
+    if (i > sampleCount / 2) {
+      inputPower  += v * v;
+      outputPower += x * x;
+    }
+  }
+  return 10.0 * log10(outputPower / inputPower);
+}
+
+// Fréquence où l'atténuation est la plus forte autour de centerHz (pas de 0.02hz)
+static float testHarmonicNotch_minimumHz(GPF_HARMONIC_NOTCH &notch, float centerHz) {
+  float  bestHz = 0;
+  double bestDb = 1e9;
+
+  for (float hz = centerHz - 0.5; hz <= centerHz + 0.5; hz += 0.02) {
+    double db = testHarmonicNotch_gainDb(notch, hz, 40000);
+    if (db < bestDb) {
+      bestDb = db;
+      bestHz = hz;
+    }
+  }
+  return bestHz;
+}
+
+GPF_TEST(harmonicNotch_curveAndSlewLimit) {
+  GPF_HARMONIC_NOTCH notch;
+
+  notch.initialize(testHarmonicNotch_curveHz, 5, 3, TEST_HARMONIC_NOTCH_Q, TEST_HARMONIC_NOTCH_SAMPLE_RATE_HZ);
+  GPF_CHECK_EQUAL(notch.get_fundamentalHz(), 90);
+  GPF_CHECK_EQUAL(notch.get_harmonicCount(), 3);
+
+  //Au plus GPF_HARMONIC_NOTCH_MAX_STEP_HZ par appel
+  notch.update(1.0);
+  GPF_CHECK_NEAR(notch.get_fundamentalHz(), 90 + GPF_HARMONIC_NOTCH_MAX_STEP_HZ, 1e-4);
+
+  testHarmonicNotch_settle(notch, 0.5);
+  GPF_CHECK_NEAR(notch.get_fundamentalHz(), 170, 1e-3);
+  testHarmonicNotch_settle(notch, 0.125); //Entre deux points
+  GPF_CHECK_NEAR(notch.get_fundamentalHz(), 110, 1e-3);
+  testHarmonicNotch_settle(notch, 2.0);
+  GPF_CHECK_NEAR(notch.get_fundamentalHz(), 250, 1e-3);
+  testHarmonicNotch_settle(notch, -1.0);
+  GPF_CHECK_NEAR(notch.get_fundamentalHz(), 90, 1e-3);
+}
+
+GPF_TEST(harmonicNotch_frequencyResponse) {
+  GPF_HARMONIC_NOTCH notch;
+
+  notch.initialize(testHarmonicNotch_curveHz, 5, 3, TEST_HARMONIC_NOTCH_Q, TEST_HARMONIC_NOTCH_SAMPLE_RATE_HZ);
+  testHarmonicNotch_settle(notch, 0.5);
+
+  GPF_CHECK(testHarmonicNotch_gainDb(notch, 170, 20000) < -40);
+  GPF_CHECK(testHarmonicNotch_gainDb(notch, 340, 20000) < -40);
+  GPF_CHECK(testHarmonicNotch_gainDb(notch, 510, 20000) < -40);
+  GPF_CHECK_NEAR(testHarmonicNotch_gainDb(notch, 130, 20000), -1.1, 0.3);
+  GPF_CHECK_NEAR(testHarmonicNotch_gainDb(notch, 200, 20000), -2.5, 0.3);
+  GPF_CHECK_NEAR(testHarmonicNotch_gainDb(notch, 600, 20000), -1.0, 0.3);
+}
+
+// 100000 déplacements aléatoires: le centre ne doit pas dériver plus loin qu'un banc neuf réglé directement à 170hz.
+GPF_TEST(harmonicNotch_noDriftAfterRandomSteps) {
+  GPF_HARMONIC_NOTCH fresh;
+  GPF_HARMONIC_NOTCH moved;
+  const float        fixedCurveHz[1] = {170};
+
+  fresh.initialize(fixedCurveHz, 1, 1, TEST_HARMONIC_NOTCH_Q, TEST_HARMONIC_NOTCH_SAMPLE_RATE_HZ);
+  moved.initialize(testHarmonicNotch_curveHz, 5, 1, TEST_HARMONIC_NOTCH_Q, TEST_HARMONIC_NOTCH_SAMPLE_RATE_HZ);
+  srand(2);
+  for (long i = 0; i < 100000; i++) {
+    moved.update(rand() / (float)RAND_MAX);
+  }
+  testHarmonicNotch_settle(moved, 0.5);
+
+  GPF_CHECK_NEAR(testHarmonicNotch_minimumHz(moved, 170), testHarmonicNotch_minimumHz(fresh, 170), 0.1);
+}
+
+GPF_BENCH(harmonicNotch_updateAndApply) {
+  GPF_HARMONIC_NOTCH notch;
+  static float       throttles[100000];
+  const int          applyCount = 1000000;
+  float              x = 1, y = 2, z = 3;
+
+  notch.initialize(testHarmonicNotch_curveHz, 5, 3, TEST_HARMONIC_NOTCH_Q, TEST_HARMONIC_NOTCH_SAMPLE_RATE_HZ);
+  srand(2);
+  for (long i = 0; i < 100000; i++) {
+    throttles[i] = rand() / (float)RAND_MAX;
+  }
+
+  uint64_t start = gpf_test_nowNs();
+  for (long i = 0; i < 100000; i++) {
+    notch.update(throttles[i]);
+  }
+  uint64_t middle = gpf_test_nowNs();
+  for (long i = 0; i < applyCount; i++) {
+    x = (float)(i & 7);
+    notch.apply(&x, &y, &z);
+    gpf_test_sink += x;
+  }
+  uint64_t end = gpf_test_nowNs();
+
+  gpf_test_reportBench("update(), gaz aléatoires", (double)(middle - start) / 100000);
+  gpf_test_reportBench("apply() 3 harmoniques sur 3 axes", (double)(end - middle) / applyCount);
+}
+
+// Pas une durée: réponse en fréquence du banc de harmonicNotch_frequencyResponse, neuf puis après 100000 déplacements
+// aléatoires (comme harmonicNotch_noDriftAfterRandomSteps), 1 ligne par hz
+GPF_BENCH(harmonicNotch_responseCsv) {
+  GPF_HARMONIC_NOTCH fresh;
+  GPF_HARMONIC_NOTCH moved;
+  FILE              *file = fopen(TEST_HARMONIC_NOTCH_CSV_FILE, "w");
+
+  if (file == NULL) {
+    printf("    impossible d'écrire %s\n", TEST_HARMONIC_NOTCH_CSV_FILE);
+    return;
+  }
+
+  fresh.initialize(testHarmonicNotch_curveHz, 5, 3, TEST_HARMONIC_NOTCH_Q, TEST_HARMONIC_NOTCH_SAMPLE_RATE_HZ);
+  testHarmonicNotch_settle(fresh, 0.5);
+  moved.initialize(testHarmonicNotch_curveHz, 5, 3, TEST_HARMONIC_NOTCH_Q, TEST_HARMONIC_NOTCH_SAMPLE_RATE_HZ);
+  srand(2);
+  for (long i = 0; i < 100000; i++) {
+    moved.update(rand() / (float)RAND_MAX);
+  }
+  testHarmonicNotch_settle(moved, 0.5);
+
+  fprintf(file, "hz,dB neuf,dB après 100000 déplacements\n");
+  for (int hz = 1; hz < TEST_HARMONIC_NOTCH_SAMPLE_RATE_HZ / 2; hz++) {
+    fprintf(file, "%d,%.2f,%.2f\n", hz, testHarmonicNotch_gainDb(fresh, hz, 20000), testHarmonicNotch_gainDb(moved, hz, 20000));
+  }
+  fclose(file);
+  printf("    réponse écrite dans test/%s\n", TEST_HARMONIC_NOTCH_CSV_FILE);
+}
@@ -0,0 +1,108 @@
+/**
+ * @file test_histogram.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * GPF_HISTOGRAM: limites des cases (15, 16, 17 et chaque puissance de 2), valeurs ramenées à 2^20-1 et percentiles comparés
+ * à ceux d'un tableau trié (rang le plus proche) sur 100 000 durées simulées d'un tour de boucle (surtout 150 à 350us,
+ * 1% de 1 à 5ms et 0.1% de 10 à 50ms).
+ *
+ * Résultats au moment d'écrire ces tests: P50, P99 et P99.9 jamais sous la valeur exacte et au plus 1/8 au dessus.
+ *
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "gpf_test.h"
+#include "gpf_histogram.h"
+
+#define TEST_HISTOGRAM_SAMPLE_COUNT 100000
+
+// Plus grande valeur de la case de value: seule valeur sous le percentile 50, l'autre est dans la dernière case
+static uint32_t testHistogram_bucketUpperValue(uint32_t value) {
+  GPF_HISTOGRAM histogram;
+
+  histogram.record(value);
+  histogram.record(GPF_HISTOGRAM_MAX_VALUE);
+  return histogram.getPercentile(50);
+}
+
+static uint32_t testHistogram_randomRange(uint32_t low, uint32_t high) {
+  return low + (uint32_t)(rand() % (high - low + 1));
+}
+
+GPF_TEST(histogram_bucketBoundaries) {
+  //0 à 15: une case par valeur
+  for (uint32_t value = 0; value < GPF_HISTOGRAM_SUB_BUCKET_COUNT; value++) {
+    GPF_CHECK_EQUAL(testHistogram_bucketUpperValue(value), value);
+  }
+  //16 et 17 partagent la première case de 2 valeurs
+  GPF_CHECK_EQUAL(testHistogram_bucketUpperValue(15), 15u);
+  GPF_CHECK_EQUAL(testHistogram_bucketUpperValue(16), 17u);
+  GPF_CHECK_EQUAL(testHistogram_bucketUpperValue(17), 17u);
+  GPF_CHECK_EQUAL(testHistogram_bucketUpperValue(18), 19u);
+
+  //Chaque puissance de 2 commence une case de 2^k/8 valeurs et la valeur juste avant termine la précédente
+  for (uint8_t k = GPF_HISTOGRAM_SUB_BUCKET_BITS; k < GPF_HISTOGRAM_MAX_VALUE_BITS; k++) {
+    uint32_t powerOfTwo = 1UL << k;
+    GPF_CHECK_EQUAL(testHistogram_bucketUpperValue(powerOfTwo), powerOfTwo + (powerOfTwo >> 3) - 1);
+    GPF_CHECK_EQUAL(testHistogram_bucketUpperValue(powerOfTwo - 1), powerOfTwo - 1);
+  }
+}
+
+GPF_TEST(histogram_clampedToMaxValue) {
+  GPF_HISTOGRAM histogram;
+
+  histogram.record(GPF_HISTOGRAM_MAX_VALUE + 1);
+  GPF_CHECK_EQUAL(histogram.get_max(), GPF_HISTOGRAM_MAX_VALUE);
+  histogram.record(0xFFFFFFFF);
+  GPF_CHECK_EQUAL(histogram.get_max(), GPF_HISTOGRAM_MAX_VALUE);
+  GPF_CHECK_EQUAL(histogram.get_count(), 2u);
+  GPF_CHECK_EQUAL(histogram.getPercentile(50), GPF_HISTOGRAM_MAX_VALUE);
+  GPF_CHECK_EQUAL(histogram.getPercentile(100), GPF_HISTOGRAM_MAX_VALUE);
+
+  //Dernière case: de 2^20 - 2^16 à 2^20-1
+  GPF_CHECK_EQUAL(testHistogram_bucketUpperValue(GPF_HISTOGRAM_MAX_VALUE - (1UL << 16) + 1), GPF_HISTOGRAM_MAX_VALUE);
+  GPF_CHECK_EQUAL(testHistogram_bucketUpperValue(GPF_HISTOGRAM_MAX_VALUE - (1UL << 16)), GPF_HISTOGRAM_MAX_VALUE - (1UL << 16));
+
+  histogram.reset();
+  GPF_CHECK_EQUAL(histogram.get_count(), 0u);
+  GPF_CHECK_EQUAL(histogram.get_max(), 0u);
+  GPF_CHECK_EQUAL(histogram.getPercentile(99), 0u);
+}
+
+GPF_TEST(histogram_percentilesMatchSortedReference) {
+  GPF_HISTOGRAM         histogram;
+  std::vector<uint32_t> values;
+  const float           percentiles[3] = {50, 99, 99.9};
+
+  srand(4);
+  for (long i = 0; i < TEST_HISTOGRAM_SAMPLE_COUNT; i++) {
+    int      draw  = rand() % 1000;
+    uint32_t value = testHistogram_randomRange(150, 350);
+    if (draw == 0) {
+      value = testHistogram_randomRange(10000, 50000);
+    } else if (draw <= 10) {
+      value = testHistogram_randomRange(1000, 5000);
+    }
+    values.push_back(value);
+    histogram.record(value);
+  }
+  std::sort(values.begin(), values.end());
+
+  GPF_CHECK_EQUAL(histogram.get_count(), (uint32_t)TEST_HISTOGRAM_SAMPLE_COUNT);
+  GPF_CHECK_EQUAL(histogram.get_max(), values.back());
+  for (int i = 0; i < 3; i++) {
+    uint32_t rank      = (uint32_t)ceil((percentiles[i] / 100.0) * values.size()); //Rang le plus proche, comme getPercentile()
+    uint32_t reference = values[rank - 1];
+    uint32_t result    = histogram.getPercentile(percentiles[i]);
+
+    GPF_CHECK(result >= reference);
+    GPF_CHECK(result <= reference + reference / 8);
+    GPF_CHECK(result <= histogram.get_max());
+  }
+  GPF_CHECK_EQUAL(histogram.getPercentile(100), values.back());
+  GPF_CHECK_EQUAL(histogram.getPercentile(0), testHistogram_bucketUpperValue(values.front()));
+}
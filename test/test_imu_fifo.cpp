@@ -0,0 +1,252 @@
+/**
+ * @file test_imu_fifo.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * Décodage des FIFO du gyro et du accel du BMI088 (gpf_imu_fifo.cpp) sur des flux d'octets construits ici.
+ *
+ * Lecture du accel par bouts de 30 octets (I2C) avec un sensor simulé qui redonne au complet une frame coupée à la fin d'un
+ * bout: en collant les bouts l'un après l'autre, les 2 premiers octets de la 5e frame sont suivis de sa relecture au
+ * complet, la 5e frame est fausse puis les headers sont décalés jusqu'à un header invalide. gpf_imu_fifo_readAccel() redonne exactement les frames écrites, peu importe la longueur lue.
+ *
+ */
+
+#include <string.h>
+#include "gpf_test.h"
+#include "gpf_imu_fifo.h"
+
+#define TEST_FIFO_I2C_CHUNK      30 //Bmi088Accel::FIFO_READ_CHUNK
+#define TEST_FIFO_SENSOR_LENGTH  256
+
+// FIFO du accel simulé: les octets écrits et le début de chaque frame
+typedef struct {
+  uint8_t  data[TEST_FIFO_SENSOR_LENGTH];
+  uint16_t length;
+  uint16_t frameStart[TEST_FIFO_SENSOR_LENGTH];
+  uint16_t frameCount;
+  uint16_t readPosition;
+  uint16_t chunkLength; //0 = tout d'un seul coup (SPI)
+} testFifo_sensor;
+
+static uint16_t testFifo_addAccelFrame(uint8_t *data, uint16_t length, int16_t x, int16_t y, int16_t z) {
+  data[length++] = GPF_IMU_FIFO_ACCEL_HEADER_ACCEL | 0x01; //Les tags d'interruption ne changent rien
+  data[length++] = x & 0xFF;
+  data[length++] = (x >> 8) & 0xFF;
+  data[length++] = y & 0xFF;
+  data[length++] = (y >> 8) & 0xFF;
+  data[length++] = z & 0xFF;
+  data[length++] = (z >> 8) & 0xFF;
+  return length;
+}
+
+GPF_TEST(imuFifo_gyroFrames) {
+  uint8_t data[GPF_IMU_FIFO_GYRO_FRAME_LENGTH * 3 + 4];
+  int16_t frames[3][3];
+
+  for (int i = 0; i < 3; i++) {
+    int16_t values[3] = {(int16_t)(100 * i - 32768), (int16_t)(-1 - i), (int16_t)(32767 - i)};
+    for (int axe = 0; axe < 3; axe++) {
+      data[i * GPF_IMU_FIFO_GYRO_FRAME_LENGTH + axe * 2]     = values[axe] & 0xFF;
+      data[i * GPF_IMU_FIFO_GYRO_FRAME_LENGTH + axe * 2 + 1] = (values[axe] >> 8) & 0xFF;
+    }
+  }
+
+  GPF_CHECK_EQUAL(gpf_imu_fifo_decodeGyro(data, GPF_IMU_FIFO_GYRO_FRAME_LENGTH * 3, frames, 3), 3);
+  GPF_CHECK_EQUAL(frames[0][0], -32768);
+  GPF_CHECK_EQUAL(frames[1][1], -2);
+  GPF_CHECK_EQUAL(frames[2][2], 32765);
+  GPF_CHECK_EQUAL(frames[2][0], 200 - 32768);
+
+  // Frame coupée et maximum de frames
+  GPF_CHECK_EQUAL(gpf_imu_fifo_decodeGyro(data, GPF_IMU_FIFO_GYRO_FRAME_LENGTH * 2 + 5, frames, 3), 2);
+  GPF_CHECK_EQUAL(gpf_imu_fifo_decodeGyro(data, GPF_IMU_FIFO_GYRO_FRAME_LENGTH * 3, frames, 1), 1);
+  GPF_CHECK_EQUAL(gpf_imu_fifo_decodeGyro(data, 0, frames, 3), 0);
+}
+
+GPF_TEST(imuFifo_accelFramesWithOtherHeaders) {
+  uint8_t  data[64];
+  uint16_t length = 0;
+  int16_t  frames[GPF_IMU_FIFO_ACCEL_MAX_FRAMES][3];
+  gpf_imu_fifo_accel_decode_result_struct result;
+
+  length = testFifo_addAccelFrame(data, length, 1, -2, 3);
+  data[length++] = GPF_IMU_FIFO_ACCEL_HEADER_SKIP;
+  data[length++] = 5;
+  data[length++] = GPF_IMU_FIFO_ACCEL_HEADER_SENSORTIME;
+  data[length++] = 0x11;
+  data[length++] = 0x22;
+  data[length++] = 0x33;
+  length = testFifo_addAccelFrame(data, length, -1000, 2000, -32768);
+  data[length++] = GPF_IMU_FIFO_ACCEL_HEADER_CONFIG;
+  data[length++] = 0;
+  data[length++] = GPF_IMU_FIFO_ACCEL_HEADER_EMPTY; //Le reste n'est pas lu
+  data[length++] = 0xFF;
+
+  gpf_imu_fifo_decodeAccel(data, length, frames, GPF_IMU_FIFO_ACCEL_MAX_FRAMES, &result);
+  GPF_CHECK_EQUAL(result.frameCount, 2);
+  GPF_CHECK_EQUAL(result.skippedFrameCount, 5);
+  GPF_CHECK_EQUAL(result.unknownHeaderCount, 0);
+  GPF_CHECK(!result.truncated);
+  GPF_CHECK_EQUAL(frames[0][1], -2);
+  GPF_CHECK_EQUAL(frames[1][0], -1000);
+  GPF_CHECK_EQUAL(frames[1][2], -32768);
+}
+
+GPF_TEST(imuFifo_accelTruncatedAndUnknownHeader) {
+  uint8_t  data[32];
+  uint16_t length = 0;
+  int16_t  frames[GPF_IMU_FIFO_ACCEL_MAX_FRAMES][3];
+  gpf_imu_fifo_accel_decode_result_struct result;
+
+  length = testFifo_addAccelFrame(data, length, 7, 8, 9);
+  length = testFifo_addAccelFrame(data, length, 10, 11, 12);
+
+  gpf_imu_fifo_decodeAccel(data, length - 2, frames, GPF_IMU_FIFO_ACCEL_MAX_FRAMES, &result); //Dernière frame coupée, relue au complet la prochaine fois
+  GPF_CHECK_EQUAL(result.frameCount, 1);
+  GPF_CHECK(result.truncated);
+
+  data[length++] = 0x00; //Header invalide: on arrête
+  length = testFifo_addAccelFrame(data, length, 13, 14, 15);
+  gpf_imu_fifo_decodeAccel(data, length, frames, GPF_IMU_FIFO_ACCEL_MAX_FRAMES, &result);
+  GPF_CHECK_EQUAL(result.frameCount, 2);
+  GPF_CHECK_EQUAL(result.unknownHeaderCount, 1);
+
+  gpf_imu_fifo_decodeAccel(data, length, frames, 1, &result); //Plus de frames que de place
+  GPF_CHECK_EQUAL(result.frameCount, 1);
+  GPF_CHECK_EQUAL(frames[0][2], 9);
+}
+
+static void testFifo_startFrame(testFifo_sensor *sensor) {
+  sensor->frameStart[sensor->frameCount++] = sensor->length;
+}
+
+// Comme le BMI088: un bout qui coupe une frame ne la retire pas du FIFO, elle est redonnée au complet au bout suivant
+static uint16_t testFifo_read(void *context, uint16_t count, uint8_t *dest) {
+  testFifo_sensor *sensor = (testFifo_sensor *)context;
+  uint16_t         readLength;
+
+  if ((sensor->chunkLength > 0) && (count > sensor->chunkLength)) {
+    count = sensor->chunkLength;
+  }
+  for (readLength = 0; readLength < count; readLength++) {
+    uint16_t position = sensor->readPosition + readLength;
+    dest[readLength] = (position < sensor->length) ? sensor->data[position] : GPF_IMU_FIFO_ACCEL_HEADER_EMPTY;
+  }
+
+  uint16_t readEnd = sensor->readPosition + readLength;
+  if (readEnd >= sensor->length) {
+    sensor->readPosition = sensor->length;
+  } else {
+    for (uint16_t frame = 0; (frame < sensor->frameCount) && (sensor->frameStart[frame] <= readEnd); frame++) {
+      sensor->readPosition = sensor->frameStart[frame]; //Début de la dernière frame qui n'a pas été lue au complet
+    }
+  }
+  return readLength;
+}
+
+// 20 frames accel avec une frame skip et une frame sensortime au milieu pour que les coupures tombent partout
+static void testFifo_fillSensor(testFifo_sensor *sensor, uint16_t chunkLength) {
+  memset(sensor, 0, sizeof(testFifo_sensor));
+  sensor->chunkLength = chunkLength;
+  for (int i = 0; i < 20; i++) {
+    if (i == 7) {
+      testFifo_startFrame(sensor);
+      sensor->data[sensor->length++] = GPF_IMU_FIFO_ACCEL_HEADER_SKIP;
+      sensor->data[sensor->length++] = 3;
+    }
+    if (i == 12) {
+      testFifo_startFrame(sensor);
+      sensor->data[sensor->length++] = GPF_IMU_FIFO_ACCEL_HEADER_SENSORTIME;
+      sensor->data[sensor->length++] = 0x01;
+      sensor->data[sensor->length++] = 0x02;
+      sensor->data[sensor->length++] = 0x03;
+    }
+    testFifo_startFrame(sensor);
+    sensor->length = testFifo_addAccelFrame(sensor->data, sensor->length, (int16_t)(i * 100), (int16_t)(-i), (int16_t)(i - 1000));
+  }
+}
+
+static void testFifo_checkFrames(int16_t frames[][3], uint16_t frameCount, int firstFrame) {
+  for (uint16_t i = 0; i < frameCount; i++) {
+    GPF_CHECK_EQUAL(frames[i][0], (firstFrame + i) * 100);
+    GPF_CHECK_EQUAL(frames[i][1], -(firstFrame + i));
+    GPF_CHECK_EQUAL(frames[i][2], (firstFrame + i) - 1000);
+  }
+}
+
+GPF_TEST(imuFifo_accelChunkedRead) {
+  testFifo_sensor sensor;
+  uint8_t         buffer[TEST_FIFO_SENSOR_LENGTH];
+  int16_t         frames[GPF_IMU_FIFO_ACCEL_MAX_FRAMES][3];
+  gpf_imu_fifo_accel_decode_result_struct result;
+
+  //Ancienne lecture: bouts de 30 octets collés l'un après l'autre
+  testFifo_fillSensor(&sensor, TEST_FIFO_I2C_CHUNK);
+  uint16_t fifoLength = sensor.length;
+  for (uint16_t done = 0; done < fifoLength; ) {
+    done += testFifo_read(&sensor, fifoLength - done, buffer + done);
+  }
+  gpf_imu_fifo_decodeAccel(buffer, fifoLength, frames, GPF_IMU_FIFO_ACCEL_MAX_FRAMES, &result);
+  GPF_CHECK_EQUAL(frames[3][0], 300);
+  GPF_CHECK(frames[4][0] != 400); //Début de la frame coupée suivi de sa relecture au complet
+  GPF_CHECK_EQUAL(result.unknownHeaderCount, 1);
+  GPF_CHECK(result.frameCount < 20);
+
+  //Bouts de 30 octets (I2C), d'un seul coup (SPI) et bouts de toutes les longueurs de 7 à 31 octets
+  for (uint16_t chunkLength = 0; chunkLength <= 31; chunkLength++) {
+    if ((chunkLength > 0) && (chunkLength < 7)) {
+      continue; //Plus court qu'une frame accel
+    }
+    testFifo_fillSensor(&sensor, chunkLength);
+    uint16_t keptLength = gpf_imu_fifo_readAccel(testFifo_read, &sensor, sensor.length, buffer);
+    GPF_CHECK_EQUAL(keptLength, sensor.length);
+    GPF_CHECK(memcmp(buffer, sensor.data, sensor.length) == 0);
+    GPF_CHECK_EQUAL(sensor.readPosition, sensor.length);
+
+    gpf_imu_fifo_decodeAccel(buffer, keptLength, frames, GPF_IMU_FIFO_ACCEL_MAX_FRAMES, &result);
+    GPF_CHECK_EQUAL(result.frameCount, 20);
+    GPF_CHECK_EQUAL(result.skippedFrameCount, 3);
+    GPF_CHECK_EQUAL(result.unknownHeaderCount, 0);
+    GPF_CHECK(!result.truncated);
+    testFifo_checkFrames(frames, result.frameCount, 0);
+  }
+}
+
+// Longueur limitée (GPF_IMU_FIFO_ACCEL_READ_MAX_LENGTH) qui coupe une frame: elle reste dans le FIFO pour la lecture suivante
+GPF_TEST(imuFifo_accelChunkedReadLengthLimit) {
+  testFifo_sensor sensor;
+  uint8_t         buffer[TEST_FIFO_SENSOR_LENGTH];
+  int16_t         frames[GPF_IMU_FIFO_ACCEL_MAX_FRAMES][3];
+  gpf_imu_fifo_accel_decode_result_struct result;
+
+  for (uint16_t chunkLength = 0; chunkLength <= TEST_FIFO_I2C_CHUNK; chunkLength += TEST_FIFO_I2C_CHUNK) {
+    testFifo_fillSensor(&sensor, chunkLength);
+    uint16_t keptLength = gpf_imu_fifo_readAccel(testFifo_read, &sensor, 7 * 5 + 3, buffer);
+    GPF_CHECK_EQUAL(keptLength, 7 * 5);
+    GPF_CHECK_EQUAL(sensor.readPosition, 7 * 5);
+    gpf_imu_fifo_decodeAccel(buffer, keptLength, frames, GPF_IMU_FIFO_ACCEL_MAX_FRAMES, &result);
+    GPF_CHECK_EQUAL(result.frameCount, 5);
+
+    keptLength = gpf_imu_fifo_readAccel(testFifo_read, &sensor, sensor.length - sensor.readPosition, buffer);
+    gpf_imu_fifo_decodeAccel(buffer, keptLength, frames, GPF_IMU_FIFO_ACCEL_MAX_FRAMES, &result);
+    GPF_CHECK_EQUAL(result.frameCount, 15);
+    GPF_CHECK(!result.truncated);
+    testFifo_checkFrames(frames, result.frameCount, 5);
+  }
+}
+
+// Fin des données au milieu d'un bout: le header vide est gardé et le décodage s'arrête là
+GPF_TEST(imuFifo_accelChunkedReadPastEnd) {
+  testFifo_sensor sensor;
+  uint8_t         buffer[TEST_FIFO_SENSOR_LENGTH + TEST_FIFO_I2C_CHUNK];
+  int16_t         frames[GPF_IMU_FIFO_ACCEL_MAX_FRAMES][3];
+  gpf_imu_fifo_accel_decode_result_struct result;
+
+  testFifo_fillSensor(&sensor, TEST_FIFO_I2C_CHUNK);
+  uint16_t keptLength = gpf_imu_fifo_readAccel(testFifo_read, &sensor, sensor.length + 10, buffer);
+  GPF_CHECK(keptLength > sensor.length);
+  gpf_imu_fifo_decodeAccel(buffer, keptLength, frames, GPF_IMU_FIFO_ACCEL_MAX_FRAMES, &result);
+  GPF_CHECK_EQUAL(result.frameCount, 20);
+  GPF_CHECK_EQUAL(result.unknownHeaderCount, 0);
+}
@@ -0,0 +1,82 @@
+/**
+ * @file test_main.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * Tests sur PC des modules qui n'utilisent rien du Teensy (ceux qui finissent par "peut être compilé sur un PC").
+ *
+ *   make -C test         Compile et roule les tests. Retourne une erreur si un test échoue.
+ *   make -C test bench   Roule aussi les mesures de durée (GPF_BENCH). Les durées sont celles du PC, pas du Teensy:
+ *                        elles servent à comparer deux versions d'un même calcul.
+ *
+ * Un fichier test_xxx.cpp par module (ex: test_pid.cpp pour gpf_pid.cpp). Les tests s'enregistrent eux-mêmes avec
+ * GPF_TEST() (Voir gpf_test.h), il n'y a rien à ajouter ici.
+ *
+ */
+
+#include <string.h>
+#include <chrono>
+#include "gpf_test.h"
+
+#define GPF_TEST_MAX_COUNT 128
+
+typedef struct {
+    const char        *name;
+    gpf_test_function  function;
+    bool               isBench;
+} gpf_test_struct;
+
+static gpf_test_struct gpf_tests[GPF_TEST_MAX_COUNT];
+static int             gpf_testCount      = 0;
+static int             gpf_failureCount   = 0; //Du test en cours
+volatile float         gpf_test_sink      = 0;
+
+GPF_TEST_REGISTER::GPF_TEST_REGISTER(const char *name, gpf_test_function function, bool isBench) {
+  if (gpf_testCount < GPF_TEST_MAX_COUNT) {
+    gpf_tests[gpf_testCount].name     = name;
+    gpf_tests[gpf_testCount].function = function;
+    gpf_tests[gpf_testCount].isBench  = isBench;
+    gpf_testCount++;
+  }
+}
+
+void gpf_test_fail(const char *file, int line, const char *expression, double actual, double expected) {
+  if (gpf_failureCount < 5) { //Un test dans une boucle peut échouer des milliers de fois
+    printf("    %s:%d: %s (obtenu %.9g, attendu %.9g)\n", file, line, expression, actual, expected);
+  }
+  gpf_failureCount++;
+}
+
+uint64_t gpf_test_nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void gpf_test_reportBench(const char *description, double nsPerCall) {
+  printf("    %-50s %8.2f ns\n", description, nsPerCall);
+}
+
+int main(int argc, char **argv) {
+  bool runBench    = (argc > 1) && (strcmp(argv[1], "--bench") == 0);
+  int  failedCount = 0;
+  int  runCount    = 0;
+
+  for (int i = 0; i < gpf_testCount; i++) {
+    if (gpf_tests[i].isBench && !runBench) {
+      continue;
+    }
+
+    gpf_failureCount = 0;
+    printf("%s %s\n", gpf_tests[i].isBench ? "[bench]" : "[test] ", gpf_tests[i].name);
+    gpf_tests[i].function();
+    runCount++;
+
+    if (gpf_failureCount > 0) {
+      printf("    ECHEC (%d)\n", gpf_failureCount);
+      failedCount++;
+    }
+  }
+
+  printf("%d/%d ok\n", runCount - failedCount, runCount);
+  return (failedCount == 0) ? 0 : 1;
+}
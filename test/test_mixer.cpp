@@ -0,0 +1,169 @@
+/**
+ * @file test_mixer.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * GPF_MIXER comparé à une copie de l'ancien controlMixer() quad X (avant gpf_mixer.cpp): 1 million d'entrées au hasard
+ * sans saturation donnent des sorties identiques bit à bit puisque les termes sont additionnés dans le même ordre.
+ * Vérifie aussi la saturation et les préréglages hex et octo.
+ *
+ * Durée par appel (make -C test bench, -O2): environ 3 fois l'ancien code qui avait les 4 moteurs écrits à la main
+ * (boucle sur la matrice et recherche du maximum), soit quelques ns, bien moins de 1% de l'étage PID.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "gpf_test.h"
+#include "gpf_mixer.h"
+
+#define TEST_MIXER_SAMPLE_COUNT 1000000
+
+static float testMixer_random(float amplitude) {
+  return amplitude * (2.0f * rand() / RAND_MAX - 1.0f);
+}
+
+// Ancien controlMixer(): gaz, pitch, roll, yaw écrits à la main pour chaque moteur
+static void testMixer_oldMix(float throttle, float roll, float pitch, float yaw, float *output) {
+  output[GPF_MOTOR_FRONT_LEFT]  = throttle - pitch + roll + yaw;
+  output[GPF_MOTOR_FRONT_RIGHT] = throttle - pitch - roll - yaw;
+  output[GPF_MOTOR_BACK_RIGHT]  = throttle + pitch - roll + yaw;
+  output[GPF_MOTOR_BACK_LEFT]   = throttle + pitch + roll - yaw;
+}
+
+static void testMixer_loadPreset(GPF_MIXER &mixer, uint8_t preset) {
+  int16_t matrix[GPF_MIXER_MAX_MOTORS][GPF_MIXER_INPUT_ITEM_COUNT];
+  uint8_t motorCount = 0;
+
+  GPF_CHECK(GPF_MIXER::loadPreset(preset, matrix, &motorCount));
+  mixer.loadMatrix(matrix, motorCount);
+}
+
+GPF_TEST(mixer_quadXMatchesOldMixer) {
+  GPF_MIXER mixer;
+  long      mismatchCount = 0;
+
+  testMixer_loadPreset(mixer, GPF_MIXER_PRESET_QUAD_X);
+  GPF_CHECK_EQUAL(mixer.get_motorCount(), GPF_MOTOR_ITEM_COUNT);
+
+  srand(1);
+  for (long i = 0; i < TEST_MIXER_SAMPLE_COUNT; i++) {
+    float throttle = 0.2f + 0.4f * rand() / RAND_MAX;
+    float roll     = testMixer_random(0.1f);
+    float pitch    = testMixer_random(0.1f);
+    float yaw      = testMixer_random(0.1f);
+    float output[GPF_MIXER_MAX_MOTORS];
+    float outputOld[GPF_MOTOR_ITEM_COUNT];
+
+    mixer.mix(throttle, roll, pitch, yaw, output);
+    testMixer_oldMix(throttle, roll, pitch, yaw, outputOld);
+    if (memcmp(output, outputOld, sizeof(outputOld)) != 0) {
+      mismatchCount++;
+    }
+  }
+  GPF_CHECK_EQUAL(mismatchCount, 0);
+  GPF_CHECK_EQUAL(mixer.get_saturationCount(), 0u);
+}
+
+GPF_TEST(mixer_saturationKeepsAttitude) {
+  GPF_MIXER mixer;
+  float     output[GPF_MIXER_MAX_MOTORS];
+
+  testMixer_loadPreset(mixer, GPF_MIXER_PRESET_QUAD_X);
+
+  //Moteurs de gauche à 105%: tous descendus de 5%, l'écart gauche/droite est gardé
+  mixer.mix(0.95f, 0.1f, 0, 0, output);
+  GPF_CHECK_NEAR(output[GPF_MOTOR_FRONT_LEFT], 1.0f, 1e-6);
+  GPF_CHECK_NEAR(output[GPF_MOTOR_BACK_LEFT], 1.0f, 1e-6);
+  GPF_CHECK_NEAR(output[GPF_MOTOR_FRONT_LEFT] - output[GPF_MOTOR_FRONT_RIGHT], 0.2f, 1e-6);
+  GPF_CHECK_EQUAL(mixer.get_saturationCount(), 1u);
+
+  //Écart de plus de 100% entre moteurs: roll et pitch réduits ensemble, le plus fort à 100%
+  mixer.mix(0.9f, 0.8f, 0.5f, 0, output);
+  float outputMin = output[0];
+  float outputMax = output[0];
+  for (uint8_t motor = 1; motor < GPF_MOTOR_ITEM_COUNT; motor++) {
+    outputMin = (output[motor] < outputMin) ? output[motor] : outputMin;
+    outputMax = (output[motor] > outputMax) ? output[motor] : outputMax;
+  }
+  GPF_CHECK_NEAR(outputMax, 1.0f, 1e-6);
+  GPF_CHECK_NEAR(outputMax - outputMin, 1.0f, 1e-6);
+  GPF_CHECK_EQUAL(mixer.get_saturationCount(), 2u);
+
+  //Gaz au minimum: les moteurs sous 0% ne sont pas remontés (rien ne part au sol)
+  mixer.mix(0, 0.1f, 0, 0, output);
+  GPF_CHECK_NEAR(output[GPF_MOTOR_FRONT_RIGHT], -0.1f, 1e-6);
+  GPF_CHECK_NEAR(output[GPF_MOTOR_FRONT_LEFT], 0.1f, 1e-6);
+  GPF_CHECK_EQUAL(mixer.get_saturationCount(), 2u);
+}
+
+// Les colonnes roll, pitch et yaw des préréglages n'ont aucun effet sur la poussée totale
+GPF_TEST(mixer_presetColumnsSumToZero) {
+  const uint8_t expectedMotorCount[GPF_MIXER_PRESET_CUSTOM] = {4, 6, 8};
+
+  for (uint8_t preset = 0; preset < GPF_MIXER_PRESET_CUSTOM; preset++) {
+    GPF_MIXER mixer;
+    testMixer_loadPreset(mixer, preset);
+    GPF_CHECK_EQUAL(mixer.get_motorCount(), expectedMotorCount[preset]);
+
+    for (uint8_t input = GPF_MIXER_INPUT_ROLL; input < GPF_MIXER_INPUT_ITEM_COUNT; input++) {
+      float inputs[GPF_MIXER_INPUT_ITEM_COUNT] = {0, 0, 0, 0};
+      float output[GPF_MIXER_MAX_MOTORS];
+      float sum = 0;
+
+      inputs[input] = 0.5f;
+      mixer.mix(inputs[GPF_MIXER_INPUT_THROTTLE], inputs[GPF_MIXER_INPUT_ROLL], inputs[GPF_MIXER_INPUT_PITCH], inputs[GPF_MIXER_INPUT_YAW], output);
+      for (uint8_t motor = 0; motor < mixer.get_motorCount(); motor++) {
+        sum += output[motor];
+      }
+      GPF_CHECK_NEAR(sum, 0, 1e-5);
+    }
+  }
+}
+
+GPF_TEST(mixer_customIsNotAPreset) {
+  int16_t matrix[GPF_MIXER_MAX_MOTORS][GPF_MIXER_INPUT_ITEM_COUNT];
+  uint8_t motorCount = 0;
+
+  GPF_CHECK(!GPF_MIXER::loadPreset(GPF_MIXER_PRESET_CUSTOM, matrix, &motorCount));
+  GPF_CHECK_EQUAL(motorCount, 0);
+  GPF_CHECK(strcmp(GPF_MIXER::getPresetDescription(GPF_MIXER_PRESET_CUSTOM), "Custom") == 0);
+  GPF_CHECK(strcmp(GPF_MIXER::getPresetDescription(GPF_MIXER_PRESET_ITEM_COUNT), "?") == 0);
+}
+
+GPF_BENCH(mixer_mix) {
+  const int    count       = 1 << 12;
+  const int    repeatCount = 2000;
+  static float inputs[count][GPF_MIXER_INPUT_ITEM_COUNT];
+  float        output[GPF_MIXER_MAX_MOTORS];
+  GPF_MIXER    mixer;
+
+  testMixer_loadPreset(mixer, GPF_MIXER_PRESET_QUAD_X);
+  srand(1);
+  for (int i = 0; i < count; i++) {
+    inputs[i][GPF_MIXER_INPUT_THROTTLE] = 0.3f + 0.2f * rand() / RAND_MAX;
+    inputs[i][GPF_MIXER_INPUT_ROLL]     = testMixer_random(0.1f);
+    inputs[i][GPF_MIXER_INPUT_PITCH]    = testMixer_random(0.1f);
+    inputs[i][GPF_MIXER_INPUT_YAW]      = testMixer_random(0.1f);
+  }
+
+  uint64_t start = gpf_test_nowNs();
+  for (int k = 0; k < repeatCount; k++) {
+    for (int i = 0; i < count; i++) {
+      testMixer_oldMix(inputs[i][0], inputs[i][1], inputs[i][2], inputs[i][3], output);
+      gpf_test_sink += output[k & 3];
+    }
+  }
+  uint64_t middle = gpf_test_nowNs();
+  for (int k = 0; k < repeatCount; k++) {
+    for (int i = 0; i < count; i++) {
+      mixer.mix(inputs[i][0], inputs[i][1], inputs[i][2], inputs[i][3], output);
+      gpf_test_sink += output[k & 3];
+    }
+  }
+  uint64_t end = gpf_test_nowNs();
+
+  gpf_test_reportBench("ancien controlMixer() quad X, par appel", (double)(middle - start) / ((double)repeatCount * count));
+  gpf_test_reportBench("GPF_MIXER::mix() quad X, par appel", (double)(end - middle) / ((double)repeatCount * count));
+}
@@ -0,0 +1,157 @@
+/**
+ * @file test_pid.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * GPF_PID comparé à une copie de l'ancien controlANGLE() (avant gpf_pid.cpp) sur un vol synthétique de 60s à 500hz.
+ *
+ */
+
+#include "gpf_test.h"
+#include "gpf_pid.h"
+
+#define TEST_PID_STORAGE_MULTIPLIER 100000.0 //GPF_PID_STORAGE_MULTIPLIER de gpf_cons.h
+#define TEST_PID_SAMPLE_COUNT       30000
+
+static const uint32_t testPidGains[GPF_PID_AXE_COUNT][3] = {{20000, 30000, 5000}, {20000, 30000, 5000}, {30000, 5000, 15}};
+
+static float testPidSetpoint[TEST_PID_SAMPLE_COUNT][GPF_PID_AXE_COUNT];
+static float testPidMeasurement[TEST_PID_SAMPLE_COUNT][GPF_PID_AXE_COUNT];
+static float testPidRate[TEST_PID_SAMPLE_COUNT][GPF_PID_AXE_COUNT];
+
+static float testPid_constrain(float value, float low, float high) {
+  return (value < low) ? low : ((value > high) ? high : value);
+}
+
+// Ancien controlANGLE(): gains divisés à chaque tour, D du roll et du pitch sur le gyro, D du yaw sur l'erreur
+struct TEST_PID_OLD {
+  GPF_FILTER_3AXES dtermFilter;
+  float sampleRate = 500;
+  float integral[GPF_PID_AXE_COUNT] = {0, 0, 0};
+  float errorYawPrevious = 0;
+  float output[GPF_PID_AXE_COUNT];
+
+  void run(const float *setpoint, const float *measurement, const float *rate, float dt, bool throttleIsLow) {
+    float k[GPF_PID_AXE_COUNT][3];
+    for (int axe = 0; axe < GPF_PID_AXE_COUNT; axe++) {
+      for (int term = 0; term < 3; term++) {
+        k[axe][term] = testPidGains[axe][term] / TEST_PID_STORAGE_MULTIPLIER;
+      }
+    }
+
+    sampleRate = 0.99 * sampleRate + 0.01 / dt;
+    dtermFilter.setSampleRate(sampleRate);
+
+    for (int axe = 0; axe < 2; axe++) {
+      float error    = setpoint[axe] - measurement[axe];
+      integral[axe]  = throttleIsLow ? 0 : integral[axe] + error * dt;
+      integral[axe]  = testPid_constrain(integral[axe], -25, 25);
+      float derivative = dtermFilter.applyOneAxe(axe, rate[axe]);
+      output[axe]    = 0.01 * (k[axe][0] * error + k[axe][1] * integral[axe] - k[axe][2] * derivative);
+    }
+
+    float errorYaw = setpoint[2] - measurement[2];
+    integral[2]    = throttleIsLow ? 0 : integral[2] + errorYaw * dt;
+    integral[2]    = testPid_constrain(integral[2], -25, 25);
+    float derivative = dtermFilter.applyOneAxe(2, (errorYaw - errorYawPrevious) / dt);
+    output[2]      = .01 * (k[2][0] * errorYaw + k[2][1] * integral[2] + k[2][2] * derivative);
+    errorYawPrevious = errorYaw;
+  }
+};
+
+static void testPid_makeFlight() {
+  for (int i = 0; i < TEST_PID_SAMPLE_COUNT; i++) {
+    float t = i * 0.002f;
+    testPidSetpoint[i][0]    = 20 * sinf(0.5f * t);
+    testPidSetpoint[i][1]    = 15 * sinf(0.7f * t + 1);
+    testPidSetpoint[i][2]    = 50 * sinf(0.3f * t);
+    testPidMeasurement[i][0] = testPidSetpoint[i][0] - 2 * sinf(3 * t) + 0.3f * sinf(900 * t);
+    testPidMeasurement[i][1] = testPidSetpoint[i][1] + 1.5f * sinf(2.5f * t);
+    testPidMeasurement[i][2] = testPidSetpoint[i][2] + 5 * sinf(40 * t);
+    testPidRate[i][0]        = 20 * 0.5f * cosf(0.5f * t) + 30 * sinf(1200 * t);
+    testPidRate[i][1]        = 15 * 0.7f * cosf(0.7f * t + 1) + 20 * sinf(1500 * t);
+    testPidRate[i][2]        = 0;
+  }
+}
+
+static void testPid_initialize(TEST_PID_OLD &oldPid, GPF_PID &pid) {
+  oldPid.dtermFilter.initialize(GPF_FILTER_TYPE_PT1, 70, 500);
+  pid.initialize(25, 1.0, GPF_FILTER_TYPE_PT1, 70, 0.002);
+  for (int axe = 0; axe < GPF_PID_AXE_COUNT; axe++) {
+    pid.setGains(axe, testPidGains[axe][0] / TEST_PID_STORAGE_MULTIPLIER, testPidGains[axe][1] / TEST_PID_STORAGE_MULTIPLIER, testPidGains[axe][2] / TEST_PID_STORAGE_MULTIPLIER);
+  }
+  pid.setDerivativeSource(0, GPF_PID_DERIVATIVE_FROM_RATE);
+  pid.setDerivativeSource(1, GPF_PID_DERIVATIVE_FROM_RATE);
+}
+
+// Même sortie que l'ancien code en roll et pitch. Le yaw diffère seulement par le terme D (mesure plutôt qu'erreur).
+GPF_TEST(pid_sameOutputAsOldControlAngle) {
+  TEST_PID_OLD oldPid;
+  GPF_PID      pid;
+  double       maxDifference[GPF_PID_AXE_COUNT] = {0, 0, 0};
+
+  testPid_makeFlight();
+  testPid_initialize(oldPid, pid);
+
+  for (int i = 0; i < TEST_PID_SAMPLE_COUNT; i++) {
+    bool throttleIsLow = (i < 500);
+    oldPid.run(testPidSetpoint[i], testPidMeasurement[i], testPidRate[i], 0.002f, throttleIsLow);
+    pid.update(testPidSetpoint[i], testPidMeasurement[i], testPidRate[i], 0.002f, throttleIsLow);
+    for (int axe = 0; axe < GPF_PID_AXE_COUNT; axe++) {
+      double difference = fabs(oldPid.output[axe] - pid.get_output(axe));
+      maxDifference[axe] = (difference > maxDifference[axe]) ? difference : maxDifference[axe];
+    }
+  }
+
+  GPF_CHECK(maxDifference[0] < 1e-6);
+  GPF_CHECK(maxDifference[1] < 1e-6);
+  GPF_CHECK(maxDifference[2] < 1e-3);
+}
+
+GPF_TEST(pid_integralResetAndLimit) {
+  GPF_PID pid;
+  float   setpoint[GPF_PID_AXE_COUNT]    = {10, 10, 10};
+  float   measurement[GPF_PID_AXE_COUNT] = {0, 0, 0};
+  float   rate[GPF_PID_AXE_COUNT]        = {0, 0, 0};
+
+  pid.initialize(25, 1.0, GPF_FILTER_TYPE_NONE, 70, 0.002);
+  pid.setGains(0, 0, 0.3, 0);
+
+  for (int i = 0; i < 100000; i++) {
+    pid.update(setpoint, measurement, rate, 0.002f, false);
+  }
+  GPF_CHECK(pid.get_output(0) <= 1.0f);
+  GPF_CHECK(pid.get_output(0) > 0.0f);
+
+  pid.update(setpoint, measurement, rate, 0.002f, true);
+  GPF_CHECK_EQUAL(pid.get_output(0), 0);
+}
+
+GPF_BENCH(pid_update) {
+  TEST_PID_OLD oldPid;
+  GPF_PID      pid;
+  const int    repeatCount = 34;
+
+  testPid_makeFlight();
+  testPid_initialize(oldPid, pid);
+
+  uint64_t start = gpf_test_nowNs();
+  for (int k = 0; k < repeatCount; k++) {
+    for (int i = 0; i < TEST_PID_SAMPLE_COUNT; i++) {
+      oldPid.run(testPidSetpoint[i], testPidMeasurement[i], testPidRate[i], 0.002f, false);
+      gpf_test_sink += oldPid.output[0];
+    }
+  }
+  uint64_t middle = gpf_test_nowNs();
+  for (int k = 0; k < repeatCount; k++) {
+    for (int i = 0; i < TEST_PID_SAMPLE_COUNT; i++) {
+      pid.update(testPidSetpoint[i], testPidMeasurement[i], testPidRate[i], 0.002f, false);
+      gpf_test_sink += pid.get_output(0);
+    }
+  }
+  uint64_t end = gpf_test_nowNs();
+
+  gpf_test_reportBench("ancien controlANGLE(), par tour", (double)(middle - start) / (repeatCount * TEST_PID_SAMPLE_COUNT));
+  gpf_test_reportBench("GPF_PID::update(), par tour", (double)(end - middle) / (repeatCount * TEST_PID_SAMPLE_COUNT));
+}
@@ -0,0 +1,85 @@
+/**
+ * @file test_rc_smoothing.cpp
+ * @author Guylain Plante (gplante2@gmail.com)
+ * @version 0.1
+ * @date 2023-04-11
+ *
+ * GPF_RC_SMOOTHING: coupure selon l'intervalle des frames reçu de GPF_CRSF et vol simulé (PT2, étage PID à 500hz, frames
+ * à 6.2ms, manche de 0 à 30 degrés en 0.2s, soit 150 deg/s).
+ *
+ * Résultats au moment d'écrire ces tests: coupure de 48hz. La dérivée de la consigne monte à 465 deg/s à chaque frame sans
+ * lissage et à 187 deg/s avec. Le retard sur le manche est de 6.0ms, dont environ 3ms viennent déjà de l'attente entre deux
+ * frames.
+ *
+ */
+
+#include <math.h>
+#include "gpf_test.h"
+#include "gpf_rc_smoothing.h"
+
+#define TEST_RC_SMOOTHING_PID_RATE       500.0  //hz
+#define TEST_RC_SMOOTHING_FRAME_INTERVAL 6200.0 //us
+
+GPF_TEST(rcSmoothing_cutoffFollowsFrameInterval) {
+  GPF_RC_SMOOTHING smoothing;
+
+  smoothing.initialize(GPF_FILTER_TYPE_PT2, TEST_RC_SMOOTHING_PID_RATE, TEST_RC_SMOOTHING_FRAME_INTERVAL);
+  GPF_CHECK_NEAR(smoothing.get_cutoffHz(), GPF_RC_SMOOTHING_CUTOFF_RATIO * 1000000.0 / TEST_RC_SMOOTHING_FRAME_INTERVAL, 0.01);
+
+  //Moins de GPF_RC_SMOOTHING_CUTOFF_TOLERANCE de différence: coefficients gardés
+  float cutoffHz = smoothing.get_cutoffHz();
+  smoothing.newFrame(TEST_RC_SMOOTHING_FRAME_INTERVAL * 1.05);
+  GPF_CHECK_EQUAL(smoothing.get_cutoffHz(), cutoffHz);
+
+  //Lien à 500hz: plafonnée par la fréquence de l'étage PID
+  smoothing.newFrame(2000);
+  GPF_CHECK_NEAR(smoothing.get_cutoffHz(), GPF_RC_SMOOTHING_CUTOFF_MAX_RATIO * TEST_RC_SMOOTHING_PID_RATE, 0.01);
+
+  //Lien très lent
+  smoothing.newFrame(200000);
+  GPF_CHECK_NEAR(smoothing.get_cutoffHz(), GPF_RC_SMOOTHING_CUTOFF_MIN, 0.01);
+}
+
+GPF_TEST(rcSmoothing_stickRamp) {
+  GPF_RC_SMOOTHING smoothing;
+  const double     dt                = 1.0 / TEST_RC_SMOOTHING_PID_RATE;
+  double           nextFrameAt       = 0;
+  float            stick             = 0;
+  float            stickPrevious     = 0;
+  float            derivativeRawMax  = 0;
+  float            derivativeMax     = 0;
+  double           idealHalfAt       = -1;
+  double           smoothedHalfAt    = -1;
+
+  smoothing.initialize(GPF_FILTER_TYPE_PT2, TEST_RC_SMOOTHING_PID_RATE, TEST_RC_SMOOTHING_FRAME_INTERVAL);
+
+  for (int i = 0; i < 1000; i++) {
+    double t = i * dt;
+
+    if (t >= nextFrameAt) { //Le manche n'est lu qu'à l'arrivée d'un frame
+      stick = (nextFrameAt < 0.5) ? 0 : ((nextFrameAt < 0.7) ? 30 * (nextFrameAt - 0.5) / 0.2 : 30);
+      smoothing.newFrame(TEST_RC_SMOOTHING_FRAME_INTERVAL);
+      nextFrameAt += TEST_RC_SMOOTHING_FRAME_INTERVAL / 1000000.0;
+    }
+
+    float roll = stick, pitch = stick, yaw = 0, throttle = 0.5;
+    smoothing.apply(&roll, &pitch, &yaw, &throttle, dt);
+
+    derivativeRawMax = fmaxf(derivativeRawMax, fabsf((stick - stickPrevious) / dt));
+    derivativeMax    = fmaxf(derivativeMax, fabsf(smoothing.get_derivative(GPF_RC_SMOOTHING_ROLL)));
+    stickPrevious    = stick;
+
+    double ideal = (t < 0.5) ? 0 : ((t < 0.7) ? 30 * (t - 0.5) / 0.2 : 30);
+    if ((idealHalfAt < 0) && (ideal >= 15)) {
+      idealHalfAt = t;
+    }
+    if ((smoothedHalfAt < 0) && (roll >= 15)) {
+      smoothedHalfAt = t;
+    }
+  }
+
+  GPF_CHECK(derivativeRawMax > 400);
+  GPF_CHECK(derivativeMax < 0.5 * derivativeRawMax);
+  GPF_CHECK(derivativeMax > 150); //Pas moins que la pente du manche
+  GPF_CHECK((smoothedHalfAt - idealHalfAt) < 0.007);
+}